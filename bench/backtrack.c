@@ -0,0 +1,331 @@
+#include "backtrack.h"
+#include <stdlib.h>
+#include <string.h>
+
+typedef enum {
+    BT_SET,
+    BT_CAT,
+    BT_ALT,
+    BT_STAR,
+    BT_PLUS,
+    BT_QUEST
+} BtKind;
+
+typedef struct BtNode {
+    BtKind kind;
+    unsigned char set[32];
+    struct BtNode **kids;
+    int num_kids;
+} BtNode;
+
+struct BtRegexp {
+    BtNode *root;
+    bool anchor_start;
+    bool anchor_end;
+};
+
+typedef struct {
+    const char *p;
+    const char *end;
+    bool error;
+} BtParser;
+
+/**
+ * @brief What is left to match after a node.
+ * @note For a CAT node, the kids from 'kid' on. For a STAR or PLUS node, one
+ * more repetition, which must not be empty, after the one which began at 'start'.
+ */
+typedef struct BtCont {
+    const BtNode *n;
+    int kid;
+    size_t start;
+    const struct BtCont *next;
+} BtCont;
+
+typedef struct {
+    const BtRegexp *re;
+    const unsigned char *hay;
+    size_t len;
+    long best;
+    unsigned long *budget;
+    bool out_of_budget;
+} BtMatcher;
+
+// ---- PARSING ----
+
+static void set_add(unsigned char *set, const int c) {
+    set[c >> 3] |= (unsigned char) (1 << (c & 7));
+}
+
+static bool set_has(const unsigned char *set, const int c) {
+    return (set[c >> 3] >> (c & 7)) & 1;
+}
+
+static bool set_add_class(unsigned char *set, const char cls) {
+    unsigned char tmp[32];
+    memset(tmp, 0, sizeof(tmp));
+
+    const char *bytes;
+    switch (cls) {
+        case 'd': case 'D':
+            bytes = "0123456789";
+            break;
+        case 'w': case 'W':
+            bytes = "0123456789abcdefghijklmnopqrstuvwxyzABCDEFGHIJKLMNOPQRSTUVWXYZ_";
+            break;
+        case 's': case 'S':
+            bytes = " \t\r\n\f\v";
+            break;
+        default:
+            return false;
+    }
+    for (const char *b = bytes; *b; b++) set_add(tmp, (unsigned char) *b);
+
+    bool negate = (cls == 'D' || cls == 'W' || cls == 'S');
+    for (int i = 0; i < 32; i++) set[i] |= negate ? (unsigned char) ~tmp[i] : tmp[i];
+    return true;
+}
+
+static BtNode *node_new(const BtKind kind) {
+    BtNode *n = calloc(1, sizeof(BtNode));
+    if (n == NULL) exit(1);
+    n->kind = kind;
+    return n;
+}
+
+static void node_add_kid(BtNode *n, BtNode *kid) {
+    n->kids = realloc(n->kids, sizeof(BtNode *) * (n->num_kids + 1));
+    if (n->kids == NULL) exit(1);
+    n->kids[n->num_kids++] = kid;
+}
+
+static void node_free(BtNode *n) {
+    if (n == NULL) return;
+    for (int i = 0; i < n->num_kids; i++) node_free(n->kids[i]);
+    free(n->kids);
+    free(n);
+}
+
+static BtNode *parse_alt(BtParser *P);
+
+static BtNode *parse_class(BtParser *P) {
+    BtNode *n = node_new(BT_SET);
+
+    bool negate = false;
+    if (P->p < P->end && *P->p == '^') {
+        negate = true;
+        P->p++;
+    }
+
+    bool first = true;
+    while (P->p < P->end && (*P->p != ']' || first)) {
+        first = false;
+        int lo = (unsigned char) *P->p++;
+        if (lo == '\\' && P->p < P->end) {
+            char e = *P->p++;
+            if (set_add_class(n->set, e)) continue;
+            lo = (e == 't') ? '\t' : (unsigned char) e;
+        }
+
+        int hi = lo;
+        if (P->p + 1 < P->end && *P->p == '-' && P->p[1] != ']') {
+            P->p++;
+            hi = (unsigned char) *P->p++;
+            if (hi == '\\' && P->p < P->end) hi = (unsigned char) *P->p++;
+            if (hi < lo) {
+                P->error = true;
+                return n;
+            }
+        }
+        for (int c = lo; c <= hi; c++) set_add(n->set, c);
+    }
+
+    if (P->p >= P->end) {
+        P->error = true;
+        return n;
+    }
+    P->p++;
+
+    if (negate) for (int i = 0; i < 32; i++) n->set[i] = (unsigned char) ~n->set[i];
+    return n;
+}
+
+static BtNode *parse_atom(BtParser *P) {
+    const char c = *P->p++;
+    BtNode *n;
+
+    switch (c) {
+        case '(':
+            n = parse_alt(P);
+            if (P->p >= P->end || *P->p != ')') P->error = true;
+            else P->p++;
+            return n;
+        case '[':
+            return parse_class(P);
+        case '.':
+            n = node_new(BT_SET);
+            memset(n->set, 0xff, sizeof(n->set));
+            return n;
+        case '\\':
+            n = node_new(BT_SET);
+            if (P->p >= P->end) {
+                P->error = true;
+                return n;
+            }
+            if (!set_add_class(n->set, *P->p)) set_add(n->set, (*P->p == 't') ? '\t' : (unsigned char) *P->p);
+            P->p++;
+            return n;
+        default:
+            n = node_new(BT_SET);
+            set_add(n->set, (unsigned char) c);
+            return n;
+    }
+}
+
+static BtNode *parse_repeat(BtParser *P) {
+    BtNode *atom = parse_atom(P);
+    while (!P->error && P->p < P->end && (*P->p == '*' || *P->p == '+' || *P->p == '?')) {
+        BtNode *n = node_new(*P->p == '*' ? BT_STAR : (*P->p == '+' ? BT_PLUS : BT_QUEST));
+        node_add_kid(n, atom);
+        atom = n;
+        P->p++;
+    }
+    return atom;
+}
+
+static BtNode *parse_cat(BtParser *P) {
+    BtNode *cat = node_new(BT_CAT);
+    while (!P->error && P->p < P->end && *P->p != '|' && *P->p != ')') node_add_kid(cat, parse_repeat(P));
+    return cat;
+}
+
+static BtNode *parse_alt(BtParser *P) {
+    BtNode *left = parse_cat(P);
+    while (!P->error && P->p < P->end && *P->p == '|') {
+        P->p++;
+        BtNode *alt = node_new(BT_ALT);
+        node_add_kid(alt, left);
+        node_add_kid(alt, parse_cat(P));
+        left = alt;
+    }
+    return left;
+}
+
+BtRegexp *bt_compile(const char *pattern, size_t len) {
+    BtRegexp *re = calloc(1, sizeof(BtRegexp));
+    if (re == NULL) exit(1);
+
+    if (len > 0 && pattern[0] == '^') {
+        re->anchor_start = true;
+        pattern++;
+        len--;
+    }
+    if (len > 0 && pattern[len - 1] == '$') {
+        size_t slashes = 0;
+        while (slashes + 1 < len && pattern[len - 2 - slashes] == '\\') slashes++;
+        if (slashes % 2 == 0) {
+            re->anchor_end = true;
+            len--;
+        }
+    }
+
+    BtParser P = {pattern, pattern + len, false};
+    re->root = parse_alt(&P);
+    if (P.error || P.p < P.end) {
+        bt_free(re);
+        return NULL;
+    }
+    return re;
+}
+
+void bt_free(BtRegexp *re) {
+    if (re == NULL) return;
+    node_free(re->root);
+    free(re);
+}
+
+// ---- MATCHING ----
+
+static void match_node(BtMatcher *M, const BtNode *n, size_t i, const BtCont *k);
+
+/**
+ * @brief Match what is left after reaching position i.
+ */
+static void match_cont(BtMatcher *M, const size_t i, const BtCont *k) {
+    if (M->budget != NULL) {
+        if (*M->budget == 0) {
+            M->out_of_budget = true;
+            return;
+        }
+        (*M->budget)--;
+    }
+
+    if (k == NULL) {
+        if ((!M->re->anchor_end || i == M->len) && (long) i > M->best) M->best = (long) i;
+        return;
+    }
+
+    const BtNode *n = k->n;
+    if (n->kind == BT_CAT) {
+        if (k->kid == n->num_kids) {
+            match_cont(M, i, k->next);
+        } else {
+            BtCont c = {n, k->kid + 1, 0, k->next};
+            match_node(M, n->kids[k->kid], i, &c);
+        }
+        return;
+    }
+
+    // End of a repetition: stop here, or go again if it was not empty
+    match_cont(M, i, k->next);
+    if (i > k->start) {
+        BtCont c = {n, 0, i, k->next};
+        match_node(M, n->kids[0], i, &c);
+    }
+}
+
+static void match_node(BtMatcher *M, const BtNode *n, const size_t i, const BtCont *k) {
+    BtCont c;
+    switch (n->kind) {
+        case BT_SET:
+            if (i < M->len && set_has(n->set, M->hay[i])) match_cont(M, i + 1, k);
+            break;
+        case BT_CAT:
+            c = (BtCont) {n, 0, 0, k};
+            match_cont(M, i, &c);
+            break;
+        case BT_ALT:
+            for (int j = 0; j < n->num_kids; j++) match_node(M, n->kids[j], i, k);
+            break;
+        case BT_QUEST:
+            match_node(M, n->kids[0], i, k);
+            match_cont(M, i, k);
+            break;
+        case BT_STAR:
+            match_cont(M, i, k);
+            c = (BtCont) {n, 0, i, k};
+            match_node(M, n->kids[0], i, &c);
+            break;
+        case BT_PLUS:
+            c = (BtCont) {n, 0, i, k};
+            match_node(M, n->kids[0], i, &c);
+            break;
+    }
+}
+
+long bt_search(const BtRegexp *re, const char *hay, const size_t len, const size_t from, size_t *match_len,
+               unsigned long *budget) {
+    if (from > len || (re->anchor_start && from > 0)) return -1;
+
+    BtMatcher M = {re, (const unsigned char *) hay, len, -1, budget, false};
+    for (size_t start = from; start <= len; start++) {
+        match_node(&M, re->root, start, NULL);
+        if (M.out_of_budget) return -2;
+        if (M.best != -1) {
+            if (match_len) *match_len = (size_t) M.best - start;
+            return (long) start;
+        }
+        if (re->anchor_start) break;
+    }
+    return -1;
+}
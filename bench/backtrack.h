@@ -0,0 +1,42 @@
+#ifndef BACKTRACK_H
+#define BACKTRACK_H
+
+#include <stdbool.h>
+#include <stddef.h>
+
+/**
+ * @brief Pattern compiled for the backtracking reference matcher.
+ * @note Parses the same syntax as regexp_compile, but matches by trying every
+ * way through the pattern from every start. It is exponential on patterns like
+ * (a*)*b, which is what the DFA is measured and checked against.
+ */
+typedef struct BtRegexp BtRegexp;
+
+/**
+ * @brief Compile a pattern for the backtracking matcher.
+ * @param pattern Pattern to compile
+ * @param len Length of the pattern
+ * @return Compiled pattern, or NULL if the pattern is invalid
+ */
+BtRegexp *bt_compile(const char *pattern, size_t len);
+
+/**
+ * @brief Free a compiled pattern.
+ * @param re Compiled pattern, may be NULL
+ */
+void bt_free(BtRegexp *re);
+
+/**
+ * @brief Find the leftmost-longest match in a buffer, starting at 'from'.
+ * @param re Compiled pattern
+ * @param hay Buffer to search
+ * @param len Length of the buffer
+ * @param from Offset to start searching at
+ * @param match_len Length of the match (will be updated), may be NULL
+ * @param budget Number of steps left (will be updated), may be NULL for no limit
+ * @return Offset of the match, -1 if there is none, or -2 if the budget ran out
+ */
+long bt_search(const BtRegexp *re, const char *hay, size_t len, size_t from, size_t *match_len,
+               unsigned long *budget);
+
+#endif //BACKTRACK_H
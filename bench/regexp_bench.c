@@ -0,0 +1,106 @@
+#include "backtrack.h"
+#include "regexp.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#define BENCH_SLOW_MS 1000.0
+#define BENCH_MAX_TEXT (1 << 20)
+
+/**
+ * @brief Pathological pattern, built for a size n, and the text it is run on.
+ */
+typedef struct {
+    const char *name;
+    void (*pattern)(char *out, int n);
+    char text_byte;
+    int max_n;
+} BenchCase;
+
+static void pattern_nested_star(char *out, int n) {
+    (void) n;
+    strcpy(out, "(a*)*b");
+}
+
+static void pattern_optional_prefix(char *out, int n) {
+    // a?^n a^n, every way to skip the optional a's is tried before a match
+    out[0] = '\0';
+    for (int i = 0; i < n; i++) strcat(out, "a?");
+    for (int i = 0; i < n; i++) strcat(out, "a");
+}
+
+static void pattern_overlapping_alt(char *out, int n) {
+    (void) n;
+    strcpy(out, "(a|aa)*c");
+}
+
+static void pattern_nested_plus(char *out, int n) {
+    (void) n;
+    strcpy(out, "(x+x+)+y");
+}
+
+static const BenchCase cases[] = {
+    {"(a*)*b", pattern_nested_star, 'a', BENCH_MAX_TEXT},
+    {"a?^n a^n", pattern_optional_prefix, 'a', 1024},
+    {"(a|aa)*c", pattern_overlapping_alt, 'a', BENCH_MAX_TEXT},
+    {"(x+x+)+y", pattern_nested_plus, 'x', BENCH_MAX_TEXT},
+};
+
+static double now_ms(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (double) ts.tv_sec * 1000.0 + (double) ts.tv_nsec / 1e6;
+}
+
+int main(void) {
+    char *pattern = malloc(3 * 1024 + 1);
+    char *text = malloc(BENCH_MAX_TEXT);
+    if (pattern == NULL || text == NULL) exit(1);
+
+    printf("%-10s %8s %14s %10s %8s\n", "pattern", "n", "backtrack ms", "dfa ms", "match");
+    for (size_t c = 0; c < sizeof(cases) / sizeof(cases[0]); c++) {
+        const BenchCase *B = &cases[c];
+        bool naive = true;
+
+        for (int n = 4; n <= B->max_n; n = (n < 32) ? n + 4 : n * 4) {
+            B->pattern(pattern, n);
+            memset(text, B->text_byte, (size_t) n);
+
+            // The backtracking run is skipped once it got too slow, it only gets worse
+            char naive_ms[32] = "-";
+            long naive_pos = 0;
+            if (naive) {
+                BtRegexp *bt = bt_compile(pattern, strlen(pattern));
+                double t = now_ms();
+                naive_pos = bt_search(bt, text, (size_t) n, 0, NULL, NULL);
+                t = now_ms() - t;
+                bt_free(bt);
+                snprintf(naive_ms, sizeof(naive_ms), "%.3f", t);
+                if (t > BENCH_SLOW_MS) naive = false;
+            }
+
+            const char *error = NULL;
+            Regexp *re = regexp_compile(pattern, strlen(pattern), &error);
+            RegexpDFA *dfa = regexp_dfa_new(re);
+            regexp_release(re);
+            double t = now_ms();
+            size_t match_len = 0;
+            long pos = regexp_search(dfa, text, (size_t) n, 0, &match_len);
+            t = now_ms() - t;
+            regexp_dfa_free(dfa);
+
+            if (naive_ms[0] != '-' && naive_pos != pos) {
+                fprintf(stderr, "%s n=%d: backtracking found %ld, the DFA %ld\n", B->name, n, naive_pos, pos);
+                return 1;
+            }
+            char match[32] = "none";
+            if (pos != -1) snprintf(match, sizeof(match), "%ld+%zu", pos, match_len);
+            printf("%-10s %8d %14s %10.3f %8s\n", B->name, n, naive_ms, t, match);
+        }
+    }
+
+    free(pattern);
+    free(text);
+    return 0;
+}
@@ -0,0 +1,142 @@
+#include "backtrack.h"
+#include "regexp.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define CHECK_PATTERN_MAX 64
+#define CHECK_TEXT_MAX 16
+#define CHECK_TEXTS 8
+#define CHECK_BUDGET 100000UL
+
+static unsigned long long rng_state;
+
+static unsigned int rng(void) {
+    // xorshift64*, so a seed gives the same cases everywhere
+    rng_state ^= rng_state >> 12;
+    rng_state ^= rng_state << 25;
+    rng_state ^= rng_state >> 27;
+    return (unsigned int) ((rng_state * 2685821657736338717ULL) >> 32);
+}
+
+static void out_add(char *out, size_t *len, const char c) {
+    if (*len < CHECK_PATTERN_MAX) out[(*len)++] = c;
+}
+
+static void out_add_str(char *out, size_t *len, const char *s) {
+    while (*s) out_add(out, len, *s++);
+}
+
+/**
+ * @brief Append a random pattern made of a few letters, classes and operators.
+ */
+static void gen_pattern(char *out, size_t *len, const int depth) {
+    static const char *atoms[] = {"a", "b", "c", ".", "[ab]", "[^a]", "[a-c]", "\\w", "\\W", "\\s", "\\.", "*", "[]a]"};
+    int pieces = 1 + (int) (rng() % 3);
+
+    for (int i = 0; i < pieces; i++) {
+        if (depth < 3 && rng() % 4 == 0) {
+            out_add(out, len, '(');
+            gen_pattern(out, len, depth + 1);
+            if (rng() % 2) {
+                out_add(out, len, '|');
+                gen_pattern(out, len, depth + 1);
+            }
+            out_add(out, len, ')');
+        } else {
+            out_add_str(out, len, atoms[rng() % (sizeof(atoms) / sizeof(atoms[0]))]);
+        }
+        switch (rng() % 6) {
+            case 0: out_add(out, len, '*'); break;
+            case 1: out_add(out, len, '+'); break;
+            case 2: out_add(out, len, '?'); break;
+            default: break;
+        }
+    }
+    if (depth == 0 && rng() % 5 == 0) {
+        out_add(out, len, '|');
+        gen_pattern(out, len, depth + 1);
+    }
+}
+
+/**
+ * @brief Make a random pattern, sometimes anchored, sometimes plain noise to check errors.
+ */
+static size_t make_pattern(char *out) {
+    size_t len = 0;
+
+    if (rng() % 10 == 0) {
+        static const char noise[] = "ab.()|*+?[]^$-\\";
+        size_t n = rng() % 8;
+        for (size_t i = 0; i < n; i++) out_add(out, &len, noise[rng() % (sizeof(noise) - 1)]);
+        return len;
+    }
+
+    if (rng() % 6 == 0) out_add(out, &len, '^');
+    gen_pattern(out, &len, 0);
+    if (rng() % 6 == 0) out_add(out, &len, '$');
+    return len;
+}
+
+static void print_case(const char *what, const char *pattern, const size_t pattern_len, const char *text,
+                       const size_t text_len, const size_t from) {
+    fprintf(stderr, "%s\n  pattern '%.*s'\n  text '%.*s' from %zu\n", what, (int) pattern_len, pattern,
+            (int) text_len, text, from);
+}
+
+int main(int argc, char **argv) {
+    // 60000 pattern and text pairs by default
+    long iterations = argc > 1 ? atol(argv[1]) : 60000 / CHECK_TEXTS;
+    rng_state = argc > 2 ? strtoull(argv[2], NULL, 10) : 1;
+    if (rng_state == 0) rng_state = 1;
+
+    long checked = 0, skipped = 0;
+    for (long it = 0; it < iterations; it++) {
+        char pattern[CHECK_PATTERN_MAX];
+        size_t pattern_len = make_pattern(pattern);
+
+        const char *error = NULL;
+        Regexp *re = regexp_compile(pattern, pattern_len, &error);
+        BtRegexp *bt = bt_compile(pattern, pattern_len);
+        if ((re == NULL) != (bt == NULL)) {
+            print_case(re == NULL ? "only the reference compiles" : "only the engine compiles", pattern, pattern_len,
+                       "", 0, 0);
+            return 1;
+        }
+        if (re == NULL) {
+            checked++;
+            continue;
+        }
+
+        RegexpDFA *dfa = regexp_dfa_new(re);
+        regexp_release(re);
+
+        for (int t = 0; t < CHECK_TEXTS; t++) {
+            char text[CHECK_TEXT_MAX];
+            size_t text_len = rng() % (CHECK_TEXT_MAX + 1);
+            for (size_t i = 0; i < text_len; i++) text[i] = "abc. _"[rng() % 6];
+            size_t from = rng() % 4 == 0 ? rng() % (text_len + 1) : 0;
+
+            unsigned long budget = CHECK_BUDGET;
+            size_t bt_len = 0, dfa_len = 0;
+            long bt_pos = bt_search(bt, text, text_len, from, &bt_len, &budget);
+            if (bt_pos == -2) {
+                skipped++;
+                continue;
+            }
+            long dfa_pos = regexp_search(dfa, text, text_len, from, &dfa_len);
+            if (bt_pos != dfa_pos || (bt_pos != -1 && bt_len != dfa_len)) {
+                print_case("mismatch", pattern, pattern_len, text, text_len, from);
+                fprintf(stderr, "  reference %ld+%zu, engine %ld+%zu\n", bt_pos, bt_len, dfa_pos, dfa_len);
+                return 1;
+            }
+            checked++;
+        }
+
+        regexp_dfa_free(dfa);
+        bt_free(bt);
+    }
+
+    printf("%ld cases match, %ld skipped over the backtracking budget\n", checked, skipped);
+    return 0;
+}
@@ -13,12 +13,21 @@ typedef enum {
 // ---- CURSOR ACTIONS ----
 
 void action_move_cursor(Editor *E, direction dir);
+
+/**
+ * @brief Move the cursor count steps at once, stopping at the edges of the file.
+ * @param E Editor state
+ * @param dir Direction to move in
+ * @param count Number of steps
+ */
+void action_move_cursor_by(Editor *E, direction dir, int count);
 void action_move_to_end_of_line(Editor *E);
 void action_move_to_start_of_line(Editor *E);
 void action_move_to_first_character(Editor *E);
 void action_move_to_last_character(Editor *E);
 void action_move_to_last_line(Editor *E);
 void action_move_to_first_line(Editor *E);
+void action_move_to_matching_bracket(Editor *E);
 
 // ---- NORMAL MODE ----
 void action_insert_mode(Editor *E);
@@ -31,17 +40,38 @@ void action_move_start_line(Editor *E);
 void action_move_end_line(Editor *E);
 void action_move_first_char(Editor *E);
 void action_move_next_word_start(Editor *E);
+void action_move_next_big_word_start(Editor *E);
 void action_move_prev_word_start(Editor *E);
+void action_move_prev_big_word_start(Editor *E);
 void action_move_curr_word_end(Editor *E);
+void action_move_curr_big_word_end(Editor *E);
+void action_move_matching_bracket(Editor *E);
+void action_move_first_line(Editor *E);
+void action_move_last_line(Editor *E);
 void action_move_left(Editor *E);
 void action_move_down(Editor *E);
 void action_move_up(Editor *E);
 void action_move_right(Editor *E);
 void action_delete_char(Editor *E);
+void action_delete_line(Editor *E);
+void action_delete_next_word_start(Editor *E);
+void action_delete_next_big_word_start(Editor *E);
+void action_delete_prev_word_start(Editor *E);
+void action_delete_prev_big_word_start(Editor *E);
+void action_delete_curr_word_end(Editor *E);
+void action_delete_curr_big_word_end(Editor *E);
+void action_yank_line(Editor *E);
+void action_put_after(Editor *E);
+void action_put_before(Editor *E);
+void action_undo(Editor *E);
+void action_redo(Editor *E);
 void action_quit(Editor *E);
 void action_save(Editor *E);
 
 void action_command_mode(Editor *E);
+void action_search(Editor *E);
+void action_search_next(Editor *E);
+void action_search_prev(Editor *E);
 
 // ---- INSERT MODE ----
 void action_normal_mode(Editor *E);
@@ -51,6 +81,27 @@ void action_insert_character(Editor *E, char c);
 void action_delete_last_word(Editor *E);
 
 // ---- VISUAL MODE ----
-// TODO: IMPLEMENT VISUAL MODE
+void action_visual_mode(Editor *E);
+void action_visual_line_mode(Editor *E);
+void action_visual_block_mode(Editor *E);
+void action_visual_exit(Editor *E);
+void action_visual_swap(Editor *E);
+void action_visual_delete(Editor *E);
+void action_visual_yank(Editor *E);
+void action_visual_indent(Editor *E);
+void action_visual_unindent(Editor *E);
+void action_visual_block_insert(Editor *E);
+void action_visual_block_append(Editor *E);
+void action_visual_cursors(Editor *E);
+
+// ---- MULTI-CURSOR ----
+void action_cursors_clear(Editor *E);
+
+// ---- WINDOWS ----
+void action_window_split(Editor *E);
+void action_window_vsplit(Editor *E);
+void action_window_close(Editor *E);
+void action_window_only(Editor *E);
+void action_window_next(Editor *E);
 
 #endif //ACTIONS_H
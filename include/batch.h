@@ -0,0 +1,41 @@
+#ifndef BATCH_H
+#define BATCH_H
+
+struct Editor;
+
+/**
+ * @brief Work given on the command line for a run without a terminal.
+ */
+typedef struct BatchOptions {
+    /**
+     * @brief File of ex commands to run, one per line, NULL if there is none.
+     */
+    const char *script;
+
+    /**
+     * @brief Commands given with "-c", run after the script in order.
+     */
+    const char **commands;
+    int num_commands;
+
+    /**
+     * @brief File to edit, NULL or "-" to read stdin and write the result to stdout.
+     */
+    const char *file;
+} BatchOptions;
+
+/**
+ * @brief Load the file, run the script and the commands on it, and write it back.
+ * @param E Editor state, initialized with init_editor_headless
+ * @param O Work to do
+ * @return Exit status: 0 on success, 1 if the result could not be written,
+ * 2 if the script could not be read
+ * @note Script lines may start with ':', empty lines and lines starting with
+ * '"' are skipped. Keys run with "normal" and macros set with "let".
+ * @note Messages of the commands go to stderr, so stdout only holds the
+ * content when editing stdin, written once at the end or by a ":w" after
+ * the last change. "q" ends the run without writing.
+ */
+int batch_run(struct Editor *E, const BatchOptions *O);
+
+#endif //BATCH_H
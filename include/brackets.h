@@ -0,0 +1,143 @@
+#ifndef BRACKETS_H
+#define BRACKETS_H
+
+#include <stdbool.h>
+
+#define BRACKET_TYPES 3
+#define BRACKET_LEAF_ROWS 32
+
+struct Editor;
+struct erow;
+
+/**
+ * @brief Bracket summary of a range of text.
+ * @note For each bracket type, 'close' is the number of unmatched closing
+ * brackets at the start of the range and 'open' is the number of unmatched
+ * opening brackets at the end of the range.
+ * @note The net nesting change of the range is open - close.
+ */
+typedef struct BracketSummary {
+    int close[BRACKET_TYPES];
+    int open[BRACKET_TYPES];
+} BracketSummary;
+
+/**
+ * @brief Segment tree of bracket summaries, each leaf holds a run of up to
+ * BRACKET_LEAF_ROWS consecutive rows.
+ * @note Each node stores the combined summary of the rows below it, which
+ * allows for the partner of a bracket to be found in O(log n).
+ * @note Row summaries are stored in the rows themselves, so they move with
+ * the rows. Leaves are kept partly empty, so inserted and removed rows are
+ * spliced in by refilling the smallest subtree with room for them, and the
+ * whole tree is only rebuilt when it has to grow or shrink.
+ */
+typedef struct BracketIndex {
+    /**
+     * @brief Nodes of the tree, 1-indexed, leaves start at 'leaves'.
+     */
+    BracketSummary *nodes;
+
+    /**
+     * @brief Number of rows below each node, in the same order as the nodes.
+     */
+    int *counts;
+
+    /**
+     * @brief Number of leaves in the tree, always a power of two.
+     */
+    int leaves;
+
+    /**
+     * @brief Height of the root, log2 of the number of leaves.
+     */
+    int height;
+
+    /**
+     * @brief Number of rows the tree was built for.
+     */
+    int num_rows;
+
+    /**
+     * @brief Tree must be rebuilt before it can be queried.
+     * @note Set until the first query, and when the lexical rules change.
+     */
+    bool stale;
+
+    /**
+     * @brief Generation of the row summaries. A row summary is valid when
+     * the row generation matches this value.
+     * @note Bumping this value invalidates every row summary.
+     */
+    unsigned int gen;
+
+    /**
+     * @brief Skip brackets inside strings and line comments.
+     * @note Only enabled for file types which are known to have them.
+     */
+    bool lexical;
+
+    /**
+     * @brief Line comment prefix of the file type, used when lexical is set.
+     */
+    const char *comment;
+} BracketIndex;
+
+/**
+ * @brief Initialize an empty bracket index.
+ * @param B Bracket index
+ */
+void bracket_index_init(BracketIndex *B);
+
+/**
+ * @brief Free the memory used by the bracket index.
+ * @param B Bracket index
+ */
+void bracket_index_free(BracketIndex *B);
+
+/**
+ * @brief Update the lexical rules used by the index based on the file type.
+ * @param E Editor state
+ * @note This will invalidate every row summary if the rules change.
+ */
+void bracket_index_set_file_type(struct Editor *E);
+
+/**
+ * @brief Notify the index that the content of a row changed.
+ * @param E Editor state
+ * @param y Row that was changed
+ * @note This is O(log n) unless the tree is already stale.
+ */
+void bracket_index_update_row(struct Editor *E, int y);
+
+/**
+ * @brief Notify the index that rows were inserted or removed.
+ * @param E Editor state
+ * @param y First row that changed
+ * @param removed Number of rows the range had before the change
+ * @param inserted Number of rows the range has now
+ * @note Only the smallest subtree with room for the rows is refilled,
+ * this is O(log n) amortized plus the size of the range.
+ */
+void bracket_index_splice(struct Editor *E, int y, int removed, int inserted);
+
+/**
+ * @brief Get the bracket type of a character.
+ * @param c Character to check
+ * @param open Set to true if the bracket is an opening bracket
+ * @return Bracket type, or -1 if c is not a bracket
+ */
+int bracket_type(char c, bool *open);
+
+/**
+ * @brief Find the partner of the bracket at (x, y).
+ * @param E Editor state
+ * @param x X position of the bracket
+ * @param y Y position of the bracket
+ * @param px Partner x position (will be updated)
+ * @param py Partner y position (will be updated)
+ * @return true if a partner was found
+ * @note Brackets inside strings or comments have no partner.
+ */
+bool bracket_find_partner(struct Editor *E, int x, int y, int *px, int *py);
+
+#endif //BRACKETS_H
@@ -0,0 +1,160 @@
+#ifndef BUFFERS_H
+#define BUFFERS_H
+
+#include "brackets.h"
+#include "trigram.h"
+#include "undo.h"
+#include <stdbool.h>
+#include <stddef.h>
+#include <sys/types.h>
+#include <time.h>
+
+/**
+ * @brief Memory the rows of all open buffers may take before clean buffers are evicted.
+ */
+#define BUFFER_MEMORY_BUDGET ((size_t) 512 << 20)
+
+/**
+ * @brief Allocations from this size on are mapped on their own once several buffers are open.
+ */
+#define BUFFER_MMAP_THRESHOLD (1 << 20)
+
+struct Editor;
+struct erow;
+
+/**
+ * @brief File open in the editor, with its rows, cursor and view.
+ * @note The current buffer lives in the editor itself, its entry in the list
+ * is only filled while another buffer is current. Switching moves the state
+ * of the buffer in and out of the editor, nothing is copied.
+ */
+typedef struct FileBuffer {
+    /**
+     * @brief Number shown by ":ls" and used by ":b {n}", never reused.
+     */
+    int id;
+
+    char *filename;
+    char *filetype;
+
+    struct erow *row;
+    int num_rows;
+    size_t num_bytes;
+    int dirty;
+
+    int cur_x;
+    int cur_y;
+    int view_start;
+    int col_start;
+
+    BracketIndex brackets;
+    TrigramIndex trigrams;
+    UndoJournal undo;
+
+    /**
+     * @brief Size and modification time of the file when it was last read or written.
+     */
+    off_t disk_size;
+    struct timespec disk_mtime;
+
+    /**
+     * @brief The file was followed when the buffer stopped being current, it is followed again from disk_size.
+     */
+    bool follow;
+
+    /**
+     * @brief Rows were freed to stay within the budget, they are read from the file when the buffer is current again.
+     * @note Only clean buffers which no window shows are evicted. The undo history is kept, and is only
+     * dropped if the file changed on disk since it was last read or written.
+     */
+    bool evicted;
+
+    /**
+     * @brief Memory used by the rows when the buffer stopped being current.
+     */
+    size_t bytes;
+
+    /**
+     * @brief Tick of the last time the buffer was current, the oldest is evicted first.
+     */
+    unsigned long used;
+} FileBuffer;
+
+/**
+ * @brief Buffers open in the editor.
+ * @note Empty until a second buffer is opened, the state in the editor is
+ * the only buffer until then.
+ */
+typedef struct BufferList {
+    FileBuffer *list;
+    int num;
+    int cap;
+
+    /**
+     * @brief Index of the buffer which lives in the editor.
+     */
+    int current;
+
+    unsigned long tick;
+    int next_id;
+} BufferList;
+
+/**
+ * @brief Open a file in a buffer of its own and make it current, like ":e {file}".
+ * @param E Editor state
+ * @param filename Name of the file, the buffer which has it open is reused
+ */
+void buffer_open(struct Editor *E, const char *filename);
+
+/**
+ * @brief Make a buffer current, like ":b {n}".
+ * @param E Editor state
+ * @param id Number of the buffer
+ * @return false if there is no such buffer
+ */
+bool buffer_select(struct Editor *E, int id);
+
+/**
+ * @brief Make a buffer current without reporting it, e.g. when its window becomes current.
+ * @param E Editor state
+ * @param id Number of the buffer
+ * @return false if there is no such buffer
+ */
+bool buffer_activate(struct Editor *E, int id);
+
+/**
+ * @brief Get the number of the current buffer.
+ * @param E Editor state
+ */
+int buffer_current_id(struct Editor *E);
+
+/**
+ * @brief Get a buffer which is not current, its rows are kept in its entry.
+ * @param E Editor state
+ * @param id Number of the buffer
+ * @return NULL if there is no such buffer, or it is the current one
+ */
+FileBuffer *buffer_find(struct Editor *E, int id);
+
+/**
+ * @brief Move through the buffer list, like ":bn" and ":bp".
+ * @param E Editor state
+ * @param count Number of buffers to move by, negative to move back, wraps around
+ */
+void buffer_cycle(struct Editor *E, int count);
+
+/**
+ * @brief Write the buffer list as a line of text, like ":ls".
+ * @param E Editor state
+ * @param buf Buffer for the text
+ * @param size Size of the buffer
+ */
+void buffer_list(struct Editor *E, char *buf, int size);
+
+/**
+ * @brief Free every buffer but the current one, which is freed with the editor.
+ * @param E Editor state
+ */
+void buffer_list_free(struct Editor *E);
+
+#endif //BUFFERS_H
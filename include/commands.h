@@ -0,0 +1,52 @@
+#ifndef COMMANDS_H
+#define COMMANDS_H
+
+#include <stdbool.h>
+
+struct Editor;
+
+/**
+ * @brief Range of rows a command applies to, 0-indexed and inclusive.
+ */
+typedef struct CommandRange {
+    int start;
+    int end;
+} CommandRange;
+
+/**
+ * @brief Parse the range at the start of a command, and move s past it.
+ * @param E Editor state
+ * @param s Command to parse (will be updated)
+ * @param range Parsed range (will be updated), the cursor row if there is none
+ * @param error Set to a description of the problem if the range is invalid
+ * @return false if the range is invalid
+ * @note Supported ranges: '%', a single address, and 'address,address'. An
+ * address is a line number, '.' or '$', followed by any number of '+N' or '-N'.
+ */
+bool command_parse_range(struct Editor *E, const char **s, CommandRange *range, const char **error);
+
+/**
+ * @brief Execute a command typed in command mode, e.g. "w", "%s/a/b/g" or ".,$m0".
+ * @param E Editor state
+ * @param cmd Command, without the leading ':'
+ * @note The command is looked up in a table by its name or an abbreviation.
+ * Commands on rows, "d", "m", "normal" and "g", work on the whole range at once.
+ */
+void command_execute(struct Editor *E, const char *cmd);
+
+/**
+ * @brief Substitute matches of a pattern in a range of rows: "s/pattern/replacement/[g]".
+ * @param E Editor state
+ * @param range Rows to substitute in
+ * @param args Command after the 's', starting at the delimiter
+ * @note The delimiter can be any punctuation character, it can be escaped with '\'
+ * inside the pattern and the replacement. In the replacement, '&' is the whole
+ * match and '\' makes the next character literal.
+ * @note An empty pattern uses the last search pattern, and the pattern becomes the
+ * last search pattern, so 'n' finds the next match.
+ * @note Each modified row is built in a single allocation and swapped in, the
+ * render is generated lazily when the row is drawn.
+ */
+void command_substitute(struct Editor *E, const CommandRange *range, const char *args);
+
+#endif //COMMANDS_H
@@ -0,0 +1,97 @@
+#ifndef CURSORS_H
+#define CURSORS_H
+
+#include <stdbool.h>
+
+struct Editor;
+
+/**
+ * @brief Position of an extra cursor.
+ */
+typedef struct Cursor {
+    int x;
+    int y;
+} Cursor;
+
+/**
+ * @brief Extra cursors, the main cursor stays in E->cur_x and E->cur_y.
+ * @note Kept sorted by row then column, with no two cursors at the same position.
+ */
+typedef struct CursorSet {
+    Cursor *list;
+    int num;
+    int cap;
+} CursorSet;
+
+/**
+ * @brief Check if there are extra cursors.
+ * @param E Editor state
+ * @return true in multi-cursor mode
+ */
+bool cursors_active(const struct Editor *E);
+
+/**
+ * @brief Add a cursor, nothing happens if a cursor is already there.
+ * @param E Editor state
+ * @param x X position
+ * @param y Y position
+ * @note The set is sorted again by cursors_merge.
+ */
+void cursors_add(struct Editor *E, int x, int y);
+
+/**
+ * @brief Remove the extra cursors, back to a single cursor.
+ * @param E Editor state
+ */
+void cursors_clear(struct Editor *E);
+
+/**
+ * @brief Sort the cursors, and merge the ones which ended up at the same position.
+ * @param E Editor state
+ * @note Extra cursors on the main cursor are dropped.
+ */
+void cursors_merge(struct Editor *E);
+
+/**
+ * @brief Run an action once for every cursor, e.g. a motion.
+ * @param E Editor state
+ * @param action Action, run with each cursor in turn as the main cursor
+ */
+void cursors_for_each(struct Editor *E, void (*action)(struct Editor *E));
+
+/**
+ * @brief Insert text at every cursor, as one batch.
+ * @param E Editor state
+ * @param s Text to insert, must not contain newlines
+ * @param len Length of the text
+ * @note The edits are sorted and applied with editor_splice_rows, so each row
+ * is rebuilt once however many cursors it has. The cursors move past the text.
+ */
+void cursors_insert(struct Editor *E, const char *s, int len);
+
+/**
+ * @brief Delete the character before every cursor, as one batch.
+ * @param E Editor state
+ * @note Cursors at the start of a row join it onto the row above, one at a time.
+ */
+void cursors_backspace(struct Editor *E);
+
+/**
+ * @brief Put a cursor on every row from y0 to y1, at the same column on screen.
+ * @param E Editor state
+ * @param y0 First row
+ * @param y1 Last row
+ * @param col Render column, rows which end before it get the cursor at their end
+ * @note The main cursor is moved to row y0.
+ */
+void cursors_add_column(struct Editor *E, int y0, int y1, int col);
+
+/**
+ * @brief Draw the extra cursors which are on screen.
+ * @param E Editor state
+ * @note The first visible cursor is found with a binary search, so the cost
+ * does not depend on the number of cursors.
+ */
+void editor_draw_cursors(struct Editor *E);
+
+#endif //CURSORS_H
@@ -6,11 +6,40 @@
 #define NUM_COL_SIZE 5
 #define RELATIVE_NUM true
 #define SCROLL_OFF 8
+#define BACKGROUND_POLL_MS 100
+#define TRIGRAM_INDEX true
+#define UNDO_LOG true
+#define KEY_STACK_SIZE 8
+#define REPEAT_MAX 100000000
+#define LOAD_BLOCK_SIZE (1 << 20)
+#define LOAD_BATCH_ROWS 4096
+#define HEADLESS_ROWS 24
+#define HEADLESS_COLS 80
+
+#include "brackets.h"
+#include "buffers.h"
+#include "cursors.h"
+#include "input.h"
+#include "load_job.h"
+#include "macros.h"
+#include "registers.h"
+#include "search.h"
+#include "trigram.h"
+#include "undo.h"
+#include "visual.h"
+#include "watch.h"
+#include "windows.h"
+#include <stdio.h>
+#include <sys/types.h>
+#include <time.h>
 
 typedef enum {
     NORMAL_MODE,
     INSERT_MODE,
-    COMMAND_MODE
+    COMMAND_MODE,
+    VISUAL_MODE,
+    VISUAL_LINE_MODE,
+    VISUAL_BLOCK_MODE
 } EditorMode;
 
 /**
@@ -41,6 +70,32 @@ typedef struct erow {
      * @note This value should be generated based on chars, before the screen is refreshed.
      */
     char *render;
+
+    /**
+     * @brief Bracket summary of the row, used by the bracket index.
+     * @note Only valid when 'bracket_gen' matches the generation of the index.
+     */
+    BracketSummary brackets;
+
+    /**
+     * @brief Generation of the bracket index the summary was computed for.
+     * @note 0 indicates the summary has never been computed.
+     */
+    unsigned int bracket_gen;
+
+    /**
+     * @brief Version of the content, a new value is assigned on every change.
+     * @note Versions are unique across rows, so they identify the content even
+     * after the row moves. Used to cache the search matches of the row.
+     */
+    unsigned long version;
+
+    /**
+     * @brief Row is marked by :global and the command has not run on it yet.
+     * @note The mark is on the row itself, so it follows the row when the
+     * command moves, inserts or deletes other rows.
+     */
+    bool marked;
 } erow;
 
 /**
@@ -58,6 +113,12 @@ typedef struct Editor {
      */
     int num_rows;
 
+    /**
+     * @brief Number of characters in the rows, without the newlines.
+     * @note Kept up to date by the row primitives, so the status bar does not add up the rows.
+     */
+    size_t num_bytes;
+
     /**
      * @breif Number of rows that can be displayed on the screen.
      * @note This also serves as the capacity for the rows memory.
@@ -93,6 +154,18 @@ typedef struct Editor {
      */
     int view_start;
 
+    /**
+     * @brief First column of the render shown, the view scrolls sideways on long rows.
+     */
+    int col_start;
+
+    /**
+     * @brief Lines of text and columns of the current window.
+     * @note The whole screen but the status and message bars with a single window.
+     */
+    int view_rows;
+    int view_cols;
+
     /**
      * @breif Message to display in the message bar.
      */
@@ -110,6 +183,15 @@ typedef struct Editor {
      */
     char *filename;
 
+    /**
+     * @brief Size and modification time of the file when it was last read or written.
+     * @note Tells whether the file changed on disk since, 0 if it was never read.
+     * @note The size is the number of bytes in the rows, which is more than
+     * the size the file had when it was opened if it grew while being read.
+     */
+    off_t disk_size;
+    struct timespec disk_mtime;
+
     /**
      * @brief Type of the file in the editor.
      * @note Stored as the file extension excluding the period.
@@ -117,9 +199,10 @@ typedef struct Editor {
     char *filetype;
 
     /**
-     * @breif Stores a value of how "dirty" the file is. The number of changes
-     * made to the file.
+     * @breif Stores a value of how "dirty" the file is.
      * @note Any value over 0 indicates a file has been changed.
+     * @note Derived from the position in the undo journal, so undoing back to
+     * the saved state makes the file clean again.
      */
     int dirty;
 
@@ -128,6 +211,108 @@ typedef struct Editor {
      * @note Mode will determine the way in which commands are parsed.
      */
     EditorMode mode;
+
+    /**
+     * @brief Count typed before a normal mode command, e.g. 500 in "500x".
+     * @note 0 indicates no count was typed. Actions read it through their
+     * count, and it is reset after every command.
+     */
+    int repeat;
+
+    /**
+     * @brief Keys of a command which is not complete yet, e.g. the first 'd' of "dd".
+     */
+    int stack[KEY_STACK_SIZE];
+    int stack_len;
+
+    /**
+     * @brief Selection of the visual modes, and a pending block insert.
+     */
+    VisualState visual;
+
+    /**
+     * @brief Registers filled by yanks and deletes, the unnamed register first, then 'a' to 'z'.
+     */
+    Register reg[REGISTER_COUNT];
+
+    /**
+     * @brief Register selected with '"' for the next command, 0 for the unnamed register.
+     * @note Reset after every command, like the count.
+     */
+    int reg_name;
+
+    /**
+     * @brief Macros recorded with "q{reg}", and the replay that is running.
+     */
+    MacroState macros;
+
+    /**
+     * @brief Extra cursors of multi-cursor mode, empty with a single cursor.
+     */
+    CursorSet cursors;
+
+    /**
+     * @brief Index of the brackets in the rows, used to find matching brackets.
+     */
+    BracketIndex brackets;
+
+    /**
+     * @brief State of the search, the last pattern and current match.
+     */
+    SearchState search;
+
+    /**
+     * @brief Trigram index of the rows, used to narrow searches in large buffers.
+     * @note Only built when TRIGRAM_INDEX is enabled.
+     */
+    TrigramIndex trigrams;
+
+    /**
+     * @brief Last version assigned to a row.
+     */
+    unsigned long row_version;
+
+    /**
+     * @brief Journal of the edits, used for undo and redo.
+     */
+    UndoJournal undo;
+
+    /**
+     * @brief Keys read from the terminal by the reader thread.
+     */
+    InputState input;
+
+    /**
+     * @brief Buffers open besides the current one, whose state is the rest of the editor.
+     */
+    BufferList buffers;
+
+    /**
+     * @brief File being read into the current buffer in the background.
+     */
+    LoadJob load;
+
+    /**
+     * @brief Watch on the file of the current buffer.
+     */
+    FileWatch watch;
+
+    /**
+     * @brief Windows on the screen, the view of the current one is the rest of the editor.
+     */
+    WindowLayout windows;
+
+    /**
+     * @brief Editor runs without a terminal, e.g. for "-s script".
+     * @note Nothing is drawn, and reading a key gives ESC.
+     */
+    bool headless;
+
+    /**
+     * @brief Buffer without a file name was written to stdout by ":w".
+     * @note Batch mode skips its final write when nothing changed since.
+     */
+    bool stdout_written;
 } Editor;
 
 /**
@@ -135,6 +320,7 @@ typedef struct Editor {
  * @param E Editor state
  * @note This function draws '~' for unused lines.
  * @note This function also updates the editor size state.
+ * @note Nothing is drawn while a macro is replayed.
  */
 void editor_refresh(Editor *E);
 
@@ -153,8 +339,22 @@ void editor_scroll(Editor *E);
  */
 void init_editor(Editor *E);
 
+/**
+ * @brief Initialize the editor state without a terminal, for batch editing.
+ * @param E Editor state
+ * @note ncurses is not started and no keys are read.
+ */
+void init_editor_headless(Editor *E);
+
 void editor_destroy(Editor *E);
 
+/**
+ * @brief Highlight the bracket which matches the bracket under the cursor.
+ * @param E Editor state
+ * @note Nothing is drawn if the partner is outside of the view.
+ */
+void editor_draw_bracket_match(Editor *E);
+
 /**
  * @brief Draw the status bar with the content pre-defined. No message here.
  * @param E Editor state
@@ -187,9 +387,46 @@ void editor_set_status_message(Editor *E, char *fmt, ...);
  * @brief Open a file and load it's content into the editor.
  * @param E Editor state
  * @param filename Name of the file to open
+ * @note With a terminal, a file larger than LOAD_BLOCK_SIZE returns once its
+ * first screen is loaded, the rest comes in the background, see LoadJob.
  */
 void editor_open_file(Editor *E, char *filename);
 
+/**
+ * @brief Read the lines of the file that is open, after the rows already there.
+ * @param E Editor state
+ * @param hash Hash of the content (will be updated), see undo_log_hash
+ * @return false if the file cannot be opened
+ * @note Reading the file is not an edit, and the undo log is left alone.
+ */
+bool editor_read_file(Editor *E, uint64_t *hash);
+
+/**
+ * @brief Load the lines of a stream into the editor, e.g. stdin.
+ * @param E Editor state
+ * @param fp Stream to read until its end
+ * @note The editor has no file name afterwards, and the loading is not an edit.
+ */
+void editor_open_stream(Editor *E, FILE *fp);
+
+/**
+ * @brief Write the rows to a stream, each followed by a newline.
+ * @param E Editor state
+ * @param fp Stream to write to
+ * @param hash Hash of the content for the undo log, updated as the rows are written, or NULL
+ * @return false if the write failed
+ * @note Rows are written one at a time, the content is never copied into a single buffer.
+ */
+bool editor_write_stream(Editor *E, FILE *fp, uint64_t *hash);
+
+/**
+ * @brief Write the rows to the file that is opened, or to stdout if there is none.
+ * @param E Editor state
+ * @return false if the file could not be written, the status message says why
+ * @note Used without a terminal, the rows are streamed and the undo log is not updated.
+ */
+bool editor_write_file(Editor *E);
+
 /**
  * @brief Save the content in the editor to the file that is opened.
  * @param E Editor state
@@ -205,13 +442,23 @@ void editor_save_file(Editor *E);
 void editor_detect_file_type(Editor *E);
 
 /**
- * Convert the content in the rows into a string. The size will be
- * updated and set in the buf_len parameter.
+ * @brief Check if any work is running in the background, like a search.
+ * @param E Editor state
+ * @return true if the screen should be refreshed while waiting for keys
+ */
+bool editor_has_background_work(Editor *E);
+
+/**
+ * @brief Wait for the next key press.
  * @param E Editor state
- * @param buf_len Length of the content (will be updated)
- * @return Content as a \\n split string
+ * @return Key that was pressed
+ * @note While background work is running, the screen is refreshed every
+ * BACKGROUND_POLL_MS so its progress is shown.
+ * @note While a macro is replayed, the keys come from the macro.
+ * @note Keys come from the ring filled by the reader thread. A change of the
+ * window size is handled here, it is not returned as a key.
  */
-char *editor_content_to_string(Editor *E, int *buf_len);
+int editor_read_key(Editor *E);
 
 /**
  * Prompt the user to fill out a prompt.
@@ -219,11 +466,12 @@ char *editor_content_to_string(Editor *E, int *buf_len);
  * If ESC is pressed at any point during the prompt, nothing will be returned.
  * @param E Editor state
  * @param prompt Prompt string
- * @param callback Callback to call when submitted
+ * @param callback Callback to call after each key press, may be NULL
  * @return The content that was provided by the user
- * @note TODO: Callback is not handled, just a parameter for now
+ * @note The callback is called with the content and the key pressed, including
+ * the final ENTER or ESC.
  * @note A string format specifier is expected to be in the prompt string.
  */
-char *editor_prompt(Editor *E, char *prompt, void (*callback)(char *,int));
+char *editor_prompt(Editor *E, char *prompt, void (*callback)(Editor *, char *, int));
 
 #endif //EDITOR_H
@@ -0,0 +1,141 @@
+#ifndef INPUT_H
+#define INPUT_H
+
+#include <pthread.h>
+#include <stdbool.h>
+#include <stdint.h>
+
+/**
+ * @brief Number of keys the ring holds, must be a power of 2.
+ */
+#define INPUT_RING_SIZE 4096
+
+/**
+ * @brief Time to wait for the rest of an escape sequence split across reads, in ms.
+ * @note A lone ESC key is only passed on after this time, like ESCDELAY.
+ */
+#define INPUT_ESCAPE_MS 25
+
+struct Editor;
+
+/**
+ * @brief Key decoded by the reader, with the time it was read.
+ */
+typedef struct InputKey {
+    int key;
+    uint64_t time_ns;
+} InputKey;
+
+/**
+ * @brief Counters of the input, shown by ":inputstats".
+ */
+typedef struct InputStats {
+    /**
+     * @brief Number of keys read from the terminal.
+     */
+    unsigned long keys;
+
+    /**
+     * @brief Largest number of keys waiting in the ring when one was taken.
+     */
+    int max_depth;
+
+    /**
+     * @brief Number of paints which showed at least one new key.
+     */
+    unsigned long paints;
+
+    /**
+     * @brief Time from reading the oldest key shown by a paint to the end of
+     * the paint, summed over the paints and the largest one.
+     */
+    uint64_t latency_ns;
+    uint64_t max_latency_ns;
+} InputStats;
+
+/**
+ * @brief Terminal input, decoded on a reader thread into a ring of keys.
+ * @note The ring has a single producer, the reader, and a single consumer,
+ * the main thread. 'head' is only written by the consumer and 'tail' by the
+ * producer, so neither side takes a lock.
+ * @note The main thread sleeps on 'wake', which the reader writes to after
+ * adding keys.
+ */
+typedef struct InputState {
+    InputKey ring[INPUT_RING_SIZE];
+    unsigned long head;
+    unsigned long tail;
+
+    pthread_t thread;
+    bool running;
+    bool stop;
+
+    /**
+     * @brief Pipe the reader wakes the main thread with.
+     */
+    int wake[2];
+
+    /**
+     * @brief Pipe SIGWINCH and input_stop wake the reader with.
+     */
+    int signal[2];
+
+    /**
+     * @brief Descriptor which wakes the main thread besides keys, e.g. the inotify instance, -1 if none.
+     */
+    int notify;
+
+    /**
+     * @brief Time the oldest key taken since the last paint was read, 0 if none.
+     */
+    uint64_t unpainted_ns;
+
+    InputStats stats;
+} InputState;
+
+/**
+ * @brief Start the reader thread, keys are read from it from now on.
+ * @param E Editor state
+ * @note The terminal must already be set up by ncurses, and wgetch must not
+ * be called while the reader runs.
+ */
+void input_start(struct Editor *E);
+
+/**
+ * @brief Stop the reader thread.
+ * @param E Editor state
+ */
+void input_stop(struct Editor *E);
+
+/**
+ * @brief Check if keys are waiting in the ring.
+ * @param E Editor state
+ * @return true if input_read would not block
+ */
+bool input_pending(struct Editor *E);
+
+/**
+ * @brief Take the next key from the ring.
+ * @param E Editor state
+ * @param timeout_ms Time to wait for a key, -1 to wait forever
+ * @param c Key (will be updated)
+ * @return false if no key came in time, or the notify descriptor became readable
+ * @note KEY_RESIZE is returned after the window changes size.
+ */
+bool input_read(struct Editor *E, int timeout_ms, int *c);
+
+/**
+ * @brief Record that the screen was painted, for the key to paint latency.
+ * @param E Editor state
+ */
+void input_painted(struct Editor *E);
+
+/**
+ * @brief Write the input counters as a line of text.
+ * @param E Editor state
+ * @param buf Buffer for the text
+ * @param size Size of the buffer
+ */
+void input_stats(struct Editor *E, char *buf, int size);
+
+#endif //INPUT_H
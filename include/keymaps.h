@@ -2,15 +2,106 @@
 #define KEYMAPS_H
 
 #include "editor.h"
+#include <ncurses.h>
+
+/**
+ * @brief Keys which can be part of a sequence, sequences are made of ASCII keys.
+ */
+#define KEY_SEQUENCE_KEYS 128
+
+/**
+ * @brief How a key works with the extra cursors of multi-cursor mode.
+ */
+typedef enum {
+    CURSORS_CLEAR = 0,  // Back to a single cursor before the action
+    CURSORS_EACH,       // Run the action once for every cursor, e.g. motions
+    CURSORS_ALL         // The action applies to every cursor itself, in one batch
+} KeyCursors;
 
 /**
 * @brief Keymap struct which allows for easy mapping of keys
 */
 typedef struct {
-    int key; // TODO: Might need to make this a string to handle multiple presses? Or maybe store the previous presses in a buffer?
+    int key;
     void (*action)(Editor *E);
+    KeyCursors cursors;
 } KeyMap;
 
+/**
+ * @brief Mapping of a command made of several keys, e.g. "dd"
+ */
+typedef struct {
+    const char *keys;
+    void (*action)(Editor *E);
+} KeySequence;
+
+/**
+ * @brief Node of the trie of sequences, one child per key.
+ * @note A node without an action is only the start of longer sequences.
+ */
+typedef struct KeyNode {
+    void (*action)(Editor *E);
+    struct KeyNode *next[KEY_SEQUENCE_KEYS];
+} KeyNode;
+
+/**
+ * @brief Keymaps of a mode, compiled for dispatch in constant time.
+ * @note Single keys index 'keys' directly, an action of NULL means the key is
+ * not mapped. Sequences are followed through the trie one key at a time.
+ */
+typedef struct KeyTable {
+    KeyMap keys[KEY_MAX + 1];
+    KeyNode sequences;
+} KeyTable;
+
+/**
+ * @brief Compile the keymaps and sequences of every mode into their tables.
+ * @note Must be called once at startup, before any key is processed.
+ */
+void keymaps_init(void);
+
+/**
+ * @brief Free the tables, and the mappings added at runtime.
+ */
+void keymaps_free(void);
+
+/**
+ * @brief Get the table of a mode, the visual modes share one.
+ * @param mode Mode
+ * @return Table, NULL for a mode without keymaps
+ */
+KeyTable *keymap_table(EditorMode mode);
+
+/**
+ * @brief Parse keys written the way they are in a mapping, e.g. "dd" or "<C-d>".
+ * @param s Keys, '<' starts a special key: <Esc>, <CR>, <BS>, <Tab>, <Space>,
+ * <lt>, <Left>, <Right>, <Up>, <Down> or <C-x>
+ * @param keys Parsed keys (will be updated)
+ * @param max Size of the keys array
+ * @return Number of keys, -1 if they cannot be parsed or there are too many
+ */
+int keymap_parse(const char *s, int *keys, int max);
+
+/**
+ * @brief Map keys to the action the other keys are mapped to in a table.
+ * @param T Table
+ * @param lhs Keys to map, a single key or a sequence
+ * @param lhs_len Number of keys to map
+ * @param rhs Keys of the action, a single key or a complete sequence
+ * @param rhs_len Number of keys of the action
+ * @return false if the rhs has no action, or the lhs cannot be a sequence
+ */
+bool keymap_bind(KeyTable *T, const int *lhs, int lhs_len, const int *rhs, int rhs_len);
+
+/**
+ * @brief Remove the mapping of keys from a table.
+ * @param T Table
+ * @param keys Keys, a single key or a sequence
+ * @param len Number of keys
+ * @return false if the keys were not mapped
+ */
+bool keymap_unbind(KeyTable *T, const int *keys, int len);
+
 /**
  * @brief Process the key presses
  * @param E Editor state
@@ -24,15 +115,20 @@ void editor_process_key_press(Editor *E, const int c);
  * @param command Key press or command to execute
  * @return Status code
  * @note Return codes: 0 = success; -1 = unknown command;
+ * @note Digits typed before a command are its count, stored in E->repeat. Keys
+ * which start a sequence wait on E->stack for the rest of it.
  */
 int execute_command_normal(Editor *E, int command);
 
+/**
+ * @brief Execute a command in one of the visual modes, counts and sequences work as in normal mode.
+ * @param E Editor state
+ * @param command Key press or command to execute
+ * @return Status code
+ * @note Return codes: 0 = success; -1 = unknown command;
+ */
+int execute_command_visual(Editor *E, int command);
+
 int execute_command_insert(Editor *E, int command);
 
 #endif //KEYMAPS_H
-
-/**
- * Add a value to the editor state called STACK to store previous key pressed
- * Add a value to the editor state called REPEAT to store the repeat value, and just loop it.
- * Use repeat to execute the commands many times.
- */
\ No newline at end of file
@@ -0,0 +1,134 @@
+#ifndef LOAD_JOB_H
+#define LOAD_JOB_H
+
+#include <pthread.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <sys/types.h>
+
+struct Editor;
+
+/**
+ * @brief Rows read from a block of the file, waiting to be added to the editor.
+ */
+typedef struct LoadBatch {
+    /**
+     * @brief Content of each row, from row_text_new, owned by the batch.
+     */
+    char **chars;
+    int *len;
+    int count;
+    int cap;
+
+    struct LoadBatch *next;
+} LoadBatch;
+
+/**
+ * @brief File being read into the current buffer by a background thread.
+ * @note The thread splits the file into rows and queues them a block at a
+ * time. The rows are only added on the main thread, at the end of the rows,
+ * so they can be edited and drawn while the rest of the file comes in.
+ * @note Anything which needs every row, e.g. a search or a save, waits for
+ * the load to finish first.
+ */
+typedef struct LoadJob {
+    pthread_t thread;
+    pthread_mutex_t lock;
+
+    /**
+     * @brief Signalled when a batch is queued, or the thread is done.
+     */
+    pthread_cond_t ready;
+
+    /**
+     * @brief Thread was started and not joined yet, only used by the main thread.
+     */
+    bool running;
+
+    /**
+     * @brief Thread read the whole file, or stopped after a cancel.
+     */
+    bool done;
+    bool cancel;
+
+    FILE *fp;
+
+    /**
+     * @brief Batches waiting to be added, oldest first.
+     */
+    LoadBatch *head;
+    LoadBatch *tail;
+
+    /**
+     * @brief Bytes read so far, and the size of the file when it was opened.
+     */
+    off_t read;
+    off_t size;
+
+    /**
+     * @brief Hash of the content, see undo_log_hash, the undo log is opened with it once the load is over.
+     */
+    uint64_t hash;
+} LoadJob;
+
+/**
+ * @brief Start reading a file into the rows of the current buffer, which must be empty.
+ * @param E Editor state
+ * @param fp File to read, closed once the load is over
+ * @param size Size of the file, for the progress
+ * @return false if the thread could not be started, nothing was read and fp is left open
+ */
+bool load_job_start(struct Editor *E, FILE *fp, off_t size);
+
+/**
+ * @brief Add the rows read so far, and end the load if the whole file was read.
+ * @param E Editor state
+ * @note Called while waiting for keys, so the rows come in while the editor is idle.
+ */
+void load_job_poll(struct Editor *E);
+
+/**
+ * @brief Wait until a row is loaded, or the whole file if the row is past its end.
+ * @param E Editor state
+ * @param y Row which is needed, -1 for every row
+ */
+void load_job_wait(struct Editor *E, int y);
+
+/**
+ * @brief Wait until the rows a count covers are loaded, e.g. the 100000 rows of "100000dd".
+ * @param E Editor state
+ * @param y First row
+ * @param count Number of rows from y
+ * @note Called where a count is clamped to the rows, so it is not clamped to
+ * the rows loaded so far.
+ */
+void load_job_wait_rows(struct Editor *E, int y, int count);
+
+/**
+ * @brief Wait for the whole file, before anything which needs every row.
+ * @param E Editor state
+ */
+void load_job_finish(struct Editor *E);
+
+/**
+ * @brief Stop the load and drop the rows which were not added yet.
+ * @param E Editor state
+ */
+void load_job_cancel(struct Editor *E);
+
+/**
+ * @brief Check if a file is still being read.
+ * @param E Editor state
+ */
+bool load_job_running(struct Editor *E);
+
+/**
+ * @brief Write the progress of the load for the status bar, e.g. "loading 42% | ".
+ * @param E Editor state
+ * @param buf Buffer for the text, empty if there is no load
+ * @param len Size of the buffer
+ */
+void load_job_status(struct Editor *E, char *buf, size_t len);
+
+#endif //LOAD_JOB_H
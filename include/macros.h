@@ -0,0 +1,125 @@
+#ifndef MACROS_H
+#define MACROS_H
+
+#include "registers.h"
+#include <stdbool.h>
+
+/**
+ * @brief Deepest a macro may replay other macros, stops a macro which replays itself.
+ */
+#define MACRO_MAX_DEPTH 100
+
+struct Editor;
+
+/**
+ * @brief Keys recorded into a register with "q{reg}".
+ */
+typedef struct Macro {
+    int *keys;
+    int num;
+    int cap;
+} Macro;
+
+/**
+ * @brief Recorded macros, and the state of the recording and the replay.
+ * @note Macros use the names of the registers, but are kept apart from the
+ * yanked text since keys are not characters.
+ */
+typedef struct MacroState {
+    Macro list[REGISTER_COUNT];
+
+    /**
+     * @brief Name of the register being recorded, 0 when not recording.
+     */
+    int recording;
+
+    /**
+     * @brief Name of the last macro replayed, for "@@".
+     */
+    int last;
+
+    /**
+     * @brief Number of replays running, nested when a macro replays another.
+     * @note Rendering is suspended while it is above 0.
+     */
+    int depth;
+
+    /**
+     * @brief Keys of the replay that is running, read instead of the terminal.
+     */
+    const int *feed;
+    int feed_len;
+    int feed_pos;
+} MacroState;
+
+/**
+ * @brief Check if a macro is being replayed.
+ * @param E Editor state
+ * @return true while replaying, the screen is not drawn until the end
+ */
+bool macro_replaying(const struct Editor *E);
+
+/**
+ * @brief Start recording keys into a register.
+ * @param E Editor state
+ * @param name Name of the register, 'a' to 'z' or 'A' to 'Z'
+ */
+void macro_record_start(struct Editor *E, int name);
+
+/**
+ * @brief Stop recording, the key that stopped it is not part of the macro.
+ * @param E Editor state
+ */
+void macro_record_stop(struct Editor *E);
+
+/**
+ * @brief Add a typed key to the macro being recorded.
+ * @param E Editor state
+ * @param c Key
+ * @note Keys read from a replay are not recorded, "@a" is recorded instead.
+ */
+void macro_record_key(struct Editor *E, int c);
+
+/**
+ * @brief Set the keys of a macro without recording them, e.g. ":let @a = dd".
+ * @param E Editor state
+ * @param name Name of the register, 'a' to 'z' or 'A' to 'Z'
+ * @param keys Keys of the macro
+ * @param len Number of keys
+ * @return false if the name is not a register or it is being recorded
+ */
+bool macro_set(struct Editor *E, int name, const int *keys, int len);
+
+/**
+ * @brief Get the next key of the replay that is running.
+ * @param E Editor state
+ * @param c Key (will be updated), ESC once the macro ran out, so a prompt it left open is cancelled
+ * @return true if a replay is running
+ */
+bool macro_read_key(struct Editor *E, int *c);
+
+/**
+ * @brief Replay a macro count times.
+ * @param E Editor state
+ * @param name Name of the register, '@' for the last macro replayed
+ * @param count Number of times to replay it
+ * @note The keys go straight to editor_process_key_press with rendering
+ * suspended, the screen is drawn once when the replay is over.
+ */
+void macro_play(struct Editor *E, int name, int count);
+
+/**
+ * @brief Run keys the way a macro is replayed, e.g. for ":normal".
+ * @param E Editor state
+ * @param keys Keys to run
+ * @param len Number of keys
+ */
+void macro_run(struct Editor *E, const int *keys, int len);
+
+/**
+ * @brief Free the recorded macros.
+ * @param M Macro state
+ */
+void macro_state_free(MacroState *M);
+
+#endif //MACROS_H
@@ -0,0 +1,78 @@
+#ifndef MOTION_H
+#define MOTION_H
+
+#include <stdbool.h>
+
+struct Editor;
+
+/**
+ * @brief Class of a character, used to find word boundaries.
+ * @note A word is a run of characters of the same class. A WORD is a run of
+ * characters which are not blank.
+ */
+typedef enum {
+    CHAR_BLANK,
+    CHAR_WORD,
+    CHAR_PUNCT
+} CharClass;
+
+typedef enum {
+    MOTION_WORD_NEXT,       // w
+    MOTION_BIG_WORD_NEXT,   // W
+    MOTION_WORD_PREV,       // b
+    MOTION_BIG_WORD_PREV,   // B
+    MOTION_WORD_END,        // e
+    MOTION_BIG_WORD_END     // E
+} Motion;
+
+/**
+ * @brief Position in the rows.
+ */
+typedef struct MotionPos {
+    int x;
+    int y;
+} MotionPos;
+
+/**
+ * @brief Text covered by a motion, for use by operators.
+ * @note 'end' is exclusive unless 'inclusive' is set.
+ */
+typedef struct MotionRange {
+    MotionPos start;
+    MotionPos end;
+    bool inclusive;
+} MotionRange;
+
+/**
+ * @brief Get the class of a character.
+ * @param c Character
+ * @param big_word Treat punctuation as part of words, for WORD motions
+ * @return Class of the character
+ * @note Looked up in a 256 entry table.
+ */
+CharClass motion_char_class(char c, bool big_word);
+
+/**
+ * @brief Find where a motion from 'from' ends.
+ * @param E Editor state
+ * @param motion Motion to perform
+ * @param from Position to start at
+ * @param count Number of times to perform the motion, all done in one scan
+ * @return Position the motion ends at
+ * @note Motions continue across rows. An empty row counts as a word for
+ * w and b, like in vim. At the ends of the file, the motion stops early.
+ */
+MotionPos motion_find(struct Editor *E, Motion motion, MotionPos from, int count);
+
+/**
+ * @brief Get the text covered by a motion from the cursor, for an operator.
+ * @param E Editor state
+ * @param motion Motion to perform
+ * @param count Number of times to perform the motion
+ * @param range Covered text (will be updated), start is always before end
+ * @note An exclusive motion which ends at the start of a later row ends at the
+ * end of the row before instead, so "dw" on the last word keeps the newline.
+ */
+void motion_range(struct Editor *E, Motion motion, int count, MotionRange *range);
+
+#endif //MOTION_H
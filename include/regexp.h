@@ -0,0 +1,103 @@
+#ifndef REGEXP_H
+#define REGEXP_H
+
+#include <stdbool.h>
+#include <stddef.h>
+
+#define REGEXP_CACHE_SIZE 16
+#define REGEXP_DFA_BUDGET (1024 * 1024)
+
+/**
+ * @brief Compiled regular expression.
+ * @note Supported syntax: literals, '.', '[...]' and '[^...]' classes with ranges,
+ * '*', '+', '?', '|', '(...)', the escapes \d \w \s \D \W \S \t, and '^' and '$'
+ * at the start and end of the whole pattern.
+ * @note Matches are leftmost-longest and never span more than one row.
+ * @note A compiled expression is immutable and can be shared between threads,
+ * the mutable matching state lives in a RegexpDFA.
+ */
+typedef struct Regexp Regexp;
+
+/**
+ * @brief Lazily built DFA used to match a Regexp.
+ * @note States are built on demand while matching. Once the states use more
+ * than REGEXP_DFA_BUDGET bytes, they are thrown away and built again, so
+ * matching stays linear in the input while memory is bounded.
+ * @note A DFA must only be used by one thread at a time.
+ */
+typedef struct RegexpDFA RegexpDFA;
+
+/**
+ * @brief Compile a pattern into a regular expression.
+ * @param pattern Pattern to compile
+ * @param len Length of the pattern
+ * @param error Set to a description of the problem if the pattern is invalid
+ * @return Compiled expression with one reference, or NULL if the pattern is invalid
+ */
+Regexp *regexp_compile(const char *pattern, size_t len, const char **error);
+
+/**
+ * @brief Get the compiled expression for a pattern, compiling it only if it is
+ * not in the cache of recently used patterns.
+ * @param pattern Pattern to compile
+ * @param len Length of the pattern
+ * @param error Set to a description of the problem if the pattern is invalid
+ * @return Compiled expression with a reference for the caller, or NULL if invalid
+ * @note The cache is not thread safe, it should only be used from the main thread.
+ */
+Regexp *regexp_cache_get(const char *pattern, size_t len, const char **error);
+
+/**
+ * @brief Add a reference to a compiled expression.
+ * @param re Compiled expression
+ */
+void regexp_retain(Regexp *re);
+
+/**
+ * @brief Remove a reference from a compiled expression, freeing it on the last one.
+ * @param re Compiled expression, may be NULL
+ */
+void regexp_release(Regexp *re);
+
+/**
+ * @brief Get the literal which every match must contain.
+ * @param re Compiled expression
+ * @param len Length of the literal (will be updated), 0 if there is none
+ * @return Literal, used as a memchr prefilter before running the DFA
+ */
+const char *regexp_required_literal(const Regexp *re, size_t *len);
+
+/**
+ * @brief Check if the expression only matches one literal string.
+ * @param re Compiled expression
+ * @return true if the required literal is the whole pattern
+ */
+bool regexp_is_literal(const Regexp *re);
+
+/**
+ * @brief Create the matching state for a compiled expression.
+ * @param re Compiled expression, a reference is held by the DFA
+ * @return New DFA with no states built
+ */
+RegexpDFA *regexp_dfa_new(Regexp *re);
+
+/**
+ * @brief Free a DFA and release its expression.
+ * @param dfa DFA to free, may be NULL
+ */
+void regexp_dfa_free(RegexpDFA *dfa);
+
+/**
+ * @brief Find the leftmost-longest match in a buffer, starting at 'from'.
+ * @param dfa Matching state
+ * @param hay Buffer to search
+ * @param len Length of the buffer
+ * @param from Offset to start searching at
+ * @param match_len Length of the match (will be updated), may be NULL
+ * @return Offset of the match, or -1 if there is none
+ * @note One pass forward finds where the match ends, and one pass back from
+ * there with the reversed pattern finds where it starts.
+ */
+long regexp_search(RegexpDFA *dfa, const char *hay, size_t len, size_t from, size_t *match_len);
+
+#endif //REGEXP_H
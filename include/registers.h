@@ -0,0 +1,124 @@
+#ifndef REGISTERS_H
+#define REGISTERS_H
+
+#include <stdbool.h>
+#include <stddef.h>
+
+/**
+ * @brief Number of registers, the unnamed register and 'a' to 'z'.
+ */
+#define REGISTER_COUNT 27
+
+struct Editor;
+
+/**
+ * @brief Shape of the text in a register, it decides how the text is put back.
+ */
+typedef enum {
+    REGISTER_CHARS,     // Text from inside rows, may span rows
+    REGISTER_LINES,     // Whole rows, each ends with a newline
+    REGISTER_BLOCK      // A column of text, one line per row
+} RegisterType;
+
+/**
+ * @brief Part of the content of a row, held by reference.
+ * @note 'chars' is shared with the row it came from, see RowText. The row
+ * copies its content on the next edit, so the slice never changes.
+ */
+typedef struct RegisterSlice {
+    char *chars;
+    int start;
+    int len;
+} RegisterSlice;
+
+/**
+ * @brief Text stored by a yank or a delete, one slice per line.
+ * @note Lines are joined by newlines. A register of lines also ends with one.
+ */
+typedef struct Register {
+    RegisterSlice *lines;
+    int num;
+    int cap;
+    RegisterType type;
+} Register;
+
+/**
+ * @brief Get the register of a name.
+ * @param E Editor state
+ * @param name '"' or 0 for the unnamed register, 'a' to 'z', or 'A' to 'Z' for the same registers
+ * @return Register, NULL if the name is not a register
+ */
+Register *register_get(struct Editor *E, int name);
+
+/**
+ * @brief Add a line to a register, sharing the content of a row.
+ * @param R Register
+ * @param chars Chars of a row, a reference is taken
+ * @param start Start of the line in the row
+ * @param len Length of the line
+ */
+void register_add(Register *R, char *chars, int start, int len);
+
+/**
+ * @brief Make a register hold the same lines as another, by reference.
+ * @param R Register
+ * @param from Register to copy
+ */
+void register_copy(Register *R, const Register *from);
+
+/**
+ * @brief Drop the content of a register, it is left empty.
+ * @param R Register
+ */
+void register_free(Register *R);
+
+/**
+ * @brief Get the text of a register as a single string.
+ * @param R Register
+ * @param len Length of the text (will be updated)
+ * @return Text, owned by the caller
+ */
+char *register_text(const Register *R, size_t *len);
+
+/**
+ * @brief Yank the text from (x0, y0) up to (x1, y1) into the register selected for the command.
+ * @param E Editor state
+ * @param x0 X position of the start
+ * @param y0 Y position of the start
+ * @param x1 X position of the end, exclusive, the end of a row includes its newline
+ * @param y1 Y position of the end
+ * @note No text is copied, the register shares the content of the rows.
+ */
+void register_yank_text(struct Editor *E, int x0, int y0, int x1, int y1);
+
+/**
+ * @brief Yank count whole rows from y into the register selected for the command.
+ * @param E Editor state
+ * @param y First row
+ * @param count Number of rows, clamped to the end of the file
+ * @note No text is copied, so yanking a million rows only takes a slice per row.
+ */
+void register_yank_lines(struct Editor *E, int y, int count);
+
+/**
+ * @brief Yank a block into the register selected for the command.
+ * @param E Editor state
+ * @param y First row of the block
+ * @param count Number of rows
+ * @param x Start of the block in each row
+ * @param len Length of the block in each row
+ */
+void register_yank_block(struct Editor *E, int y, int count, const int *x, const int *len);
+
+/**
+ * @brief Put the register selected for the command count times, after or before the cursor.
+ * @param E Editor state
+ * @param before true to put before the cursor, or above it for lines
+ * @param count Number of times to put the text
+ * @note Lines are inserted with a single splice, and share their content with
+ * the register until either side is edited.
+ * @note The cursor is moved to the start of the text that was put.
+ */
+void register_put(struct Editor *E, bool before, int count);
+
+#endif //REGISTERS_H
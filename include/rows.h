@@ -4,6 +4,39 @@
 #include "editor.h"
 #include <stdlib.h>
 
+#define ROWS_PARALLEL_MIN 16384
+#define ROWS_MAX_THREADS 8
+
+/**
+ * @brief Content of a row, the chars of the row point at the text.
+ * @note The text is shared by reference between rows and registers. While it
+ * is shared it is never changed, the first edit of a row copies it.
+ */
+typedef struct RowText {
+    size_t refs;
+    char chars[];
+} RowText;
+
+/**
+ * @brief Allocate the content of a row.
+ * @param len Number of characters, the '\0' after them is set
+ * @return Chars for a row, with one reference
+ */
+char *row_text_new(int len);
+
+/**
+ * @brief Take another reference to the content of a row.
+ * @param chars Chars of a row, from row_text_new
+ * @return chars
+ */
+char *row_text_share(char *chars);
+
+/**
+ * @brief Drop a reference to the content of a row, the last one frees it.
+ * @param chars Chars of a row, may be NULL
+ */
+void row_text_release(char *chars);
+
 /**
  * @breif Remove the line at position pos.
  * @param E Editor state
@@ -12,6 +45,106 @@
  */
 void editor_remove_row(Editor *E, const int pos);
 
+/**
+ * @brief Remove count rows starting at y, with a single move of the rows after them.
+ * @param E Editor state
+ * @param y First row to remove
+ * @param count Number of rows to remove, clamped to the end of the file
+ * @note Removing every row leaves a single empty row.
+ * @note This function does NOT move the cursor. The edit is recorded for undo.
+ */
+void editor_delete_rows(Editor *E, int y, int count);
+
+/**
+ * @brief Remove the rows in a list, moving every row that stays at most once.
+ * @param E Editor state
+ * @param ys Rows to remove, sorted and without duplicates
+ * @param count Number of rows in the list
+ * @note Removing every row leaves a single empty row.
+ * @note This function does NOT move the cursor. The edit is recorded for undo.
+ */
+void editor_delete_row_list(Editor *E, const int *ys, int count);
+
+/**
+ * @brief Insert rows at the positions in a list, moving every row that was there at most once.
+ * @param E Editor state
+ * @param ys Positions of the new rows once they are all inserted, sorted and without duplicates
+ * @param count Number of rows to insert
+ * @param s Text of each row, copied
+ * @param len Length of each text
+ * @note This function does NOT move the cursor. The edit is recorded for undo.
+ */
+void editor_insert_row_list(Editor *E, const int *ys, int count, char *const *s, const int *len);
+
+/**
+ * @brief Move count rows starting at y so the first of them ends up at row to.
+ * @param E Editor state
+ * @param y First row to move
+ * @param count Number of rows to move
+ * @param to Position of the first row after the move, counted without the moved rows
+ * @note The rows are moved as they are, with one move of the rows in between.
+ * @note This function does NOT move the cursor. The edit is recorded for undo.
+ */
+void editor_move_rows(Editor *E, int y, int count, int to);
+
+/**
+ * @brief Call fn for every row in [y0, y1], split across threads for large ranges.
+ * @param E Editor state
+ * @param y0 First row
+ * @param y1 Last row, inclusive
+ * @param fn Function to call, it may only touch row y and its own slot of arg
+ * @param arg Argument passed to fn
+ * @note Returns once every row is done. Ranges of ROWS_PARALLEL_MIN rows or more
+ * are split into contiguous parts, one per thread.
+ */
+void editor_for_rows(Editor *E, int y0, int y1, void (*fn)(Editor *E, int y, void *arg), void *arg);
+
+/**
+ * @brief Edit every row in [y0, y1] with fn, in parallel like editor_for_rows.
+ * @param E Editor state
+ * @param y0 First row
+ * @param y1 Last row, inclusive
+ * @param fn Function which edits row y, e.g. with row_splice
+ * @param arg Argument passed to fn
+ * @note The edits are NOT recorded for undo, the caller records them before.
+ * @note The subsystems are notified once all threads are done, so the whole
+ * range is one update.
+ */
+void editor_edit_rows(Editor *E, int y0, int y1, void (*fn)(Editor *E, int y, void *arg), void *arg);
+
+/**
+ * @brief Replace del characters at x with the text s, for use in editor_edit_rows.
+ * @param row Row to edit
+ * @param x Position of the change, x + del must be inside the row
+ * @param del Number of characters to remove
+ * @param s Text to insert
+ * @param len Length of the text
+ * @note Nothing is notified or recorded, and the render is left as it is.
+ */
+void row_splice(erow *row, int x, int del, const char *s, int len);
+
+/**
+ * @brief Edit of a row, part of a batch applied by editor_splice_rows.
+ * @note Positions refer to the content before any edit of the batch.
+ */
+typedef struct RowEdit {
+    int x;
+    int y;
+    int del;
+    const char *s;
+    int len;
+} RowEdit;
+
+/**
+ * @brief Apply many edits at once, each row is rebuilt in a single pass.
+ * @param E Editor state
+ * @param edits Edits sorted by row then column, they must not overlap
+ * @param count Number of edits
+ * @note Each edit is recorded for undo, and every row is notified once.
+ * @note This function does NOT move the cursor.
+ */
+void editor_splice_rows(Editor *E, const RowEdit *edits, int count);
+
 /**
  * @brief Render the row into the render field.
  * @param row Row to render
@@ -21,20 +154,23 @@ void editor_render_row(erow *row);
 
 /**
  * Write a 'row' to the buffer at 'pos.'
+ * @param E Editor state
  * @param row Row to render
- * @param pos Position in the buffer
- * @note The position will be offset by the NUM_COL_SIZE
+ * @param pos Line of the window being drawn
+ * @note The position will be offset by the NUM_COL_SIZE, and the text scrolled and cut to the window
+ * @note Search matches in the row are painted over the text.
  */
-void editor_draw_row(erow *row, int pos);
+void editor_draw_row(Editor *E, erow *row, int pos);
 
 /**
- * Draws the row number to the row at pos.
+ * Draws the row number to the row at pos, in the window being drawn.
+ * @param E Editor state
  * @param cur_y Current y position
  * @param pos Position in the buffer
  * @param offset Offset to add to each line number, allows for scrolling
  * @note Pos should be the index of the row, one should be added for the print-out.
  */
-void editor_draw_row_num(int cur_y, int pos, int offset);
+void editor_draw_row_num(Editor *E, int cur_y, int pos, int offset);
 
 /**
  * @brief Free a row from memory.
@@ -42,6 +178,29 @@ void editor_draw_row_num(int cur_y, int pos, int offset);
  */
 void editor_free_row(erow *row);
 
+/**
+ * @brief Insert count rows at pos, with a single move of the rows after them.
+ * @param E Editor state
+ * @param pos Index the first new row gets, 0-indexed
+ * @param count Number of rows to insert
+ * @param s Content of each row, copied
+ * @param len Length of the content of each row
+ * @note The renders are generated when the rows are drawn.
+ * @note This function does NOT move the cursor. The edit is recorded for undo.
+ */
+void editor_insert_rows(Editor *E, int pos, int count, char *const *s, const int *len);
+
+/**
+ * @brief Insert count rows at pos like editor_insert_rows, sharing the text instead of copying it.
+ * @param E Editor state
+ * @param pos Index the first new row gets, 0-indexed
+ * @param count Number of rows to insert
+ * @param chars Content of each row, from row_text_new, the same content may appear more than once
+ * @param len Length of the content of each row, chars[i][len[i]] must be '\0'
+ * @note This function does NOT move the cursor. The edit is recorded for undo.
+ */
+void editor_insert_shared_rows(Editor *E, int pos, int count, char *const *chars, const int *len);
+
 /**
  * @brief Inserts a row above 'pos' with the content [ s + '\0' ]
  * @param E Editor state
@@ -49,6 +208,7 @@ void editor_free_row(erow *row);
  * @param s String to append to the new row
  * @param len Size of the string to append
  * @note This function does NOT re-render, it just modifies the state.
+ * @note The edit is recorded for undo.
  */
 void editor_insert_row_above(Editor *E, int pos, char *s, size_t len);
 
@@ -59,13 +219,14 @@ void editor_insert_row_above(Editor *E, int pos, char *s, size_t len);
  * @param s String to append to the new row
  * @param len Size of the string to append
  * @note This function does NOT re-render, it just modifies the state.
+ * @note The edit is recorded for undo.
  */
 void editor_insert_row_below(Editor *E, int pos, char *s, size_t len);
 
 /**
  * This was taken from kilo
  * TODO: Figure out what tf this does.
- * @note This function will increment the dirty counter.
+ * @note The row is split at the cursor, and the indent is inserted on the new row.
  */
 void editor_insert_newline(Editor *E);
 
@@ -79,6 +240,72 @@ void editor_insert_newline(Editor *E);
  */
 void row_append_str(Editor *E, erow *row, const char *s, const int len);
 
+/**
+ * @brief Insert a span of text into row y at x.
+ * @param E Editor state
+ * @param x X position, location in the row
+ * @param y Y position, row to insert into
+ * @param s Text to insert, must not contain newlines
+ * @param len Length of the text
+ * @note This function does NOT move the cursor. The edit is recorded for undo.
+ */
+void editor_row_insert_span(Editor *E, int x, int y, const char *s, int len);
+
+/**
+ * @brief Delete a span of text from row y at x.
+ * @param E Editor state
+ * @param x X position, location in the row
+ * @param y Y position, row to delete from
+ * @param len Length of the span, clamped to the end of the row
+ * @note This function does NOT move the cursor. The edit is recorded for undo.
+ */
+void editor_row_delete_span(Editor *E, int x, int y, int len);
+
+/**
+ * @brief Split row y at x, the rest of the row moves to a new row below.
+ * @param E Editor state
+ * @param x X position to split at
+ * @param y Row to split
+ * @note This function does NOT move the cursor. The edit is recorded for undo.
+ */
+void editor_split_row(Editor *E, int x, int y);
+
+/**
+ * @brief Append row y + 1 to row y, and remove it.
+ * @param E Editor state
+ * @param y Row to join the next row onto
+ * @note This function does NOT move the cursor. The edit is recorded for undo.
+ */
+void editor_join_rows(Editor *E, int y);
+
+/**
+ * @brief Insert text at (x, y), the text may contain newlines.
+ * @param E Editor state
+ * @param x X position, location in the row
+ * @param y Y position, row to insert into
+ * @param s Text to insert
+ * @param len Length of the text
+ * @param end_x Column after the inserted text (will be updated), can be NULL
+ * @param end_y Row of the end of the inserted text (will be updated), can be NULL
+ * @note Row y is edited in place, the other lines are inserted as new rows with
+ * a single splice. The rest of row y moves to the end of the last line.
+ * @note This function does NOT move the cursor. The edit is recorded for undo.
+ */
+void editor_insert_text(Editor *E, int x, int y, const char *s, int len, int *end_x, int *end_y);
+
+/**
+ * @brief Delete the text from (x0, y0) up to (x1, y1), the end is exclusive.
+ * @param E Editor state
+ * @param x0 X position of the start
+ * @param y0 Y position of the start
+ * @param x1 X position of the end, the end of a row includes its newline
+ * @param y1 Y position of the end, clamped to the end of the file
+ * @note What is left of row y1 is moved onto row y0, and the rows after y0 are
+ * removed with a single splice.
+ * @note This function does NOT move the cursor. The edit is recorded for undo.
+ */
+void editor_delete_range(Editor *E, int x0, int y0, int x1, int y1);
+
 /**
  * @breif Insert a character c at (x, y)
  * @param E Editor state
@@ -86,7 +313,6 @@ void row_append_str(Editor *E, erow *row, const char *s, const int len);
  * @param y Y position, row to insert into
  * @param c Character to insert
  * @note This function DOES move the cursor, in the +x direction.
- * @note This function will increment the dirty counter.
  */
 void editor_insert_character(Editor *E, const int x, const int y, const char c);
 
@@ -95,11 +321,22 @@ void editor_insert_character(Editor *E, const int x, const int y, const char c);
  * @param E Editor state
  * @param x X position, location in the row
  * @param y Y position, row to insert into
- * @note This function will increment the dirty counter.
  * @note This function DOES move the cursor.
  */
 void editor_remove_character(Editor *E, const int x, const int y);
 
+/**
+ * @brief Replace the content of row y with chars, used by bulk edits.
+ * @param E Editor state
+ * @param y Row to replace
+ * @param chars New content from row_text_new, the row takes its reference
+ * @param size Length of the new content
+ * @note The render is freed and generated again when the row is drawn, so
+ * replacing many rows does not render rows that are never shown.
+ * @note This function does NOT move the cursor. The edit is recorded for undo.
+ */
+void editor_set_row_chars(Editor *E, int y, char *chars, int size);
+
 /**
  * @brief Compute the position of the cursor in the render based on the current position.
  * @param row Row to generate render position for.
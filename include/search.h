@@ -0,0 +1,251 @@
+#ifndef SEARCH_H
+#define SEARCH_H
+
+#include <stdbool.h>
+#include <stddef.h>
+
+#define SEARCH_HIGHLIGHT_CACHE 256
+
+struct Editor;
+struct erow;
+struct SearchJob;
+
+/**
+ * @brief Compiled search pattern.
+ * @note Patterns are regular expressions, see regexp.h. Patterns which only
+ * match a literal skip the regular expression entirely.
+ * @note The rarest byte of the literal is used as a memchr prefilter, each
+ * candidate is then verified with memcmp.
+ */
+typedef struct SearchPattern {
+    /**
+     * @brief Pattern as it was typed, NULL if the pattern is empty.
+     */
+    char *source;
+
+    /**
+     * @brief Literal to search for. For regular expressions, this is the literal
+     * every match contains, used to skip rows which cannot match. May be NULL.
+     */
+    char *needle;
+
+    /**
+     * @brief Length of the needle.
+     */
+    size_t len;
+
+    /**
+     * @brief Offset of the rarest byte in the needle.
+     */
+    size_t rare;
+
+    /**
+     * @brief Compiled regular expression, NULL if the pattern is a literal.
+     */
+    struct Regexp *re;
+
+    /**
+     * @brief Matching state of the regular expression, owned by this pattern.
+     * @note Not thread safe, each thread needs its own copy of the pattern.
+     */
+    struct RegexpDFA *dfa;
+} SearchPattern;
+
+/**
+ * @brief Match in a row, in chars.
+ */
+typedef struct SearchSpan {
+    int start;
+    int len;
+} SearchSpan;
+
+/**
+ * @brief Matches of the search pattern in one version of a row.
+ * @note Entries are only valid while 'version' and 'generation' match the row
+ * and the pattern, so they never have to be invalidated.
+ */
+typedef struct SearchRowMatches {
+    unsigned long version;
+    unsigned long generation;
+    SearchSpan *spans;
+    int count;
+    int cap;
+} SearchRowMatches;
+
+/**
+ * @brief Search state stored in the editor.
+ */
+typedef struct SearchState {
+    /**
+     * @brief Pattern that was last searched for.
+     * @note Used by next and previous match.
+     */
+    SearchPattern pattern;
+
+    /**
+     * @brief Direction of the last search: 1 is forward, -1 is backward.
+     */
+    int direction;
+
+    /**
+     * @brief Position of the cursor when the search prompt was opened.
+     * @note The cursor is restored here if the search is cancelled.
+     */
+    int origin_x, origin_y;
+
+    /**
+     * @brief Position of the current match in chars, match_y is -1 if there is no match.
+     */
+    int match_x, match_y;
+
+    /**
+     * @brief Search prompt is open.
+     */
+    bool active;
+
+    /**
+     * @brief Incremented each time the pattern changes, used to key the match cache.
+     */
+    unsigned long generation;
+
+    /**
+     * @brief Matches of the rows drawn recently, indexed by row version.
+     * @note SEARCH_HIGHLIGHT_CACHE entries, allocated on first use. The view
+     * covers consecutive versions after loading, so the visible rows rarely
+     * collide, and scrolling only computes the newly exposed rows.
+     */
+    SearchRowMatches *highlights;
+
+    /**
+     * @brief Parallel search of the rows for the pattern, NULL until the first search.
+     */
+    struct SearchJob *job;
+} SearchState;
+
+/**
+ * @brief Initialize the search state.
+ * @param S Search state
+ */
+void search_state_init(SearchState *S);
+
+/**
+ * @brief Free the memory used by the search state.
+ * @param S Search state
+ */
+void search_state_free(SearchState *S);
+
+/**
+ * @brief Compile a pattern. Any previous content in P is freed.
+ * @param P Pattern to compile into
+ * @param s Pattern
+ * @param len Length of the pattern
+ * @param error Set to a description of the problem if the pattern is invalid, may be NULL
+ * @return false if the pattern is invalid, P is left empty
+ * @note Compiled regular expressions are cached, so compiling the same pattern again is cheap.
+ */
+bool search_pattern_compile(SearchPattern *P, const char *s, size_t len, const char **error);
+
+/**
+ * @brief Copy a compiled pattern, for use on another thread.
+ * @param dst Pattern to copy into, any previous content is freed
+ * @param src Pattern to copy
+ * @note The compiled expression is shared, the matching state is not.
+ */
+void search_pattern_copy(SearchPattern *dst, const SearchPattern *src);
+
+/**
+ * @brief Free the memory used by a pattern.
+ * @param P Pattern
+ */
+void search_pattern_free(SearchPattern *P);
+
+/**
+ * @brief Find the first match of the pattern in a buffer, starting at 'from'.
+ * @param P Compiled pattern
+ * @param hay Buffer to search
+ * @param len Length of the buffer
+ * @param from Offset to start searching at
+ * @param match_len Length of the match (will be updated), may be NULL
+ * @return Offset of the match, or -1 if there is none
+ */
+long search_find(SearchPattern *P, const char *hay, size_t len, size_t from, size_t *match_len);
+
+/**
+ * @brief Find the last match of the pattern in a buffer which starts before 'before'.
+ * @param P Compiled pattern
+ * @param hay Buffer to search
+ * @param len Length of the buffer
+ * @param before Matches must start before this offset
+ * @param match_len Length of the match (will be updated), may be NULL
+ * @return Offset of the match, or -1 if there is none
+ */
+long search_find_last(SearchPattern *P, const char *hay, size_t len, size_t before, size_t *match_len);
+
+/**
+ * @brief Find the next match in the rows, starting after (x, y), wrapping around the file.
+ * @param E Editor state
+ * @param x X position to start at, the match must not start here
+ * @param y Y position to start at
+ * @param direction 1 to search forward, -1 to search backward
+ * @param mx Match x position (will be updated)
+ * @param my Match y position (will be updated)
+ * @return true if a match was found
+ * @note Rows are searched on their chars, so positions do not include tab expansion.
+ */
+bool search_next(struct Editor *E, int x, int y, int direction, int *mx, int *my);
+
+/**
+ * @brief Find the next match of the search pattern after (x, y), using the parallel search.
+ * @param E Editor state
+ * @param x X position to start at, the match must not start here
+ * @param y Y position to start at
+ * @param direction 1 to search forward, -1 to search backward
+ * @param mx Match x position (will be updated)
+ * @param my Match y position (will be updated)
+ * @return true if a match was found
+ * @note A new parallel search is started if the rows changed since the last one.
+ */
+bool search_find_match(struct Editor *E, int x, int y, int direction, int *mx, int *my);
+
+/**
+ * @brief Write the match counter of the search into buf, e.g. "[3/120] ".
+ * @param E Editor state
+ * @param buf Buffer to write into
+ * @param len Size of the buffer
+ * @note The buffer is empty when there is no search. The total is followed
+ * by '+' while the search is still running.
+ */
+void search_status(struct Editor *E, char *buf, size_t len);
+
+/**
+ * @brief Prompt callback which performs the incremental search.
+ * @param E Editor state
+ * @param query Current content of the prompt
+ * @param key Key that was last pressed
+ */
+void search_callback(struct Editor *E, char *query, int key);
+
+/**
+ * @brief Check if the matches of the search should be highlighted.
+ * @param E Editor state
+ * @note Only while searching, or while the cursor is on the match.
+ */
+bool search_highlight_visible(struct Editor *E);
+
+/**
+ * @brief Highlight every match of the search pattern in a row which is being drawn.
+ * @param E Editor state
+ * @param row Row that was drawn
+ * @param pos Line of the window being drawn
+ * @note Matches are computed once per row version and pattern, then cached.
+ */
+void editor_draw_row_matches(struct Editor *E, struct erow *row, int pos);
+
+/**
+ * @brief Highlight the current match, if it is visible.
+ * @param E Editor state
+ * @note Match positions are converted to the render, so tabs are accounted for.
+ */
+void editor_draw_search_match(struct Editor *E);
+
+#endif //SEARCH_H
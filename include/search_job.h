@@ -0,0 +1,207 @@
+#ifndef SEARCH_JOB_H
+#define SEARCH_JOB_H
+
+#include "search.h"
+#include <pthread.h>
+#include <stdbool.h>
+
+#define SEARCH_CHUNK_ROWS 8192
+#define SEARCH_CHUNK_MATCHES 4096
+#define SEARCH_MAX_THREADS 16
+
+struct Editor;
+
+/**
+ * @brief Position of a match in the rows.
+ */
+typedef struct SearchMatch {
+    int y;
+    int x;
+} SearchMatch;
+
+/**
+ * @brief Range of rows scanned by a single worker.
+ */
+typedef struct SearchChunk {
+    /**
+     * @brief Rows covered by the chunk, [start, end).
+     */
+    int start, end;
+
+    /**
+     * @brief Matches found in the chunk, in document order.
+     * @note At most SEARCH_CHUNK_MATCHES are stored, see 'overflow'.
+     */
+    SearchMatch *matches;
+    int stored;
+
+    /**
+     * @brief Total number of matches in the chunk.
+     */
+    long count;
+
+    /**
+     * @brief More matches exist than were stored, the chunk has to be scanned
+     * again to find the positions past the stored ones.
+     */
+    bool overflow;
+
+    /**
+     * @brief Chunk has been handed to a worker.
+     */
+    bool claimed;
+
+    /**
+     * @brief Chunk has been scanned and the results are final.
+     */
+    bool done;
+} SearchChunk;
+
+/**
+ * @brief Parallel search over the rows, run on a pool of worker threads.
+ * @note Chunks are handed out starting at the cursor, so the matches near it
+ * are found first. The total count fills in as the remaining chunks finish.
+ * @note Workers read the rows directly, so any edit must cancel the job first.
+ */
+typedef struct SearchJob {
+    pthread_mutex_t lock;
+
+    /**
+     * @brief Signalled when a new job is started or the pool shuts down.
+     */
+    pthread_cond_t work;
+
+    /**
+     * @brief Signalled when a chunk is finished or a worker goes idle.
+     */
+    pthread_cond_t progress;
+
+    pthread_t *threads;
+    int num_threads;
+
+    /**
+     * @brief Number of workers currently scanning a chunk.
+     */
+    int busy;
+
+    bool shutdown;
+
+    /**
+     * @brief Job should be stopped as soon as possible.
+     */
+    bool cancel;
+
+    /**
+     * @brief Results of the job match the current content of the rows.
+     */
+    bool valid;
+
+    /**
+     * @brief Copy of the pattern, owned by the job and used by the main thread.
+     * @note Workers use their own copy, made when the generation changes.
+     */
+    SearchPattern pattern;
+
+    /**
+     * @brief Incremented each time a job is started.
+     */
+    unsigned long generation;
+
+    /**
+     * @brief Rows being searched, the editor must not change them while the job runs.
+     */
+    struct erow *rows;
+    int num_rows;
+
+    /**
+     * @brief Sorted rows which can contain a match, from the trigram index.
+     * @note NULL if every row has to be scanned.
+     */
+    int *candidates;
+    int num_candidates;
+
+    SearchChunk *chunks;
+    int num_chunks;
+
+    /**
+     * @brief Chunk the workers start at, usually the one with the cursor.
+     */
+    int first_chunk;
+
+    /**
+     * @brief Number of chunks handed out so far, counted from first_chunk.
+     */
+    int next_claim;
+
+    /**
+     * @brief Number of chunks which have been scanned.
+     */
+    int completed;
+
+    /**
+     * @brief Number of matches in the scanned chunks.
+     */
+    long total;
+} SearchJob;
+
+/**
+ * @brief Start a search of the rows for the current search pattern.
+ * @param E Editor state
+ * @param y Row to start at, chunks are handed out from here onwards
+ * @note Any search in progress is cancelled first.
+ */
+void search_job_start(struct Editor *E, int y);
+
+/**
+ * @brief Cancel the search in progress and throw away its results.
+ * @param E Editor state
+ * @note This blocks until every worker has stopped reading the rows.
+ */
+void search_job_cancel(struct Editor *E);
+
+/**
+ * @brief Stop the worker threads and free the job.
+ * @param E Editor state
+ */
+void search_job_destroy(struct Editor *E);
+
+/**
+ * @brief Check if the job results are usable for the current content.
+ * @param E Editor state
+ * @return true if a job has been started and was not cancelled
+ */
+bool search_job_valid(struct Editor *E);
+
+/**
+ * @brief Check if the job is still scanning chunks.
+ * @param E Editor state
+ * @return true if a valid job has chunks left
+ */
+bool search_job_running(struct Editor *E);
+
+/**
+ * @brief Find the next match after (x, y) using the job results, wrapping around the file.
+ * @param E Editor state
+ * @param x X position to start at, the match must not start here
+ * @param y Y position to start at
+ * @param direction 1 to search forward, -1 to search backward
+ * @param mx Match x position (will be updated)
+ * @param my Match y position (will be updated)
+ * @return true if a match was found
+ * @note Chunks which are not finished yet are scanned on the calling thread
+ * if no worker has claimed them, otherwise this waits for the worker.
+ */
+bool search_job_find(struct Editor *E, int x, int y, int direction, int *mx, int *my);
+
+/**
+ * @brief Get the progress of the job.
+ * @param E Editor state
+ * @param x X position of the current match
+ * @param y Y position of the current match
+ * @param index 1-indexed number of the match at (x, y), 0 if it is not known yet
+ * @param total Number of matches found so far
+ * @return true if every chunk has been scanned, and total is final
+ */
+bool search_job_progress(struct Editor *E, int x, int y, long *index, long *total);
+
+#endif //SEARCH_JOB_H
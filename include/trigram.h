@@ -0,0 +1,215 @@
+#ifndef TRIGRAM_H
+#define TRIGRAM_H
+
+#include <pthread.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#define TRIGRAM_MIN_ROWS 100000
+#define TRIGRAM_MAX_DIRTY 65536
+#define TRIGRAM_MAX_SEGMENTS 4096
+#define TRIGRAM_MAX_DEAD 4096
+
+struct Editor;
+struct erow;
+struct SearchPattern;
+
+/**
+ * @brief Rows containing a trigram.
+ * @note Row ids are stored as varint encoded deltas in increasing order, so
+ * long lists of nearby rows take about a byte per row.
+ */
+typedef struct TrigramPostings {
+    unsigned char *data;
+    size_t len;
+    size_t cap;
+
+    /**
+     * @brief Last row added to the list, the next delta is taken from it.
+     */
+    int last;
+
+    /**
+     * @brief Number of rows in the list.
+     */
+    int count;
+} TrigramPostings;
+
+/**
+ * @brief Open addressing table from the trigrams to their lists, a key of 0 is an empty slot.
+ * @note Keys are the three bytes of the trigram plus one in the top byte.
+ */
+typedef struct TrigramTable {
+    uint32_t *keys;
+    TrigramPostings *lists;
+    size_t cap;
+    size_t used;
+} TrigramTable;
+
+/**
+ * @brief Rows inserted or removed in one place.
+ * @note The position is taken before the change. A positive delta inserted
+ * rows before it, a negative one removed the rows from it on.
+ */
+typedef struct TrigramShift {
+    int pos;
+    int delta;
+} TrigramShift;
+
+/**
+ * @brief Rows of the index which are still in the buffer, in one piece.
+ * @note Rows base to base + len - 1 of the index are now offset rows further.
+ */
+typedef struct TrigramSegment {
+    int base;
+    int len;
+    int offset;
+} TrigramSegment;
+
+/**
+ * @brief Row changed or inserted since the index was built or compacted.
+ * @note The id is the one of the row in the overlay, -1 until it is indexed there.
+ */
+typedef struct TrigramDirty {
+    int y;
+    int id;
+} TrigramDirty;
+
+/**
+ * @brief Index from each trigram of the row contents to the rows containing it.
+ * @note Used to narrow the rows a search has to scan. The rows containing every
+ * trigram of the literal a pattern requires are the candidates, the exact match
+ * only runs on them.
+ * @note The index is built on a background thread the first time a large buffer
+ * is searched. Edits after that are folded in: inserted and removed rows move
+ * the segments which map the rows of the index to their current position, and
+ * changed rows are indexed again in a small overlay on the next search. Past
+ * TRIGRAM_MAX_SEGMENTS segments, or TRIGRAM_MAX_DIRTY changed rows at a search,
+ * both are compacted into the lists.
+ */
+typedef struct TrigramIndex {
+    /**
+     * @brief Lists of the rows the index was built or last compacted for.
+     */
+    TrigramTable table;
+
+    /**
+     * @brief Lists of the changed rows, by their id in the overlay.
+     * @note Rows changed again leave their old id behind. The overlay is built
+     * again once there are TRIGRAM_MAX_DEAD more old ids than changed rows.
+     */
+    TrigramTable overlay;
+    int next_id;
+
+    /**
+     * @brief Index was built and can be queried.
+     */
+    bool ready;
+
+    /**
+     * @brief Background build is running on 'thread'.
+     */
+    bool building;
+
+    /**
+     * @brief Set by the build thread when it is finished.
+     */
+    bool done;
+
+    /**
+     * @brief Set to stop the build thread early.
+     */
+    bool cancel;
+
+    pthread_t thread;
+
+    /**
+     * @brief Rows read by the build thread, the editor must not change them while it runs.
+     * @note The number of rows is the one the lists were made for, it stays after the build.
+     */
+    struct erow *rows;
+    int num_rows;
+
+    /**
+     * @brief Rows of the lists still in the buffer, in order.
+     */
+    TrigramSegment *segments;
+    int num_segments;
+    int segments_cap;
+
+    /**
+     * @brief Rows changed since the lists were made, in current positions, sorted.
+     */
+    TrigramDirty *dirty;
+    int num_dirty;
+    int dirty_cap;
+} TrigramIndex;
+
+/**
+ * @brief Initialize an empty trigram index.
+ * @param T Trigram index
+ */
+void trigram_index_init(TrigramIndex *T);
+
+/**
+ * @brief Stop any build in progress and free the memory used by the index.
+ * @param T Trigram index
+ */
+void trigram_index_free(TrigramIndex *T);
+
+/**
+ * @brief Stop the background build, if it is running. The index is built again
+ * on the next search.
+ * @param E Editor state
+ * @note Must be called before the row array is changed, the build reads it.
+ */
+void trigram_index_cancel(struct Editor *E);
+
+/**
+ * @brief Record that the content of a row changed.
+ * @param E Editor state
+ * @param y Row that was changed
+ */
+void trigram_index_update_row(struct Editor *E, int y);
+
+/**
+ * @brief Record that rows were inserted or removed.
+ * @param E Editor state
+ * @param y Position the rows were inserted or removed at
+ * @param count Number of rows inserted, negative for removed rows
+ */
+void trigram_index_shift_rows(struct Editor *E, int y, int count);
+
+/**
+ * @brief Record that rows were inserted or removed at several places at once.
+ * @param E Editor state
+ * @param ys Sorted rows, their positions before they were removed, or after they were inserted
+ * @param count Number of rows
+ * @param inserted The rows were inserted, not removed
+ */
+void trigram_index_shift_row_list(struct Editor *E, const int *ys, int count, bool inserted);
+
+/**
+ * @brief Record that rows were moved, like editor_move_rows.
+ * @param E Editor state
+ * @param y First row moved
+ * @param count Number of rows moved
+ * @param to Position of the first row after the move
+ * @note Reported at once, so the index never sees the rows removed but not put back.
+ */
+void trigram_index_move_rows(struct Editor *E, int y, int count, int to);
+
+/**
+ * @brief Get the rows which can contain a match of the pattern.
+ * @param E Editor state
+ * @param P Compiled pattern
+ * @param count Number of candidate rows (will be updated)
+ * @return Sorted candidate rows to be freed by the caller, or NULL if every row
+ * has to be scanned
+ * @note Starts the background build if the buffer is large enough and there
+ * is no index yet.
+ */
+int *trigram_index_candidates(struct Editor *E, const struct SearchPattern *P, int *count);
+
+#endif //TRIGRAM_H
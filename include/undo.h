@@ -0,0 +1,217 @@
+#ifndef UNDO_H
+#define UNDO_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include "undo_log.h"
+
+#define UNDO_MEMORY_CAP (64 * 1024 * 1024)
+#define UNDO_BLOCK_SIZE (64 * 1024)
+
+struct Editor;
+
+typedef enum {
+    UNDO_INSERT,        // Text inserted into a row at (x, y)
+    UNDO_DELETE,        // Text deleted from a row at (x, y)
+    UNDO_SPLIT,         // Row y split at x, the rest moved to a new row below
+    UNDO_JOIN,          // Row y + 1 appended to row y, which was x long
+    UNDO_ROW_INSERT,    // Row inserted at y
+    UNDO_ROW_DELETE,    // Row removed from y
+    UNDO_ROW_SET        // Content of row y replaced, used by bulk edits
+} UndoType;
+
+/**
+ * @brief Primitive edit stored in the journal.
+ * @note The text follows the header in the same allocation. For UNDO_ROW_SET
+ * the old content comes first, followed by the new content.
+ */
+typedef struct UndoRecord {
+    unsigned char type;
+
+    /**
+     * @brief First record of an undo step, undo and redo stop at these.
+     */
+    bool step_start;
+
+    int x;
+    int y;
+
+    /**
+     * @brief Length of the text, the old content for UNDO_ROW_SET.
+     */
+    int len;
+
+    /**
+     * @brief Length of the new content for UNDO_ROW_SET.
+     */
+    int len2;
+
+    /**
+     * @brief Unique number of the record, never reused. Used to tell if the
+     * journal is back at the position the file was saved at.
+     */
+    unsigned long serial;
+
+    char text[];
+} UndoRecord;
+
+/**
+ * @brief Block of the arena the records are allocated from.
+ */
+typedef struct UndoBlock {
+    struct UndoBlock *next;
+    size_t used;
+    size_t cap;
+    char data[];
+} UndoBlock;
+
+/**
+ * @brief Journal of the edits made to the rows, used for undo and redo.
+ * @note Records are bump allocated from a list of blocks, oldest first. Once
+ * the blocks use more than UNDO_MEMORY_CAP, the oldest steps are dropped.
+ * @note Records after 'pos' have been undone, they are dropped when a new
+ * edit is recorded.
+ */
+typedef struct UndoJournal {
+    UndoBlock *head;
+    UndoBlock *tail;
+    size_t bytes;
+
+    /**
+     * @brief Records in order, the live ones are [first, num).
+     * @note Records loaded from the log point into its map instead of the arena.
+     */
+    UndoRecord **records;
+    long first;
+    long num;
+    long cap;
+
+    /**
+     * @brief Absolute index of records[0], counting every record since the
+     * history in the log started. Grows when the index is compacted.
+     */
+    long offset;
+
+    /**
+     * @brief Number of records which are applied, [first, pos) can be undone.
+     */
+    long pos;
+
+    /**
+     * @brief Index of the first record of the newest step, which is never dropped.
+     */
+    long last_step;
+
+    /**
+     * @brief The next record starts a new step.
+     */
+    bool sealed;
+
+    /**
+     * @brief Recording is turned off, e.g. while loading a file or replaying the journal.
+     */
+    int suspended;
+
+    /**
+     * @brief Edits are grouped into a single step, seals are ignored, e.g. during ":normal".
+     */
+    int grouped;
+
+    unsigned long next_serial;
+
+    /**
+     * @brief Serial of the last record that was dropped, the position before the first record.
+     */
+    unsigned long base_serial;
+
+    /**
+     * @brief Serial of the position the file was saved at.
+     */
+    unsigned long saved_serial;
+
+    /**
+     * @brief Copy of the journal on disk, so the history survives the session.
+     */
+    UndoLog log;
+} UndoJournal;
+
+/**
+ * @brief Initialize an empty journal.
+ * @param J Journal
+ */
+void undo_journal_init(UndoJournal *J);
+
+/**
+ * @brief Free the memory used by the journal.
+ * @param J Journal
+ */
+void undo_journal_free(UndoJournal *J);
+
+/**
+ * @brief Stop recording edits, calls can be nested.
+ * @param E Editor state
+ */
+void undo_suspend(struct Editor *E);
+
+/**
+ * @brief Resume recording edits.
+ * @param E Editor state
+ */
+void undo_resume(struct Editor *E);
+
+/**
+ * @brief End the current undo step, the next edit starts a new one.
+ * @param E Editor state
+ * @note Every edit between two calls is undone at once.
+ * @note Does nothing inside a group.
+ */
+void undo_seal(struct Editor *E);
+
+/**
+ * @brief Start a group, the edits up to undo_group_end are a single step, calls can be nested.
+ * @param E Editor state
+ */
+void undo_group_begin(struct Editor *E);
+
+/**
+ * @brief End a group.
+ * @param E Editor state
+ */
+void undo_group_end(struct Editor *E);
+
+/**
+ * @brief Record text inserted into a row.
+ * @note Consecutive inserts into the same row coalesce into a single record.
+ */
+void undo_record_insert(struct Editor *E, int x, int y, const char *s, int len);
+void undo_record_delete(struct Editor *E, int x, int y, const char *s, int len);
+void undo_record_split(struct Editor *E, int x, int y);
+void undo_record_join(struct Editor *E, int x, int y);
+void undo_record_row_insert(struct Editor *E, int y, const char *s, int len);
+void undo_record_row_delete(struct Editor *E, int y, const char *s, int len);
+void undo_record_row_set(struct Editor *E, int y, const char *old, int old_len, const char *s, int len);
+
+/**
+ * @brief Undo the last step.
+ * @param E Editor state
+ * @return false if there is nothing to undo
+ * @note The cursor is moved to the start of the change.
+ * @note Undoing past the start of the session loads the history from the log.
+ */
+bool undo_undo(struct Editor *E);
+
+/**
+ * @brief Redo the last undone step.
+ * @param E Editor state
+ * @return false if there is nothing to redo
+ */
+bool undo_redo(struct Editor *E);
+
+/**
+ * @brief Remember the current position as the saved state of the file.
+ * @param E Editor state
+ * @note The dirty value of the editor is derived from this.
+ */
+void undo_mark_saved(struct Editor *E);
+
+#endif //UNDO_H
@@ -0,0 +1,155 @@
+#ifndef UNDO_LOG_H
+#define UNDO_LOG_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <sys/types.h>
+
+#define UNDO_LOG_BUFFER (64 * 1024)
+#define UNDO_LOG_MAGIC "UNDOLOG1"
+#define UNDO_LOG_HASH_INIT 0xcbf29ce484222325ULL
+
+struct Editor;
+struct UndoJournal;
+
+/**
+ * @brief Kind of an entry in the log file.
+ */
+typedef enum {
+    UNDO_LOG_RECORD = 1,    // Journal record, laid out as an UndoRecord
+    UNDO_LOG_TRUNCATE,      // Records after the first 'count' were dropped
+    UNDO_LOG_SAVE           // The file was saved with the first 'count' records applied
+} UndoLogKind;
+
+/**
+ * @brief Start of the log file.
+ * @note 'save_offset' points to the entry of the last save, and 'hash' is the
+ * hash of the content written by it. Only these are ever written over.
+ */
+typedef struct UndoLogHeader {
+    char magic[8];
+    uint64_t hash;
+    uint64_t save_offset;
+} UndoLogHeader;
+
+/**
+ * @brief Header of every entry, followed by 'size' bytes of payload.
+ * @note Sizes are multiples of 8, so records can be used straight from the mapped file.
+ */
+typedef struct UndoLogEntry {
+    uint32_t kind;
+    uint32_t size;
+} UndoLogEntry;
+
+/**
+ * @brief Append only copy of the journal on disk, next to the file.
+ * @note Entries are numbered by their position in the log, 'base' is the
+ * absolute journal index of the first one.
+ */
+typedef struct UndoLog {
+    bool enabled;
+
+    /**
+     * @brief Path of the log, e.g. "dir/.name.undo" for "dir/name".
+     */
+    char *path;
+
+    /**
+     * @brief Open log file, -1 until the first write of a new log.
+     */
+    int fd;
+
+    /**
+     * @brief Size of the log file, where the buffer is written next.
+     */
+    off_t end;
+
+    /**
+     * @brief Entries not yet written to the file.
+     */
+    char *buf;
+    size_t buf_len;
+    size_t buf_cap;
+
+    /**
+     * @brief An entry was added this session, the buffer is written on close.
+     */
+    bool touched;
+
+    long base;
+
+    /**
+     * @brief Number of records in the log, records after it are only in memory.
+     */
+    long logged;
+
+    /**
+     * @brief Log file of a previous session, mapped on open.
+     */
+    char *map;
+    size_t map_len;
+    uint64_t save_offset;
+
+    /**
+     * @brief Number of records before the session start which can be loaded from the map.
+     */
+    long history;
+} UndoLog;
+
+/**
+ * @brief Continue the hash of some content, FNV-1a.
+ * @param hash Hash so far, UNDO_LOG_HASH_INIT for empty content
+ * @param s Content
+ * @param len Length of the content
+ * @return Hash with the content added
+ */
+uint64_t undo_log_hash(uint64_t hash, const char *s, size_t len);
+
+/**
+ * @brief Set up the log of a file which was just loaded.
+ * @param E Editor state
+ * @param filename Name of the file
+ * @param hash Hash of the content of the file on disk
+ * @note If the log next to the file was last saved with the same content, it is
+ * mapped and its history can be undone. Otherwise a new log replaces it on the first write.
+ */
+void undo_log_open(struct Editor *E, const char *filename, uint64_t hash);
+
+/**
+ * @brief Record that the file was saved.
+ * @param E Editor state
+ * @param hash Hash of the content that was written
+ * @note Only the records since the last write are written, followed by a save entry.
+ */
+void undo_log_save(struct Editor *E, uint64_t hash);
+
+/**
+ * @brief Add the records up to an absolute index to the log.
+ * @param J Journal
+ * @param upto Absolute index of the first record which is not added
+ */
+void undo_log_sync(struct UndoJournal *J, long upto);
+
+/**
+ * @brief Drop the records from an absolute index, they were undone and replaced.
+ * @param J Journal
+ * @param count Absolute index of the first dropped record
+ */
+void undo_log_truncate(struct UndoJournal *J, long count);
+
+/**
+ * @brief Put the history of the previous sessions in front of the journal.
+ * @param J Journal
+ * @return false if there is no history to load
+ * @note The records are used straight from the map, only the index is built.
+ */
+bool undo_log_load_history(struct UndoJournal *J);
+
+/**
+ * @brief Write out the buffer, and release the log.
+ * @param J Journal
+ */
+void undo_log_close(struct UndoJournal *J);
+
+#endif //UNDO_LOG_H
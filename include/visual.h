@@ -0,0 +1,118 @@
+#ifndef VISUAL_H
+#define VISUAL_H
+
+#include <stdbool.h>
+
+struct Editor;
+
+/**
+ * @brief State of the visual modes.
+ * @note The selection runs from the anchor to the cursor, in either order.
+ */
+typedef struct VisualState {
+    int anchor_x;
+    int anchor_y;
+
+    /**
+     * @brief A block insert or append is waiting for insert mode to end.
+     * @note The text typed on the first row is then copied to the other rows.
+     */
+    bool block_insert;
+    bool block_append;
+    int block_y0;
+    int block_y1;
+
+    /**
+     * @brief Render column the text goes at, the start of the block for an
+     * insert, and the column after it for an append.
+     */
+    int block_col;
+
+    /**
+     * @brief Where insert mode started on the first row, and its size then.
+     */
+    int block_x;
+    int block_size;
+} VisualState;
+
+/**
+ * @brief Check if the editor is in one of the visual modes.
+ * @param E Editor state
+ * @return true in VISUAL, V-LINE and V-BLOCK mode
+ */
+bool visual_active(const struct Editor *E);
+
+/**
+ * @brief Enter a visual mode, or switch between them.
+ * @param E Editor state
+ * @param mode Visual mode to use, entering the current one leaves visual mode
+ */
+void visual_start(struct Editor *E, int mode);
+
+/**
+ * @brief Leave visual mode, back to normal mode.
+ * @param E Editor state
+ */
+void visual_exit(struct Editor *E);
+
+/**
+ * @brief Swap the anchor and the cursor, to move the other end of the selection.
+ * @param E Editor state
+ */
+void visual_swap_ends(struct Editor *E);
+
+/**
+ * @brief Yank the selection into the register, and leave visual mode.
+ * @param E Editor state
+ */
+void visual_yank(struct Editor *E);
+
+/**
+ * @brief Delete the selection into the register, and leave visual mode.
+ * @param E Editor state
+ * @note Blocks are deleted from every row in parallel, see editor_edit_rows.
+ */
+void visual_delete(struct Editor *E);
+
+/**
+ * @brief Shift the rows of the selection, and leave visual mode.
+ * @param E Editor state
+ * @param direction 1 adds a tab at the start of each row, -1 removes one level of indent
+ * @param count Number of levels to shift by
+ * @note Empty rows are not indented. Large selections are shifted in parallel.
+ */
+void visual_indent(struct Editor *E, int direction, int count);
+
+/**
+ * @brief Start inserting on every row of the block, before it or after it.
+ * @param E Editor state
+ * @param append true to append after the block, short rows are padded with spaces
+ * @note Text is typed on the first row. When insert mode ends, it is copied to
+ * the other rows by visual_block_insert_finish.
+ */
+void visual_block_insert(struct Editor *E, bool append);
+
+/**
+ * @brief Copy the text typed by a block insert to the other rows of the block.
+ * @param E Editor state
+ * @return false if no block insert was waiting
+ * @note The text is only copied if it was typed on the first row without a
+ * newline. The cursor is moved to the start of the block.
+ */
+bool visual_block_insert_finish(struct Editor *E);
+
+/**
+ * @brief Put a cursor on every row of the selection, at the column of the cursor, and leave visual mode.
+ * @param E Editor state
+ * @note Edits typed afterwards go to every cursor, see cursors.h.
+ */
+void visual_cursors(struct Editor *E);
+
+/**
+ * @brief Highlight the selection in the rows that are on screen.
+ * @param E Editor state
+ * @note Only the visible rows are looked at, so the cost does not depend on the size of the selection.
+ */
+void editor_draw_selection(struct Editor *E);
+
+#endif //VISUAL_H
@@ -0,0 +1,126 @@
+#ifndef WATCH_H
+#define WATCH_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <sys/types.h>
+
+/**
+ * @brief Most bytes read from a followed file before they are added as rows.
+ */
+#define WATCH_READ_MAX (64 << 20)
+
+/**
+ * @brief Most rows deleted and inserted which the diff of a changed file looks for.
+ * @note Past this the rows between the first and last difference are replaced whole.
+ */
+#define WATCH_DIFF_MAX 1024
+
+struct Editor;
+
+/**
+ * @brief Watch on the file of the current buffer, with inotify.
+ * @note The inotify descriptor wakes the main thread like a key does, see
+ * InputState, so nothing is polled while the file does not change.
+ * @note A file changed by another program is read again once it is closed,
+ * and only the rows which differ are replaced, so the cursor, the undo
+ * history and the caches of the other rows stay as they are.
+ */
+typedef struct FileWatch {
+    /**
+     * @brief inotify instance, -1 until a file is watched.
+     */
+    int fd;
+
+    /**
+     * @brief Watch on the file, -1 if there is none.
+     */
+    int wd;
+
+    /**
+     * @brief Rows are added as the file grows, like "tail -f".
+     */
+    bool follow;
+
+    /**
+     * @brief The file may have changed, it is compared with the rows once no load is running.
+     */
+    bool pending;
+
+    /**
+     * @brief File being followed, and the offset of the first byte which is not in the rows.
+     */
+    int file;
+    off_t offset;
+
+    /**
+     * @brief Bytes read after the last newline, added once the line is complete.
+     */
+    char *carry;
+    size_t carry_len;
+    size_t carry_cap;
+
+    /**
+     * @brief The last row is a line the file did not end yet, the next bytes go at its end.
+     */
+    bool open_row;
+} FileWatch;
+
+/**
+ * @brief Initialize a watch which watches nothing.
+ * @param W Watch
+ */
+void watch_init(FileWatch *W);
+
+/**
+ * @brief Stop watching and close the inotify instance.
+ * @param E Editor state
+ */
+void watch_free(struct Editor *E);
+
+/**
+ * @brief Watch the file of the current buffer, after it was opened or became the current buffer.
+ * @param E Editor state
+ * @note Changes made while the buffer was not watched are picked up as well.
+ */
+void watch_start(struct Editor *E);
+
+/**
+ * @brief Stop watching the file of the current buffer, and stop following it.
+ * @param E Editor state
+ */
+void watch_stop(struct Editor *E);
+
+/**
+ * @brief Follow the file of the current buffer, rows are added at the end as it grows.
+ * @param E Editor state
+ * @return false if there is no file to follow, or no terminal
+ * @note The file is followed from where the rows end, so anything written
+ * since it was read comes in first.
+ */
+bool watch_follow_start(struct Editor *E);
+
+/**
+ * @brief Stop following the file.
+ * @param E Editor state
+ */
+void watch_follow_stop(struct Editor *E);
+
+/**
+ * @brief Handle the changes to the watched file, called while waiting for keys.
+ * @param E Editor state
+ * @note New complete lines of a followed file are added with a single insert
+ * per read, and the view moves with them if the cursor is on the last row.
+ * @note Any other change is diffed against the rows if the buffer has no
+ * changes, see WATCH_DIFF_MAX, otherwise it is only reported.
+ */
+void watch_poll(struct Editor *E);
+
+/**
+ * @brief Tell the watch the buffer was written to its file, the file ends where the rows end.
+ * @param E Editor state
+ * @note The file is watched from then on, it may be new or have a new name.
+ */
+void watch_saved(struct Editor *E);
+
+#endif //WATCH_H
@@ -0,0 +1,211 @@
+#ifndef WINDOWS_H
+#define WINDOWS_H
+
+#include <stdbool.h>
+
+/**
+ * @brief Smallest window, in lines including the status line, and in columns.
+ */
+#define WINDOW_MIN_ROWS 3
+#define WINDOW_MIN_COLS 20
+
+struct Editor;
+struct _win_st;
+
+/**
+ * @brief Node of the layout: a window, or a split of a rectangle in two.
+ */
+typedef enum {
+    WINDOW_LEAF,
+    WINDOW_SPLIT_ROWS,
+    WINDOW_SPLIT_COLUMNS
+} WindowSplit;
+
+/**
+ * @brief What was drawn on a line of a window, to tell if it has to be drawn again.
+ */
+typedef struct WindowLine {
+    /**
+     * @brief Row shown on the line and its version, -1 and 0 for a '~' line.
+     */
+    int row;
+    unsigned long version;
+
+    /**
+     * @brief Line number shown, negative on the cursor line which is drawn differently.
+     */
+    int number;
+
+    /**
+     * @brief A highlight was painted over the line, e.g. the selection, so it is drawn again next time.
+     */
+    bool overlaid;
+} WindowLine;
+
+/**
+ * @brief Window of the layout, or a split holding two of them.
+ * @note Windows only hold the view: the cursor, the first row and the first
+ * column shown. Two windows on the same buffer draw the same rows, so they
+ * share the renders and the search highlights cached with the rows.
+ * @note The view of the current window lives in the editor itself, like the
+ * current buffer, and is written back to the window before it is drawn.
+ */
+typedef struct EditorWindow {
+    WindowSplit split;
+    struct EditorWindow *parent;
+    struct EditorWindow *child[2];
+
+    /**
+     * @brief ncurses window of the text and the status line, NULL for a split.
+     */
+    struct _win_st *win;
+
+    /**
+     * @brief Rectangle on the screen, the last line is the status line.
+     */
+    int top, left, rows, cols;
+
+    /**
+     * @brief Number of the buffer shown, see FileBuffer.
+     */
+    int buffer;
+
+    int cur_x;
+    int cur_y;
+    int view_start;
+    int col_start;
+
+    /**
+     * @brief What is on each line of text, the window only draws the lines which changed.
+     */
+    WindowLine *lines;
+
+    /**
+     * @brief Every line has to be drawn, e.g. after a resize or a new search pattern.
+     */
+    bool damaged;
+
+    /**
+     * @brief Search pattern the highlights were drawn for, 0 if none were.
+     */
+    unsigned long search_key;
+
+    /**
+     * @brief Number of lines of text drawn since the window opened.
+     */
+    unsigned long drawn;
+} EditorWindow;
+
+/**
+ * @brief Windows on the screen, arranged as a tree of splits.
+ * @note Empty without a terminal.
+ */
+typedef struct WindowLayout {
+    EditorWindow *root;
+    EditorWindow *current;
+
+    /**
+     * @brief Window being drawn, the draw functions paint into it.
+     */
+    EditorWindow *drawing;
+} WindowLayout;
+
+/**
+ * @brief Open a single window over the screen, above the message line.
+ * @param E Editor state
+ */
+void window_layout_init(struct Editor *E);
+
+/**
+ * @brief Close every window.
+ * @param E Editor state
+ */
+void window_layout_free(struct Editor *E);
+
+/**
+ * @brief Place the windows on the screen again, after the terminal changed size.
+ * @param E Editor state
+ */
+void window_layout_resize(struct Editor *E);
+
+/**
+ * @brief Split the current window in two, both show its buffer and the new one becomes current.
+ * @param E Editor state
+ * @param split WINDOW_SPLIT_ROWS for one above the other, WINDOW_SPLIT_COLUMNS for side by side
+ * @return false if there is no room for another window
+ */
+bool window_split(struct Editor *E, WindowSplit split);
+
+/**
+ * @brief Close the current window, its sibling takes its place.
+ * @param E Editor state
+ * @return false if it is the last window
+ */
+bool window_close(struct Editor *E);
+
+/**
+ * @brief Close every window but the current one.
+ * @param E Editor state
+ */
+void window_only(struct Editor *E);
+
+/**
+ * @brief Make another window current, in the order they are on the screen.
+ * @param E Editor state
+ * @param count Number of windows to move by, negative to move back, wraps around
+ */
+void window_cycle(struct Editor *E, int count);
+
+/**
+ * @brief Check if a buffer is shown in a window, such a buffer is not evicted.
+ * @param E Editor state
+ * @param id Number of the buffer
+ */
+bool window_shows_buffer(struct Editor *E, int id);
+
+/**
+ * @brief Draw the lines of every window which changed, their status lines and the cursor.
+ * @param E Editor state
+ * @note The windows are copied to the screen with wnoutrefresh, doupdate shows them.
+ */
+void window_draw(struct Editor *E);
+
+/**
+ * @brief Get the ncurses window being drawn.
+ * @param E Editor state
+ */
+struct _win_st *window_canvas(struct Editor *E);
+
+/**
+ * @brief Print text on a line of the window being drawn, scrolled and cut to the window.
+ * @param E Editor state
+ * @param line Line of the window
+ * @param s Render of a row
+ * @param len Length of the render
+ */
+void window_print(struct Editor *E, int line, const char *s, int len);
+
+/**
+ * @brief Change the attributes of text on a line of the window being drawn.
+ * @param E Editor state
+ * @param line Line of the window
+ * @param x Column in the render plus NUM_COL_SIZE, the window scroll is applied
+ * @param n Number of columns
+ * @param attr Attributes, e.g. A_REVERSE
+ * @param pair Color pair
+ */
+void window_paint(struct Editor *E, int line, int x, int n, int attr, short pair);
+
+/**
+ * @brief Highlight text of a row in the current window, e.g. the selection.
+ * @param E Editor state
+ * @param y Row
+ * @param x Column in the render plus NUM_COL_SIZE, the window scroll is applied
+ * @param n Number of columns
+ * @param attr Attributes
+ * @param pair Color pair
+ * @note The line is drawn again on the next frame, so the highlight goes away when it moves.
+ */
+void window_highlight(struct Editor *E, int y, int x, int n, int attr, short pair);
+
+#endif //WINDOWS_H
@@ -1,36 +1,52 @@
 #include "actions.h"
+#include "commands.h"
+#include "keymaps.h"
+#include "motion.h"
 #include "rows.h"
 #include <stdbool.h>
+#include <stdlib.h>
 #include <string.h>
 #include <ctype.h>
 
 // ---- CURSOR ACTIONS ----
 
+/**
+ * @brief Get the count typed before the command, 1 if there is none.
+ */
+static int action_count(const Editor *E) {
+    return (E->repeat > 0) ? E->repeat : 1;
+}
+
 void action_move_cursor(Editor *E, const direction dir) {
+    action_move_cursor_by(E, dir, 1);
+}
+
+void action_move_cursor_by(Editor *E, const direction dir, const int count) {
     switch (dir) {
         case DIRECTION_UP:
-            if (E->cur_y > 0) {
-                E->cur_y--;
-                if (E->row != NULL && E->cur_x >= E->row[E->cur_y].size)
-                    E->cur_x = E->row[E->cur_y].size;
-            }
-            break;
-        case DIRECTION_DOWN:
-            if (E->cur_y < E->num_rows - 1) {
-                E->cur_y++;
-                if (E->row != NULL && E->cur_x >= E->row[E->cur_y].size)
-                    E->cur_x = E->row[E->cur_y].size;
-            }
+        case DIRECTION_DOWN: {
+            int y = E->cur_y + ((dir == DIRECTION_UP) ? -count : count);
+            if (dir == DIRECTION_DOWN) load_job_wait(E, y);
+            if (y < 0) y = 0;
+            if (y > E->num_rows - 1) y = E->num_rows - 1;
+            if (y == E->cur_y) break;
+
+            E->cur_y = y;
+            if (E->row != NULL && E->cur_x >= E->row[E->cur_y].size)
+                E->cur_x = E->row[E->cur_y].size;
             break;
+        }
         case DIRECTION_LEFT:
-            if (E->cur_x > 0) E->cur_x--;
+            E->cur_x = (E->cur_x > count) ? E->cur_x - count : 0;
             break;
-        case DIRECTION_RIGHT:
-            if (E->mode == INSERT_MODE)
-                if (E->row != NULL && E->cur_x < E->row[E->cur_y].size) E->cur_x++;
-            if (E->mode == NORMAL_MODE)
-                if (E->row != NULL && E->cur_x < E->row[E->cur_y].size - 1) E->cur_x++;
+        case DIRECTION_RIGHT: {
+            if (E->row == NULL) break;
+
+            // Insert mode can move past the last character, normal and visual mode cannot
+            int last = E->row[E->cur_y].size - ((E->mode == NORMAL_MODE || visual_active(E)) ? 1 : 0);
+            if (E->cur_x < last) E->cur_x = (last - E->cur_x > count) ? E->cur_x + count : last;
             break;
+        }
     }
 }
 
@@ -60,9 +76,35 @@ void action_move_to_last_character(Editor *E) {
     E->cur_x = i + 1;
 }
 
-void action_move_to_last_line(Editor *E){}
+void action_move_to_last_line(Editor *E) {
+    // A count picks the line, like vim, only the rows up to it have to be loaded
+    load_job_wait(E, E->repeat - 1);
+    E->cur_y = (E->repeat > 0 && E->repeat < E->num_rows) ? E->repeat - 1 : E->num_rows - 1;
+    action_move_to_first_character(E);
+}
+
+void action_move_to_first_line(Editor *E) {
+    if (E->repeat > 0) load_job_wait(E, E->repeat - 1);
+    E->cur_y = (E->repeat > 0) ? ((E->repeat < E->num_rows) ? E->repeat - 1 : E->num_rows - 1) : 0;
+    action_move_to_first_character(E);
+}
+
+void action_move_to_matching_bracket(Editor *E) {
+    erow *row = &E->row[E->cur_y];
 
-void action_move_to_first_line(Editor *E){}
+    // Use the first bracket at or after the cursor, like vim
+    int i;
+    bool open;
+    for (i = E->cur_x; i < row->size; i++)
+        if (bracket_type(row->chars[i], &open) >= 0) break;
+    if (i == row->size) return;
+
+    int x, y;
+    if (bracket_find_partner(E, i, E->cur_y, &x, &y)) {
+        E->cur_x = x;
+        E->cur_y = y;
+    }
+}
 
 
 // ---- NORMAL MODE ----
@@ -114,33 +156,67 @@ void action_move_first_char(Editor *E) {
     action_move_to_first_character(E);
 };
 
+void action_move_first_line(Editor *E) {
+    action_move_to_first_line(E);
+}
+
+void action_move_last_line(Editor *E) {
+    action_move_to_last_line(E);
+}
+
 void action_move_left(Editor *E) {
-    action_move_cursor(E, DIRECTION_LEFT);
+    action_move_cursor_by(E, DIRECTION_LEFT, action_count(E));
 };
 
 void action_move_down(Editor *E) {
-    action_move_cursor(E, DIRECTION_DOWN);
+    action_move_cursor_by(E, DIRECTION_DOWN, action_count(E));
 };
 
 void action_move_up(Editor *E) {
-    action_move_cursor(E, DIRECTION_UP);
+    action_move_cursor_by(E, DIRECTION_UP, action_count(E));
 };
 
 void action_move_right(Editor *E) {
-    action_move_cursor(E, DIRECTION_RIGHT);
+    action_move_cursor_by(E, DIRECTION_RIGHT, action_count(E));
 };
 
 void action_delete_char(Editor *E) {
-    if ((E->cur_x) == E->row[E->cur_y].size) {
-        editor_remove_character(E, E->cur_x, E->cur_y);
-    } else {
-        editor_remove_character(E, E->cur_x + 1, E->cur_y);
-        action_move_cursor(E, DIRECTION_RIGHT);
-    }
+    if (E->cur_x >= E->row[E->cur_y].size) return;
+
+    // The whole count is removed as one span, a single move of the rest of the row
+    register_yank_text(E, E->cur_x, E->cur_y, E->cur_x + action_count(E), E->cur_y);
+    editor_delete_range(E, E->cur_x, E->cur_y, E->cur_x + action_count(E), E->cur_y);
 };
 
+void action_delete_line(Editor *E) {
+    // The register takes the rows by reference before they are removed
+    register_yank_lines(E, E->cur_y, action_count(E));
+    editor_delete_rows(E, E->cur_y, action_count(E));
+    if (E->cur_y >= E->num_rows) E->cur_y = E->num_rows - 1;
+    action_move_to_first_character(E);
+}
+
+void action_yank_line(Editor *E) {
+    register_yank_lines(E, E->cur_y, action_count(E));
+    int lines = E->reg[0].num;
+    if (lines > 2) editor_set_status_message(E, "%d lines yanked", lines);
+}
+
+void action_put_after(Editor *E) {
+    register_put(E, false, action_count(E));
+}
+
+void action_put_before(Editor *E) {
+    register_put(E, true, action_count(E));
+}
+
+void action_move_matching_bracket(Editor *E) {
+    action_move_to_matching_bracket(E);
+}
+
 void action_quit(Editor *E) {
     editor_destroy(E);
+    keymaps_free();
     exit(0);
 };
 
@@ -148,85 +224,178 @@ void action_save(Editor *E) {
     editor_save_file(E);
 };
 
-void action_move_next_word_start(Editor *E) {
-    erow *row = &E->row[E->cur_y];
+/**
+ * @brief Move the cursor with a word motion.
+ * @param E Editor state
+ * @param motion Word motion to perform
+ */
+static void move_word(Editor *E, const Motion motion) {
+    MotionPos from = {E->cur_x, E->cur_y};
+    MotionPos to = motion_find(E, motion, from, action_count(E));
+    E->cur_x = to.x;
+    E->cur_y = to.y;
+}
 
-    int i;
-    bool space_found = false;
-    for (i = E->cur_x; i < row->size; i++) {
-        if (row->chars[i] == ' ') space_found = true;
-        if (space_found && row->chars[i] != ' ') break;
-    }
+/**
+ * @brief Delete the text covered by a word motion, like "dw".
+ * @param E Editor state
+ * @param motion Word motion that covers the text
+ */
+static void delete_word(Editor *E, const Motion motion) {
+    MotionRange range;
+    motion_range(E, motion, action_count(E), &range);
+
+    int end_x = range.end.x + (range.inclusive ? 1 : 0);
+    register_yank_text(E, range.start.x, range.start.y, end_x, range.end.y);
+    editor_delete_range(E, range.start.x, range.start.y, end_x, range.end.y);
+    E->cur_x = range.start.x;
+    E->cur_y = range.start.y;
+}
 
-    // TODO: Move to next lines when at the end
-    // If we didn't find another word, move to the next line
-    // if (!char_found && !space_found && E->cur_y < E->num_rows) {
-    //     erow *next_row = &E->row[E->cur_y + 1];
-    //     for (i = 0; i < next_row->size; i++) {
-    //         if (row->chars[i] == ' ') space_found = true;
-    //         if (space_found && row->chars[i] != ' ') break;
-    //     }
-    //     E->cur_y++;
-    // }
+void action_delete_next_word_start(Editor *E) {
+    delete_word(E, MOTION_WORD_NEXT);
+}
 
-    E->cur_x = i;
+void action_delete_next_big_word_start(Editor *E) {
+    delete_word(E, MOTION_BIG_WORD_NEXT);
 }
 
-void action_move_prev_word_start(Editor *E) {
-    erow *row = &E->row[E->cur_y];
+void action_delete_prev_word_start(Editor *E) {
+    delete_word(E, MOTION_WORD_PREV);
+}
 
-    int i;
-    bool space_found = false;
-    bool chars_found = false;
-    for (i = E->cur_x; i > 0; i--) {
-        if (row->chars[i] == ' ') space_found = true;
-        if (space_found && !isspace(row->chars[i])) chars_found = true;
-        if (chars_found && space_found && isspace(row->chars[i])) break;
-    }
+void action_delete_prev_big_word_start(Editor *E) {
+    delete_word(E, MOTION_BIG_WORD_PREV);
+}
 
-    E->cur_x = (i == 0) ? i : ++i;
+void action_delete_curr_word_end(Editor *E) {
+    delete_word(E, MOTION_WORD_END);
+}
 
+void action_delete_curr_big_word_end(Editor *E) {
+    delete_word(E, MOTION_BIG_WORD_END);
 }
 
-void action_move_curr_word_end(Editor *E) {
-    erow *row = &E->row[E->cur_y];
+void action_move_next_word_start(Editor *E) {
+    move_word(E, MOTION_WORD_NEXT);
+}
 
-    int i = E->cur_x + 1;
+void action_move_next_big_word_start(Editor *E) {
+    move_word(E, MOTION_BIG_WORD_NEXT);
+}
 
-    // Move until the chars aren't spaces
-    while (row->chars[i] == ' ') i++;
+void action_move_prev_word_start(Editor *E) {
+    move_word(E, MOTION_WORD_PREV);
+}
 
-    for (i; i < row->size; i++) {
-        if (row->chars[i] == ' ') break;
+void action_move_prev_big_word_start(Editor *E) {
+    move_word(E, MOTION_BIG_WORD_PREV);
+}
+
+void action_move_curr_word_end(Editor *E) {
+    move_word(E, MOTION_WORD_END);
+}
+
+void action_move_curr_big_word_end(Editor *E) {
+    move_word(E, MOTION_BIG_WORD_END);
+}
+
+void action_undo(Editor *E) {
+    // Every step is its own unit of work, so a count undoes them one by one
+    int count = action_count(E);
+    if (!undo_undo(E)) {
+        editor_set_status_message(E, "Already at oldest change");
+        return;
     }
+    while (--count > 0 && undo_undo(E));
+}
 
-    E->cur_x = --i;
+void action_redo(Editor *E) {
+    int count = action_count(E);
+    if (!undo_redo(E)) {
+        editor_set_status_message(E, "Already at newest change");
+        return;
+    }
+    while (--count > 0 && undo_redo(E));
 }
 
 void action_command_mode(Editor *E) {
     char *cmd = editor_prompt(E, ":%s", NULL);
-    editor_set_status_message(E, cmd);
-
-    // TODO: Make this work the same way, but for now, ignore it
-    if (strcmp(cmd, "w") == 0) {
-        editor_save_file(E);
-    } else if (strcmp(cmd, "q") == 0) {
-        action_quit(E);
-    } else if (strcmp(cmd, "wq") == 0) {
-        editor_save_file(E);
-        action_quit(E);
+    if (cmd == NULL) return;
+    editor_set_status_message(E, "%s", cmd);
+
+    command_execute(E, cmd);
+    free(cmd);
+}
+
+void action_search(Editor *E) {
+    SearchState *S = &E->search;
+    load_job_finish(E);
+    S->origin_x = E->cur_x;
+    S->origin_y = E->cur_y;
+    S->match_y = -1;
+    S->active = true;
+
+    char *query = editor_prompt(E, "/%s", search_callback);
+    if (query == NULL) return;
+
+    if (S->match_y == -1 && query[0] != '\0')
+        editor_set_status_message(E, "Pattern not found: %s", query);
+    free(query);
+}
+
+/**
+ * @brief Move to the next match of the last search in the given direction.
+ * @param E Editor state
+ * @param direction 1 repeats the search in the same direction, -1 reverses it
+ */
+static void search_repeat(Editor *E, const int direction) {
+    SearchState *S = &E->search;
+    if (S->pattern.source == NULL) {
+        editor_set_status_message(E, "No previous search pattern");
+        return;
     }
+    load_job_finish(E);
+
+    int x = E->cur_x, y = E->cur_y;
+    bool found = false;
+    for (int i = action_count(E); i > 0; i--) {
+        if (!search_find_match(E, x, y, S->direction * direction, &x, &y)) break;
+        found = true;
+    }
+
+    if (found) {
+        S->match_x = x;
+        S->match_y = y;
+        E->cur_x = x;
+        E->cur_y = y;
+    } else {
+        editor_set_status_message(E, "Pattern not found: %s", S->pattern.source);
+    }
+}
+
+void action_search_next(Editor *E) {
+    search_repeat(E, 1);
+}
+
+void action_search_prev(Editor *E) {
+    search_repeat(E, -1);
 }
 
 // ---- INSERT MORE ----
 
 void action_normal_mode(Editor *E) {
     E->mode = NORMAL_MODE;
-    action_move_cursor(E, DIRECTION_LEFT);
+
+    // Everything typed since entering insert mode is undone at once, with the
+    // copies of a block insert
+    if (!visual_block_insert_finish(E)) action_move_cursor(E, DIRECTION_LEFT);
+    undo_seal(E);
 }
 
 void action_backspace(Editor *E) {
-    editor_remove_character(E, E->cur_x, E->cur_y);
+    if (cursors_active(E)) cursors_backspace(E);
+    else editor_remove_character(E, E->cur_x, E->cur_y);
 }
 
 void action_enter(Editor *E) {
@@ -234,7 +403,8 @@ void action_enter(Editor *E) {
 }
 
 void action_insert_character(Editor *E, const char c) {
-    editor_insert_character(E, E->cur_x, E->cur_y, c);
+    if (cursors_active(E)) cursors_insert(E, &c, 1);
+    else editor_insert_character(E, E->cur_x, E->cur_y, c);
 }
 
 void action_delete_last_word(Editor *E) {
@@ -247,10 +417,84 @@ void action_delete_last_word(Editor *E) {
     // Find the beginning of the word
     while (i >= 0 && !isspace(row->chars[i])) i--;
 
-    // TODO: Maybe there is a better way? But maybe not!
-    int count = E->cur_x - i;
-    while (count-- > 1) {
-        action_move_cursor(E, DIRECTION_LEFT);
-        action_delete_char(E);
-    }
+    // Remove the word as a single span
+    int start = i + 1;
+    editor_delete_range(E, start, E->cur_y, E->cur_x, E->cur_y);
+    E->cur_x = start;
+}
+
+// ---- VISUAL MODE ----
+
+void action_visual_mode(Editor *E) {
+    visual_start(E, VISUAL_MODE);
+}
+
+void action_visual_line_mode(Editor *E) {
+    visual_start(E, VISUAL_LINE_MODE);
+}
+
+void action_visual_block_mode(Editor *E) {
+    visual_start(E, VISUAL_BLOCK_MODE);
+}
+
+void action_visual_exit(Editor *E) {
+    visual_exit(E);
+}
+
+void action_visual_swap(Editor *E) {
+    visual_swap_ends(E);
+}
+
+void action_visual_delete(Editor *E) {
+    visual_delete(E);
+}
+
+void action_visual_yank(Editor *E) {
+    visual_yank(E);
+}
+
+void action_visual_indent(Editor *E) {
+    visual_indent(E, 1, action_count(E));
+}
+
+void action_visual_unindent(Editor *E) {
+    visual_indent(E, -1, action_count(E));
+}
+
+void action_visual_block_insert(Editor *E) {
+    visual_block_insert(E, false);
+}
+
+void action_visual_block_append(Editor *E) {
+    visual_block_insert(E, true);
+}
+
+void action_visual_cursors(Editor *E) {
+    visual_cursors(E);
+}
+
+// ---- MULTI-CURSOR ----
+
+void action_cursors_clear(Editor *E) {
+    cursors_clear(E);
+}
+
+void action_window_split(Editor *E) {
+    if (!window_split(E, WINDOW_SPLIT_ROWS)) editor_set_status_message(E, "Not enough room");
+}
+
+void action_window_vsplit(Editor *E) {
+    if (!window_split(E, WINDOW_SPLIT_COLUMNS)) editor_set_status_message(E, "Not enough room");
+}
+
+void action_window_close(Editor *E) {
+    if (!window_close(E)) editor_set_status_message(E, "Cannot close last window");
+}
+
+void action_window_only(Editor *E) {
+    window_only(E);
+}
+
+void action_window_next(Editor *E) {
+    window_cycle(E, action_count(E));
 }
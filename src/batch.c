@@ -0,0 +1,81 @@
+#include "batch.h"
+#include "commands.h"
+#include "editor.h"
+#include <errno.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+/**
+ * @brief Size of the buffers of stdin and stdout, large files are streamed through them.
+ */
+#define BATCH_IO_BUFFER (1 << 20)
+
+/**
+ * @brief Run one line of a script, and report the message it left on stderr.
+ * @param where Name of the script, or "-c"
+ * @param line Line number in the script, 0 for "-c"
+ */
+static void batch_execute(Editor *E, const char *where, const int line, const char *cmd) {
+    // Leading ':' are allowed, so lines can be copied from the editor
+    while (*cmd == ' ' || *cmd == '\t' || *cmd == ':') cmd++;
+    if (*cmd == '\0' || *cmd == '"') return;
+
+    free(E->message);
+    E->message = NULL;
+    command_execute(E, cmd);
+
+    if (E->message != NULL && E->message[0] != '\0') {
+        if (line > 0) fprintf(stderr, "%s:%d: %s\n", where, line, E->message);
+        else fprintf(stderr, "%s: %s\n", where, E->message);
+    }
+}
+
+/**
+ * @brief Run every line of a script file.
+ * @return false if the script could not be opened
+ */
+static bool batch_run_script(Editor *E, const char *script) {
+    FILE *fp = fopen(script, "r");
+    if (fp == NULL) {
+        fprintf(stderr, "%s: %s\n", script, strerror(errno));
+        return false;
+    }
+
+    char *line = NULL;
+    size_t line_cap = 0;
+    ssize_t line_len;
+    int n = 0;
+    while ((line_len = getline(&line, &line_cap, fp)) != -1) {
+        n++;
+        while (line_len > 0 && (line[line_len - 1] == '\n' || line[line_len - 1] == '\r')) line_len--;
+        line[line_len] = '\0';
+        batch_execute(E, script, n, line);
+    }
+    free(line);
+    fclose(fp);
+    return true;
+}
+
+int batch_run(Editor *E, const BatchOptions *O) {
+    static char in_buffer[BATCH_IO_BUFFER], out_buffer[BATCH_IO_BUFFER];
+    setvbuf(stdout, out_buffer, _IOFBF, sizeof(out_buffer));
+
+    if (O->file == NULL || strcmp(O->file, "-") == 0) {
+        setvbuf(stdin, in_buffer, _IOFBF, sizeof(in_buffer));
+        editor_open_stream(E, stdin);
+    } else {
+        editor_open_file(E, (char *) O->file);
+    }
+
+    if (O->script != NULL && !batch_run_script(E, O->script)) return 2;
+    for (int i = 0; i < O->num_commands; i++) batch_execute(E, "-c", 0, O->commands[i]);
+
+    // A ":w" already sent the buffer to stdout, it is not repeated
+    if (E->filename == NULL && E->stdout_written && !E->dirty) return 0;
+    if (!editor_write_file(E)) {
+        fprintf(stderr, "%s\n", E->message);
+        return 1;
+    }
+    return 0;
+}
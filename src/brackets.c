@@ -0,0 +1,485 @@
+#include "brackets.h"
+#include "editor.h"
+#include <stdlib.h>
+#include <string.h>
+
+typedef struct {
+    char *extension;
+    char *comment;
+} BracketSyntax;
+
+// File types where quotes start strings and brackets in comments are ignored
+static BracketSyntax bracket_syntax[] = {
+    {"c", "//"}, {"h", "//"}, {"cpp", "//"}, {"hpp", "//"}, {"cc", "//"},
+    {"java", "//"}, {"js", "//"}, {"ts", "//"}, {"go", "//"}, {"rs", "//"},
+    {"cs", "//"}, {"py", "#"}, {"sh", "#"}, {"rb", "#"}, {"lua", "--"},
+
+    {NULL, NULL} // Null terminator: ALL TYPES MUST BE ABOVE THIS
+};
+
+/**
+ * @brief Lexer over a single row which only reports brackets outside of strings and comments.
+ * @note Strings and comments do not carry over between rows.
+ */
+typedef struct {
+    const BracketIndex *B;
+    const erow *row;
+    int i;
+    char quote;
+} BracketLexer;
+
+static void lexer_init(BracketLexer *L, const BracketIndex *B, const erow *row) {
+    L->B = B;
+    L->row = row;
+    L->i = 0;
+    L->quote = '\0';
+}
+
+/**
+ * @brief Advance the lexer to the next bracket in the row.
+ * @return Position of the bracket, or -1 at the end of the row
+ */
+static int lexer_next(BracketLexer *L) {
+    const char *chars = L->row->chars;
+    const int size = L->row->size;
+    const size_t comment_len = L->B->comment ? strlen(L->B->comment) : 0;
+
+    while (L->i < size) {
+        const char c = chars[L->i];
+
+        if (L->B->lexical) {
+            if (L->quote != '\0') {
+                // Skip escaped characters, and the closing quote
+                if (c == '\\') L->i++;
+                else if (c == L->quote) L->quote = '\0';
+                L->i++;
+                continue;
+            }
+            if (c == '"' || c == '\'' || c == '`') {
+                L->quote = c;
+                L->i++;
+                continue;
+            }
+            if (comment_len > 0 && (size_t) (size - L->i) >= comment_len &&
+                memcmp(&chars[L->i], L->B->comment, comment_len) == 0) {
+                L->i = size;
+                break;
+            }
+        }
+
+        bool open;
+        if (bracket_type(c, &open) >= 0) return L->i++;
+        L->i++;
+    }
+    return -1;
+}
+
+static void summary_clear(BracketSummary *s) {
+    memset(s, 0, sizeof(BracketSummary));
+}
+
+/**
+ * @brief Combine the summaries of two adjacent ranges, a is before b.
+ */
+static void summary_combine(BracketSummary *out, const BracketSummary *a, const BracketSummary *b) {
+    for (int t = 0; t < BRACKET_TYPES; t++) {
+        int matched = a->open[t] < b->close[t] ? a->open[t] : b->close[t];
+        int close = a->close[t] + b->close[t] - matched;
+        int open = a->open[t] + b->open[t] - matched;
+        out->close[t] = close;
+        out->open[t] = open;
+    }
+}
+
+/**
+ * @brief Compute the summary of a row and store it in the row.
+ */
+static void bracket_scan_row(const BracketIndex *B, erow *row) {
+    summary_clear(&row->brackets);
+
+    BracketLexer L;
+    lexer_init(&L, B, row);
+
+    int pos;
+    while ((pos = lexer_next(&L)) != -1) {
+        bool open = false;
+        int t = bracket_type(row->chars[pos], &open);
+        if (open) {
+            row->brackets.open[t]++;
+        } else if (row->brackets.open[t] > 0) {
+            row->brackets.open[t]--;
+        } else {
+            row->brackets.close[t]++;
+        }
+    }
+
+    row->bracket_gen = B->gen;
+}
+
+/**
+ * @brief Get the summary of a row, scanning it if the stored one is outdated.
+ */
+static const BracketSummary *row_summary(const BracketIndex *B, erow *row) {
+    if (row->bracket_gen != B->gen) bracket_scan_row(B, row);
+    return &row->brackets;
+}
+
+/**
+ * @brief Number of rows a node at height h may hold before a splice has to go up a level.
+ * @note Leaves may be full, the root only half full, so a rebuilt subtree leaves room below it.
+ */
+static long node_limit(const BracketIndex *B, const int h) {
+    long cap = (long) BRACKET_LEAF_ROWS << h;
+    if (B->height == 0) return cap;
+    return cap - cap * h / (2 * B->height);
+}
+
+/**
+ * @brief Combine the summaries of the rows of a leaf, which start at row s.
+ */
+static void leaf_summary(Editor *E, const int node, const int s) {
+    BracketIndex *B = &E->brackets;
+    summary_clear(&B->nodes[node]);
+    for (int y = s; y < s + B->counts[node]; y++)
+        summary_combine(&B->nodes[node], &B->nodes[node], row_summary(B, &E->row[y]));
+}
+
+/**
+ * @brief Spread rows [s, s + count) evenly over the leaves below a node.
+ */
+static void subtree_fill(Editor *E, const int node, const int s, const int count) {
+    BracketIndex *B = &E->brackets;
+    B->counts[node] = count;
+    if (node >= B->leaves) {
+        leaf_summary(E, node, s);
+        return;
+    }
+
+    int left = (count + 1) / 2;
+    subtree_fill(E, 2 * node, s, left);
+    subtree_fill(E, 2 * node + 1, s + left, count - left);
+    summary_combine(&B->nodes[node], &B->nodes[2 * node], &B->nodes[2 * node + 1]);
+}
+
+static void bracket_index_rebuild(Editor *E) {
+    BracketIndex *B = &E->brackets;
+
+    // Start half full, so rows can be spliced in before the tree has to grow
+    int leaves = 1, height = 0;
+    while ((long) leaves * BRACKET_LEAF_ROWS < 2L * E->num_rows) {
+        leaves *= 2;
+        height++;
+    }
+
+    if (leaves != B->leaves || B->nodes == NULL) {
+        free(B->nodes);
+        free(B->counts);
+        B->nodes = malloc(sizeof(BracketSummary) * 2 * leaves);
+        B->counts = malloc(sizeof(int) * 2 * leaves);
+        if (B->nodes == NULL || B->counts == NULL) exit(1);
+        B->leaves = leaves;
+        B->height = height;
+    }
+
+    subtree_fill(E, 1, 0, E->num_rows);
+    B->num_rows = E->num_rows;
+    B->stale = false;
+}
+
+/**
+ * @brief Find the leaf which holds a row.
+ * @param s First row of the leaf (will be updated)
+ * @note Past the last row, this is the last leaf.
+ */
+static int find_leaf(const BracketIndex *B, const int y, int *s) {
+    int node = 1;
+    *s = 0;
+    while (node < B->leaves) {
+        node *= 2;
+        if (y >= *s + B->counts[node]) {
+            *s += B->counts[node];
+            node++;
+        }
+    }
+    return node;
+}
+
+void bracket_index_init(BracketIndex *B) {
+    B->nodes = NULL;
+    B->counts = NULL;
+    B->leaves = 0;
+    B->height = 0;
+    B->num_rows = 0;
+    B->stale = true;
+    B->gen = 1;
+    B->lexical = false;
+    B->comment = NULL;
+}
+
+void bracket_index_free(BracketIndex *B) {
+    free(B->nodes);
+    free(B->counts);
+    bracket_index_init(B);
+}
+
+void bracket_index_set_file_type(Editor *E) {
+    BracketIndex *B = &E->brackets;
+
+    const char *comment = NULL;
+    bool lexical = false;
+    for (int i = 0; E->filetype != NULL && bracket_syntax[i].extension != NULL; i++) {
+        if (strcmp(E->filetype, bracket_syntax[i].extension) == 0) {
+            comment = bracket_syntax[i].comment;
+            lexical = true;
+            break;
+        }
+    }
+
+    if (lexical == B->lexical && comment == B->comment) return;
+
+    B->lexical = lexical;
+    B->comment = comment;
+    B->gen++;
+    B->stale = true;
+}
+
+void bracket_index_update_row(Editor *E, int y) {
+    BracketIndex *B = &E->brackets;
+    if (y < 0 || y >= E->num_rows) return;
+
+    bracket_scan_row(B, &E->row[y]);
+    if (B->stale || B->num_rows != E->num_rows) {
+        B->stale = true;
+        return;
+    }
+
+    // Update the leaf and every node above it
+    int s;
+    int i = find_leaf(B, y, &s);
+    leaf_summary(E, i, s);
+    for (i /= 2; i > 0; i /= 2)
+        summary_combine(&B->nodes[i], &B->nodes[2 * i], &B->nodes[2 * i + 1]);
+}
+
+void bracket_index_splice(Editor *E, const int y, const int removed, const int inserted) {
+    BracketIndex *B = &E->brackets;
+    if (B->stale) return;
+    if (y < 0 || y + removed > B->num_rows || B->num_rows - removed + inserted != E->num_rows) {
+        B->stale = true;
+        return;
+    }
+
+    // Go up from the leaf of the first row until the node holds every removed
+    // row and has room for the new ones
+    int s;
+    int node = find_leaf(B, y, &s);
+    for (int h = 0;; h++) {
+        int count = B->counts[node] - removed + inserted;
+        if (y + removed <= s + B->counts[node] && count <= node_limit(B, h)) {
+            subtree_fill(E, node, s, count);
+            break;
+        }
+        if (node == 1) {
+            bracket_index_rebuild(E);
+            return;
+        }
+        if (node % 2 == 1) s -= B->counts[node - 1];
+        node /= 2;
+    }
+
+    for (node /= 2; node > 0; node /= 2) {
+        B->counts[node] += inserted - removed;
+        summary_combine(&B->nodes[node], &B->nodes[2 * node], &B->nodes[2 * node + 1]);
+    }
+    B->num_rows = E->num_rows;
+
+    // Shrink the tree once most of it is empty
+    if (B->leaves > 1 && 8L * E->num_rows < (long) B->leaves * BRACKET_LEAF_ROWS) bracket_index_rebuild(E);
+}
+
+int bracket_type(const char c, bool *open) {
+    switch (c) {
+        case '(': *open = true;  return 0;
+        case ')': *open = false; return 0;
+        case '[': *open = true;  return 1;
+        case ']': *open = false; return 1;
+        case '{': *open = true;  return 2;
+        case '}': *open = false; return 2;
+        default: return -1;
+    }
+}
+
+/**
+ * @brief Find the first row after 'after' where the unmatched closes reach 'need'.
+ * @param s First row of the node
+ * @note 'need' is updated to the depth left at the start of the returned row.
+ */
+static int tree_search_forward(Editor *E, const int node, const int s, const int after, const int t, int *need) {
+    const BracketIndex *B = &E->brackets;
+    const int count = B->counts[node];
+    if (count == 0 || s + count - 1 <= after) return -1;
+
+    const BracketSummary *S = &B->nodes[node];
+    if (s > after && S->close[t] < *need) {
+        *need = *need - S->close[t] + S->open[t];
+        return -1;
+    }
+
+    // Leaves are searched row by row, from the row after 'after' if it is in the leaf
+    if (node >= B->leaves) {
+        for (int y = (s > after) ? s : after + 1; y < s + count; y++) {
+            const BracketSummary *R = row_summary(B, &E->row[y]);
+            if (R->close[t] >= *need) return y;
+            *need = *need - R->close[t] + R->open[t];
+        }
+        return -1;
+    }
+
+    int found = tree_search_forward(E, 2 * node, s, after, t, need);
+    if (found != -1) return found;
+    return tree_search_forward(E, 2 * node + 1, s + B->counts[2 * node], after, t, need);
+}
+
+/**
+ * @brief Find the last row before 'before' where the unmatched opens reach 'need'.
+ * @param s First row of the node
+ * @note 'need' is updated to the depth left at the end of the returned row.
+ */
+static int tree_search_backward(Editor *E, const int node, const int s, const int before, const int t, int *need) {
+    const BracketIndex *B = &E->brackets;
+    const int count = B->counts[node];
+    if (count == 0 || s >= before) return -1;
+
+    const BracketSummary *S = &B->nodes[node];
+    if (s + count <= before && S->open[t] < *need) {
+        *need = *need - S->open[t] + S->close[t];
+        return -1;
+    }
+
+    if (node >= B->leaves) {
+        for (int y = ((s + count < before) ? s + count : before) - 1; y >= s; y--) {
+            const BracketSummary *R = row_summary(B, &E->row[y]);
+            if (R->open[t] >= *need) return y;
+            *need = *need - R->open[t] + R->close[t];
+        }
+        return -1;
+    }
+
+    int found = tree_search_backward(E, 2 * node + 1, s + B->counts[2 * node], before, t, need);
+    if (found != -1) return found;
+    return tree_search_backward(E, 2 * node, s, before, t, need);
+}
+
+/**
+ * @brief Collect the positions of the brackets of type t in a row.
+ * @return Number of brackets, positions are stored in *out (caller frees)
+ */
+static int row_brackets(const BracketIndex *B, const erow *row, int t, int **out) {
+    int cap = 16, len = 0;
+    int *pos = malloc(sizeof(int) * cap);
+    if (pos == NULL) exit(1);
+
+    BracketLexer L;
+    lexer_init(&L, B, row);
+
+    int p;
+    while ((p = lexer_next(&L)) != -1) {
+        bool open;
+        if (bracket_type(row->chars[p], &open) != t) continue;
+        if (len == cap) {
+            cap *= 2;
+            pos = realloc(pos, sizeof(int) * cap);
+            if (pos == NULL) exit(1);
+        }
+        pos[len++] = p;
+    }
+
+    *out = pos;
+    return len;
+}
+
+bool bracket_find_partner(Editor *E, const int x, const int y, int *px, int *py) {
+    BracketIndex *B = &E->brackets;
+    if (y < 0 || y >= E->num_rows || x < 0 || x >= E->row[y].size) return false;
+
+    bool open;
+    const int t = bracket_type(E->row[y].chars[x], &open);
+    if (t < 0) return false;
+
+    // Find the bracket in the row, this also rules out brackets in strings
+    int *pos;
+    int len = row_brackets(B, &E->row[y], t, &pos);
+    int idx = -1;
+    for (int i = 0; i < len; i++) if (pos[i] == x) idx = i;
+    if (idx == -1) {
+        free(pos);
+        return false;
+    }
+
+    // Try to match the bracket within its own row first
+    int depth = 0;
+    if (open) {
+        for (int i = idx; i < len; i++) {
+            bracket_type(E->row[y].chars[pos[i]], &open);
+            depth += open ? 1 : -1;
+            if (depth == 0) {
+                *px = pos[i];
+                *py = y;
+                free(pos);
+                return true;
+            }
+        }
+        open = true;
+    } else {
+        for (int i = idx; i >= 0; i--) {
+            bracket_type(E->row[y].chars[pos[i]], &open);
+            depth += open ? -1 : 1;
+            if (depth == 0) {
+                *px = pos[i];
+                *py = y;
+                free(pos);
+                return true;
+            }
+        }
+        open = false;
+    }
+    free(pos);
+
+    // Find the row which contains the partner using the tree
+    if (B->stale || B->num_rows != E->num_rows) bracket_index_rebuild(E);
+
+    int need = depth;
+    int row = open
+        ? tree_search_forward(E, 1, 0, y, t, &need)
+        : tree_search_backward(E, 1, 0, y, t, &need);
+    if (row == -1) return false;
+
+    // Find the exact position of the partner in the row
+    len = row_brackets(B, &E->row[row], t, &pos);
+    if (open) {
+        for (int i = 0; i < len; i++) {
+            bracket_type(E->row[row].chars[pos[i]], &open);
+            need += open ? 1 : -1;
+            if (need == 0) {
+                *px = pos[i];
+                *py = row;
+                free(pos);
+                return true;
+            }
+        }
+    } else {
+        for (int i = len - 1; i >= 0; i--) {
+            bracket_type(E->row[row].chars[pos[i]], &open);
+            need += open ? -1 : 1;
+            if (need == 0) {
+                *px = pos[i];
+                *py = row;
+                free(pos);
+                return true;
+            }
+        }
+    }
+
+    free(pos);
+    return false;
+}
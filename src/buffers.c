@@ -0,0 +1,366 @@
+#include "buffers.h"
+#include "editor.h"
+#include "rows.h"
+#include "search_job.h"
+#include "undo_log.h"
+#include "visual.h"
+#include "windows.h"
+#include <malloc.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+/**
+ * @brief Memory taken by an allocation of size bytes, with the header and alignment of malloc.
+ */
+static size_t alloc_bytes(const size_t size) {
+    size_t bytes = (size + sizeof(size_t) + 15) & ~(size_t) 15;
+    return (bytes < 32) ? 32 : bytes;
+}
+
+/**
+ * @brief Memory used by rows, the contents, the renders and the array itself.
+ * @note Shared contents are counted for every row which holds them.
+ */
+static size_t rows_bytes(const erow *row, const int num_rows) {
+    size_t bytes = sizeof(erow) * (size_t) num_rows;
+    for (int i = 0; i < num_rows; i++) {
+        bytes += alloc_bytes(sizeof(RowText) + row[i].size + 1);
+        if (row[i].render != NULL) bytes += alloc_bytes(row[i].rsize + 1);
+    }
+    return bytes;
+}
+
+static FileBuffer *buffer_add(BufferList *L) {
+    if (L->num == L->cap) {
+        L->cap = L->cap ? L->cap * 2 : 8;
+        L->list = realloc(L->list, sizeof(FileBuffer) * L->cap);
+        if (L->list == NULL) exit(1);
+    }
+    FileBuffer *B = &L->list[L->num++];
+    memset(B, 0, sizeof(FileBuffer));
+    B->id = ++L->next_id;
+    return B;
+}
+
+/**
+ * @brief Give the state in the editor an entry, it is the only buffer until the second one opens.
+ */
+static void buffer_list_start(Editor *E) {
+    BufferList *L = &E->buffers;
+    if (L->num > 0) return;
+    buffer_add(L);
+    L->current = 0;
+}
+
+/**
+ * @brief Move the current buffer out of the editor into its entry, leaving the editor empty.
+ */
+static void buffer_stash(Editor *E) {
+    BufferList *L = &E->buffers;
+    FileBuffer *B = &L->list[L->current];
+
+    // The workers read the rows, they stop before the rows change hands, and
+    // the file being loaded is read to the end
+    load_job_finish(E);
+    B->follow = E->watch.follow;
+    watch_stop(E);
+    search_job_cancel(E);
+    trigram_index_cancel(E);
+    if (visual_active(E)) visual_exit(E);
+    cursors_clear(E);
+
+    B->filename = E->filename;
+    B->filetype = E->filetype;
+    B->disk_size = E->disk_size;
+    B->disk_mtime = E->disk_mtime;
+    B->row = E->row;
+    B->num_rows = E->num_rows;
+    B->num_bytes = E->num_bytes;
+    B->dirty = E->dirty;
+    B->cur_x = E->cur_x;
+    B->cur_y = E->cur_y;
+    B->view_start = E->view_start;
+    B->col_start = E->col_start;
+    B->brackets = E->brackets;
+    B->trigrams = E->trigrams;
+    B->undo = E->undo;
+    B->bytes = rows_bytes(E->row, E->num_rows);
+    B->used = ++L->tick;
+
+    E->filename = NULL;
+    E->filetype = NULL;
+    E->disk_size = 0;
+    E->disk_mtime = (struct timespec) {0, 0};
+    E->row = NULL;
+    E->num_rows = 0;
+    E->num_bytes = 0;
+    E->dirty = 0;
+    E->cur_x = 0;
+    E->cur_y = 0;
+    E->view_start = 0;
+    E->col_start = 0;
+    bracket_index_init(&E->brackets);
+    trigram_index_init(&E->trigrams);
+    undo_journal_init(&E->undo);
+    E->search.match_y = -1;
+}
+
+/**
+ * @brief Read the rows of an evicted buffer from its file again.
+ * @note The undo history only survives if the file did not change on disk.
+ */
+static void buffer_reload(Editor *E, FileBuffer *B) {
+    B->evicted = false;
+
+    struct stat st;
+    bool same = stat(E->filename, &st) == 0 && st.st_size == E->disk_size &&
+                st.st_mtim.tv_sec == E->disk_mtime.tv_sec &&
+                st.st_mtim.tv_nsec == E->disk_mtime.tv_nsec;
+    if (!same) undo_journal_free(&E->undo);
+
+    uint64_t hash = UNDO_LOG_HASH_INIT;
+    if (!editor_read_file(E, &hash)) {
+        undo_suspend(E);
+        editor_insert_row_below(E, 0, "", 0);
+        undo_resume(E);
+        editor_set_status_message(E, "%s no longer exists", E->filename);
+    } else if (!same) {
+        editor_set_status_message(E, "%s changed on disk, undo history dropped", E->filename);
+    } else {
+        editor_set_status_message(E, "\"%s\" %d lines, read again", E->filename, E->num_rows);
+    }
+    if (!same && !E->headless) undo_log_open(E, E->filename, hash);
+    bracket_index_set_file_type(E);
+
+    // The file may have shrunk while it was away
+    if (E->cur_y >= E->num_rows) E->cur_y = E->num_rows - 1;
+    if (E->cur_x > E->row[E->cur_y].size) E->cur_x = E->row[E->cur_y].size;
+    if (E->view_start > E->cur_y) E->view_start = E->cur_y;
+}
+
+/**
+ * @brief Move a buffer from its entry into the editor, the editor must be empty.
+ */
+static void buffer_restore(Editor *E, const int index) {
+    BufferList *L = &E->buffers;
+    FileBuffer *B = &L->list[index];
+    L->current = index;
+
+    E->filename = B->filename;
+    E->filetype = B->filetype;
+    E->disk_size = B->disk_size;
+    E->disk_mtime = B->disk_mtime;
+    E->row = B->row;
+    E->num_rows = B->num_rows;
+    E->num_bytes = B->num_bytes;
+    E->dirty = B->dirty;
+    E->cur_x = B->cur_x;
+    E->cur_y = B->cur_y;
+    E->view_start = B->view_start;
+    E->col_start = B->col_start;
+    E->brackets = B->brackets;
+    E->trigrams = B->trigrams;
+    E->undo = B->undo;
+
+    // The editor owns the state now
+    B->filename = NULL;
+    B->filetype = NULL;
+    B->row = NULL;
+    B->num_rows = 0;
+    B->num_bytes = 0;
+
+    if (B->evicted) buffer_reload(E, B);
+    watch_start(E);
+
+    // What was written while the buffer was away comes in first
+    if (B->follow) watch_follow_start(E);
+}
+
+/**
+ * @brief Check if the rows of a buffer can be freed and read again from its file.
+ */
+static bool buffer_evictable(const FileBuffer *B) {
+    return !B->evicted && B->dirty == 0 && B->filename != NULL && access(B->filename, R_OK) == 0;
+}
+
+static void buffer_evict(FileBuffer *B) {
+    for (int i = 0; i < B->num_rows; i++) editor_free_row(&B->row[i]);
+    free(B->row);
+    B->row = NULL;
+    B->num_rows = 0;
+    B->num_bytes = 0;
+    bracket_index_free(&B->brackets);
+    trigram_index_free(&B->trigrams);
+
+    B->evicted = true;
+    B->bytes = 0;
+}
+
+/**
+ * @brief Evict the least recently used clean buffers until the rows fit in the budget.
+ * @note The current buffer is never evicted, nor are buffers with changes or shown in a window.
+ */
+static void buffer_enforce_budget(Editor *E) {
+    BufferList *L = &E->buffers;
+    size_t total = rows_bytes(E->row, E->num_rows);
+    for (int i = 0; i < L->num; i++) {
+        if (i != L->current && !L->list[i].evicted) total += L->list[i].bytes;
+    }
+
+    while (total > BUFFER_MEMORY_BUDGET) {
+        FileBuffer *victim = NULL;
+        for (int i = 0; i < L->num; i++) {
+            FileBuffer *B = &L->list[i];
+            if (i == L->current || !buffer_evictable(B) || window_shows_buffer(E, B->id)) continue;
+            if (victim == NULL || B->used < victim->used) victim = B;
+        }
+        if (victim == NULL) break;
+
+        total -= victim->bytes;
+        buffer_evict(victim);
+    }
+}
+
+/**
+ * @brief Make the buffer at index current, the one in the editor goes back to the list.
+ * @param report Show the name and size of the buffer
+ */
+static void buffer_switch(Editor *E, const int index, const bool report) {
+    BufferList *L = &E->buffers;
+    bool evicted = L->list[index].evicted;
+    bool follow = false;
+    if (index != L->current) {
+        buffer_stash(E);
+        buffer_restore(E, index);
+        buffer_enforce_budget(E);
+        follow = L->list[index].follow;
+        L->list[index].follow = false;
+    }
+
+    // A file which was followed and cannot be followed again is reported,
+    // reading an evicted buffer again reports on the file itself
+    if (follow && !E->watch.follow) {
+        editor_set_status_message(E, "Cannot follow %s again", E->filename);
+    } else if (report && !evicted) {
+        editor_set_status_message(E, "\"%s\" %d lines", E->filename ? E->filename : "[No Name]", E->num_rows);
+    }
+}
+
+void buffer_open(Editor *E, const char *filename) {
+    BufferList *L = &E->buffers;
+    buffer_list_start(E);
+
+    // A file is open in at most one buffer
+    for (int i = 0; i < L->num; i++) {
+        const char *name = (i == L->current) ? E->filename : L->list[i].filename;
+        if (name != NULL && strcmp(name, filename) == 0) {
+            buffer_switch(E, i, true);
+            return;
+        }
+    }
+
+    // Row arrays of large buffers are mapped on their own, so an evicted
+    // buffer gives its array back whole. Otherwise malloc raises the threshold
+    // after the first large free, and the arrays end up in the heap where the
+    // rows of other buffers keep the hole they leave from being reused.
+    if (L->num == 1) mallopt(M_MMAP_THRESHOLD, BUFFER_MMAP_THRESHOLD);
+
+    buffer_stash(E);
+    buffer_add(L);
+    L->current = L->num - 1;
+    editor_open_file(E, (char *) filename);
+    buffer_enforce_budget(E);
+}
+
+/**
+ * @brief Get the index of a buffer in the list, -1 if there is no such buffer.
+ */
+static int buffer_index(Editor *E, const int id) {
+    BufferList *L = &E->buffers;
+    buffer_list_start(E);
+
+    for (int i = 0; i < L->num; i++) {
+        if (L->list[i].id == id) return i;
+    }
+    return -1;
+}
+
+bool buffer_select(Editor *E, const int id) {
+    int index = buffer_index(E, id);
+    if (index == -1) return false;
+    buffer_switch(E, index, true);
+    return true;
+}
+
+bool buffer_activate(Editor *E, const int id) {
+    int index = buffer_index(E, id);
+    if (index == -1) return false;
+    buffer_switch(E, index, false);
+    return true;
+}
+
+int buffer_current_id(Editor *E) {
+    buffer_list_start(E);
+    return E->buffers.list[E->buffers.current].id;
+}
+
+FileBuffer *buffer_find(Editor *E, const int id) {
+    int index = buffer_index(E, id);
+    if (index == -1 || index == E->buffers.current) return NULL;
+    return &E->buffers.list[index];
+}
+
+void buffer_cycle(Editor *E, const int count) {
+    BufferList *L = &E->buffers;
+    buffer_list_start(E);
+
+    int index = (L->current + count) % L->num;
+    if (index < 0) index += L->num;
+    buffer_switch(E, index, true);
+}
+
+void buffer_list(Editor *E, char *buf, const int size) {
+    BufferList *L = &E->buffers;
+    buffer_list_start(E);
+
+    // Memory of the rows first, the list is cut off when it does not fit
+    size_t total = rows_bytes(E->row, E->num_rows);
+    int evicted = 0;
+    for (int i = 0; i < L->num; i++) {
+        if (i == L->current) continue;
+        if (L->list[i].evicted) evicted++;
+        else total += L->list[i].bytes;
+    }
+    int len = snprintf(buf, size, "%d buffers, %d evicted, %zuMB of %zuMB:",
+        L->num, evicted, total >> 20, BUFFER_MEMORY_BUDGET >> 20);
+
+    for (int i = 0; i < L->num && len < size; i++) {
+        const FileBuffer *B = &L->list[i];
+        bool current = (i == L->current);
+        const char *name = current ? E->filename : B->filename;
+        int dirty = current ? E->dirty : B->dirty;
+
+        len += snprintf(buf + len, size - len, "%s %d%s%s \"%s\"%s",
+            (i > 0) ? " |" : "", B->id, current ? " %" : "", dirty ? " +" : "",
+            name ? name : "[No Name]", B->evicted ? " (evicted)" : "");
+    }
+}
+
+void buffer_list_free(Editor *E) {
+    BufferList *L = &E->buffers;
+    for (int i = 0; i < L->num; i++) {
+        FileBuffer *B = &L->list[i];
+        if (i == L->current) continue;
+
+        for (int j = 0; j < B->num_rows; j++) editor_free_row(&B->row[j]);
+        free(B->row);
+        free(B->filename);
+        bracket_index_free(&B->brackets);
+        trigram_index_free(&B->trigrams);
+        undo_journal_free(&B->undo);
+    }
+    free(L->list);
+    memset(L, 0, sizeof(BufferList));
+}
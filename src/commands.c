@@ -0,0 +1,779 @@
+#include "commands.h"
+#include "actions.h"
+#include "buffers.h"
+#include "editor.h"
+#include "keymaps.h"
+#include "macros.h"
+#include "rows.h"
+#include "search_job.h"
+#include <ctype.h>
+#include <stdlib.h>
+#include <string.h>
+
+/**
+ * @brief Growable byte buffer, reused between rows so bulk edits allocate once per row.
+ */
+typedef struct {
+    char *b;
+    size_t len;
+    size_t cap;
+} Buffer;
+
+static void buffer_append(Buffer *B, const char *s, const size_t len) {
+    if (len == 0) return;
+    if (B->len + len > B->cap) {
+        while (B->len + len > B->cap) B->cap = B->cap ? B->cap * 2 : 256;
+        B->b = realloc(B->b, B->cap);
+        if (B->b == NULL) exit(1);
+    }
+    memcpy(B->b + B->len, s, len);
+    B->len += len;
+}
+
+static void skip_spaces(const char **s) {
+    while (**s == ' ' || **s == '\t') (*s)++;
+}
+
+/**
+ * @brief Parse a single address, e.g. "12", "." or "$-3".
+ * @return false if there is no address at s
+ */
+static bool parse_address(Editor *E, const char **s, int *line) {
+    const char *p = *s;
+    bool found = true;
+
+    if (*p == '.') {
+        *line = E->cur_y;
+        p++;
+    } else if (*p == '$') {
+        *line = E->num_rows - 1;
+        p++;
+    } else if (isdigit((unsigned char) *p)) {
+        *line = (int) strtol(p, (char **) &p, 10) - 1;
+    } else if (*p == '+' || *p == '-') {
+        // An offset on its own is relative to the cursor
+        *line = E->cur_y;
+    } else {
+        found = false;
+    }
+    if (!found) return false;
+
+    while (*p == '+' || *p == '-') {
+        int sign = (*p == '+') ? 1 : -1;
+        p++;
+        int n = isdigit((unsigned char) *p) ? (int) strtol(p, (char **) &p, 10) : 1;
+        *line += sign * n;
+    }
+
+    *s = p;
+    return true;
+}
+
+bool command_parse_range(Editor *E, const char **s, CommandRange *range, const char **error) {
+    range->start = range->end = E->cur_y;
+    skip_spaces(s);
+
+    if (**s == '%') {
+        (*s)++;
+        range->start = 0;
+        range->end = E->num_rows - 1;
+        return true;
+    }
+
+    if (!parse_address(E, s, &range->start)) return true;
+    range->end = range->start;
+
+    if (**s == ',') {
+        (*s)++;
+        if (!parse_address(E, s, &range->end)) {
+            *error = "Invalid range";
+            return false;
+        }
+    }
+
+    // Backwards ranges are swapped, like vim does after asking
+    if (range->start > range->end) {
+        int tmp = range->start;
+        range->start = range->end;
+        range->end = tmp;
+    }
+
+    if (range->start < 0 || range->end >= E->num_rows) {
+        *error = "Invalid range";
+        return false;
+    }
+    return true;
+}
+
+/**
+ * @brief Read a part of the substitute command up to an unescaped delimiter.
+ * @param s Start of the part (will be moved past the delimiter)
+ * @param delim Delimiter
+ * @param out Buffer the part is copied into, escaped delimiters lose their '\'
+ */
+static void substitute_part(const char **s, const char delim, Buffer *out) {
+    const char *p = *s;
+    while (*p != '\0' && *p != delim) {
+        if (p[0] == '\\' && p[1] == delim) {
+            p++;
+        } else if (p[0] == '\\' && p[1] != '\0') {
+            buffer_append(out, p++, 1);
+        }
+        buffer_append(out, p++, 1);
+    }
+    if (*p == delim) p++;
+    *s = p;
+}
+
+/**
+ * @brief Append the replacement for a match to the output.
+ */
+static void substitute_expand(Buffer *out, const Buffer *rep, const char *match, const size_t match_len) {
+    const char *r = rep->b;
+    const char *end = rep->b + rep->len;
+    while (r < end) {
+        // Copy the literal run up to the next special character in one go
+        const char *special = r;
+        while (special < end && *special != '&' && *special != '\\') special++;
+        if (special > r) buffer_append(out, r, special - r);
+        if (special == end) break;
+
+        if (*special == '&') {
+            buffer_append(out, match, match_len);
+            r = special + 1;
+        } else if (special + 1 < end) {
+            buffer_append(out, special + 1, 1);
+            r = special + 2;
+        } else {
+            r = special + 1;
+        }
+    }
+}
+
+/**
+ * @brief Build the substituted content of a row into out.
+ * @return Number of substitutions made in the row
+ */
+static long substitute_row(SearchPattern *P, const Buffer *rep, const erow *row, const bool global, Buffer *out) {
+    long count = 0;
+    size_t from = 0, copied = 0;
+    long last_end = -1;
+    out->len = 0;
+
+    while (from <= (size_t) row->size) {
+        size_t match_len;
+        long pos = search_find(P, row->chars, row->size, from, &match_len);
+        if (pos == -1) break;
+
+        // An empty match right after the previous match is not a new match
+        if (match_len == 0 && pos == last_end) {
+            from = (size_t) pos + 1;
+            continue;
+        }
+
+        buffer_append(out, row->chars + copied, (size_t) pos - copied);
+        substitute_expand(out, rep, row->chars + pos, match_len);
+        copied = (size_t) pos + match_len;
+        last_end = (long) copied;
+        count++;
+
+        if (!global) break;
+        from = (match_len == 0) ? (size_t) pos + 1 : copied;
+    }
+
+    if (count > 0) buffer_append(out, row->chars + copied, row->size - copied);
+    return count;
+}
+
+void command_substitute(Editor *E, const CommandRange *range, const char *args) {
+    if (*args == '\0') {
+        editor_set_status_message(E, "Usage: s/pattern/replacement/[g]");
+        return;
+    }
+
+    const char delim = *args++;
+    Buffer pattern = {0}, rep = {0}, out = {0};
+    substitute_part(&args, delim, &pattern);
+    substitute_part(&args, delim, &rep);
+
+    bool global = false;
+    for (; *args != '\0'; args++) {
+        if (*args == 'g') global = true;
+        else if (*args != ' ') {
+            editor_set_status_message(E, "Trailing characters: %s", args);
+            free(pattern.b);
+            free(rep.b);
+            return;
+        }
+    }
+
+    // Compile the pattern, an empty pattern is the last search
+    SearchPattern P = {0};
+    if (pattern.len == 0) {
+        if (E->search.pattern.source == NULL) {
+            editor_set_status_message(E, "No previous search pattern");
+            free(rep.b);
+            return;
+        }
+        search_pattern_copy(&P, &E->search.pattern);
+    } else {
+        const char *error = "Invalid pattern";
+        bool valid = search_pattern_compile(&P, pattern.b, pattern.len, &error);
+        free(pattern.b);
+        if (!valid) {
+            editor_set_status_message(E, "%s", error);
+            free(rep.b);
+            return;
+        }
+    }
+
+    long substitutions = 0;
+    int lines = 0, last_row = -1;
+    for (int y = range->start; y <= range->end && y < E->num_rows; y++) {
+        long count = substitute_row(&P, &rep, &E->row[y], global, &out);
+        if (count == 0) continue;
+
+        // One allocation per modified row, sized exactly for the new content. The
+        // rows are recorded in the undo step of the command, so one undo reverts them all.
+        char *chars = row_text_new((int) out.len);
+        memcpy(chars, out.b, out.len);
+        editor_set_row_chars(E, y, chars, (int) out.len);
+
+        substitutions += count;
+        lines++;
+        last_row = y;
+    }
+
+    if (substitutions == 0) {
+        editor_set_status_message(E, "Pattern not found: %s", P.source);
+    } else {
+        // Move to the first character of the last substituted row
+        E->cur_y = last_row;
+        E->cur_x = 0;
+        erow *row = &E->row[last_row];
+        while (E->cur_x < row->size && (row->chars[E->cur_x] == ' ' || row->chars[E->cur_x] == '\t')) E->cur_x++;
+
+        editor_set_status_message(E, "%ld substitution%s on %d line%s",
+            substitutions, substitutions == 1 ? "" : "s", lines, lines == 1 ? "" : "s");
+    }
+
+    // The pattern becomes the last search, so 'n' finds the next occurrence
+    search_job_cancel(E);
+    search_pattern_free(&E->search.pattern);
+    E->search.pattern = P;
+    E->search.generation++;
+    E->search.direction = 1;
+    E->search.match_y = -1;
+
+    free(rep.b);
+    free(out.b);
+}
+
+/**
+ * @brief Arguments of an ex command.
+ */
+typedef struct CommandArgs {
+    /**
+     * @brief Full name of the command, from the table.
+     */
+    const char *name;
+
+    /**
+     * @brief Rows given before the command, the cursor row if 'ranged' is false.
+     */
+    CommandRange range;
+    bool ranged;
+
+    /**
+     * @brief Text after the name, spaces skipped.
+     */
+    const char *args;
+} CommandArgs;
+
+/**
+ * @brief Entry of the table of ex commands.
+ */
+typedef struct ExCommand {
+    const char *name;
+
+    /**
+     * @brief Length of the shortest abbreviation, e.g. 1 for "d" of "delete".
+     */
+    int min;
+
+    void (*run)(Editor *E, const CommandArgs *A);
+
+    /**
+     * @brief Runs while a file is still loading, the other commands wait for all of its rows.
+     */
+    bool loading;
+} ExCommand;
+
+static void command_write(Editor *E, const CommandArgs *A) {
+    (void) A;
+    editor_save_file(E);
+}
+
+static void command_quit(Editor *E, const CommandArgs *A) {
+    (void) A;
+    action_quit(E);
+}
+
+static void command_write_quit(Editor *E, const CommandArgs *A) {
+    (void) A;
+    editor_save_file(E);
+    action_quit(E);
+}
+
+static void command_substitute_range(Editor *E, const CommandArgs *A) {
+    command_substitute(E, &A->range, A->args);
+}
+
+static void command_input_stats(Editor *E, const CommandArgs *A) {
+    (void) A;
+    char stats[80];
+    input_stats(E, stats, sizeof(stats));
+    editor_set_status_message(E, "%s", stats);
+}
+
+/**
+ * @brief Move to the first character of a row which is not a space.
+ */
+static void command_move_to_row(Editor *E, int y) {
+    if (y >= E->num_rows) y = E->num_rows - 1;
+    if (y < 0) y = 0;
+    E->cur_y = y;
+    E->cur_x = 0;
+    erow *row = &E->row[y];
+    while (E->cur_x < row->size && (row->chars[E->cur_x] == ' ' || row->chars[E->cur_x] == '\t')) E->cur_x++;
+}
+
+/**
+ * @brief Delete the rows of the range: "[range]d".
+ * @note The rows are yanked into the unnamed register first, then removed with
+ * a single move of the rows after them.
+ */
+static void command_delete(Editor *E, const CommandArgs *A) {
+    int count = A->range.end - A->range.start + 1;
+    register_yank_lines(E, A->range.start, count);
+    editor_delete_rows(E, A->range.start, count);
+    command_move_to_row(E, A->range.start);
+    if (count > 2) editor_set_status_message(E, "%d fewer lines", count);
+}
+
+/**
+ * @brief Move the rows of the range below an address: "[range]m {address}", 0 moves them to the top.
+ */
+static void command_move(Editor *E, const CommandArgs *A) {
+    const char *p = A->args;
+    int line;
+    if (*p == '0' && !isdigit((unsigned char) p[1])) {
+        line = -1;
+        p++;
+    } else if (!parse_address(E, &p, &line) || line < -1 || line >= E->num_rows) {
+        editor_set_status_message(E, "Invalid address");
+        return;
+    }
+
+    int start = A->range.start, end = A->range.end;
+    if (line >= start && line < end) {
+        editor_set_status_message(E, "Cannot move lines into themselves");
+        return;
+    }
+
+    // Rows after the range move up by the size of the range once it is taken out
+    int count = end - start + 1;
+    int to = (line > end) ? line - count + 1 : line + 1;
+    editor_move_rows(E, start, count, to);
+    command_move_to_row(E, to + count - 1);
+    if (count > 2) editor_set_status_message(E, "%d lines moved", count);
+}
+
+/**
+ * @brief Run normal mode keys on every row of the range: "[range]normal {keys}".
+ * @note Keys are written the way they are in a mapping, e.g. "A;<Esc>". Each
+ * row starts in normal mode at its first column, and an insert left open is
+ * closed. The whole command is a single undo step.
+ */
+static void command_normal(Editor *E, const CommandArgs *A) {
+    int max = (int) strlen(A->args);
+    int *keys = malloc(sizeof(int) * (max + 1));
+    if (keys == NULL) exit(1);
+    int len = keymap_parse(A->args, keys, max + 1);
+    if (len <= 0) {
+        editor_set_status_message(E, (len == 0) ? "Argument required" : "Invalid keys");
+        free(keys);
+        return;
+    }
+
+    undo_group_begin(E);
+    if (!A->ranged) {
+        macro_run(E, keys, len);
+        if (E->mode != NORMAL_MODE) editor_process_key_press(E, 27);
+    }
+
+    // Rows added or removed by the keys are taken to be at or after the row
+    // they ran on, so the rest of the range moves with them
+    int end = A->range.end;
+    for (int y = A->range.start; A->ranged && y <= end && y < E->num_rows;) {
+        int rows = E->num_rows;
+        E->cur_y = y;
+        E->cur_x = 0;
+        macro_run(E, keys, len);
+        if (E->mode != NORMAL_MODE) editor_process_key_press(E, 27);
+
+        int delta = E->num_rows - rows;
+        end += delta;
+        y += 1 + delta;
+    }
+    undo_group_end(E);
+    undo_seal(E);
+    free(keys);
+}
+
+/**
+ * @brief Clear the rows marked by :global.
+ */
+static void global_clear_marks(Editor *E) {
+    for (int y = 0; y < E->num_rows; y++) E->row[y].marked = false;
+}
+
+/**
+ * @brief Find the first row marked by :global at or after a row.
+ * @note Wraps to the top when no row after it is marked.
+ * @return The row, or -1 when no row is marked
+ */
+static int global_next_marked(Editor *E, int y) {
+    for (int i = y; i < E->num_rows; i++) {
+        if (E->row[i].marked) return i;
+    }
+    for (int i = 0; i < y && i < E->num_rows; i++) {
+        if (E->row[i].marked) return i;
+    }
+    return -1;
+}
+
+/**
+ * @brief Run a command on every row which matches a pattern: "[range]g/pattern/cmd".
+ * @note The range is the whole file by default, "g!" and "v" use the rows
+ * which do not match. The command defaults to counting the rows.
+ * @note "d" removes every matching row at once, other commands run one row at
+ * a time with the cursor on the row, as a single undo step. The matching rows
+ * are marked up front, so a command which moves or removes rows still runs on
+ * each of them once.
+ */
+static void command_global(Editor *E, const CommandArgs *A) {
+    static bool running = false;
+    if (running) {
+        editor_set_status_message(E, "Cannot use :global recursively");
+        return;
+    }
+
+    const char *p = A->args;
+    bool invert = (A->name[0] == 'v');
+    if (*p == '!') {
+        invert = true;
+        p++;
+    }
+    if (*p == '\0' || isalnum((unsigned char) *p) || *p == ' ') {
+        editor_set_status_message(E, "Usage: g/pattern/cmd");
+        return;
+    }
+
+    const char delim = *p++;
+    Buffer pattern = {0};
+    substitute_part(&p, delim, &pattern);
+    skip_spaces(&p);
+
+    SearchPattern P = {0};
+    if (pattern.len == 0) {
+        if (E->search.pattern.source == NULL) {
+            editor_set_status_message(E, "No previous search pattern");
+            return;
+        }
+        search_pattern_copy(&P, &E->search.pattern);
+    } else {
+        const char *error = "Invalid pattern";
+        bool valid = search_pattern_compile(&P, pattern.b, pattern.len, &error);
+        free(pattern.b);
+        if (!valid) {
+            editor_set_status_message(E, "%s", error);
+            return;
+        }
+    }
+
+    // Mark the rows first, so the command does not change which rows match.
+    // Rows outside the range are cleared, in case an earlier run left marks
+    int start = A->ranged ? A->range.start : 0;
+    int end = A->ranged ? A->range.end : E->num_rows - 1;
+    int count = 0;
+    for (int y = 0; y < E->num_rows; y++) {
+        erow *row = &E->row[y];
+        row->marked = false;
+        if (y < start || y > end) continue;
+        bool match = search_find(&P, row->chars, row->size, 0, NULL) != -1;
+        row->marked = (match != invert);
+        if (row->marked) count++;
+    }
+    search_pattern_free(&P);
+
+    if (count == 0) {
+        editor_set_status_message(E, "Pattern not found");
+    } else if (*p == '\0') {
+        global_clear_marks(E);
+        editor_set_status_message(E, "%d matching line%s", count, count == 1 ? "" : "s");
+    } else if (strcmp(p, "d") == 0 || strcmp(p, "delete") == 0) {
+        int *ys = malloc(sizeof(int) * count);
+        if (ys == NULL) exit(1);
+        for (int y = start, i = 0; i < count; y++) {
+            if (!E->row[y].marked) continue;
+            E->row[y].marked = false;
+            ys[i++] = y;
+        }
+        editor_delete_row_list(E, ys, count);
+        command_move_to_row(E, ys[0]);
+        if (count > 2) editor_set_status_message(E, "%d fewer lines", count);
+        free(ys);
+    } else {
+        // The next row is the first marked row after the one the command ran
+        // on, taking back the rows it removed, the search wraps to the top
+        // for marked rows the command moved above it
+        running = true;
+        undo_group_begin(E);
+        int y = start;
+        while ((y = global_next_marked(E, y)) != -1) {
+            int rows = E->num_rows;
+            E->row[y].marked = false;
+            E->cur_y = y;
+            E->cur_x = 0;
+            command_execute(E, p);
+            if (E->num_rows < rows) y -= rows - E->num_rows;
+            if (y < 0) y = 0;
+        }
+        undo_group_end(E);
+        undo_seal(E);
+        running = false;
+    }
+}
+
+/**
+ * @brief Map or unmap keys: "nmap {lhs} {rhs}", "vunmap {lhs}", and the same for 'i'.
+ * @note The lhs takes the action the rhs is mapped to in the same mode.
+ */
+static void command_map(Editor *E, const CommandArgs *A) {
+    EditorMode mode = NORMAL_MODE;
+    if (A->name[0] == 'v') mode = VISUAL_MODE;
+    if (A->name[0] == 'i') mode = INSERT_MODE;
+    bool unmap = strstr(A->name, "unmap") != NULL;
+
+    // The lhs and the rhs are split by the first space, there is no rhs when unmapping
+    const char *p = A->args;
+    const char *space = strchr(p, ' ');
+    size_t lhs_size = space ? (size_t) (space - p) : strlen(p);
+    char *lhs_keys = strndup(p, lhs_size);
+    if (lhs_keys == NULL) exit(1);
+    const char *rhs_keys = space ? space : "";
+    skip_spaces(&rhs_keys);
+
+    int lhs[KEY_STACK_SIZE], rhs[KEY_STACK_SIZE];
+    int lhs_len = keymap_parse(lhs_keys, lhs, KEY_STACK_SIZE);
+    int rhs_len = keymap_parse(rhs_keys, rhs, KEY_STACK_SIZE);
+    free(lhs_keys);
+
+    KeyTable *T = keymap_table(mode);
+    if (lhs_len <= 0 || (!unmap && rhs_len <= 0)) {
+        editor_set_status_message(E, "Invalid keys");
+    } else if (unmap) {
+        if (!keymap_unbind(T, lhs, lhs_len)) editor_set_status_message(E, "No such mapping");
+    } else if (!keymap_bind(T, lhs, lhs_len, rhs, rhs_len)) {
+        editor_set_status_message(E, "No action mapped to %s", rhs_keys);
+    }
+}
+
+/**
+ * @brief Set the keys of a macro: "let @a = keys", written the way they are in a mapping.
+ * @note Lets a script define the macros it replays, e.g. with "%norm @a".
+ */
+static void command_let(Editor *E, const CommandArgs *A) {
+    const char *p = A->args;
+    if (p[0] != '@' || p[1] == '\0') {
+        editor_set_status_message(E, "Usage: let @{reg} = {keys}");
+        return;
+    }
+    int name = (unsigned char) p[1];
+    p += 2;
+    skip_spaces(&p);
+    if (*p != '=') {
+        editor_set_status_message(E, "Usage: let @{reg} = {keys}");
+        return;
+    }
+    p++;
+    skip_spaces(&p);
+
+    int max = (int) strlen(p);
+    int *keys = malloc(sizeof(int) * (max + 1));
+    if (keys == NULL) exit(1);
+    int len = keymap_parse(p, keys, max + 1);
+    if (len < 0) {
+        editor_set_status_message(E, "Invalid keys");
+    } else if (!macro_set(E, name, keys, len)) {
+        editor_set_status_message(E, "Cannot set @%c", name);
+    }
+    free(keys);
+}
+
+/**
+ * @brief Open a file in a buffer: "e {file}", without a file it shows the current one.
+ */
+static void command_edit(Editor *E, const CommandArgs *A) {
+    if (A->args[0] == '\0') {
+        editor_set_status_message(E, "\"%s\" %d lines", E->filename ? E->filename : "[No Name]", E->num_rows);
+        return;
+    }
+    buffer_open(E, A->args);
+}
+
+/**
+ * @brief Go to a buffer by its number: "b {n}".
+ */
+static void command_buffer(Editor *E, const CommandArgs *A) {
+    char *end;
+    long id = strtol(A->args, &end, 10);
+    if (end == A->args || !buffer_select(E, (int) id)) {
+        editor_set_status_message(E, "No such buffer: %s", A->args);
+    }
+}
+
+/**
+ * @brief Go to the next or previous buffer: "bn [count]" and "bp [count]".
+ */
+static void command_buffer_cycle(Editor *E, const CommandArgs *A) {
+    int count = (A->args[0] != '\0') ? atoi(A->args) : 1;
+    if (count < 1) count = 1;
+    buffer_cycle(E, (A->name[1] == 'n') ? count : -count);
+}
+
+static void command_buffer_list(Editor *E, const CommandArgs *A) {
+    (void) A;
+    char list[256];
+    buffer_list(E, list, sizeof(list));
+    editor_set_status_message(E, "%s", list);
+}
+
+/**
+ * @brief Split the window: "sp [file]" and "vs [file]", the new window shows the file if there is one.
+ */
+static void command_split(Editor *E, const CommandArgs *A) {
+    if (!window_split(E, (A->name[0] == 'v') ? WINDOW_SPLIT_COLUMNS : WINDOW_SPLIT_ROWS)) {
+        editor_set_status_message(E, "Not enough room");
+        return;
+    }
+    if (A->args[0] != '\0') buffer_open(E, A->args);
+}
+
+static void command_close(Editor *E, const CommandArgs *A) {
+    (void) A;
+    if (!window_close(E)) editor_set_status_message(E, "Cannot close last window");
+}
+
+static void command_only(Editor *E, const CommandArgs *A) {
+    (void) A;
+    window_only(E);
+}
+
+/**
+ * @brief Follow the file as it grows, like "tail -f": "follow", again to stop.
+ */
+static void command_follow(Editor *E, const CommandArgs *A) {
+    (void) A;
+    if (E->watch.follow) {
+        watch_follow_stop(E);
+        editor_set_status_message(E, "Stopped following %s", E->filename);
+    } else if (!watch_follow_start(E)) {
+        editor_set_status_message(E, "Cannot follow %s", E->filename ? E->filename : "[No Name]");
+    } else if (E->watch.follow) {
+        editor_set_status_message(E, "Following %s", E->filename);
+    }
+}
+
+/**
+ * @brief Ex commands, an abbreviation matches the first command it is a prefix of.
+ */
+static const ExCommand ex_commands[] = {
+    {"delete", 1, command_delete},
+    {"global", 1, command_global},
+    {"move", 1, command_move},
+    {"normal", 4, command_normal},
+    {"quit", 1, command_quit, true},
+    {"substitute", 1, command_substitute_range},
+    {"vglobal", 1, command_global},
+    {"write", 1, command_write},
+    {"wq", 2, command_write_quit},
+    {"nmap", 4, command_map},
+    {"vmap", 4, command_map},
+    {"imap", 4, command_map},
+    {"nunmap", 6, command_map},
+    {"vunmap", 6, command_map},
+    {"iunmap", 6, command_map},
+    {"inputstats", 10, command_input_stats, true},
+    {"let", 3, command_let},
+    {"edit", 1, command_edit},
+    {"buffer", 1, command_buffer},
+    {"bnext", 2, command_buffer_cycle},
+    {"bprevious", 2, command_buffer_cycle},
+    {"ls", 2, command_buffer_list},
+    {"split", 2, command_split, true},
+    {"vsplit", 2, command_split, true},
+    {"close", 3, command_close, true},
+    {"only", 2, command_only, true},
+    {"follow", 3, command_follow},
+
+    {NULL, 0, NULL} // Null terminator: ALL COMMANDS MUST BE ABOVE THIS
+};
+
+void command_execute(Editor *E, const char *cmd) {
+    const char *error = NULL;
+    CommandArgs A = {0};
+
+    const char *p = cmd;
+    skip_spaces(&p);
+    const char *range_start = p;
+
+    // A range can end at the last row, so the whole file has to be in
+    if (*p != '\0' && !isalpha((unsigned char) *p)) load_job_finish(E);
+    if (!command_parse_range(E, &p, &A.range, &error)) {
+        editor_set_status_message(E, "%s", error);
+        return;
+    }
+    A.ranged = (p != range_start);
+    skip_spaces(&p);
+    if (*p == '\0') return;
+
+    // The name is made of letters, anything after it is an argument, e.g. "s/a/b/" or "m0"
+    size_t len = 0;
+    while (isalpha((unsigned char) p[len])) len++;
+
+    const ExCommand *C = NULL;
+    for (int i = 0; len > 0 && ex_commands[i].name != NULL; i++) {
+        const char *name = ex_commands[i].name;
+        if ((int) len < ex_commands[i].min || strncmp(name, p, len) != 0) continue;
+
+        // The full name of a command wins over an abbreviation of one above it
+        if (name[len] == '\0') {
+            C = &ex_commands[i];
+            break;
+        }
+        if (C == NULL) C = &ex_commands[i];
+    }
+    if (C == NULL) {
+        editor_set_status_message(E, "Not an editor command: %s", p);
+        return;
+    }
+
+    if (!C->loading) load_job_finish(E);
+
+    A.name = C->name;
+    A.args = p + len;
+    skip_spaces(&A.args);
+    C->run(E, &A);
+}
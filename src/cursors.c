@@ -0,0 +1,232 @@
+#include "cursors.h"
+#include "editor.h"
+#include "rows.h"
+#include <ncurses.h>
+#include <stdlib.h>
+#include <string.h>
+
+bool cursors_active(const Editor *E) {
+    return E->cursors.num > 0;
+}
+
+void cursors_add(Editor *E, const int x, const int y) {
+    CursorSet *S = &E->cursors;
+    if (S->num == S->cap) {
+        S->cap = S->cap ? S->cap * 2 : 64;
+        S->list = realloc(S->list, sizeof(Cursor) * S->cap);
+        if (S->list == NULL) exit(1);
+    }
+    S->list[S->num++] = (Cursor) {x, y};
+}
+
+void cursors_clear(Editor *E) {
+    free(E->cursors.list);
+    memset(&E->cursors, 0, sizeof(CursorSet));
+}
+
+static int cursor_compare(const void *a, const void *b) {
+    const Cursor *A = a, *B = b;
+    if (A->y != B->y) return (A->y < B->y) ? -1 : 1;
+    return (A->x > B->x) - (A->x < B->x);
+}
+
+void cursors_merge(Editor *E) {
+    CursorSet *S = &E->cursors;
+    qsort(S->list, S->num, sizeof(Cursor), cursor_compare);
+
+    int n = 0;
+    for (int i = 0; i < S->num; i++) {
+        Cursor C = S->list[i];
+        if (C.x == E->cur_x && C.y == E->cur_y) continue;
+        if (n > 0 && C.x == S->list[n - 1].x && C.y == S->list[n - 1].y) continue;
+        S->list[n++] = C;
+    }
+    S->num = n;
+    if (n == 0) cursors_clear(E);
+}
+
+void cursors_for_each(Editor *E, void (*action)(Editor *E)) {
+    CursorSet *S = &E->cursors;
+    int x = E->cur_x, y = E->cur_y;
+
+    for (int i = 0; i < S->num; i++) {
+        E->cur_x = S->list[i].x;
+        E->cur_y = S->list[i].y;
+        action(E);
+        S->list[i] = (Cursor) {E->cur_x, E->cur_y};
+    }
+
+    // The main cursor goes last, so the mode it leaves is the mode of the editor
+    E->cur_x = x;
+    E->cur_y = y;
+    action(E);
+    cursors_merge(E);
+}
+
+/**
+ * @brief Get every cursor in order, the main cursor included.
+ * @param main Index of the main cursor (will be updated)
+ * @return Cursors, owned by the caller
+ */
+static Cursor *cursors_gather(Editor *E, int *main) {
+    CursorSet *S = &E->cursors;
+    Cursor *all = malloc(sizeof(Cursor) * (S->num + 1));
+    if (all == NULL) exit(1);
+
+    // The extra cursors are sorted, the main cursor goes where it belongs
+    Cursor M = {E->cur_x, E->cur_y};
+    int lo = 0, hi = S->num;
+    while (lo < hi) {
+        int mid = (lo + hi) / 2;
+        if (cursor_compare(&S->list[mid], &M) < 0) lo = mid + 1;
+        else hi = mid;
+    }
+    memcpy(all, S->list, sizeof(Cursor) * lo);
+    all[lo] = M;
+    memcpy(&all[lo + 1], &S->list[lo], sizeof(Cursor) * (S->num - lo));
+
+    // Cursors past the end of their row are at its end
+    for (int i = 0; i <= S->num; i++) {
+        if (all[i].y >= E->num_rows) all[i].y = E->num_rows - 1;
+        if (all[i].x > E->row[all[i].y].size) all[i].x = E->row[all[i].y].size;
+    }
+    *main = lo;
+    return all;
+}
+
+/**
+ * @brief Put the cursors back in the set after an edit.
+ */
+static void cursors_scatter(Editor *E, const Cursor *all, const int main) {
+    CursorSet *S = &E->cursors;
+    for (int i = 0, k = 0; i <= S->num; i++) {
+        if (i == main) {
+            E->cur_x = all[i].x;
+            E->cur_y = all[i].y;
+        } else {
+            S->list[k++] = all[i];
+        }
+    }
+    cursors_merge(E);
+}
+
+void cursors_insert(Editor *E, const char *s, const int len) {
+    if (len <= 0) return;
+
+    int main;
+    Cursor *all = cursors_gather(E, &main);
+    int n = E->cursors.num + 1;
+
+    RowEdit *edits = malloc(sizeof(RowEdit) * n);
+    if (edits == NULL) exit(1);
+    for (int i = 0; i < n; i++) edits[i] = (RowEdit) {all[i].x, all[i].y, 0, s, len};
+    editor_splice_rows(E, edits, n);
+    free(edits);
+
+    // Every cursor moves past its text and the text inserted before it in the row
+    int shift = 0;
+    for (int i = 0; i < n; i++) {
+        if (i > 0 && all[i].y != all[i - 1].y) shift = 0;
+        shift += len;
+        all[i].x += shift;
+    }
+
+    cursors_scatter(E, all, main);
+    free(all);
+}
+
+void cursors_backspace(Editor *E) {
+    int main;
+    Cursor *all = cursors_gather(E, &main);
+    int n = E->cursors.num + 1;
+
+    // Characters before the cursors go in one batch
+    RowEdit *edits = malloc(sizeof(RowEdit) * n);
+    int *joins = malloc(sizeof(int) * n);
+    if (edits == NULL || joins == NULL) exit(1);
+    int count = 0, num_joins = 0;
+    for (int i = 0; i < n; i++) {
+        if (all[i].x > 0) edits[count++] = (RowEdit) {all[i].x - 1, all[i].y, 1, NULL, 0};
+        else if (all[i].y > 0) joins[num_joins++] = i;
+    }
+    editor_splice_rows(E, edits, count);
+    free(edits);
+
+    int shift = 0;
+    for (int i = 0; i < n; i++) {
+        if (i > 0 && all[i].y != all[i - 1].y) shift = 0;
+        if (all[i].x == 0) continue;
+        shift--;
+        all[i].x += shift;
+    }
+
+    // Cursors at the start of a row join it onto the row above, from the bottom
+    // up so the rows above do not move
+    for (int j = num_joins - 1; j >= 0; j--) {
+        int i = joins[j];
+        int y = all[i].y;
+        int prev = E->row[y - 1].size;
+        editor_join_rows(E, y - 1);
+
+        for (int k = i; k < n; k++) {
+            if (all[k].y == y) {
+                all[k].y--;
+                all[k].x += prev;
+            } else if (all[k].y > y) {
+                all[k].y--;
+            }
+        }
+    }
+    free(joins);
+
+    cursors_scatter(E, all, main);
+    free(all);
+}
+
+void cursors_add_column(Editor *E, int y0, int y1, const int col) {
+    if (y0 < 0) y0 = 0;
+    if (y1 >= y0) load_job_wait(E, y1);
+    if (y1 >= E->num_rows) y1 = E->num_rows - 1;
+    cursors_clear(E);
+
+    for (int y = y0; y <= y1; y++) {
+        const erow *row = &E->row[y];
+        int rx = 0, x = 0;
+        while (x < row->size) {
+            int w = (row->chars[x] == '\t') ? TAB_STOP - rx % TAB_STOP : 1;
+            if (rx + w > col) break;
+            rx += w;
+            x++;
+        }
+
+        if (y == y0) {
+            E->cur_x = x;
+            E->cur_y = y;
+        } else {
+            cursors_add(E, x, y);
+        }
+    }
+    cursors_merge(E);
+}
+
+void editor_draw_cursors(Editor *E) {
+    CursorSet *S = &E->cursors;
+    if (S->num == 0) return;
+
+    // Find the first cursor on screen
+    int view_height = E->view_rows;
+    int lo = 0, hi = S->num;
+    while (lo < hi) {
+        int mid = (lo + hi) / 2;
+        if (S->list[mid].y < E->view_start) lo = mid + 1;
+        else hi = mid;
+    }
+
+    for (int i = lo; i < S->num && S->list[i].y < E->view_start + view_height; i++) {
+        const Cursor *C = &S->list[i];
+        if (C->y >= E->num_rows) break;
+        erow *row = &E->row[C->y];
+        int x = (C->x > row->size) ? row->size : C->x;
+        window_highlight(E, C->y, editor_row_get_render_x(row, x), 1, A_REVERSE, 0);
+    }
+}
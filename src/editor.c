@@ -1,5 +1,6 @@
 #include "editor.h"
 #include "rows.h"
+#include "search_job.h"
 
 #include <errno.h>
 #include <stdlib.h>
@@ -10,52 +11,40 @@
 #include <sys/types.h>
 #include <ctype.h>
 #include <stdio.h>
-#include <fcntl.h>
+#include <sys/ioctl.h>
+#include <sys/stat.h>
 
 void editor_refresh(Editor *E) {
-    // Update size state
-    E->screen_rows = LINES;
-    E->screen_cols = COLS;
-
-    // Clear the screen before new render
-    wclear(stdscr);
-
-    // Update scroll values
-    editor_scroll(E);
-
-    // Calculate the height of the screen, based on the rows
-    int view_height = E->screen_rows - 2;
-
-    for (int y = 0; y < view_height; y++) {
-        int row_index = E->view_start + y;
-        if (row_index >= 0 && row_index < E->num_rows) {
-            editor_draw_row_num(E->cur_y - E->view_start,
-                row_index - E->view_start,
-                E->view_start);
-            editor_draw_row(&E->row[row_index], y);
-        } else {
-            mvwprintw(stdscr, y, 0, "~");
-        }
+    // A replay draws once it is over, not after every key, and there is no
+    // screen without a terminal
+    if (E->headless || macro_replaying(E)) return;
+
+    // Place the windows again when the terminal changed size
+    if (E->screen_rows != LINES || E->screen_cols != COLS) {
+        E->screen_rows = LINES;
+        E->screen_cols = COLS;
+        window_layout_resize(E);
     }
 
-    // Draw status bar and message bar
-    editor_draw_status_bar(E);
+    // The message bar belongs to the screen, the windows draw the lines which changed
     editor_draw_message(E);
+    wnoutrefresh(stdscr);
+    window_draw(E);
 
-    // Move the cursor to the proper position defined in the state
-    wmove(stdscr, E->cur_y - E->view_start, E->ren_x);
+    // Keys are not read with wgetch, which used to paint the screen as a side effect
+    doupdate();
+    input_painted(E);
 }
 
 void editor_scroll(Editor *E) {
-    // Prevent the cursor from being on the last blank character in NORMAL MODE
-    if (E->mode == NORMAL_MODE && E->cur_x == E->row[E->cur_y].size && E->cur_x > 0) E->cur_x--;
+    // Prevent the cursor from being on the last blank character in NORMAL and VISUAL MODE
+    if ((E->mode == NORMAL_MODE || visual_active(E)) && E->cur_x == E->row[E->cur_y].size && E->cur_x > 0) E->cur_x--;
 
     // Calculate render cursor position
     E->ren_x = 0;
     if (E->cur_y < E->num_rows) E->ren_x = editor_row_get_render_x(&E->row[E->cur_y], E->cur_x);
 
-    // Subtract status and message bars
-    int view_height = E->screen_rows - 2;
+    int view_height = E->view_rows;
 
     // Ensure the cursor is within view with offset
     if (E->cur_y < E->view_start + SCROLL_OFF) {
@@ -71,17 +60,27 @@ void editor_scroll(Editor *E) {
         E->view_start = E->num_rows - view_height;
         if (E->view_start < 0) E->view_start = 0;
     }
+
+    // Same for the columns, long rows scroll sideways instead of wrapping
+    int view_width = E->view_cols - NUM_COL_SIZE;
+    int col = E->ren_x - NUM_COL_SIZE;
+    if (col < E->col_start) E->col_start = col;
+    else if (view_width > 0 && col >= E->col_start + view_width) E->col_start = col - view_width + 1;
 }
 
-void editor_draw_status_bar(Editor *E) {
-    char *status_f = (char *)malloc((E->screen_cols + 1) * sizeof(char));
-    char status_l[160], status_r[40];
+void editor_draw_bracket_match(Editor *E) {
+    if (E->cur_y >= E->num_rows) return;
 
-    // Calculate bytes
-    int bytes = 0;
-    for (int i = 0; i < E->num_rows; i++) {
-        bytes += E->row[i].size;
-    }
+    int x, y;
+    if (!bracket_find_partner(E, E->cur_x, E->cur_y, &x, &y)) return;
+
+    // Nothing is drawn when the partner is not in the window
+    window_highlight(E, y, editor_row_get_render_x(&E->row[y], x), 1, A_REVERSE, 0);
+}
+
+void editor_draw_status_bar(Editor *E) {
+    char *status_f = (char *)malloc((E->view_cols + 1) * sizeof(char));
+    char status_l[160], status_r[80], search[40], load[24];
 
     char *mode;
     switch (E->mode) {
@@ -94,38 +93,57 @@ void editor_draw_status_bar(Editor *E) {
         case COMMAND_MODE:
             mode = "COMMAND";
             break;
+        case VISUAL_MODE:
+            mode = "VISUAL";
+            break;
+        case VISUAL_LINE_MODE:
+            mode = "V-LINE";
+            break;
+        case VISUAL_BLOCK_MODE:
+            mode = "V-BLOCK";
+            break;
     }
 
+    char recording[16] = "";
+    if (E->macros.recording) snprintf(recording, sizeof(recording), " recording @%c", E->macros.recording);
+
     int len_l = snprintf(status_l, sizeof(status_l),
-        " %.10s %.20s %s",
+        " %.10s%s %.20s %s",
         mode,
+        recording,
         E->filename ? E->filename : "[No Name]",
         E->dirty != 0 ? "- (modified)" : ""
         );
+    search_status(E, search, sizeof(search));
+    load_job_status(E, load, sizeof(load));
     int len_r = snprintf(status_r, sizeof(status_r),
-        "%s | %db | %d:%d ",
+        "%s%s%s%s | %zub | %d:%d ",
+        load,
+        E->watch.follow ? "follow | " : "",
+        search,
         E->filetype ? E->filetype : "no ft",
-        bytes,
+        E->num_bytes,
         E->cur_y + 1,
         E->ren_x + 1
         );
 
-    if (len_l > E->screen_cols) len_l = E->screen_cols;
-    strcpy(status_f, status_l);
+    if (len_l > E->view_cols) len_l = E->view_cols;
+    memcpy(status_f, status_l, len_l);
 
-    while (len_l < E->screen_cols) {
-        if (E->screen_cols - len_l == len_r) {
+    while (len_l < E->view_cols) {
+        if (E->view_cols - len_l == len_r) {
             strcpy(&status_f[len_l], status_r);
             break;
         } else {
             status_f[len_l++] = ' ';
         }
     }
-    status_f[E->screen_cols] = '\0';
+    status_f[E->view_cols] = '\0';
 
-    attron(COLOR_PAIR(1));
-    mvwprintw(stdscr, E->screen_rows - 2, 0, "%s", status_f);
-    attroff(COLOR_PAIR(1));
+    WINDOW *win = window_canvas(E);
+    wattron(win, COLOR_PAIR(1));
+    mvwprintw(win, E->view_rows, 0, "%s", status_f);
+    wattroff(win, COLOR_PAIR(1));
 
     free(status_f);
 }
@@ -155,6 +173,45 @@ void editor_set_status_message(Editor *E, char *fmt, ...) {
     free(message);
 }
 
+/**
+ * @brief Initialize the state of the editor which does not depend on the terminal.
+ */
+static void editor_init_state(Editor *E) {
+    E->row = NULL;
+    E->filename = NULL;
+    E->filetype = NULL;
+    E->disk_size = 0;
+    E->disk_mtime = (struct timespec) {0, 0};
+    E->message = NULL;
+    E->dirty = 0;
+    E->num_rows = 0;
+    E->num_bytes = 0;
+    E->cur_x = 0;
+    E->cur_y = 0;
+    E->view_start = 0;
+    E->col_start = 0;
+    E->mode = NORMAL_MODE;
+    E->repeat = 0;
+    E->stack_len = 0;
+    E->headless = false;
+    E->stdout_written = false;
+    memset(&E->visual, 0, sizeof(VisualState));
+    memset(E->reg, 0, sizeof(E->reg));
+    E->reg_name = 0;
+    memset(&E->macros, 0, sizeof(MacroState));
+    memset(&E->cursors, 0, sizeof(CursorSet));
+    memset(&E->input, 0, sizeof(InputState));
+    memset(&E->buffers, 0, sizeof(BufferList));
+    memset(&E->windows, 0, sizeof(WindowLayout));
+    memset(&E->load, 0, sizeof(LoadJob));
+    watch_init(&E->watch);
+    E->row_version = 0;
+    bracket_index_init(&E->brackets);
+    search_state_init(&E->search);
+    trigram_index_init(&E->trigrams);
+    undo_journal_init(&E->undo);
+}
+
 void init_editor(Editor *E) {
     // Initialize ncurses
     initscr();
@@ -163,35 +220,171 @@ void init_editor(Editor *E) {
     noecho();
     keypad(stdscr, TRUE);
 
-    E->row = NULL;
-    E->filename = NULL;
-    E->dirty = 0;
-    E->num_rows = 0;
-    E->cur_x = 0;
-    E->cur_y = 0;
-    E->view_start = 0;
+    editor_init_state(E);
     E->screen_rows = LINES;
     E->screen_cols = COLS;
-    E->mode = NORMAL_MODE;
+    window_layout_init(E);
 
     // Set esc to be handled instantly
     ESCDELAY = 0;
 
     init_pair(1, COLOR_BLACK, COLOR_WHITE);
     init_pair(2, COLOR_YELLOW, COLOR_BLACK);
+    init_pair(3, COLOR_BLACK, COLOR_YELLOW);
 
 
     // Set default colors
     assume_default_colors(COLOR_WHITE, COLOR_BLACK);
     use_default_colors();
+
+    // Keys are read on their own thread from now on
+    input_start(E);
+}
+
+void init_editor_headless(Editor *E) {
+    editor_init_state(E);
+    E->headless = true;
+    E->screen_rows = HEADLESS_ROWS;
+    E->screen_cols = HEADLESS_COLS;
+    E->view_rows = HEADLESS_ROWS - 2;
+    E->view_cols = HEADLESS_COLS;
 }
 
 void editor_destroy(Editor *E) {
-    endwin();
+    if (!E->headless) {
+        input_stop(E);
+        window_layout_free(E);
+        endwin();
+    }
+
+    // Stop the background workers before the rows go away
+    load_job_cancel(E);
+    watch_free(E);
+    search_job_destroy(E);
+    buffer_list_free(E);
+    search_state_free(&E->search);
+    trigram_index_free(&E->trigrams);
+    undo_journal_free(&E->undo);
+    for (int i = 0; i < REGISTER_COUNT; i++) register_free(&E->reg[i]);
+    macro_state_free(&E->macros);
+    cursors_clear(E);
 
     // TODO: Clear any memory allocated in the editor
 };
 
+/**
+ * @brief Add the lines in a block to the end of the rows, with a single insert.
+ * @return Number of bytes used, the rest is a line which is not complete
+ */
+static size_t editor_load_block(Editor *E, char *buf, const size_t len, const bool eof) {
+    char *s[LOAD_BATCH_ROWS];
+    int size[LOAD_BATCH_ROWS];
+    int count = 0;
+    size_t start = 0;
+    while (start < len) {
+        char *nl = memchr(buf + start, '\n', len - start);
+        if (nl == NULL && !eof) break;
+
+        size_t end = nl ? (size_t) (nl - buf) : len;
+        size_t next = nl ? end + 1 : len;
+
+        // Remove the \r from end of line
+        while (end > start && buf[end - 1] == '\r') end--;
+
+        s[count] = buf + start;
+        size[count] = (int) (end - start);
+        start = next;
+        if (++count == LOAD_BATCH_ROWS) {
+            editor_insert_rows(E, E->num_rows, count, s, size);
+            count = 0;
+        }
+    }
+    editor_insert_rows(E, E->num_rows, count, s, size);
+    return start;
+}
+
+/**
+ * @brief Read the lines of a stream into rows, after the rows already there.
+ * @return Hash of the content, see undo_log_hash, only computed with a terminal
+ * since it is only used to find the undo log
+ * @note The stream is read in blocks, and the lines of a block are added with
+ * a single insert, so the rows grow once per block instead of once per line.
+ * @note The file keeps at least one row, so an empty stream gives an empty row.
+ */
+static uint64_t editor_load_rows(Editor *E, FILE *fp) {
+    size_t cap = LOAD_BLOCK_SIZE, len = 0;
+    char *buf = malloc(cap);
+    if (buf == NULL) exit(1);
+
+    uint64_t hash = UNDO_LOG_HASH_INIT;
+    while (true) {
+        // A line longer than the block makes the block grow
+        if (len == cap) {
+            cap *= 2;
+            buf = realloc(buf, cap);
+            if (buf == NULL) exit(1);
+        }
+        size_t n = fread(buf + len, 1, cap - len, fp);
+        if (!E->headless) hash = undo_log_hash(hash, buf + len, n);
+        len += n;
+
+        bool eof = (n == 0);
+        size_t used = editor_load_block(E, buf, len, eof);
+        memmove(buf, buf + used, len - used);
+        len -= used;
+        if (eof) break;
+    }
+    free(buf);
+
+    if (E->num_rows == 0) editor_insert_row_below(E, 0, "", 0);
+    return hash;
+}
+
+/**
+ * @brief Remember the size and modification time of the file, after reading or writing it.
+ */
+static void editor_stat_file(Editor *E, const int fd) {
+    struct stat st;
+    bool found = (fd != -1) ? fstat(fd, &st) == 0 : stat(E->filename, &st) == 0;
+    E->disk_size = found ? st.st_size : 0;
+    E->disk_mtime = found ? st.st_mtim : (struct timespec) {0, 0};
+}
+
+bool editor_read_file(Editor *E, uint64_t *hash) {
+    FILE *fp = fopen(E->filename, "r");
+    if (fp == NULL) return false;
+    editor_stat_file(E, fileno(fp));
+
+    // Loading the file is not an edit
+    undo_suspend(E);
+    *hash = editor_load_rows(E, fp);
+    undo_resume(E);
+
+    // The file may have grown while it was read, the rows hold what was read
+    E->disk_size = ftello(fp);
+    fclose(fp);
+    return true;
+}
+
+/**
+ * @brief Read a large file in the background, once its first screen is in.
+ * @return false if the file is small or cannot be read that way, nothing was read
+ */
+static bool editor_stream_file(Editor *E) {
+    struct stat st;
+    if (stat(E->filename, &st) != 0 || st.st_size <= LOAD_BLOCK_SIZE) return false;
+
+    FILE *fp = fopen(E->filename, "r");
+    if (fp == NULL) return false;
+    editor_stat_file(E, fileno(fp));
+    if (!load_job_start(E, fp, st.st_size)) {
+        fclose(fp);
+        return false;
+    }
+    load_job_wait(E, E->screen_rows);
+    return true;
+}
+
 void editor_open_file(Editor *E, char *filename) {
     // Set the filename in the state
     free(E->filename);
@@ -199,36 +392,71 @@ void editor_open_file(Editor *E, char *filename) {
 
     // Detect and update the filetype
     editor_detect_file_type(E);
+    watch_start(E);
 
-    // Open the file
-    FILE *fp = fopen(filename, "r");
-    if (!fp) {
+    // The undo log is opened once the load is over, it needs the hash of the whole file
+    if (!E->headless && editor_stream_file(E)) return;
+
+    uint64_t hash;
+    if (!editor_read_file(E, &hash)) {
         // Append row to the first line to allow for typing, same as in main
+        undo_suspend(E);
         editor_insert_row_below(E, 0, "", 0);
+        undo_resume(E);
         editor_set_status_message(E, "%s does not exist, it will be created on save.", E->filename);
-        return;
+        hash = UNDO_LOG_HASH_INIT;
     }
+    if (!E->headless) undo_log_open(E, filename, hash);
+}
 
-    // Get the lines and add them to the editor
-    char *line = NULL;
-    size_t line_cap = 0;
-    size_t line_len;
-    while ((line_len = getline(&line, &line_cap, fp)) != -1) {
-        // Remove the \n or \r from end of line
-        while (line_len > 0 &&
-              (line[line_len - 1] == '\n' ||
-               line[line_len - 1] == '\r')) line_len--;
-
-        editor_insert_row_below(E, E->num_rows, line, line_len);
+void editor_open_stream(Editor *E, FILE *fp) {
+    undo_suspend(E);
+    editor_load_rows(E, fp);
+    undo_resume(E);
+}
+
+bool editor_write_stream(Editor *E, FILE *fp, uint64_t *hash) {
+    for (int i = 0; i < E->num_rows; i++) {
+        if (fwrite(E->row[i].chars, 1, E->row[i].size, fp) != (size_t) E->row[i].size) return false;
+        if (putc('\n', fp) == EOF) return false;
+        if (hash != NULL) *hash = undo_log_hash(undo_log_hash(*hash, E->row[i].chars, E->row[i].size), "\n", 1);
     }
+    return fflush(fp) == 0;
+}
 
+bool editor_write_file(Editor *E) {
+    FILE *fp = (E->filename != NULL) ? fopen(E->filename, "w") : stdout;
+    if (fp == NULL) {
+        editor_set_status_message(E, "Failed to save: %s", strerror(errno));
+        return false;
+    }
 
-    // Close the file and free memory
-    fclose(fp);
-    free(line);
+    bool written = editor_write_stream(E, fp, NULL);
+    if (fp != stdout && fclose(fp) != 0) written = false;
+    if (!written) {
+        editor_set_status_message(E, "Failed to save: %s", strerror(errno));
+        return false;
+    }
+    if (fp != stdout) {
+        editor_stat_file(E, -1);
+        watch_saved(E);
+    } else {
+        E->stdout_written = true;
+    }
+    undo_mark_saved(E);
+    return true;
 }
 
 void editor_save_file(Editor *E) {
+    // Without a terminal there is nobody to ask for a name
+    if (E->headless) {
+        editor_write_file(E);
+        return;
+    }
+
+    // The rest of the file has to be in before it is written
+    load_job_finish(E);
+
     if (E->filename == NULL) {
         char *filename = editor_prompt(E, "Enter a filename: %s", NULL);
         if (filename == NULL) {
@@ -241,28 +469,27 @@ void editor_save_file(Editor *E) {
     // Detect and update the filetype
     editor_detect_file_type(E);
 
-    // Convert the content to a string
-    int len;
-    char *buf = editor_content_to_string(E, &len);
-
-    int fd = open(E->filename, O_RDWR | O_CREAT, 0644);
-    if (fd != -1) {
-        // Truncate file to the content size, the bytes will be written over, but
-        // excess bytes will not, so we remove them here.
-        if (ftruncate(fd, len) != 1) {
-            if (write(fd, buf, len) == len) {
-                close(fd);
-                free(buf);
-                editor_set_status_message(E, "%d bytes written to %s", len, E->filename);
-                E->dirty = 0;
-                return;
-            }
-        }
+    // The rows are streamed to the file, and hashed on the way for the undo log
+    FILE *fp = fopen(E->filename, "w");
+    if (fp == NULL) {
+        editor_set_status_message(E, "Failed to save: %s", strerror(errno));
+        return;
     }
 
-    // Catch error and free buffer
-    free(buf);
-    editor_set_status_message(E, "Failed to save: %s", strerror(errno));
+    uint64_t hash = UNDO_LOG_HASH_INIT;
+    bool written = editor_write_stream(E, fp, &hash);
+    off_t len = ftello(fp);
+    if (written) editor_stat_file(E, fileno(fp));
+    if (fclose(fp) != 0) written = false;
+    if (!written) {
+        editor_set_status_message(E, "Failed to save: %s", strerror(errno));
+        return;
+    }
+
+    watch_saved(E);
+    editor_set_status_message(E, "%lld bytes written to %s", (long long) len, E->filename);
+    undo_mark_saved(E);
+    undo_log_save(E, hash);
 }
 
 void editor_detect_file_type(Editor *E) {
@@ -272,30 +499,42 @@ void editor_detect_file_type(Editor *E) {
     // Unknown filetype: missing .ext
     if (dot == NULL) return;
     E->filetype = ++dot;
+
+    // Brackets inside strings and comments depend on the filetype
+    bracket_index_set_file_type(E);
+}
+
+bool editor_has_background_work(Editor *E) {
+    return search_job_running(E) || load_job_running(E);
 }
 
-char *editor_content_to_string(Editor *E, int *buf_len) {
-    // Compute total length and update passed value
-    int tot_len = 0;
-    for (int i = 0; i < E->num_rows; i++)
-        tot_len += E->row[i].size + 1;
-    *buf_len = tot_len;
+int editor_read_key(Editor *E) {
+    int c;
+    if (macro_read_key(E, &c)) return c;
 
-    // Generate the final string
-    char *buf = malloc(tot_len);
-    char *p = buf;
-    for (int i = 0; i < E->num_rows; i++) {
-        memcpy(p, E->row[i].chars, E->row[i].size);
-        p += E->row[i].size;
-        *p = '\n';
-        p++;
-    }
+    // Without a terminal there are no keys, a prompt reading one is cancelled
+    if (E->headless) return 27;
 
-    return buf;
+    for (bool woken = false;; woken = true) {
+        // Rows loaded in the background, and changes to the watched file,
+        // come in between keys
+        load_job_poll(E);
+        watch_poll(E);
+
+        // What woke the loop up is drawn before it waits again
+        if (woken) editor_refresh(E);
+
+        // Poll while work is running in the background, so its progress is drawn
+        if (input_read(E, editor_has_background_work(E) ? BACKGROUND_POLL_MS : -1, &c)) {
+            if (c != KEY_RESIZE) return c;
+
+            struct winsize ws;
+            if (ioctl(STDOUT_FILENO, TIOCGWINSZ, &ws) == 0) resizeterm(ws.ws_row, ws.ws_col);
+        }
+    }
 }
 
-char *editor_prompt(Editor *E, char *prompt, void (*callback)(char *, int)) {
-    // TODO: Callback is ignored, implement it for searching
+char *editor_prompt(Editor *E, char *prompt, void (*callback)(Editor *, char *, int)) {
     // Create input buffer
     size_t buf_size = 128;
     char *buf = malloc(buf_size);
@@ -311,19 +550,25 @@ char *editor_prompt(Editor *E, char *prompt, void (*callback)(char *, int)) {
         editor_set_status_message(E, prompt, buf);
         editor_refresh(E);
 
-        int c = wgetch(stdscr);
+        // Keys of the prompt are part of a macro being recorded, they never
+        // reach editor_process_key_press
+        int c = editor_read_key(E);
+        macro_record_key(E, c);
         if (c == KEY_BACKSPACE) {
             if (buf_len > 0) buf[--buf_len] = '\0';
         } else if (c == '\n' || c == KEY_ENTER || c == '\r') {
             editor_set_status_message(E, "");
+            if (callback) callback(E, buf, c);
             ESCDELAY = delay;
             return buf;
         // Catch ESC: There doesn't seem to be an escape key
         } else if (c == 27 || c == '\x1b') {
             editor_set_status_message(E, "");
+            if (callback) callback(E, buf, 27);
             ESCDELAY = delay;
+            free(buf);
             return NULL;
-        } else if (!iscntrl(c) && c > 26) {
+        } else if (!iscntrl(c) && c > 26 && c < KEY_MIN) {
             if (buf_len == buf_size - 1) {
                 buf_size *= 2;
                 buf = realloc(buf, buf_size);
@@ -332,5 +577,7 @@ char *editor_prompt(Editor *E, char *prompt, void (*callback)(char *, int)) {
             buf[buf_len++] = (char) c;
             buf[buf_len] = '\0';
         }
+
+        if (callback) callback(E, buf, c);
     }
 }
\ No newline at end of file
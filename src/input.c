@@ -0,0 +1,280 @@
+#include "input.h"
+#include "editor.h"
+#include <errno.h>
+#include <fcntl.h>
+#include <ncurses.h>
+#include <poll.h>
+#include <signal.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+/**
+ * @brief Pipe the SIGWINCH handler writes to, the handler has no other way to reach the reader.
+ */
+static int signal_fd = -1;
+static volatile sig_atomic_t resized = 0;
+
+static void input_on_resize(int sig) {
+    (void) sig;
+    int saved = errno;
+    resized = 1;
+    if (signal_fd != -1 && write(signal_fd, "r", 1) < 0) {
+        // The pipe is full, the reader wakes up anyway
+    }
+    errno = saved;
+}
+
+static uint64_t input_now(void) {
+    struct timespec t;
+    clock_gettime(CLOCK_MONOTONIC, &t);
+    return (uint64_t) t.tv_sec * 1000000000ull + (uint64_t) t.tv_nsec;
+}
+
+static void drain(const int fd) {
+    char buf[64];
+    while (read(fd, buf, sizeof(buf)) > 0);
+}
+
+/**
+ * @brief Add a key to the ring, waiting for room if the main thread is behind.
+ * @note Only called by the reader thread.
+ */
+static void input_push(InputState *I, const int key) {
+    unsigned long tail = I->tail;
+    while (tail - __atomic_load_n(&I->head, __ATOMIC_ACQUIRE) == INPUT_RING_SIZE) {
+        if (__atomic_load_n(&I->stop, __ATOMIC_RELAXED)) return;
+        usleep(1000);
+    }
+    I->ring[tail & (INPUT_RING_SIZE - 1)] = (InputKey) {key, input_now()};
+    __atomic_store_n(&I->tail, tail + 1, __ATOMIC_RELEASE);
+}
+
+/**
+ * @brief Get the key of an escape sequence, e.g. ESC [ A for the up arrow.
+ * @param s Bytes after the ESC
+ * @param n Number of bytes
+ * @param used Number of bytes of the sequence (will be updated), 0 if it is not complete
+ * @return Key, -1 if the sequence is not a known key
+ */
+static int decode_escape(const unsigned char *s, const int n, int *used) {
+    *used = 0;
+    if (n < 2 || (s[0] != '[' && s[0] != 'O')) return -1;
+
+    // Parameters, then the final byte
+    int i = 1, param = 0;
+    while (i < n && s[i] >= '0' && s[i] <= ';') {
+        if (s[i] >= '0' && s[i] <= '9') param = param * 10 + (s[i] - '0');
+        i++;
+    }
+    if (i == n) return -1;
+    *used = i + 1;
+
+    switch (s[i]) {
+        case 'A': return KEY_UP;
+        case 'B': return KEY_DOWN;
+        case 'C': return KEY_RIGHT;
+        case 'D': return KEY_LEFT;
+        case 'H': return KEY_HOME;
+        case 'F': return KEY_END;
+        case '~':
+            switch (param) {
+                case 1: case 7: return KEY_HOME;
+                case 2: return KEY_IC;
+                case 3: return KEY_DC;
+                case 4: case 8: return KEY_END;
+                case 5: return KEY_PPAGE;
+                case 6: return KEY_NPAGE;
+            }
+            break;
+    }
+    return -1;
+}
+
+/**
+ * @brief Decode the bytes read from the terminal into keys.
+ * @return Number of bytes used, the rest is the start of an escape sequence
+ * @note An ESC at the end of the bytes is kept as well, the rest of its
+ * sequence may still be on the way.
+ */
+static int input_decode(InputState *I, const unsigned char *buf, const int n) {
+    int i = 0;
+    while (i < n) {
+        unsigned char c = buf[i];
+        if (c == 27 && i + 1 == n) return i;
+        if (c == 27 && (buf[i + 1] == '[' || buf[i + 1] == 'O')) {
+            int used;
+            int key = decode_escape(buf + i + 1, n - i - 1, &used);
+            if (used == 0) return i;
+
+            // ESC then 'O' typed quickly, e.g. to open a line, is not a key of the terminal
+            if (key == -1 && buf[i + 1] == 'O') {
+                input_push(I, c);
+                i++;
+                continue;
+            }
+            if (key != -1) input_push(I, key);
+            i += 1 + used;
+            continue;
+        }
+
+        // An ESC followed by another key is the key itself
+        input_push(I, (c == 127) ? KEY_BACKSPACE : c);
+        i++;
+    }
+    return n;
+}
+
+static void *input_reader(void *arg) {
+    InputState *I = arg;
+    unsigned char buf[512];
+    int len = 0;
+
+    struct pollfd fds[2] = {
+        {STDIN_FILENO, POLLIN, 0},
+        {I->signal[0], POLLIN, 0}
+    };
+    while (!__atomic_load_n(&I->stop, __ATOMIC_ACQUIRE)) {
+        // An escape sequence cut in half is completed by bytes on their way,
+        // e.g. over a slow connection
+        int r = poll(fds, 2, (len > 0) ? INPUT_ESCAPE_MS : -1);
+        if (r < 0) {
+            if (errno == EINTR) continue;
+            break;
+        }
+
+        if (fds[1].revents & POLLIN) {
+            drain(I->signal[0]);
+            if (resized) {
+                resized = 0;
+                input_push(I, KEY_RESIZE);
+            }
+        }
+
+        if (fds[0].revents & POLLIN) {
+            ssize_t r = read(STDIN_FILENO, buf + len, sizeof(buf) - len);
+            if (r == 0 || (r < 0 && errno != EINTR && errno != EAGAIN)) break;
+            if (r > 0) len += (int) r;
+        } else if (r == 0 && len > 0) {
+            // Nothing followed in time, the bytes are keys of their own
+            for (int i = 0; i < len; i++) input_push(I, buf[i]);
+            len = 0;
+        }
+
+        int used = input_decode(I, buf, len);
+        memmove(buf, buf + used, len - used);
+        len -= used;
+
+        if (write(I->wake[1], "k", 1) < 0) {
+            // The pipe is full, the main thread is awake already
+        }
+    }
+    return NULL;
+}
+
+/**
+ * @brief Open a pipe with both ends non-blocking.
+ */
+static bool open_pipe(int fds[2]) {
+    if (pipe(fds) != 0) return false;
+    fcntl(fds[0], F_SETFL, O_NONBLOCK);
+    fcntl(fds[1], F_SETFL, O_NONBLOCK);
+    return true;
+}
+
+void input_start(Editor *E) {
+    InputState *I = &E->input;
+    memset(I, 0, sizeof(InputState));
+    I->notify = -1;
+    if (!open_pipe(I->wake) || !open_pipe(I->signal)) {
+        perror("pipe");
+        exit(1);
+    }
+
+    signal_fd = I->signal[1];
+    struct sigaction sa;
+    memset(&sa, 0, sizeof(sa));
+    sa.sa_handler = input_on_resize;
+    sa.sa_flags = SA_RESTART;
+    sigemptyset(&sa.sa_mask);
+    sigaction(SIGWINCH, &sa, NULL);
+
+    if (pthread_create(&I->thread, NULL, input_reader, I) != 0) {
+        perror("pthread_create");
+        exit(1);
+    }
+    I->running = true;
+}
+
+void input_stop(Editor *E) {
+    InputState *I = &E->input;
+    if (!I->running) return;
+
+    __atomic_store_n(&I->stop, true, __ATOMIC_RELEASE);
+    if (write(I->signal[1], "s", 1) < 0) {
+        // The pipe is full, the reader wakes up anyway
+    }
+    pthread_join(I->thread, NULL);
+    I->running = false;
+
+    signal(SIGWINCH, SIG_DFL);
+    signal_fd = -1;
+    for (int i = 0; i < 2; i++) {
+        close(I->wake[i]);
+        close(I->signal[i]);
+    }
+}
+
+bool input_pending(Editor *E) {
+    InputState *I = &E->input;
+    return I->head != __atomic_load_n(&I->tail, __ATOMIC_ACQUIRE);
+}
+
+bool input_read(Editor *E, const int timeout_ms, int *c) {
+    InputState *I = &E->input;
+    while (true) {
+        unsigned long tail = __atomic_load_n(&I->tail, __ATOMIC_ACQUIRE);
+        if (I->head != tail) {
+            int depth = (int) (tail - I->head);
+            if (depth > I->stats.max_depth) I->stats.max_depth = depth;
+
+            InputKey K = I->ring[I->head & (INPUT_RING_SIZE - 1)];
+            __atomic_store_n(&I->head, I->head + 1, __ATOMIC_RELEASE);
+
+            I->stats.keys++;
+            if (I->unpainted_ns == 0) I->unpainted_ns = K.time_ns;
+            *c = K.key;
+            return true;
+        }
+        if (!I->running) return false;
+
+        // Sleep until the reader adds keys, the ring is checked again first
+        // since keys may have been added before the pipe was written to
+        struct pollfd fds[2] = {{I->wake[0], POLLIN, 0}, {I->notify, POLLIN, 0}};
+        int r = poll(fds, (I->notify >= 0) ? 2 : 1, timeout_ms);
+        if (r < 0 && errno == EINTR) continue;
+        if (r <= 0 || !(fds[0].revents & POLLIN)) return false;
+        drain(I->wake[0]);
+    }
+}
+
+void input_painted(Editor *E) {
+    InputState *I = &E->input;
+    if (I->unpainted_ns == 0) return;
+
+    uint64_t latency = input_now() - I->unpainted_ns;
+    I->unpainted_ns = 0;
+    I->stats.paints++;
+    I->stats.latency_ns += latency;
+    if (latency > I->stats.max_latency_ns) I->stats.max_latency_ns = latency;
+}
+
+void input_stats(Editor *E, char *buf, const int size) {
+    const InputStats *S = &E->input.stats;
+    unsigned long tail = __atomic_load_n(&E->input.tail, __ATOMIC_ACQUIRE);
+    double avg = S->paints ? (double) S->latency_ns / S->paints / 1e6 : 0;
+    snprintf(buf, size, "%lu keys | queue %lu, max %d | key to paint %.2fms, max %.2fms",
+        S->keys, tail - E->input.head, S->max_depth, avg, (double) S->max_latency_ns / 1e6);
+}
@@ -3,57 +3,352 @@
 #include "actions.h"
 #include <ncurses.h>
 #include <ctype.h>
+#include <stdlib.h>
 #include <string.h>
+#include <strings.h>
 
 KeyMap normal_mode_keymaps[] = {
-    {'i', action_insert_mode},
-    {'I', action_insert_mode_start},
-    {'a', action_insert_mode_append},
-    {'A', action_insert_mode_append_end},
+    {'i', action_insert_mode, CURSORS_EACH},
+    {'I', action_insert_mode_start, CURSORS_EACH},
+    {'a', action_insert_mode_append, CURSORS_EACH},
+    {'A', action_insert_mode_append_end, CURSORS_EACH},
     {'o', action_insert_mode_below},
     {'O', action_insert_mode_above},
-    {'w', action_move_next_word_start}, // TODO: differentiate W and w
-    {'b', action_move_prev_word_start}, // TODO: differentiate B and b
-    {'e', action_move_curr_word_end},   // TODO: differentiate E and e
+    {'w', action_move_next_word_start, CURSORS_EACH},
+    {'W', action_move_next_big_word_start, CURSORS_EACH},
+    {'b', action_move_prev_word_start, CURSORS_EACH},
+    {'B', action_move_prev_big_word_start, CURSORS_EACH},
+    {'e', action_move_curr_word_end, CURSORS_EACH},
+    {'E', action_move_curr_big_word_end, CURSORS_EACH},
+    {'0', action_move_start_line, CURSORS_EACH},
+    {'$', action_move_end_line, CURSORS_EACH},
+    {'_', action_move_first_char, CURSORS_EACH},
+    {'%', action_move_matching_bracket, CURSORS_EACH},
+    {'G', action_move_last_line},
+    {'h', action_move_left, CURSORS_EACH},
+    {'j', action_move_down, CURSORS_EACH},
+    {'k', action_move_up, CURSORS_EACH},
+    {'l', action_move_right, CURSORS_EACH},
+    {'x', action_delete_char},
+    {'Y', action_yank_line},
+    {'p', action_put_after},
+    {'P', action_put_before},
+    {'u', action_undo},
+    {18, action_redo}, // Ctrl-R
+    // {3, action_quit},  // Ctrl-C
+    // {17, action_quit}, // Ctrl-Q
+    {19, action_save}, // Ctrl-S
+    {KEY_ENTER, action_move_down, CURSORS_EACH}, // Enter
+    {'\r', action_move_down, CURSORS_EACH},      // Enter
+    {'\n', action_move_down, CURSORS_EACH},      // Enter
+    {KEY_BACKSPACE, action_move_left, CURSORS_EACH},
+    {8, action_move_left, CURSORS_EACH},      // BACKSPACE
+    {':', action_command_mode},
+    {'/', action_search},
+    {'n', action_search_next},
+    {'N', action_search_prev},
+    {27, action_cursors_clear},    // ESC
+    {'v', action_visual_mode},
+    {'V', action_visual_line_mode},
+    {22, action_visual_block_mode}, // Ctrl-V
+
+    {0, NULL} // Null terminator: ALL MAPS MUST BE ABOVE THIS
+};
+
+KeySequence normal_mode_sequences[] = {
+    {"dd", action_delete_line},
+    {"dw", action_delete_next_word_start},
+    {"dW", action_delete_next_big_word_start},
+    {"db", action_delete_prev_word_start},
+    {"dB", action_delete_prev_big_word_start},
+    {"de", action_delete_curr_word_end},
+    {"dE", action_delete_curr_big_word_end},
+    {"gg", action_move_first_line},
+    {"yy", action_yank_line},
+    {"\x17" "w", action_window_next},    // Ctrl-W w
+    {"\x17" "\x17", action_window_next}, // Ctrl-W Ctrl-W
+    {"\x17" "s", action_window_split},
+    {"\x17" "v", action_window_vsplit},
+    {"\x17" "c", action_window_close},
+    {"\x17" "o", action_window_only},
+
+    {NULL, NULL} // Null terminator: ALL SEQUENCES MUST BE ABOVE THIS
+};
+
+KeyMap visual_mode_keymaps[] = {
+    {'\x1b', action_visual_exit}, // ESC
+    {'w', action_move_next_word_start},
+    {'W', action_move_next_big_word_start},
+    {'b', action_move_prev_word_start},
+    {'B', action_move_prev_big_word_start},
+    {'e', action_move_curr_word_end},
+    {'E', action_move_curr_big_word_end},
     {'0', action_move_start_line},
     {'$', action_move_end_line},
     {'_', action_move_first_char},
+    {'%', action_move_matching_bracket},
+    {'G', action_move_last_line},
     {'h', action_move_left},
     {'j', action_move_down},
     {'k', action_move_up},
     {'l', action_move_right},
-    {'x', action_delete_char},
-    // {3, action_quit},  // Ctrl-C
-    // {17, action_quit}, // Ctrl-Q
-    {19, action_save}, // Ctrl-S
-    {KEY_ENTER, action_move_down}, // Enter
-    {'\r', action_move_down},      // Enter
-    {'\n', action_move_down},      // Enter
-    {KEY_BACKSPACE, action_move_left},
-    {8, action_move_left},      // BACKSPACE
-    {':', action_command_mode},
+    {KEY_LEFT, action_move_left},
+    {KEY_RIGHT, action_move_right},
+    {KEY_UP, action_move_up},
+    {KEY_DOWN, action_move_down},
+    {'n', action_search_next},
+    {'N', action_search_prev},
+    {'o', action_visual_swap},
+    {'d', action_visual_delete},
+    {'x', action_visual_delete},
+    {'y', action_visual_yank},
+    {'>', action_visual_indent},
+    {'<', action_visual_unindent},
+    {'M', action_visual_cursors},
+    {'I', action_visual_block_insert},
+    {'A', action_visual_block_append},
+    {'v', action_visual_mode},
+    {'V', action_visual_line_mode},
+    {22, action_visual_block_mode}, // Ctrl-V
 
     {0, NULL} // Null terminator: ALL MAPS MUST BE ABOVE THIS
 };
 
+KeySequence visual_mode_sequences[] = {
+    {"gg", action_move_first_line},
+
+    {NULL, NULL} // Null terminator: ALL SEQUENCES MUST BE ABOVE THIS
+};
+
 KeyMap insert_mode_keymaps[] = {
-    {'\x1b', action_normal_mode},  // ESC
-    {27, action_normal_mode},      // ESC
-    {KEY_BACKSPACE, action_backspace},
-    {8, action_backspace},      // BACKSPACE
+    {'\x1b', action_normal_mode, CURSORS_EACH},  // ESC
+    {27, action_normal_mode, CURSORS_EACH},      // ESC
+    {KEY_BACKSPACE, action_backspace, CURSORS_ALL},
+    {8, action_backspace, CURSORS_ALL},      // BACKSPACE
     {KEY_ENTER, action_enter},  // Enter
     {'\r', action_enter},       // Enter
     {'\n', action_enter},       // Enter
     {23, action_delete_last_word}, // Ctrl-W
-    {KEY_LEFT, action_move_left},
-    {KEY_RIGHT, action_move_right},
-    {KEY_UP, action_move_up},
-    {KEY_DOWN, action_move_down},
+    {KEY_LEFT, action_move_left, CURSORS_EACH},
+    {KEY_RIGHT, action_move_right, CURSORS_EACH},
+    {KEY_UP, action_move_up, CURSORS_EACH},
+    {KEY_DOWN, action_move_down, CURSORS_EACH},
 
     {0, NULL} // Null terminator: ALL MAPS MUST BE ABOVE THIS
 };
 
+static KeyTable normal_table, visual_table, insert_table;
+
+/**
+ * @brief Find the node of a sequence in the trie, NULL if there is none.
+ */
+static KeyNode *find_node(KeyTable *T, const int *keys, const int len) {
+    KeyNode *node = &T->sequences;
+    for (int i = 0; i < len && node != NULL; i++) {
+        if (keys[i] <= 0 || keys[i] >= KEY_SEQUENCE_KEYS) return NULL;
+        node = node->next[keys[i]];
+    }
+    return node;
+}
+
+/**
+ * @brief Map a sequence to an action, adding the nodes it needs to the trie.
+ * @return false if the keys cannot be a sequence
+ */
+static bool bind_sequence(KeyTable *T, const int *keys, const int len, void (*action)(Editor *E)) {
+    if (len > KEY_STACK_SIZE) return false;
+
+    KeyNode *node = &T->sequences;
+    for (int i = 0; i < len; i++) {
+        if (keys[i] <= 0 || keys[i] >= KEY_SEQUENCE_KEYS) return false;
+        if (node->next[keys[i]] == NULL) {
+            node->next[keys[i]] = calloc(1, sizeof(KeyNode));
+            if (node->next[keys[i]] == NULL) exit(1);
+        }
+        node = node->next[keys[i]];
+    }
+    node->action = action;
+    return true;
+}
+
+/**
+ * @brief Add the sequences of a mode to the trie of its table.
+ */
+static void compile_sequences(KeyTable *T, const KeySequence *sequences) {
+    for (int i = 0; sequences[i].action != NULL; i++) {
+        int keys[KEY_STACK_SIZE];
+        int len = 0;
+        for (const char *k = sequences[i].keys; *k != '\0' && len < KEY_STACK_SIZE; k++) keys[len++] = (unsigned char) *k;
+
+        // The first mapping of keys wins, as it did when the arrays were scanned
+        KeyNode *node = find_node(T, keys, len);
+        if (node == NULL || node->action == NULL) bind_sequence(T, keys, len, sequences[i].action);
+    }
+}
+
+/**
+ * @brief Compile the keymaps and sequences of a mode into its table.
+ */
+static void compile_table(KeyTable *T, const KeyMap *keymaps, const KeySequence *sequences) {
+    memset(T, 0, sizeof(KeyTable));
+    for (int i = 0; keymaps[i].action != NULL; i++) {
+        int key = keymaps[i].key;
+        if (key >= 0 && key <= KEY_MAX && T->keys[key].action == NULL) T->keys[key] = keymaps[i];
+    }
+    if (sequences != NULL) compile_sequences(T, sequences);
+}
+
+void keymaps_init(void) {
+    compile_table(&normal_table, normal_mode_keymaps, normal_mode_sequences);
+    compile_table(&visual_table, visual_mode_keymaps, visual_mode_sequences);
+    compile_table(&insert_table, insert_mode_keymaps, NULL);
+}
+
+/**
+ * @brief Free the children of a node, the node itself is kept.
+ */
+static void free_node(KeyNode *node) {
+    for (int i = 0; i < KEY_SEQUENCE_KEYS; i++) {
+        if (node->next[i] == NULL) continue;
+        free_node(node->next[i]);
+        free(node->next[i]);
+        node->next[i] = NULL;
+    }
+}
+
+void keymaps_free(void) {
+    free_node(&normal_table.sequences);
+    free_node(&visual_table.sequences);
+    free_node(&insert_table.sequences);
+}
+
+KeyTable *keymap_table(const EditorMode mode) {
+    switch (mode) {
+        case NORMAL_MODE:
+            return &normal_table;
+        case INSERT_MODE:
+            return &insert_table;
+        case VISUAL_MODE:
+        case VISUAL_LINE_MODE:
+        case VISUAL_BLOCK_MODE:
+            return &visual_table;
+        case COMMAND_MODE:
+            break;
+    }
+    return NULL;
+}
+
+/**
+ * @brief Names of the special keys of a mapping, between '<' and '>'.
+ */
+static const struct {
+    const char *name;
+    int key;
+} key_names[] = {
+    {"esc", 27},
+    {"cr", '\r'},
+    {"enter", '\r'},
+    {"bs", KEY_BACKSPACE},
+    {"tab", '\t'},
+    {"space", ' '},
+    {"lt", '<'},
+    {"left", KEY_LEFT},
+    {"right", KEY_RIGHT},
+    {"up", KEY_UP},
+    {"down", KEY_DOWN},
+
+    {NULL, 0}
+};
+
+int keymap_parse(const char *s, int *keys, const int max) {
+    int len = 0;
+    while (*s != '\0') {
+        if (len == max) return -1;
+
+        const char *close = (*s == '<') ? strchr(s, '>') : NULL;
+        if (close == NULL || close == s + 1) {
+            keys[len++] = (unsigned char) *s++;
+            continue;
+        }
+
+        // <C-x> is the control key of x, other names come from the table
+        int n = (int) (close - s - 1);
+        int key = -1;
+        if (n == 3 && (s[1] == 'C' || s[1] == 'c') && s[2] == '-' && isalpha((unsigned char) s[3])) {
+            key = tolower((unsigned char) s[3]) - 'a' + 1;
+        }
+        for (int i = 0; key == -1 && key_names[i].name != NULL; i++) {
+            if ((int) strlen(key_names[i].name) == n && strncasecmp(s + 1, key_names[i].name, n) == 0) key = key_names[i].key;
+        }
+        if (key == -1) return -1;
+
+        keys[len++] = key;
+        s = close + 1;
+    }
+    return len;
+}
+
+bool keymap_bind(KeyTable *T, const int *lhs, const int lhs_len, const int *rhs, const int rhs_len) {
+    if (lhs_len <= 0 || rhs_len <= 0) return false;
+
+    // The action of the rhs, a single key keeps how it works with the cursors
+    KeyMap map = {lhs[0], NULL, CURSORS_CLEAR};
+    if (rhs_len == 1 && rhs[0] >= 0 && rhs[0] <= KEY_MAX && T->keys[rhs[0]].action != NULL) {
+        map.action = T->keys[rhs[0]].action;
+        map.cursors = T->keys[rhs[0]].cursors;
+    } else {
+        KeyNode *node = find_node(T, rhs, rhs_len);
+        if (node != NULL) map.action = node->action;
+    }
+    if (map.action == NULL) return false;
+
+    if (lhs_len == 1) {
+        if (lhs[0] < 0 || lhs[0] > KEY_MAX) return false;
+        T->keys[lhs[0]] = map;
+        return true;
+    }
+
+    return bind_sequence(T, lhs, lhs_len, map.action);
+}
+
+/**
+ * @brief Remove a sequence below a node, and the nodes it leaves without a sequence.
+ * @return true if the node has no sequence left
+ */
+static bool unbind_node(KeyNode *node, const int *keys, const int len, bool *found) {
+    if (len == 0) {
+        *found = node->action != NULL;
+        node->action = NULL;
+    } else {
+        KeyNode *next = (keys[0] > 0 && keys[0] < KEY_SEQUENCE_KEYS) ? node->next[keys[0]] : NULL;
+        if (next != NULL && unbind_node(next, keys + 1, len - 1, found)) {
+            free(next);
+            node->next[keys[0]] = NULL;
+        }
+    }
+
+    if (node->action != NULL) return false;
+    for (int i = 0; i < KEY_SEQUENCE_KEYS; i++) {
+        if (node->next[i] != NULL) return false;
+    }
+    return true;
+}
+
+bool keymap_unbind(KeyTable *T, const int *keys, const int len) {
+    if (len <= 0) return false;
+    if (len == 1) {
+        if (keys[0] < 0 || keys[0] > KEY_MAX || T->keys[keys[0]].action == NULL) return false;
+        T->keys[keys[0]].action = NULL;
+        return true;
+    }
+
+    bool found = false;
+    unbind_node(&T->sequences, keys, len, &found);
+    return found;
+}
+
 void editor_process_key_press(Editor *E, const int c) {
+    macro_record_key(E, c);
 
     // editor_set_status_message(E, "Key pressed: '%c' (%d)", (c == '\n') ? ' ' : c, c);
     switch (E->mode) {
@@ -63,27 +358,130 @@ void editor_process_key_press(Editor *E, const int c) {
         case INSERT_MODE:
             execute_command_insert(E, c);
             break;
+        case VISUAL_MODE:
+        case VISUAL_LINE_MODE:
+        case VISUAL_BLOCK_MODE:
+            execute_command_visual(E, c);
+            break;
         case COMMAND_MODE:
             break;
     }
 }
 
-int execute_command_normal(Editor *E, const int command) {
-    for (int i = 0; normal_mode_keymaps[i].action != NULL; i++) {
-        if (command == normal_mode_keymaps[i].key) {
-            normal_mode_keymaps[i].action(E);
-            return 0;
+/**
+ * @brief Run the action of a key, for every cursor if the key allows it.
+ */
+static void execute_keymap(Editor *E, const KeyMap *map) {
+    if (cursors_active(E)) {
+        if (map->cursors == CURSORS_EACH) {
+            cursors_for_each(E, map->action);
+            return;
         }
+        if (map->cursors == CURSORS_CLEAR) cursors_clear(E);
     }
-    return  -1;
+    map->action(E);
 }
 
-int execute_command_insert(Editor *E, const int command) {
-    for (int i = 0; insert_mode_keymaps[i].action != NULL; i++) {
-        if (command == insert_mode_keymaps[i].key) {
-            insert_mode_keymaps[i].action(E);
+/**
+ * @brief Push a key onto the stack, and execute the sequence it completes.
+ * @return 0 if a sequence was executed, 1 if the keys start a sequence, -1 if nothing matches
+ * @note The key is popped again if nothing matches.
+ */
+static int execute_sequence(Editor *E, const KeyNode *sequences, const int command) {
+    if (command <= 0 || command >= KEY_SEQUENCE_KEYS || E->stack_len == KEY_STACK_SIZE) return -1;
+
+    // The pending keys lead to a node of the trie, the new key to one of its children
+    const KeyNode *node = sequences;
+    for (int i = 0; i < E->stack_len && node != NULL; i++) node = node->next[E->stack[i]];
+    if (node != NULL) node = node->next[command];
+    if (node == NULL) return -1;
+
+    E->stack[E->stack_len++] = command;
+    if (node->action == NULL) return 1;
+
+    // Sequences only work with a single cursor
+    cursors_clear(E);
+    node->action(E);
+    return 0;
+}
+
+/**
+ * @brief Execute a command of a mode which takes counts and sequences, normal or visual.
+ */
+static int execute_command(Editor *E, const KeyTable *T, const int command) {
+    // Digits build the count, a 0 on its own moves to the start of the line
+    if (E->stack_len == 0 && command >= '0' && command <= '9' && (command != '0' || E->repeat > 0)) {
+        E->repeat = E->repeat * 10 + (command - '0');
+        if (E->repeat > REPEAT_MAX) E->repeat = REPEAT_MAX;
+        return 0;
+    }
+
+    // '"' and a name select the register for the command, in normal mode 'q'
+    // and a name record a macro into it and '@' and a name replay it
+    if (E->stack_len == 1 && (E->stack[0] == '"' || E->stack[0] == 'q' || E->stack[0] == '@')) {
+        int key = E->stack[0];
+        E->stack_len = 0;
+        bool letter = (command >= 'a' && command <= 'z') || (command >= 'A' && command <= 'Z');
+        if (key == '"' && (letter || command == '"')) {
+            E->reg_name = command;
             return 0;
         }
+        if (key != '"' && (letter || (key == '@' && command == '@'))) {
+            int count = E->repeat;
+            E->repeat = 0;
+            E->reg_name = 0;
+            undo_seal(E);
+            cursors_clear(E);
+            if (key == 'q') macro_record_start(E, command);
+            else macro_play(E, command, count);
+            return 0;
+        }
+        E->repeat = 0;
+        E->reg_name = 0;
+        return -1;
+    }
+    if (E->stack_len == 0 && E->mode == NORMAL_MODE && command == 'q' && E->macros.recording) {
+        macro_record_stop(E);
+        E->repeat = 0;
+        E->reg_name = 0;
+        return 0;
+    }
+    if (E->stack_len == 0 && (command == '"' || (E->mode == NORMAL_MODE && (command == 'q' || command == '@')))) {
+        E->stack[E->stack_len++] = command;
+        return 0;
+    }
+
+    // Each command is its own undo step
+    undo_seal(E);
+
+    int status = execute_sequence(E, &T->sequences, command);
+    if (status == 1) return 0;
+
+    // A single key command, unless it broke off a sequence
+    if (status == -1 && E->stack_len == 0 && command >= 0 && command <= KEY_MAX && T->keys[command].action != NULL) {
+        execute_keymap(E, &T->keys[command]);
+        status = 0;
+    }
+
+    // The count, the register and the pending keys only apply to this command
+    E->repeat = 0;
+    E->reg_name = 0;
+    E->stack_len = 0;
+    return status;
+}
+
+int execute_command_normal(Editor *E, const int command) {
+    return execute_command(E, &normal_table, command);
+}
+
+int execute_command_visual(Editor *E, const int command) {
+    return execute_command(E, &visual_table, command);
+}
+
+int execute_command_insert(Editor *E, const int command) {
+    if (command >= 0 && command <= KEY_MAX && insert_table.keys[command].action != NULL) {
+        execute_keymap(E, &insert_table.keys[command]);
+        return 0;
     }
     action_insert_character(E, (char) command);
 
@@ -0,0 +1,214 @@
+#include "load_job.h"
+#include "editor.h"
+#include "rows.h"
+#include "undo_log.h"
+#include <limits.h>
+#include <stdlib.h>
+#include <string.h>
+
+static void load_batch_free(LoadBatch *B) {
+    for (int i = 0; i < B->count; i++) row_text_release(B->chars[i]);
+    free(B->chars);
+    free(B->len);
+    free(B);
+}
+
+/**
+ * @brief Split the complete lines of a block into a batch of rows.
+ * @return Number of bytes used, the rest is a line which is not complete
+ */
+static size_t load_split_block(LoadBatch *B, const char *buf, const size_t len, const bool eof) {
+    size_t start = 0;
+    while (start < len) {
+        const char *nl = memchr(buf + start, '\n', len - start);
+        if (nl == NULL && !eof) break;
+
+        size_t end = nl ? (size_t) (nl - buf) : len;
+        size_t next = nl ? end + 1 : len;
+
+        // Remove the \r from end of line
+        while (end > start && buf[end - 1] == '\r') end--;
+
+        if (B->count == B->cap) {
+            B->cap = B->cap ? B->cap * 2 : 4096;
+            B->chars = realloc(B->chars, sizeof(char *) * B->cap);
+            B->len = realloc(B->len, sizeof(int) * B->cap);
+            if (B->chars == NULL || B->len == NULL) exit(1);
+        }
+        int size = (int) (end - start);
+        B->chars[B->count] = row_text_new(size);
+        memcpy(B->chars[B->count], buf + start, size);
+        B->len[B->count] = size;
+        B->count++;
+        start = next;
+    }
+    return start;
+}
+
+/**
+ * @brief Thread which reads the file a block at a time and queues the rows of each block.
+ */
+static void *load_worker(void *arg) {
+    LoadJob *J = arg;
+    size_t cap = LOAD_BLOCK_SIZE, len = 0;
+    char *buf = malloc(cap);
+    if (buf == NULL) exit(1);
+
+    uint64_t hash = UNDO_LOG_HASH_INIT;
+    while (!__atomic_load_n(&J->cancel, __ATOMIC_RELAXED)) {
+        // A line longer than the block makes the block grow
+        if (len == cap) {
+            cap *= 2;
+            buf = realloc(buf, cap);
+            if (buf == NULL) exit(1);
+        }
+        size_t n = fread(buf + len, 1, cap - len, J->fp);
+        hash = undo_log_hash(hash, buf + len, n);
+        len += n;
+
+        bool eof = (n == 0);
+        LoadBatch *B = calloc(1, sizeof(LoadBatch));
+        if (B == NULL) exit(1);
+        size_t used = load_split_block(B, buf, len, eof);
+        memmove(buf, buf + used, len - used);
+        len -= used;
+
+        pthread_mutex_lock(&J->lock);
+        if (B->count > 0) {
+            if (J->tail != NULL) J->tail->next = B;
+            else J->head = B;
+            J->tail = B;
+        }
+        J->read += (off_t) n;
+        if (eof) {
+            J->hash = hash;
+            J->done = true;
+        }
+        pthread_cond_signal(&J->ready);
+        pthread_mutex_unlock(&J->lock);
+
+        if (B->count == 0) load_batch_free(B);
+        if (eof) break;
+    }
+    free(buf);
+
+    // A cancel ends the load as well
+    pthread_mutex_lock(&J->lock);
+    J->done = true;
+    pthread_cond_signal(&J->ready);
+    pthread_mutex_unlock(&J->lock);
+    return NULL;
+}
+
+/**
+ * @brief Join the thread and free what is left of the load.
+ */
+static void load_job_stop(LoadJob *J) {
+    pthread_join(J->thread, NULL);
+    while (J->head != NULL) {
+        LoadBatch *next = J->head->next;
+        load_batch_free(J->head);
+        J->head = next;
+    }
+    J->tail = NULL;
+    fclose(J->fp);
+    J->fp = NULL;
+    pthread_cond_destroy(&J->ready);
+    pthread_mutex_destroy(&J->lock);
+    J->running = false;
+}
+
+bool load_job_start(Editor *E, FILE *fp, const off_t size) {
+    LoadJob *J = &E->load;
+    memset(J, 0, sizeof(LoadJob));
+    J->fp = fp;
+    J->size = size;
+    pthread_mutex_init(&J->lock, NULL);
+    pthread_cond_init(&J->ready, NULL);
+
+    if (pthread_create(&J->thread, NULL, load_worker, J) != 0) {
+        pthread_cond_destroy(&J->ready);
+        pthread_mutex_destroy(&J->lock);
+        J->fp = NULL;
+        return false;
+    }
+    J->running = true;
+    return true;
+}
+
+void load_job_poll(Editor *E) {
+    LoadJob *J = &E->load;
+    if (!J->running) return;
+
+    pthread_mutex_lock(&J->lock);
+    LoadBatch *B = J->head;
+    J->head = J->tail = NULL;
+    bool done = J->done;
+    pthread_mutex_unlock(&J->lock);
+
+    // Loading the file is not an edit, the rows go after the ones already
+    // added, and after any the user added at the end
+    undo_suspend(E);
+    while (B != NULL) {
+        LoadBatch *next = B->next;
+        editor_insert_shared_rows(E, E->num_rows, B->count, B->chars, B->len);
+        load_batch_free(B);
+        B = next;
+    }
+    undo_resume(E);
+    if (!done) return;
+
+    load_job_stop(J);
+    E->disk_size = J->read;
+    if (E->num_rows == 0) {
+        undo_suspend(E);
+        editor_insert_row_below(E, 0, "", 0);
+        undo_resume(E);
+    }
+    undo_log_open(E, E->filename, J->hash);
+}
+
+void load_job_wait(Editor *E, const int y) {
+    LoadJob *J = &E->load;
+    while (J->running && (y < 0 || y >= E->num_rows)) {
+        pthread_mutex_lock(&J->lock);
+        while (J->head == NULL && !J->done) pthread_cond_wait(&J->ready, &J->lock);
+        pthread_mutex_unlock(&J->lock);
+        load_job_poll(E);
+    }
+}
+
+void load_job_wait_rows(Editor *E, const int y, const int count) {
+    if (count <= 0) return;
+    load_job_wait(E, (count > INT_MAX - y) ? -1 : y + count - 1);
+}
+
+void load_job_finish(Editor *E) {
+    load_job_wait(E, -1);
+}
+
+void load_job_cancel(Editor *E) {
+    LoadJob *J = &E->load;
+    if (!J->running) return;
+
+    __atomic_store_n(&J->cancel, true, __ATOMIC_RELAXED);
+    load_job_stop(J);
+}
+
+bool load_job_running(Editor *E) {
+    return E->load.running;
+}
+
+void load_job_status(Editor *E, char *buf, const size_t len) {
+    LoadJob *J = &E->load;
+    buf[0] = '\0';
+    if (!J->running) return;
+
+    pthread_mutex_lock(&J->lock);
+    off_t read = J->read;
+    pthread_mutex_unlock(&J->lock);
+
+    int percent = (J->size > 0) ? (int) (read * 100 / J->size) : 0;
+    if (percent > 99) percent = 99;
+    snprintf(buf, len, "loading %d%% | ", percent);
+}
@@ -0,0 +1,123 @@
+#include "macros.h"
+#include "editor.h"
+#include "keymaps.h"
+#include <stdlib.h>
+#include <string.h>
+
+/**
+ * @brief Get the macro of a register name, NULL if the name is not a register.
+ */
+static Macro *macro_get(Editor *E, const int name) {
+    if (name >= 'a' && name <= 'z') return &E->macros.list[name - 'a' + 1];
+    if (name >= 'A' && name <= 'Z') return &E->macros.list[name - 'A' + 1];
+    return NULL;
+}
+
+bool macro_replaying(const Editor *E) {
+    return E->macros.depth > 0;
+}
+
+void macro_record_start(Editor *E, const int name) {
+    Macro *M = macro_get(E, name);
+    if (M == NULL || macro_replaying(E)) return;
+
+    M->num = 0;
+    E->macros.recording = name;
+}
+
+void macro_record_stop(Editor *E) {
+    Macro *M = macro_get(E, E->macros.recording);
+    E->macros.recording = 0;
+    if (M == NULL) return;
+
+    // Drop the 'q' which stopped the recording
+    if (M->num > 0) M->num--;
+}
+
+void macro_record_key(Editor *E, const int c) {
+    Macro *M = macro_get(E, E->macros.recording);
+    if (M == NULL || macro_replaying(E)) return;
+
+    if (M->num == M->cap) {
+        M->cap = M->cap ? M->cap * 2 : 64;
+        M->keys = realloc(M->keys, sizeof(int) * M->cap);
+        if (M->keys == NULL) exit(1);
+    }
+    M->keys[M->num++] = c;
+}
+
+bool macro_set(Editor *E, const int name, const int *keys, const int len) {
+    Macro *M = macro_get(E, name);
+    if (M == NULL || M == macro_get(E, E->macros.recording)) return false;
+
+    if (len > M->cap) {
+        M->cap = len;
+        M->keys = realloc(M->keys, sizeof(int) * M->cap);
+        if (M->keys == NULL) exit(1);
+    }
+    if (len > 0) memcpy(M->keys, keys, sizeof(int) * len);
+    M->num = len;
+    return true;
+}
+
+bool macro_read_key(Editor *E, int *c) {
+    MacroState *S = &E->macros;
+    if (!macro_replaying(E)) return false;
+
+    *c = (S->feed_pos < S->feed_len) ? S->feed[S->feed_pos++] : 27;
+    return true;
+}
+
+void macro_play(Editor *E, int name, int count) {
+    MacroState *S = &E->macros;
+    if (name == '@') name = S->last;
+
+    Macro *M = macro_get(E, name);
+    if (M == NULL) {
+        editor_set_status_message(E, "No macro to replay");
+        return;
+    }
+    if (M == macro_get(E, S->recording)) {
+        editor_set_status_message(E, "Cannot replay @%c while recording it", name);
+        return;
+    }
+    if (S->depth >= MACRO_MAX_DEPTH) {
+        editor_set_status_message(E, "Macros nested too deep");
+        S->feed_pos = S->feed_len + 1;
+        return;
+    }
+    S->last = name;
+    if (count < 1) count = 1;
+    for (int i = 0; i < count; i++) {
+        macro_run(E, M->keys, M->num);
+
+        // A nested macro which went too deep ends every replay
+        if (S->feed_pos > S->feed_len) break;
+    }
+}
+
+void macro_run(Editor *E, const int *keys, const int len) {
+    MacroState *S = &E->macros;
+
+    // Keys are read from the macro instead of the terminal, the replay it
+    // interrupts carries on once this one is over
+    const int *feed = S->feed;
+    int feed_len = S->feed_len, feed_pos = (S->depth > 0) ? S->feed_pos : 0;
+    S->depth++;
+
+    S->feed = keys;
+    S->feed_len = len;
+    S->feed_pos = 0;
+    while (S->feed_pos < S->feed_len) editor_process_key_press(E, S->feed[S->feed_pos++]);
+
+    S->depth--;
+    bool aborted = S->feed_pos > S->feed_len;
+    S->feed = feed;
+    S->feed_len = feed_len;
+    S->feed_pos = aborted ? feed_len + 1 : feed_pos;
+}
+
+void macro_state_free(MacroState *M) {
+    for (int i = 0; i < REGISTER_COUNT; i++) free(M->list[i].keys);
+    memset(M, 0, sizeof(MacroState));
+}
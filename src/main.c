@@ -1,4 +1,8 @@
 #include <ncurses.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "batch.h"
 #include "editor.h"
 #include "keymaps.h"
 
@@ -13,19 +17,63 @@
  * WMOVE(screen, x, y) MOVES the cursor
  */
 
+static void usage(const char *name) {
+    fprintf(stderr, "Usage: %s [file]\n", name);
+    fprintf(stderr, "       %s [-s script] [-c command]... [file | -]\n", name);
+    exit(2);
+}
+
 int main (int argc, char *argv[]) {
+    // "-s" and "-c" edit without a terminal, everything else opens the editor
+    BatchOptions O = {0};
+    bool batch = false;
+    O.commands = calloc(argc, sizeof(char *));
+    if (O.commands == NULL) exit(1);
+
+    for (int i = 1; i < argc; i++) {
+        if (strcmp(argv[i], "-s") == 0 || strcmp(argv[i], "-c") == 0) {
+            if (i + 1 == argc) usage(argv[0]);
+            if (argv[i][1] == 's') O.script = argv[++i];
+            else O.commands[O.num_commands++] = argv[++i];
+            batch = true;
+        } else if (O.file == NULL) {
+            O.file = argv[i];
+        } else {
+            usage(argv[0]);
+        }
+    }
+
     Editor E;
+    if (batch) {
+        init_editor_headless(&E);
+        keymaps_init();
+        int status = batch_run(&E, &O);
+        editor_destroy(&E);
+        keymaps_free();
+        free(O.commands);
+        return status;
+    }
+    free(O.commands);
+
     init_editor(&E);
+    keymaps_init();
 
-    if (argc >= 2) {
-        editor_open_file(&E, argv[1]);
+    if (O.file != NULL) {
+        editor_open_file(&E, (char *) O.file);
     } else {
         // Append row to the first line to allow for typing
+        undo_suspend(&E);
         editor_insert_row_below(&E, 0, "", 0);
+        undo_resume(&E);
     }
 
     while (true) {
         editor_refresh(&E);
-        editor_process_key_press(&E, wgetch(stdscr));
+
+        // Every key which came in while the screen was drawn is handled before
+        // the next frame, so a slow frame does not hold back the keys behind it
+        do {
+            editor_process_key_press(&E, editor_read_key(&E));
+        } while (input_pending(&E));
     }
 }
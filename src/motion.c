@@ -0,0 +1,171 @@
+#include "motion.h"
+#include "editor.h"
+#include <ctype.h>
+
+/**
+ * @brief Class of every byte, for words [0] and WORDS [1]. Built on first use by motion_classes.
+ * @note Bytes above 0x7f are treated as word characters, so UTF-8 text is not
+ * split into punctuation.
+ */
+static unsigned char char_class[2][256];
+static bool char_class_ready = false;
+
+static void motion_classes(void) {
+    if (char_class_ready) return;
+
+    for (int c = 0; c < 256; c++) {
+        if (c == ' ' || c == '\t' || c == '\n' || c == '\r' || c == '\v' || c == '\f' || c == '\0')
+            char_class[0][c] = CHAR_BLANK;
+        else if (c >= 0x80 || isalnum(c) || c == '_')
+            char_class[0][c] = CHAR_WORD;
+        else
+            char_class[0][c] = CHAR_PUNCT;
+
+        char_class[1][c] = (char_class[0][c] == CHAR_BLANK) ? CHAR_BLANK : CHAR_WORD;
+    }
+    char_class_ready = true;
+}
+
+CharClass motion_char_class(const char c, const bool big_word) {
+    motion_classes();
+    return char_class[big_word][(unsigned char) c];
+}
+
+/**
+ * @brief Get the character at a position, the end of a row reads as a newline.
+ */
+static char pos_char(const Editor *E, const MotionPos p) {
+    const erow *row = &E->row[p.y];
+    return (p.x < row->size) ? row->chars[p.x] : '\n';
+}
+
+/**
+ * @brief Move to the next position, the end of each row is a position of its own.
+ * @return false at the end of the file
+ */
+static bool pos_next(const Editor *E, MotionPos *p) {
+    if (p->x < E->row[p->y].size) {
+        p->x++;
+        return true;
+    }
+    if (p->y + 1 >= E->num_rows) return false;
+    p->x = 0;
+    p->y++;
+    return true;
+}
+
+/**
+ * @brief Move to the previous position.
+ * @return false at the start of the file
+ */
+static bool pos_prev(const Editor *E, MotionPos *p) {
+    if (p->x > 0) {
+        p->x--;
+        return true;
+    }
+    if (p->y == 0) return false;
+    p->y--;
+    p->x = E->row[p->y].size;
+    return true;
+}
+
+static bool pos_empty_row(const Editor *E, const MotionPos p) {
+    return p.x == 0 && E->row[p.y].size == 0;
+}
+
+/**
+ * @brief Perform the motion without clamping the result to a character.
+ * @note The result can be the end of a row, which operators use as an exclusive end.
+ */
+static MotionPos motion_scan(Editor *E, const Motion motion, MotionPos p, int count) {
+    const bool big = (motion == MOTION_BIG_WORD_NEXT || motion == MOTION_BIG_WORD_PREV ||
+                      motion == MOTION_BIG_WORD_END);
+    motion_classes();
+
+    // Class lookup for the chosen word kind
+    const unsigned char *classes = char_class[big];
+    #define CLASS(pos) ((CharClass) classes[(unsigned char) pos_char(E, (pos))])
+
+    for (; count > 0; count--) {
+        MotionPos start = p;
+
+        switch (motion) {
+            case MOTION_WORD_NEXT:
+            case MOTION_BIG_WORD_NEXT: {
+                // Skip the rest of the current word, then the blanks after it
+                CharClass cls = CLASS(p);
+                bool more = true;
+                if (cls != CHAR_BLANK)
+                    while (more && CLASS(p) == cls) more = pos_next(E, &p);
+                while (more && CLASS(p) == CHAR_BLANK) {
+                    if (pos_empty_row(E, p) && p.y != start.y) break;
+                    more = pos_next(E, &p);
+                }
+                if (!more) return p;
+                break;
+            }
+
+            case MOTION_WORD_END:
+            case MOTION_BIG_WORD_END: {
+                // Step off the current end, skip blanks, then run to the end of the word
+                if (!pos_next(E, &p)) return p;
+                bool more = true;
+                while (more && CLASS(p) == CHAR_BLANK) more = pos_next(E, &p);
+                if (!more) return p;
+
+                CharClass cls = CLASS(p);
+                MotionPos peek = p;
+                while (pos_next(E, &peek) && CLASS(peek) == cls) p = peek;
+                break;
+            }
+
+            case MOTION_WORD_PREV:
+            case MOTION_BIG_WORD_PREV: {
+                // Step back, skip blanks, then run back to the start of the word
+                if (!pos_prev(E, &p)) return p;
+                bool more = true;
+                while (more && CLASS(p) == CHAR_BLANK && !pos_empty_row(E, p)) more = pos_prev(E, &p);
+                if (!more || pos_empty_row(E, p)) break;
+
+                CharClass cls = CLASS(p);
+                MotionPos peek = p;
+                while (pos_prev(E, &peek) && CLASS(peek) == cls) p = peek;
+                break;
+            }
+        }
+    }
+
+    #undef CLASS
+    return p;
+}
+
+MotionPos motion_find(Editor *E, const Motion motion, const MotionPos from, const int count) {
+    if (E->num_rows == 0) return from;
+
+    MotionPos p = motion_scan(E, motion, from, count > 0 ? count : 1);
+
+    // The cursor has to be on a character, not on the end of the row
+    int size = E->row[p.y].size;
+    if (p.x >= size) p.x = (size > 0) ? size - 1 : 0;
+    return p;
+}
+
+void motion_range(Editor *E, const Motion motion, const int count, MotionRange *range) {
+    MotionPos cursor = {E->cur_x, E->cur_y};
+    range->start = range->end = cursor;
+    range->inclusive = (motion == MOTION_WORD_END || motion == MOTION_BIG_WORD_END);
+    if (E->num_rows == 0) return;
+
+    MotionPos target = motion_scan(E, motion, cursor, count > 0 ? count : 1);
+    if (target.y < cursor.y || (target.y == cursor.y && target.x < cursor.x)) {
+        range->start = target;
+    } else {
+        range->end = target;
+
+        // Do not take the newline of the row with the last word
+        if (!range->inclusive && target.y > cursor.y && target.x == 0) {
+            range->end.y = target.y - 1;
+            range->end.x = E->row[target.y - 1].size;
+        }
+    }
+}
@@ -0,0 +1,836 @@
+#include "regexp.h"
+#include <stdlib.h>
+#include <string.h>
+#include <limits.h>
+
+typedef enum {
+    NFA_SET,
+    NFA_SPLIT,
+    NFA_MATCH
+} NfaKind;
+
+/**
+ * @brief State of the NFA.
+ * @note SET states consume one byte in 'set' and move to 'out'. SPLIT states
+ * move to both 'out' and 'out1' without consuming anything.
+ */
+typedef struct {
+    NfaKind kind;
+    int out, out1;
+    unsigned char set[32];
+} NfaState;
+
+typedef enum {
+    RX_SET,
+    RX_CAT,
+    RX_ALT,
+    RX_STAR,
+    RX_PLUS,
+    RX_QUEST
+} RxKind;
+
+/**
+ * @brief Node of the parsed pattern, only used while compiling.
+ */
+typedef struct RxNode {
+    RxKind kind;
+    unsigned char set[32];
+    struct RxNode **kids;
+    int num_kids;
+} RxNode;
+
+typedef struct {
+    const char *p;
+    const char *end;
+    const char *error;
+} RxParser;
+
+struct Regexp {
+    char *source;
+    size_t source_len;
+
+    NfaState *states;
+    int num_states;
+    int cap_states;
+    int start;
+
+    /**
+     * @brief Start of the pattern reversed, in the same states, matched backwards from the end of a match.
+     */
+    int reverse_start;
+
+    bool anchor_start;
+    bool anchor_end;
+
+    /**
+     * @brief Literal which every match contains, used as a prefilter.
+     */
+    char *literal;
+    size_t literal_len;
+    bool pure_literal;
+
+    int refs;
+};
+
+/**
+ * @brief Separates the groups of NFA states in the set of a leftmost DFA state.
+ */
+#define DFA_GROUP (-1)
+
+/**
+ * @brief State of the DFA, a set of NFA states.
+ * @note In a leftmost cache the set is split into groups by DFA_GROUP, one
+ * per start of a match, the oldest start first.
+ */
+typedef struct {
+    int *set;
+    int n;
+    bool match;
+
+    /**
+     * @brief A match was seen before this state, no new start is added.
+     */
+    bool seen;
+} DfaState;
+
+typedef struct {
+    DfaState **states;
+    int num;
+    int cap;
+
+    /**
+     * @brief Transitions of every state, trans[s * 256 + c] is the index of the
+     * state after c, or -1 if it was not built yet.
+     * @note Kept in one array so each byte only costs one load while matching.
+     */
+    int *trans;
+
+    /**
+     * @brief Hash table of state indices, keyed by the NFA set. -1 is empty.
+     */
+    int *table;
+    int table_size;
+
+    /**
+     * @brief Memory used by the states, compared against REGEXP_DFA_BUDGET.
+     */
+    size_t bytes;
+
+    /**
+     * @brief Number of times the states were thrown away, invalidates any held index.
+     */
+    unsigned long flushes;
+
+    /**
+     * @brief Index of the start state, or -1 if it has to be built.
+     */
+    int start;
+
+    /**
+     * @brief NFA state the matches begin at, the pattern or the pattern reversed.
+     */
+    int entry;
+
+    /**
+     * @brief The entry is added after each byte as a new group, so a match can
+     * begin anywhere, until a match is seen. Groups newer than the first one
+     * which matches are dropped, so the last match is where the leftmost-longest match ends.
+     */
+    bool leftmost;
+} DfaCache;
+
+struct RegexpDFA {
+    Regexp *re;
+
+    /**
+     * @brief Cache 0 finds where the leftmost match ends, cache 1 matches from a
+     * fixed start, cache 2 matches backwards from the end to find the start.
+     */
+    DfaCache caches[3];
+
+    int *mark;
+    int mark_gen;
+    int *stack;
+    int *scratch;
+    int scratch_n;
+};
+
+// ---- PARSING ----
+
+static void set_add(unsigned char *set, const int c) {
+    set[c >> 3] |= (unsigned char) (1 << (c & 7));
+}
+
+static bool set_has(const unsigned char *set, const int c) {
+    return (set[c >> 3] >> (c & 7)) & 1;
+}
+
+/**
+ * @brief Get the only byte in a set.
+ * @return The byte, or -1 if the set does not contain exactly one byte
+ */
+static int set_single(const unsigned char *set) {
+    int found = -1;
+    for (int c = 0; c < 256; c++) {
+        if (!set_has(set, c)) continue;
+        if (found != -1) return -1;
+        found = c;
+    }
+    return found;
+}
+
+/**
+ * @brief Add the bytes of a shorthand class (\d, \w, \s) to a set.
+ * @return false if cls is not a shorthand class
+ */
+static bool set_add_class(unsigned char *set, const char cls) {
+    unsigned char tmp[32];
+    memset(tmp, 0, sizeof(tmp));
+
+    switch (cls) {
+        case 'd': case 'D':
+            for (int c = '0'; c <= '9'; c++) set_add(tmp, c);
+            break;
+        case 'w': case 'W':
+            for (int c = '0'; c <= '9'; c++) set_add(tmp, c);
+            for (int c = 'a'; c <= 'z'; c++) set_add(tmp, c);
+            for (int c = 'A'; c <= 'Z'; c++) set_add(tmp, c);
+            set_add(tmp, '_');
+            break;
+        case 's': case 'S':
+            set_add(tmp, ' ');
+            set_add(tmp, '\t');
+            set_add(tmp, '\r');
+            set_add(tmp, '\n');
+            set_add(tmp, '\f');
+            set_add(tmp, '\v');
+            break;
+        default:
+            return false;
+    }
+
+    // Upper case classes are the negation of the lower case ones
+    bool negate = (cls == 'D' || cls == 'W' || cls == 'S');
+    for (int i = 0; i < 32; i++) set[i] |= negate ? (unsigned char) ~tmp[i] : tmp[i];
+    return true;
+}
+
+static RxNode *rx_node(const RxKind kind) {
+    RxNode *n = calloc(1, sizeof(RxNode));
+    if (n == NULL) exit(1);
+    n->kind = kind;
+    return n;
+}
+
+static void rx_add_kid(RxNode *n, RxNode *kid) {
+    n->kids = realloc(n->kids, sizeof(RxNode *) * (n->num_kids + 1));
+    if (n->kids == NULL) exit(1);
+    n->kids[n->num_kids++] = kid;
+}
+
+static void rx_free(RxNode *n) {
+    if (n == NULL) return;
+    for (int i = 0; i < n->num_kids; i++) rx_free(n->kids[i]);
+    free(n->kids);
+    free(n);
+}
+
+static RxNode *parse_alt(RxParser *P);
+
+static RxNode *parse_class(RxParser *P) {
+    RxNode *n = rx_node(RX_SET);
+
+    bool negate = false;
+    if (P->p < P->end && *P->p == '^') {
+        negate = true;
+        P->p++;
+    }
+
+    // A ']' at the start of the class is a literal
+    bool first = true;
+    while (P->p < P->end && (*P->p != ']' || first)) {
+        first = false;
+        int lo = (unsigned char) *P->p++;
+
+        if (lo == '\\' && P->p < P->end) {
+            char e = *P->p++;
+            if (set_add_class(n->set, e)) continue;
+            lo = (e == 't') ? '\t' : (unsigned char) e;
+        }
+
+        // Range, a '-' before the closing ']' is a literal
+        int hi = lo;
+        if (P->p + 1 < P->end && *P->p == '-' && P->p[1] != ']') {
+            P->p++;
+            hi = (unsigned char) *P->p++;
+            if (hi == '\\' && P->p < P->end) hi = (unsigned char) *P->p++;
+            if (hi < lo) {
+                P->error = "Invalid range in []";
+                rx_free(n);
+                return NULL;
+            }
+        }
+        for (int c = lo; c <= hi; c++) set_add(n->set, c);
+    }
+
+    if (P->p >= P->end) {
+        P->error = "Unmatched [";
+        rx_free(n);
+        return NULL;
+    }
+    P->p++;
+
+    if (negate) for (int i = 0; i < 32; i++) n->set[i] = (unsigned char) ~n->set[i];
+    return n;
+}
+
+static RxNode *parse_atom(RxParser *P) {
+    const char c = *P->p++;
+    RxNode *n;
+
+    switch (c) {
+        case '(':
+            n = parse_alt(P);
+            if (n == NULL) return NULL;
+            if (P->p >= P->end || *P->p != ')') {
+                P->error = "Unmatched (";
+                rx_free(n);
+                return NULL;
+            }
+            P->p++;
+            return n;
+        case '[':
+            return parse_class(P);
+        case '.':
+            n = rx_node(RX_SET);
+            memset(n->set, 0xff, sizeof(n->set));
+            return n;
+        case '\\':
+            if (P->p >= P->end) {
+                P->error = "Trailing \\";
+                return NULL;
+            }
+            n = rx_node(RX_SET);
+            if (!set_add_class(n->set, *P->p)) set_add(n->set, (*P->p == 't') ? '\t' : (unsigned char) *P->p);
+            P->p++;
+            return n;
+        default:
+            // Repeat operators with nothing to repeat are literals
+            n = rx_node(RX_SET);
+            set_add(n->set, (unsigned char) c);
+            return n;
+    }
+}
+
+static RxNode *parse_repeat(RxParser *P) {
+    RxNode *atom = parse_atom(P);
+    if (atom == NULL) return NULL;
+
+    while (P->p < P->end && (*P->p == '*' || *P->p == '+' || *P->p == '?')) {
+        RxNode *n = rx_node(*P->p == '*' ? RX_STAR : (*P->p == '+' ? RX_PLUS : RX_QUEST));
+        rx_add_kid(n, atom);
+        atom = n;
+        P->p++;
+    }
+    return atom;
+}
+
+static RxNode *parse_cat(RxParser *P) {
+    RxNode *cat = rx_node(RX_CAT);
+    while (P->p < P->end && *P->p != '|' && *P->p != ')') {
+        RxNode *n = parse_repeat(P);
+        if (n == NULL) {
+            rx_free(cat);
+            return NULL;
+        }
+
+        // Flatten nested concatenations, so literals can be found in one list
+        if (n->kind == RX_CAT) {
+            for (int i = 0; i < n->num_kids; i++) rx_add_kid(cat, n->kids[i]);
+            n->num_kids = 0;
+            rx_free(n);
+        } else {
+            rx_add_kid(cat, n);
+        }
+    }
+    return cat;
+}
+
+static RxNode *parse_alt(RxParser *P) {
+    RxNode *left = parse_cat(P);
+    if (left == NULL) return NULL;
+
+    while (P->p < P->end && *P->p == '|') {
+        P->p++;
+        RxNode *right = parse_cat(P);
+        if (right == NULL) {
+            rx_free(left);
+            return NULL;
+        }
+        RxNode *alt = rx_node(RX_ALT);
+        rx_add_kid(alt, left);
+        rx_add_kid(alt, right);
+        left = alt;
+    }
+    return left;
+}
+
+// ---- COMPILING ----
+
+static int nfa_add(Regexp *re, const NfaKind kind, const unsigned char *set, const int out, const int out1) {
+    if (re->num_states == re->cap_states) {
+        re->cap_states = re->cap_states ? re->cap_states * 2 : 16;
+        re->states = realloc(re->states, sizeof(NfaState) * re->cap_states);
+        if (re->states == NULL) exit(1);
+    }
+
+    NfaState *s = &re->states[re->num_states];
+    s->kind = kind;
+    s->out = out;
+    s->out1 = out1;
+    if (set) memcpy(s->set, set, sizeof(s->set));
+    else memset(s->set, 0, sizeof(s->set));
+    return re->num_states++;
+}
+
+/**
+ * @brief Emit the NFA states for a node, which continue to 'next'.
+ * @param reverse Emit the node reversed, matching its bytes last to first
+ * @return Entry state of the node
+ */
+static int nfa_emit(Regexp *re, const RxNode *n, int next, const bool reverse) {
+    int s, body;
+    switch (n->kind) {
+        case RX_SET:
+            return nfa_add(re, NFA_SET, n->set, next, -1);
+        case RX_CAT:
+            if (reverse) {
+                for (int i = 0; i < n->num_kids; i++) next = nfa_emit(re, n->kids[i], next, reverse);
+            } else {
+                for (int i = n->num_kids - 1; i >= 0; i--) next = nfa_emit(re, n->kids[i], next, reverse);
+            }
+            return next;
+        case RX_ALT:
+            s = nfa_emit(re, n->kids[0], next, reverse);
+            body = nfa_emit(re, n->kids[1], next, reverse);
+            return nfa_add(re, NFA_SPLIT, NULL, s, body);
+        case RX_STAR:
+            s = nfa_add(re, NFA_SPLIT, NULL, -1, next);
+            body = nfa_emit(re, n->kids[0], s, reverse);
+            re->states[s].out = body;
+            return s;
+        case RX_PLUS:
+            s = nfa_add(re, NFA_SPLIT, NULL, -1, next);
+            body = nfa_emit(re, n->kids[0], s, reverse);
+            re->states[s].out = body;
+            return body;
+        case RX_QUEST:
+            body = nfa_emit(re, n->kids[0], next, reverse);
+            return nfa_add(re, NFA_SPLIT, NULL, body, next);
+    }
+    return next;
+}
+
+/**
+ * @brief Find the longest run of single bytes in the top level concatenation.
+ */
+static void extract_literal(Regexp *re, const RxNode *root) {
+    const RxNode *const *kids = (const RxNode *const *) root->kids;
+    int num_kids = root->num_kids;
+    if (root->kind == RX_SET) {
+        kids = &root;
+        num_kids = 1;
+    } else if (root->kind != RX_CAT) {
+        return;
+    }
+
+    int best_start = 0, best_len = 0, run_start = 0, run_len = 0;
+    for (int i = 0; i < num_kids; i++) {
+        if (kids[i]->kind == RX_SET && set_single(kids[i]->set) != -1) {
+            if (run_len++ == 0) run_start = i;
+            if (run_len > best_len) {
+                best_len = run_len;
+                best_start = run_start;
+            }
+        } else {
+            run_len = 0;
+        }
+    }
+    if (best_len == 0) return;
+
+    re->literal = malloc(best_len + 1);
+    if (re->literal == NULL) exit(1);
+    for (int i = 0; i < best_len; i++) re->literal[i] = (char) set_single(kids[best_start + i]->set);
+    re->literal[best_len] = '\0';
+    re->literal_len = best_len;
+    re->pure_literal = (best_len == num_kids) && !re->anchor_start && !re->anchor_end;
+}
+
+Regexp *regexp_compile(const char *pattern, size_t len, const char **error) {
+    Regexp *re = calloc(1, sizeof(Regexp));
+    if (re == NULL) exit(1);
+
+    re->source = malloc(len + 1);
+    if (re->source == NULL) exit(1);
+    memcpy(re->source, pattern, len);
+    re->source[len] = '\0';
+    re->source_len = len;
+    re->refs = 1;
+
+    // Anchors are only supported at the ends of the whole pattern
+    if (len > 0 && pattern[0] == '^') {
+        re->anchor_start = true;
+        pattern++;
+        len--;
+    }
+    if (len > 0 && pattern[len - 1] == '$') {
+        size_t slashes = 0;
+        while (slashes + 1 < len && pattern[len - 2 - slashes] == '\\') slashes++;
+        if (slashes % 2 == 0) {
+            re->anchor_end = true;
+            len--;
+        }
+    }
+
+    RxParser P = {pattern, pattern + len, NULL};
+    RxNode *root = parse_alt(&P);
+    if (root != NULL && P.p < P.end) {
+        P.error = "Unmatched )";
+        rx_free(root);
+        root = NULL;
+    }
+    if (root == NULL) {
+        if (error) *error = P.error;
+        regexp_release(re);
+        return NULL;
+    }
+
+    int match = nfa_add(re, NFA_MATCH, NULL, -1, -1);
+    re->start = nfa_emit(re, root, match, false);
+    re->reverse_start = nfa_emit(re, root, match, true);
+    extract_literal(re, root);
+    rx_free(root);
+
+    return re;
+}
+
+void regexp_retain(Regexp *re) {
+    __atomic_add_fetch(&re->refs, 1, __ATOMIC_RELAXED);
+}
+
+void regexp_release(Regexp *re) {
+    if (re == NULL) return;
+    if (__atomic_sub_fetch(&re->refs, 1, __ATOMIC_ACQ_REL) != 0) return;
+
+    free(re->source);
+    free(re->states);
+    free(re->literal);
+    free(re);
+}
+
+const char *regexp_required_literal(const Regexp *re, size_t *len) {
+    *len = re->literal_len;
+    return re->literal;
+}
+
+bool regexp_is_literal(const Regexp *re) {
+    return re->pure_literal;
+}
+
+// ---- CACHE ----
+
+static Regexp *regexp_cache[REGEXP_CACHE_SIZE];
+static unsigned long regexp_cache_used[REGEXP_CACHE_SIZE];
+static unsigned long regexp_cache_clock = 0;
+
+Regexp *regexp_cache_get(const char *pattern, const size_t len, const char **error) {
+    int victim = 0;
+    for (int i = 0; i < REGEXP_CACHE_SIZE; i++) {
+        Regexp *re = regexp_cache[i];
+        if (re != NULL && re->source_len == len && memcmp(re->source, pattern, len) == 0) {
+            regexp_cache_used[i] = ++regexp_cache_clock;
+            regexp_retain(re);
+            return re;
+        }
+        if (regexp_cache_used[i] < regexp_cache_used[victim]) victim = i;
+    }
+
+    Regexp *re = regexp_compile(pattern, len, error);
+    if (re == NULL) return NULL;
+
+    // Replace the least recently used pattern, the cache holds its own reference
+    regexp_release(regexp_cache[victim]);
+    regexp_retain(re);
+    regexp_cache[victim] = re;
+    regexp_cache_used[victim] = ++regexp_cache_clock;
+    return re;
+}
+
+// ---- MATCHING ----
+
+static void dfa_cache_init(DfaCache *C, const int entry, const bool leftmost) {
+    memset(C, 0, sizeof(DfaCache));
+    C->start = -1;
+    C->entry = entry;
+    C->leftmost = leftmost;
+}
+
+static void dfa_cache_clear(DfaCache *C) {
+    for (int i = 0; i < C->num; i++) {
+        free(C->states[i]->set);
+        free(C->states[i]);
+    }
+    C->num = 0;
+    C->bytes = 0;
+    C->start = -1;
+    C->flushes++;
+    if (C->table) memset(C->table, 0xff, sizeof(int) * C->table_size);
+}
+
+static void dfa_cache_free(DfaCache *C) {
+    dfa_cache_clear(C);
+    free(C->states);
+    free(C->trans);
+    free(C->table);
+}
+
+static unsigned int set_hash(const int *set, const int n, const bool seen) {
+    unsigned int h = 2166136261u ^ (unsigned int) seen;
+    for (int i = 0; i < n; i++) {
+        h ^= (unsigned int) set[i];
+        h *= 16777619u;
+    }
+    return h;
+}
+
+static void table_insert(DfaCache *C, const int idx) {
+    unsigned int mask = (unsigned int) C->table_size - 1;
+    unsigned int h = set_hash(C->states[idx]->set, C->states[idx]->n, C->states[idx]->seen) & mask;
+    while (C->table[h] != -1) h = (h + 1) & mask;
+    C->table[h] = idx;
+}
+
+/**
+ * @brief Get the state for an NFA set, building it if it does not exist.
+ * @note This can throw away every other state when over budget.
+ */
+static int dfa_state(RegexpDFA *D, DfaCache *C, const int *set, const int n, const bool seen) {
+    if (C->table != NULL) {
+        unsigned int mask = (unsigned int) C->table_size - 1;
+        unsigned int h = set_hash(set, n, seen) & mask;
+        while (C->table[h] != -1) {
+            DfaState *S = C->states[C->table[h]];
+            if (S->n == n && S->seen == seen && memcmp(S->set, set, sizeof(int) * n) == 0) return C->table[h];
+            h = (h + 1) & mask;
+        }
+    }
+
+    size_t bytes = sizeof(DfaState) + sizeof(int) * (n + 256);
+    if (C->bytes + bytes > REGEXP_DFA_BUDGET && C->num > 0) dfa_cache_clear(C);
+
+    DfaState *S = malloc(sizeof(DfaState));
+    if (S == NULL) exit(1);
+    S->set = malloc(sizeof(int) * (n > 0 ? n : 1));
+    if (S->set == NULL) exit(1);
+    memcpy(S->set, set, sizeof(int) * n);
+    S->n = n;
+    S->match = false;
+    S->seen = seen;
+    for (int i = 0; i < n; i++) if (set[i] != DFA_GROUP && D->re->states[set[i]].kind == NFA_MATCH) S->match = true;
+
+    if (C->num == C->cap) {
+        C->cap = C->cap ? C->cap * 2 : 16;
+        C->states = realloc(C->states, sizeof(DfaState *) * C->cap);
+        C->trans = realloc(C->trans, sizeof(int) * 256 * C->cap);
+        if (C->states == NULL || C->trans == NULL) exit(1);
+    }
+    C->states[C->num] = S;
+    memset(&C->trans[C->num * 256], 0xff, sizeof(int) * 256);
+    C->bytes += bytes;
+
+    // Keep the table at most half full
+    if ((C->num + 1) * 2 > C->table_size) {
+        free(C->table);
+        C->table_size = C->table_size ? C->table_size * 2 : 64;
+        C->table = malloc(sizeof(int) * C->table_size);
+        if (C->table == NULL) exit(1);
+        memset(C->table, 0xff, sizeof(int) * C->table_size);
+        for (int i = 0; i < C->num; i++) table_insert(C, i);
+    }
+    table_insert(C, C->num);
+
+    return C->num++;
+}
+
+/**
+ * @brief Add the epsilon closure of an NFA state to the scratch set.
+ */
+static void closure_add(RegexpDFA *D, const int s) {
+    const NfaState *states = D->re->states;
+    int top = 0;
+    D->stack[top++] = s;
+
+    while (top > 0) {
+        int i = D->stack[--top];
+        if (i < 0 || D->mark[i] == D->mark_gen) continue;
+        D->mark[i] = D->mark_gen;
+
+        if (states[i].kind == NFA_SPLIT) {
+            D->stack[top++] = states[i].out1;
+            D->stack[top++] = states[i].out;
+        } else {
+            D->scratch[D->scratch_n++] = i;
+        }
+    }
+}
+
+static void closure_begin(RegexpDFA *D) {
+    if (D->mark_gen == INT_MAX) {
+        memset(D->mark, 0, sizeof(int) * D->re->num_states);
+        D->mark_gen = 0;
+    }
+    D->mark_gen++;
+    D->scratch_n = 0;
+}
+
+static int compare_int(const void *a, const void *b) {
+    return *(const int *) a - *(const int *) b;
+}
+
+/**
+ * @brief Close the group of NFA states added to the scratch set since 'group'.
+ * @note The states in a group are sorted so equal sets give the same DFA state.
+ */
+static void closure_group_end(RegexpDFA *D, int *group) {
+    if (D->scratch_n == *group) return;
+    qsort(D->scratch + *group, D->scratch_n - *group, sizeof(int), compare_int);
+    D->scratch[D->scratch_n++] = DFA_GROUP;
+    *group = D->scratch_n;
+}
+
+/**
+ * @brief Build the DFA state for the groups in the scratch set.
+ */
+static int closure_state(RegexpDFA *D, DfaCache *C, const bool seen) {
+    if (D->scratch_n > 0) D->scratch_n--;
+    return dfa_state(D, C, D->scratch, D->scratch_n, seen);
+}
+
+static int dfa_start(RegexpDFA *D, DfaCache *C) {
+    if (C->start != -1) return C->start;
+
+    int group = 0;
+    closure_begin(D);
+    closure_add(D, C->entry);
+    closure_group_end(D, &group);
+    C->start = closure_state(D, C, false);
+    return C->start;
+}
+
+static int dfa_next(RegexpDFA *D, DfaCache *C, const int s, const unsigned char c) {
+    int next = C->trans[s * 256 + c];
+    if (next >= 0) return next;
+
+    const NfaState *states = D->re->states;
+    const DfaState *S = C->states[s];
+
+    // A state reached from two starts stays in the group of the older one
+    int group = 0;
+    bool matched = false;
+    closure_begin(D);
+    for (int i = 0; i <= S->n; i++) {
+        if (i == S->n || S->set[i] == DFA_GROUP) {
+            closure_group_end(D, &group);
+            // Matches from newer starts are not leftmost
+            if (matched) break;
+            continue;
+        }
+        const NfaState *n = &states[S->set[i]];
+        if (n->kind == NFA_SET && set_has(n->set, c)) closure_add(D, n->out);
+        if (n->kind == NFA_MATCH) matched = C->leftmost;
+    }
+    bool seen = C->leftmost && (S->seen || S->match);
+    if (C->leftmost && !seen) {
+        closure_add(D, C->entry);
+        closure_group_end(D, &group);
+    }
+
+    unsigned long flushes = C->flushes;
+    next = closure_state(D, C, seen);
+    if (flushes == C->flushes) C->trans[s * 256 + c] = next;
+    return next;
+}
+
+RegexpDFA *regexp_dfa_new(Regexp *re) {
+    RegexpDFA *D = calloc(1, sizeof(RegexpDFA));
+    if (D == NULL) exit(1);
+
+    regexp_retain(re);
+    D->re = re;
+    dfa_cache_init(&D->caches[0], re->start, true);
+    dfa_cache_init(&D->caches[1], re->start, false);
+    dfa_cache_init(&D->caches[2], re->reverse_start, false);
+
+    // Every state can be on the stack twice, once from each side of a split,
+    // and each state in a set can be followed by a group separator
+    D->mark = calloc(re->num_states, sizeof(int));
+    D->stack = malloc(sizeof(int) * (re->num_states * 2 + 1));
+    D->scratch = malloc(sizeof(int) * (re->num_states * 2 + 1));
+    if (D->mark == NULL || D->stack == NULL || D->scratch == NULL) exit(1);
+
+    return D;
+}
+
+void regexp_dfa_free(RegexpDFA *D) {
+    if (D == NULL) return;
+    for (int i = 0; i < 3; i++) dfa_cache_free(&D->caches[i]);
+    free(D->mark);
+    free(D->stack);
+    free(D->scratch);
+    regexp_release(D->re);
+    free(D);
+}
+
+long regexp_search(RegexpDFA *D, const char *hay, const size_t len, const size_t from, size_t *match_len) {
+    const Regexp *re = D->re;
+    if (from > len || (re->anchor_start && from > 0)) return -1;
+
+    // Find where the leftmost-longest match ends, each byte is read once
+    long end = -1;
+    if (re->anchor_end) {
+        end = (long) len;
+    } else {
+        DfaCache *C = &D->caches[re->anchor_start ? 1 : 0];
+        int s = dfa_start(D, C);
+        if (C->states[s]->match) end = (long) from;
+        for (size_t i = from; i < len; i++) {
+            // Fast path: the transition was already built
+            int next = C->trans[s * 256 + (unsigned char) hay[i]];
+            s = (next >= 0) ? next : dfa_next(D, C, s, (unsigned char) hay[i]);
+            if (C->states[s]->n == 0) break;
+            if (C->states[s]->match) end = (long) i + 1;
+        }
+        if (end == -1) return -1;
+        if (re->anchor_start) {
+            if (match_len) *match_len = (size_t) end;
+            return 0;
+        }
+    }
+
+    // Walk back from the end with the reversed pattern, the leftmost start is
+    // the furthest one it matches
+    DfaCache *C = &D->caches[2];
+    int s = dfa_start(D, C);
+    long start = C->states[s]->match ? end : -1;
+    size_t lowest = re->anchor_start ? 0 : from;
+    for (size_t i = (size_t) end; i > lowest; i--) {
+        int next = C->trans[s * 256 + (unsigned char) hay[i - 1]];
+        s = (next >= 0) ? next : dfa_next(D, C, s, (unsigned char) hay[i - 1]);
+        if (C->states[s]->n == 0) break;
+        if (C->states[s]->match) start = (long) i - 1;
+    }
+    if (start == -1 || (re->anchor_start && start != 0)) return -1;
+
+    if (match_len) *match_len = (size_t) (end - start);
+    return start;
+}
@@ -0,0 +1,284 @@
+#include "registers.h"
+#include "editor.h"
+#include "rows.h"
+#include <limits.h>
+#include <stdlib.h>
+#include <string.h>
+
+Register *register_get(Editor *E, const int name) {
+    if (name == 0 || name == '"') return &E->reg[0];
+    if (name >= 'a' && name <= 'z') return &E->reg[name - 'a' + 1];
+    if (name >= 'A' && name <= 'Z') return &E->reg[name - 'A' + 1];
+    return NULL;
+}
+
+void register_add(Register *R, char *chars, const int start, const int len) {
+    if (R->num == R->cap) {
+        R->cap = R->cap ? R->cap * 2 : 16;
+        R->lines = realloc(R->lines, sizeof(RegisterSlice) * R->cap);
+        if (R->lines == NULL) exit(1);
+    }
+    R->lines[R->num++] = (RegisterSlice) {row_text_share(chars), start, len};
+}
+
+void register_copy(Register *R, const Register *from) {
+    if (R == from) return;
+    register_free(R);
+    for (int i = 0; i < from->num; i++) register_add(R, from->lines[i].chars, from->lines[i].start, from->lines[i].len);
+    R->type = from->type;
+}
+
+void register_free(Register *R) {
+    for (int i = 0; i < R->num; i++) row_text_release(R->lines[i].chars);
+    free(R->lines);
+    memset(R, 0, sizeof(Register));
+}
+
+char *register_text(const Register *R, size_t *len) {
+    size_t size = 0;
+    for (int i = 0; i < R->num; i++) size += R->lines[i].len + 1;
+
+    char *text = malloc(size + 1);
+    if (text == NULL) exit(1);
+
+    // Lines are joined by newlines, only a register of lines ends with one
+    char *p = text;
+    for (int i = 0; i < R->num; i++) {
+        memcpy(p, R->lines[i].chars + R->lines[i].start, R->lines[i].len);
+        p += R->lines[i].len;
+        if (i < R->num - 1 || R->type == REGISTER_LINES) *p++ = '\n';
+    }
+    *p = '\0';
+    *len = p - text;
+    return text;
+}
+
+/**
+ * @brief Empty the register selected for the command, so a yank can fill it.
+ */
+static Register *yank_begin(Editor *E) {
+    Register *R = register_get(E, E->reg_name);
+    if (R == NULL) R = &E->reg[0];
+    register_free(R);
+    return R;
+}
+
+/**
+ * @brief Finish a yank, the unnamed register always holds the last one.
+ */
+static void yank_end(Editor *E, Register *R, const RegisterType type) {
+    R->type = type;
+    register_copy(&E->reg[0], R);
+}
+
+void register_yank_text(Editor *E, const int x0, const int y0, int x1, int y1) {
+    if (y0 < 0 || y0 >= E->num_rows || y1 < y0) return;
+    load_job_wait(E, y1);
+    if (y1 >= E->num_rows) {
+        y1 = E->num_rows - 1;
+        x1 = E->row[y1].size;
+    }
+
+    Register *R = yank_begin(E);
+    for (int y = y0; y <= y1; y++) {
+        erow *row = &E->row[y];
+        int start = (y == y0) ? x0 : 0;
+        int end = (y == y1) ? x1 : row->size;
+        if (start > row->size) start = row->size;
+        if (end > row->size) end = row->size;
+        register_add(R, row->chars, start, (end > start) ? end - start : 0);
+    }
+    yank_end(E, R, REGISTER_CHARS);
+}
+
+void register_yank_lines(Editor *E, const int y, int count) {
+    if (y < 0 || y >= E->num_rows || count <= 0) return;
+    load_job_wait_rows(E, y, count);
+    if (count > E->num_rows - y) count = E->num_rows - y;
+
+    Register *R = yank_begin(E);
+    for (int i = 0; i < count; i++) register_add(R, E->row[y + i].chars, 0, E->row[y + i].size);
+    yank_end(E, R, REGISTER_LINES);
+}
+
+void register_yank_block(Editor *E, const int y, const int count, const int *x, const int *len) {
+    Register *R = yank_begin(E);
+    for (int i = 0; i < count && y + i < E->num_rows; i++) register_add(R, E->row[y + i].chars, x[i], len[i]);
+    yank_end(E, R, REGISTER_BLOCK);
+}
+
+/**
+ * @brief Put lines as new rows, with a single splice.
+ */
+static void put_lines(Editor *E, const Register *R, const bool before, const int count) {
+    // A large count would make more rows than a file can hold
+    size_t rows = (R->num > 0 && count > 0) ? (size_t) R->num * (size_t) count : 0;
+    if (rows == 0) return;
+    if (rows > (size_t) INT_MAX - (size_t) E->num_rows) {
+        editor_set_status_message(E, "Too many lines to put");
+        return;
+    }
+
+    int total = (int) rows;
+    char **chars = calloc(total, sizeof(char *));
+    int *lens = calloc(total, sizeof(int));
+    if (chars == NULL || lens == NULL) exit(1);
+
+    // Whole rows are shared as they are, parts of rows get their own copy
+    for (int i = 0; i < total; i++) {
+        const RegisterSlice *S = &R->lines[i % R->num];
+        if (S->start == 0 && S->chars[S->len] == '\0') {
+            chars[i] = row_text_share(S->chars);
+        } else {
+            chars[i] = row_text_new(S->len);
+            memcpy(chars[i], S->chars + S->start, S->len);
+        }
+        lens[i] = S->len;
+    }
+
+    int y = before ? E->cur_y : E->cur_y + 1;
+    editor_insert_shared_rows(E, y, total, chars, lens);
+    for (int i = 0; i < total; i++) row_text_release(chars[i]);
+    free(chars);
+    free(lens);
+
+    // Move to the first character of the first row
+    E->cur_y = y;
+    E->cur_x = 0;
+    erow *row = &E->row[y];
+    while (E->cur_x < row->size && (row->chars[E->cur_x] == ' ' || row->chars[E->cur_x] == '\t')) E->cur_x++;
+}
+
+/**
+ * @brief Put text inside the cursor row, lines after the first become new rows.
+ */
+static void put_chars(Editor *E, const Register *R, const bool before, const int count) {
+    size_t len;
+    char *text = register_text(R, &len);
+    if (len == 0) {
+        free(text);
+        return;
+    }
+    if (len > (size_t) INT_MAX / (size_t) count) {
+        free(text);
+        editor_set_status_message(E, "Too much text to put");
+        return;
+    }
+
+    char *all = malloc(len * count);
+    if (all == NULL) exit(1);
+    for (int i = 0; i < count; i++) memcpy(all + len * i, text, len);
+    free(text);
+
+    int x = E->cur_x;
+    if (!before && E->row[E->cur_y].size > 0) x++;
+    if (x > E->row[E->cur_y].size) x = E->row[E->cur_y].size;
+
+    int end_x, end_y;
+    editor_insert_text(E, x, E->cur_y, all, (int) (len * count), &end_x, &end_y);
+    free(all);
+
+    // Text on a single row leaves the cursor on its last character
+    if (R->num == 1) E->cur_x = end_x - 1;
+    else E->cur_x = x;
+}
+
+/**
+ * @brief Find the position of a render column in a row.
+ * @param pad Number of spaces needed to reach the column (will be updated)
+ */
+static int column_x(const erow *row, const int col, int *pad) {
+    int rx = 0, x = 0;
+    while (x < row->size && rx < col) {
+        rx += (row->chars[x] == '\t') ? TAB_STOP - rx % TAB_STOP : 1;
+        x++;
+    }
+    *pad = (rx < col) ? col - rx : 0;
+    return x;
+}
+
+/**
+ * @brief Put a block at the cursor column, one line per row, padding short rows.
+ */
+static void put_block(Editor *E, const Register *R, const bool before, const int count) {
+    erow *row = &E->row[E->cur_y];
+    int x = E->cur_x;
+    if (!before && row->size > 0) x++;
+    if (x > row->size) x = row->size;
+    int col = editor_row_get_render_x(row, x) - NUM_COL_SIZE;
+
+    // Rows past the end of the file are added first, with one splice
+    int missing = E->cur_y + R->num - E->num_rows;
+    if (missing > 0) {
+        char **texts = malloc(sizeof(char *) * missing);
+        int *lens = calloc(missing, sizeof(int));
+        if (texts == NULL || lens == NULL) exit(1);
+        for (int i = 0; i < missing; i++) texts[i] = "";
+        editor_insert_rows(E, E->num_rows, missing, texts, lens);
+        free(texts);
+        free(lens);
+    }
+
+    // Lines of the block are padded to the same width when they are repeated
+    int width = 0;
+    for (int i = 0; i < R->num; i++) {
+        const RegisterSlice *S = &R->lines[i];
+        int w = editor_row_get_render_x(&(erow) {.size = S->len, .chars = S->chars + S->start}, S->len) - NUM_COL_SIZE;
+        if (w > width) width = w;
+    }
+
+    char *line = NULL;
+    for (int i = 0; i < R->num; i++) {
+        const RegisterSlice *S = &R->lines[i];
+        int y = E->cur_y + i, pad;
+        int at = column_x(&E->row[y], col, &pad);
+        int w = editor_row_get_render_x(&(erow) {.size = S->len, .chars = S->chars + S->start}, S->len) - NUM_COL_SIZE;
+
+        // Padding before the block, then the copies, each padded to the width
+        // of the block except the last one
+        size_t size = (size_t) pad + (size_t) (S->len + width) * (size_t) count;
+        if (size == 0) continue;
+        if (size > (size_t) INT_MAX - (size_t) E->row[y].size) {
+            editor_set_status_message(E, "Block is too wide to put");
+            break;
+        }
+        line = realloc(line, size);
+        if (line == NULL) exit(1);
+        int n = pad;
+        memset(line, ' ', pad);
+        for (int k = 0; k < count; k++) {
+            memcpy(line + n, S->chars + S->start, S->len);
+            n += S->len;
+            if (k < count - 1) {
+                memset(line + n, ' ', width - w);
+                n += width - w;
+            }
+        }
+        editor_row_insert_span(E, at, y, line, n);
+    }
+    free(line);
+
+    E->cur_x = x;
+}
+
+void register_put(Editor *E, const bool before, int count) {
+    Register *R = register_get(E, E->reg_name);
+    if (R == NULL || R->num == 0) {
+        editor_set_status_message(E, "Nothing in register %c", E->reg_name ? E->reg_name : '"');
+        return;
+    }
+    if (count < 1) count = 1;
+
+    switch (R->type) {
+        case REGISTER_LINES:
+            put_lines(E, R, before, count);
+            break;
+        case REGISTER_CHARS:
+            put_chars(E, R, before, count);
+            break;
+        case REGISTER_BLOCK:
+            put_block(E, R, before, count);
+            break;
+    }
+    if (R->type == REGISTER_LINES && R->num * count > 2) editor_set_status_message(E, "%d more lines", R->num * count);
+}
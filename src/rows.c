@@ -1,29 +1,364 @@
 #include "rows.h"
+#include "search_job.h"
+#include "undo.h"
+#include <stddef.h>
 #include <string.h>
 #include <stdlib.h>
 #include <ncurses.h>
+#include <pthread.h>
+#include <unistd.h>
 
 // TODO: Check for errors in allocation
 
+static RowText *row_text_header(char *chars) {
+    return (RowText *) (chars - offsetof(RowText, chars));
+}
+
+char *row_text_new(const int len) {
+    RowText *T = malloc(sizeof(RowText) + len + 1);
+    if (T == NULL) exit(1);
+    T->refs = 1;
+    T->chars[len] = '\0';
+    return T->chars;
+}
+
+char *row_text_share(char *chars) {
+    __atomic_add_fetch(&row_text_header(chars)->refs, 1, __ATOMIC_RELAXED);
+    return chars;
+}
+
+void row_text_release(char *chars) {
+    if (chars == NULL) return;
+    RowText *T = row_text_header(chars);
+    if (__atomic_sub_fetch(&T->refs, 1, __ATOMIC_ACQ_REL) == 0) free(T);
+}
+
+/**
+ * @brief Make the content of a row its own, with room for size characters and the '\0'.
+ * @note Shared content is copied, this is the copy on write of the rows.
+ */
+static void row_reserve(erow *row, const int size) {
+    RowText *T = row_text_header(row->chars);
+    if (__atomic_load_n(&T->refs, __ATOMIC_ACQUIRE) == 1) {
+        T = realloc(T, sizeof(RowText) + size + 1);
+        if (T == NULL) exit(1);
+        row->chars = T->chars;
+        return;
+    }
+
+    char *chars = row_text_new(size);
+    memcpy(chars, row->chars, row->size + 1);
+    row_text_release(row->chars);
+    row->chars = chars;
+}
+
+/**
+ * @brief Notify the editor subsystems that the rows are about to change.
+ * @param E Editor state
+ * @note Background readers of the rows have to stop before any memory is moved.
+ */
+static void rows_begin_edit(Editor *E) {
+    search_job_cancel(E);
+    trigram_index_cancel(E);
+}
+
+/**
+ * @brief Notify the editor subsystems that the content of a row changed.
+ * @param E Editor state
+ * @param y Row that was changed
+ */
+static void row_changed(Editor *E, const int y) {
+    E->row[y].version = ++E->row_version;
+    bracket_index_update_row(E, y);
+    trigram_index_update_row(E, y);
+}
+
+/**
+ * @brief Notify the editor subsystems that rows were inserted or removed.
+ * @param E Editor state
+ * @param y Position the rows were inserted or removed at
+ * @param count Number of rows inserted, negative for removed rows
+ */
+static void rows_changed(Editor *E, const int y, const int count) {
+    if (count > 0) bracket_index_splice(E, y, 0, count);
+    else bracket_index_splice(E, y, -count, 0);
+    trigram_index_shift_rows(E, y, count);
+}
+
+/**
+ * @brief Notify the editor subsystems that rows were inserted or removed at several places.
+ * @param E Editor state
+ * @param ys Sorted rows, their positions before they were removed, or after they were inserted
+ * @param count Number of rows
+ * @param inserted The rows were inserted, not removed
+ */
+static void rows_changed_list(Editor *E, const int *ys, const int count, const bool inserted) {
+    // The brackets are refilled over the whole range from the first row to the last
+    int span = ys[count - 1] - ys[0] + 1;
+    if (inserted) bracket_index_splice(E, ys[0], span - count, span);
+    else bracket_index_splice(E, ys[0], span, span - count);
+    trigram_index_shift_row_list(E, ys, count, inserted);
+}
+
 void editor_remove_row(Editor *E, const int pos) {
-    // Bounds check
-    if (E->num_rows == 1 || pos >= E->num_rows || pos == 0) return;
+    // Bounds check, the last row is never removed
+    if (E->num_rows <= 1 || pos < 0 || pos >= E->num_rows) return;
 
+    rows_begin_edit(E);
     // Get the row we want to remove
     erow *row = &E->row[pos];
+    undo_record_row_delete(E, pos, row->chars, row->size);
+    E->num_bytes -= row->size;
     editor_free_row(row);
 
-    // Move the memory on top of the old row
+    // Move the memory on top of the old row. The renders move with the rows, so
+    // nothing has to be rendered again.
     memmove(&E->row[pos], &E->row[pos + 1], sizeof(erow) * (E->num_rows - pos - 1));
 
-    // Generate new renders
-    // TODO: If any render issues come along with deleting, check here
-    for (int i = pos; i < E->num_rows; i++) {
-        editor_render_row(&E->row[i]);
-    }
-
     // Decrease the row count
     E->num_rows--;
+    rows_changed(E, pos, -1);
+}
+
+void editor_delete_rows(Editor *E, const int y, int count) {
+    // Bounds check
+    if (y < 0 || y >= E->num_rows || count <= 0) return;
+    load_job_wait_rows(E, y, count);
+    if (count > E->num_rows - y) count = E->num_rows - y;
+
+    // The file always keeps a row, the last one is emptied instead
+    bool empty_first = (count == E->num_rows);
+    if (empty_first) count--;
+
+    rows_begin_edit(E);
+    for (int i = 0; i < count; i++) {
+        erow *row = &E->row[y + i];
+        undo_record_row_delete(E, y, row->chars, row->size);
+        E->num_bytes -= row->size;
+        editor_free_row(row);
+    }
+
+    memmove(&E->row[y], &E->row[y + count], sizeof(erow) * (E->num_rows - y - count));
+    E->num_rows -= count;
+    if (count > 0) rows_changed(E, y, -count);
+
+    if (empty_first) editor_set_row_chars(E, 0, row_text_new(0), 0);
+}
+
+void editor_delete_row_list(Editor *E, const int *ys, const int count) {
+    if (count <= 0) return;
+    if (count >= E->num_rows) {
+        editor_delete_rows(E, 0, E->num_rows);
+        return;
+    }
+
+    rows_begin_edit(E);
+
+    // Each run of rows that stays is moved once, down over the rows removed before it
+    int to = ys[0];
+    for (int i = 0; i < count; i++) {
+        erow *row = &E->row[ys[i]];
+        undo_record_row_delete(E, ys[i] - i, row->chars, row->size);
+        E->num_bytes -= row->size;
+        editor_free_row(row);
+
+        int next = (i + 1 < count) ? ys[i + 1] : E->num_rows;
+        int keep = next - ys[i] - 1;
+        memmove(&E->row[to], &E->row[ys[i] + 1], sizeof(erow) * keep);
+        to += keep;
+    }
+    E->num_rows -= count;
+    rows_changed_list(E, ys, count, false);
+}
+
+void editor_insert_row_list(Editor *E, const int *ys, const int count, char *const *s, const int *len) {
+    if (count <= 0 || ys[0] < 0 || ys[count - 1] >= E->num_rows + count) return;
+
+    rows_begin_edit(E);
+    E->row = realloc(E->row, sizeof(erow) * (E->num_rows + count));
+    if (E->row == NULL) exit(1);
+
+    // From the end, each run of rows that stays is moved once, up past the
+    // rows inserted before it
+    int end = E->num_rows + count;
+    for (int i = count - 1; i >= 0; i--) {
+        memmove(&E->row[ys[i] + 1], &E->row[ys[i] - i], sizeof(erow) * (end - ys[i] - 1));
+        end = ys[i];
+
+        erow *row = &E->row[ys[i]];
+        row->size = len[i];
+        row->chars = row_text_new(len[i]);
+        memcpy(row->chars, s[i], len[i]);
+        E->num_bytes += len[i];
+        row->render = NULL;
+        row->rsize = 0;
+        row->bracket_gen = 0;
+        row->version = ++E->row_version;
+        row->marked = false;
+    }
+    E->num_rows += count;
+
+    for (int i = 0; i < count; i++) undo_record_row_insert(E, ys[i], s[i], len[i]);
+    rows_changed_list(E, ys, count, true);
+}
+
+void editor_move_rows(Editor *E, const int y, int count, const int to) {
+    if (y < 0 || y >= E->num_rows || count <= 0) return;
+    load_job_wait_rows(E, y, count);
+    if (count > E->num_rows - y) count = E->num_rows - y;
+    if (to == y || to < 0 || to + count > E->num_rows) return;
+
+    rows_begin_edit(E);
+    for (int i = 0; i < count; i++) undo_record_row_delete(E, y, E->row[y + i].chars, E->row[y + i].size);
+    for (int i = 0; i < count; i++) undo_record_row_insert(E, to + i, E->row[y + i].chars, E->row[y + i].size);
+
+    erow *moved = malloc(sizeof(erow) * count);
+    if (moved == NULL) exit(1);
+    memcpy(moved, &E->row[y], sizeof(erow) * count);
+    if (to < y) memmove(&E->row[to + count], &E->row[to], sizeof(erow) * (y - to));
+    else memmove(&E->row[y], &E->row[y + count], sizeof(erow) * (to - y));
+    memcpy(&E->row[to], moved, sizeof(erow) * count);
+    free(moved);
+
+    int span = count + ((to < y) ? y - to : to - y);
+    bracket_index_splice(E, (to < y) ? to : y, span, span);
+    trigram_index_move_rows(E, y, count, to);
+}
+
+/**
+ * @brief Part of the rows handed to one thread by editor_for_rows.
+ */
+typedef struct {
+    Editor *E;
+    int y0;
+    int y1;
+    void (*fn)(Editor *E, int y, void *arg);
+    void *arg;
+} RowsTask;
+
+static void *rows_worker(void *arg) {
+    RowsTask *T = arg;
+    for (int y = T->y0; y <= T->y1; y++) T->fn(T->E, y, T->arg);
+    return NULL;
+}
+
+void editor_for_rows(Editor *E, int y0, int y1, void (*fn)(Editor *E, int y, void *arg), void *arg) {
+    if (y0 < 0) y0 = 0;
+    if (y1 >= y0) load_job_wait(E, y1);
+    if (y1 >= E->num_rows) y1 = E->num_rows - 1;
+    if (y1 < y0) return;
+
+    // Small ranges are not worth starting threads for
+    int count = y1 - y0 + 1;
+    int threads = 1;
+    if (count >= ROWS_PARALLEL_MIN) {
+        long cores = sysconf(_SC_NPROCESSORS_ONLN);
+        threads = (int) (cores > 1 ? cores : 1);
+        if (threads > ROWS_MAX_THREADS) threads = ROWS_MAX_THREADS;
+        if (threads > count / (ROWS_PARALLEL_MIN / 4)) threads = count / (ROWS_PARALLEL_MIN / 4);
+    }
+
+    RowsTask tasks[ROWS_MAX_THREADS];
+    pthread_t ids[ROWS_MAX_THREADS];
+    int started = 0;
+    for (int i = 0; i < threads; i++) {
+        tasks[i] = (RowsTask) {E, y0 + (int) ((long) count * i / threads),
+                               y0 + (int) ((long) count * (i + 1) / threads) - 1, fn, arg};
+    }
+
+    // The calling thread takes the first part, and falls back to doing every
+    // part a thread could not be started for
+    for (int i = 1; i < threads; i++) {
+        if (pthread_create(&ids[i], NULL, rows_worker, &tasks[i]) != 0) break;
+        started = i;
+    }
+    rows_worker(&tasks[0]);
+    for (int i = started + 1; i < threads; i++) rows_worker(&tasks[i]);
+    for (int i = 1; i <= started; i++) pthread_join(ids[i], NULL);
+}
+
+void editor_edit_rows(Editor *E, int y0, int y1, void (*fn)(Editor *E, int y, void *arg), void *arg) {
+    if (y0 < 0) y0 = 0;
+    if (y1 >= y0) load_job_wait(E, y1);
+    if (y1 >= E->num_rows) y1 = E->num_rows - 1;
+    if (y1 < y0) return;
+
+    // The threads change the sizes, the byte count is taken from the range
+    // before and after
+    rows_begin_edit(E);
+    for (int y = y0; y <= y1; y++) E->num_bytes -= E->row[y].size;
+    editor_for_rows(E, y0, y1, fn, arg);
+
+    // The subsystems are told once the threads are done. The renders are
+    // generated again when the rows are drawn.
+    for (int y = y0; y <= y1; y++) {
+        erow *row = &E->row[y];
+        E->num_bytes += row->size;
+        free(row->render);
+        row->render = NULL;
+        row->rsize = 0;
+        row_changed(E, y);
+    }
+}
+
+void row_splice(erow *row, const int x, const int del, const char *s, const int len) {
+    row_reserve(row, (len > del) ? row->size + len - del : row->size);
+
+    // Move the rest of the row, including the '\0', then copy the text in
+    memmove(&row->chars[x + len], &row->chars[x + del], row->size - x - del + 1);
+    if (len > 0) memcpy(&row->chars[x], s, len);
+    row->size += len - del;
+}
+
+void editor_splice_rows(Editor *E, const RowEdit *edits, const int count) {
+    if (count <= 0) return;
+    rows_begin_edit(E);
+
+    for (int i = 0; i < count;) {
+        int y = edits[i].y;
+        int end = i;
+        long size = E->row[y].size;
+        while (end < count && edits[end].y == y) {
+            size += edits[end].len - edits[end].del;
+            end++;
+        }
+
+        // Record the edits in order, each at its position after the ones before it
+        erow *row = &E->row[y];
+        int shift = 0;
+        for (int k = i; k < end; k++) {
+            const RowEdit *R = &edits[k];
+            if (R->del > 0) undo_record_delete(E, R->x + shift, y, &row->chars[R->x], R->del);
+            if (R->len > 0) undo_record_insert(E, R->x + shift, y, R->s, R->len);
+            shift += R->len - R->del;
+        }
+
+        // Build the new content in one pass over the row
+        char *chars = row_text_new((int) size);
+        char *p = chars;
+        int from = 0;
+        for (int k = i; k < end; k++) {
+            const RowEdit *R = &edits[k];
+            memcpy(p, &row->chars[from], R->x - from);
+            p += R->x - from;
+            if (R->len > 0) memcpy(p, R->s, R->len);
+            p += R->len;
+            from = R->x + R->del;
+        }
+        memcpy(p, &row->chars[from], row->size - from);
+
+        row_text_release(row->chars);
+        row->chars = chars;
+        E->num_bytes += size - row->size;
+        row->size = (int) size;
+
+        // The render is generated again when the row is drawn
+        free(row->render);
+        row->render = NULL;
+        row->rsize = 0;
+        row_changed(E, y);
+        i = end;
+    }
 }
 
 void editor_render_row(erow *row) {
@@ -54,13 +389,16 @@ void editor_render_row(erow *row) {
     row->rsize = idx;
 }
 
-void editor_draw_row(erow *row, int pos) {
+void editor_draw_row(Editor *E, erow *row, int pos) {
     // Render the row if it doesn't exist, should only have to happen on load.
     if (row->render == NULL) editor_render_row(row);
-    mvwprintw(stdscr, pos, NUM_COL_SIZE, "%s", row->render);
+    window_print(E, pos, row->render, row->rsize);
+
+    // Paint the search matches over the text
+    editor_draw_row_matches(E, row, pos);
 }
 
-void editor_draw_row_num(int cur_y, int pos, int offset) {
+void editor_draw_row_num(Editor *E, int cur_y, int pos, int offset) {
     int line_num = 0;
     char fmt[10];
 
@@ -77,174 +415,275 @@ void editor_draw_row_num(int cur_y, int pos, int offset) {
     if (cur_y == pos) snprintf(fmt, sizeof(fmt), "%%%dd  ", NUM_COL_SIZE - 2);
     else snprintf(fmt, sizeof(fmt), "%%%dd ", NUM_COL_SIZE - 1);
 
-    attron(COLOR_PAIR(2) | A_BOLD);
-    mvwprintw(stdscr, pos, 0, fmt, line_num);
-    attroff(COLOR_PAIR(2) | A_BOLD);
+    WINDOW *win = window_canvas(E);
+    wattron(win, COLOR_PAIR(2) | A_BOLD);
+    mvwprintw(win, pos, 0, fmt, line_num);
+    wattroff(win, COLOR_PAIR(2) | A_BOLD);
 }
 
 void editor_free_row(erow *row) {
-    if (row->chars != NULL) free(row->chars);
-    // TODO: This was causing a double free when backspace pressed at x = 0
-    // if (row->render != NULL) free(row->render);
+    row_text_release(row->chars);
+    free(row->render);
+    row->chars = NULL;
+    row->render = NULL;
 }
 
-void editor_insert_row_above(Editor *E, int pos, char *s, size_t len) {
+/**
+ * @brief Insert count rows at pos, with copies of the text or sharing it.
+ */
+static void insert_rows(Editor *E, const int pos, const int count, char *const *s, const int *len, const bool share) {
     // Bounds check
-    if (pos < 0 || pos > E->num_rows) return;
-
-    // Reallocate enough memory for the new row
-    E->row = realloc(E->row, sizeof(erow) * (E->num_rows + 1));
-
-    // Move all memory (rows) after (below) the position back one to make room for the new row.
-    // We don't have to increment E.num_rows before this because num_rows stores 1 higher than the index (it's not 0 indexed)
-    for (int i = E->num_rows; i > pos; i--) {
-        int oldSize = E->row[i - 1].size;
-        char *oldChars = E->row[i - 1].chars;
-
-        E->row[i].chars = malloc(oldSize + 1);
-        memcpy(E->row[i].chars, oldChars, oldSize);
-        E->row[i].chars[oldSize] = '\0';
-        E->row[i].size = oldSize;
-        editor_render_row(&E->row[i]);
+    if (pos < 0 || pos > E->num_rows || count <= 0) return;
+
+    rows_begin_edit(E);
+
+    // Open a gap for the rows with a single move, the rows after it keep their
+    // content and render
+    E->row = realloc(E->row, sizeof(erow) * (E->num_rows + count));
+    if (E->row == NULL) exit(1);
+    memmove(&E->row[pos + count], &E->row[pos], sizeof(erow) * (E->num_rows - pos));
+
+    for (int i = 0; i < count; i++) {
+        erow *row = &E->row[pos + i];
+        row->size = len[i];
+        E->num_bytes += len[i];
+        if (share) {
+            row->chars = row_text_share(s[i]);
+        } else {
+            row->chars = row_text_new(len[i]);
+            memcpy(row->chars, s[i], len[i]);
+        }
 
-        free(oldChars);
+        // The render is generated when the row is drawn
+        row->render = NULL;
+        row->rsize = 0;
+        row->bracket_gen = 0;
+        row->version = ++E->row_version;
+        row->marked = false;
+        undo_record_row_insert(E, pos + i, s[i], len[i]);
     }
 
-    // Allocate memory for the new row, of size len + 1
-    // Plus one is for the '\0'
-    // Then, copy string into the new row and append '\0'
-    E->row[pos].size = len;
-    E->row[pos].chars = malloc(len + 1);
-    memcpy(E->row[pos].chars, s, len);
-    E->row[pos].chars[len] = '\0';
-
-    // TODO: Create an updated render of the row
-    editor_render_row(&E->row[pos]);
-
-    // Increment the number of rows
-    E->num_rows++;
+    E->num_rows += count;
+    rows_changed(E, pos, count);
 }
 
-void editor_insert_row_below(Editor *E, int pos, char *s, size_t len) {
-    // Bounds check
-    if (pos < 0 || pos > E->num_rows) return;
-
-    // Reallocate enough memory for the new row
-    E->row = realloc(E->row, sizeof(erow) * (E->num_rows + 1));
-
-    // Move all memory (rows) after (below) the position back one to make room for the new row.
-    // We don't have to increment E.num_rows before this because num_rows stores 1 higher than the index (it's not 0 indexed)
-    for (int i = E->num_rows; i > pos; i--) {
-        int oldSize = E->row[i - 1].size;
-        char *oldChars = E->row[i - 1].chars;
-
-        E->row[i].chars = malloc(oldSize + 1);
-        memcpy(E->row[i].chars, oldChars, oldSize);
-        E->row[i].chars[oldSize] = '\0';
-        E->row[i].size = oldSize;
-        editor_render_row(&E->row[i]);
-
-        free(oldChars);
-    }
+void editor_insert_rows(Editor *E, const int pos, const int count, char *const *s, const int *len) {
+    insert_rows(E, pos, count, s, len, false);
+}
 
-    // Allocate memory for the new row, of size len + 1
-    // Plus one is for the '\0'
-    // Then, copy string into the new row and append '\0'
-    E->row[pos].size = len;
-    E->row[pos].chars = malloc(len + 1);
-    memcpy(E->row[pos].chars, s, len);
-    E->row[pos].chars[len] = '\0';
+void editor_insert_shared_rows(Editor *E, const int pos, const int count, char *const *chars, const int *len) {
+    insert_rows(E, pos, count, chars, len, true);
+}
 
-    // TODO: Create an updated render of the row
-    editor_render_row(&E->row[pos]);
+void editor_insert_row_above(Editor *E, int pos, char *s, size_t len) {
+    int size = (int) len;
+    editor_insert_rows(E, pos, 1, &s, &size);
+}
 
-    // Increment the number of rows
-    E->num_rows++;
+void editor_insert_row_below(Editor *E, int pos, char *s, size_t len) {
+    int size = (int) len;
+    editor_insert_rows(E, pos, 1, &s, &size);
 }
 
 void editor_insert_newline(Editor *E) {
+    rows_begin_edit(E);
+
     size_t tabs;
     char *indent = editor_calculate_indent(E, &tabs, E->cur_y);
 
     if (E->cur_x == 0) {
-        editor_insert_row_below(E, E->cur_y, indent, tabs);
-        editor_render_row(&E->row[E->cur_y]);
+        // The indent goes on a new row above the cursor
+        editor_split_row(E, 0, E->cur_y);
+        editor_row_insert_span(E, 0, E->cur_y, indent, (int) tabs);
     } else {
-        erow *row = &E->row[E->cur_y];
-        // Create the new string with the appended tabs, +1 for null terminator
-        const size_t len = tabs + (row->size - E->cur_x);
-        char *newChars = (char *)malloc((len + 1) * sizeof(char));
-
-        // Concat the strings together
-        strcpy(newChars, indent);
-        strcat(newChars, &row->chars[E->cur_x]);
-        newChars[len] = '\0';
-
-        editor_insert_row_below(E, E->cur_y + 1, newChars, len);
-        editor_render_row(&E->row[E->cur_y + 1]);
-        row = &E->row[E->cur_y];
-        row->size = E->cur_x;
-        editor_render_row(row);
+        // The rest of the row moves to a new row below, after the indent
+        editor_split_row(E, E->cur_x, E->cur_y);
+        editor_row_insert_span(E, 0, E->cur_y + 1, indent, (int) tabs);
     }
 
-    E->dirty++;
     E->cur_y++;
     E->cur_x = tabs;
     free(indent);
 }
 
 void row_append_str(Editor *E, erow *row, const char *s, const int len) {
-    // Update size
-    // TODO: Why do I need this silly 0 check?
-    row->size = (row->size == 0) ? len : row->size + len;
+    int y = (int) (row - E->row);
+    editor_row_insert_span(E, row->size, y, s, len);
+
+    // Set the cursor to the new position in the line
+    E->cur_x = E->row[y].size - len;
+}
+
+void editor_row_insert_span(Editor *E, const int x, const int y, const char *s, const int len) {
+    // Bounds check
+    if (y < 0 || y >= E->num_rows || len <= 0) return;
+    if (x < 0 || x > E->row[y].size) return;
 
-    // Reallocate memory to make space for new content, one extra byte for the \0
-    row->chars = realloc(row->chars, sizeof(char) * (row->size + 1));
+    rows_begin_edit(E);
+    undo_record_insert(E, x, y, s, len);
 
-    // Copy the string into the row and append \0
-    memcpy(&row->chars[row->size - len], s, len);
+    erow *row = &E->row[y];
+
+    // Make room for the span and the '\0', then move the rest of the row over
+    row_reserve(row, row->size + len);
+    memmove(&row->chars[x + len], &row->chars[x], row->size - x);
+    memcpy(&row->chars[x], s, len);
+    row->size += len;
+    E->num_bytes += len;
     row->chars[row->size] = '\0';
 
-    // Set the cursor to the new position in the line
-    E->cur_x = row->size - len;
+    editor_render_row(row);
+    row_changed(E, y);
+}
+
+void editor_row_delete_span(Editor *E, const int x, const int y, int len) {
+    // Bounds check
+    if (y < 0 || y >= E->num_rows) return;
+    if (x < 0 || x >= E->row[y].size) return;
+
+    erow *row = &E->row[y];
+    if (len > row->size - x) len = row->size - x;
+    if (len <= 0) return;
+
+    rows_begin_edit(E);
+    undo_record_delete(E, x, y, &row->chars[x], len);
+
+    // Move the rest of the row over the span, including the '\0'
+    // We don't need to malloc less space, we just wait for the memory to be free when another change takes place
+    row_reserve(row, row->size);
+    memmove(&row->chars[x], &row->chars[x + len], row->size - x - len + 1);
+    row->size -= len;
+    E->num_bytes -= len;
 
-    // Update the render in the row
     editor_render_row(row);
+    row_changed(E, y);
 }
 
-void editor_insert_character(Editor *E, const int x, const int y, const char c) {
+void editor_split_row(Editor *E, const int x, const int y) {
     // Bounds check
     if (y < 0 || y >= E->num_rows) return;
     if (x < 0 || x > E->row[y].size) return;
-    
-    // If we are on the last (or first, on open), create a line below
-    if (y == E->num_rows) editor_insert_row_below(E, y, "", 0);
 
-    // Get the row we are working with
+    rows_begin_edit(E);
+    undo_record_split(E, x, y);
+
+    // The split is a single record, the row insert is part of it
+    undo_suspend(E);
+    editor_insert_row_below(E, y + 1, &E->row[y].chars[x], E->row[y].size - x);
+    undo_resume(E);
+
     erow *row = &E->row[y];
+    row_reserve(row, row->size);
+    E->num_bytes -= row->size - x;
+    row->size = x;
+    row->chars[x] = '\0';
+    editor_render_row(row);
+    row_changed(E, y);
+}
 
-    // Increase the size
-    row->size++;
+void editor_join_rows(Editor *E, const int y) {
+    // Bounds check
+    if (y < 0 || y + 1 >= E->num_rows) return;
 
-    // Malloc one more character in memory
-    row->chars = realloc(row->chars, sizeof(char) * (row->size + 1));
+    rows_begin_edit(E);
+    undo_record_join(E, E->row[y].size, y);
 
-    // Move memory past x, over one
-    memmove(&row->chars[x + 1], &row->chars[x], sizeof(char) * (row->size - x - 1));
+    // The join is a single record, the append and the remove are part of it
+    undo_suspend(E);
+    erow *next = &E->row[y + 1];
+    if (next->size > 0) editor_row_insert_span(E, E->row[y].size, y, next->chars, next->size);
+    editor_remove_row(E, y + 1);
+    undo_resume(E);
+}
 
-    // Copy c into the x position
-    row->chars[x] = c;
+void editor_insert_text(Editor *E, const int x, const int y, const char *s, const int len, int *end_x, int *end_y) {
+    // Bounds check
+    if (y < 0 || y >= E->num_rows || len <= 0) return;
+    if (x < 0 || x > E->row[y].size) return;
 
-    // Append null-terminator, since we increased the size of malloc by 1, we can append to the size.
-    // TODO: Abstract this into an update row function
-    row->chars[row->size] = '\0';
+    const char *nl = memchr(s, '\n', len);
+    if (nl == NULL) {
+        editor_row_insert_span(E, x, y, s, len);
+        if (end_x != NULL) *end_x = x + len;
+        if (end_y != NULL) *end_y = y;
+        return;
+    }
 
-    // Move the cursor one to the right and update dirty status
-    E->cur_x++;
-    E->dirty++;
+    // Split the text into the part for row y, and the lines of the new rows
+    int lines = 0;
+    for (const char *p = nl; p != NULL; p = memchr(p + 1, '\n', len - (p + 1 - s))) lines++;
 
-    // Update the render in the row
-    editor_render_row(row);
+    char **texts = malloc(sizeof(char *) * lines);
+    int *lens = malloc(sizeof(int) * lines);
+    if (texts == NULL || lens == NULL) exit(1);
+
+    const char *start = nl + 1;
+    for (int i = 0; i < lines - 1; i++) {
+        const char *next = memchr(start, '\n', len - (start - s));
+        texts[i] = (char *) start;
+        lens[i] = (int) (next - start);
+        start = next + 1;
+    }
+
+    // The last line gets the rest of row y after x
+    erow *row = &E->row[y];
+    int last_len = (int) (len - (start - s));
+    int tail = row->size - x;
+    char *last = malloc(last_len + tail + 1);
+    if (last == NULL) exit(1);
+    memcpy(last, start, last_len);
+    memcpy(last + last_len, &row->chars[x], tail);
+    texts[lines - 1] = last;
+    lens[lines - 1] = last_len + tail;
+
+    rows_begin_edit(E);
+    editor_row_delete_span(E, x, y, tail);
+    editor_row_insert_span(E, x, y, s, (int) (nl - s));
+    editor_insert_rows(E, y + 1, lines, texts, lens);
+
+    if (end_x != NULL) *end_x = last_len;
+    if (end_y != NULL) *end_y = y + lines;
+
+    free(last);
+    free(texts);
+    free(lens);
+}
+
+void editor_delete_range(Editor *E, int x0, const int y0, int x1, int y1) {
+    // Bounds check, the end is clamped to the end of the file
+    if (y0 < 0 || y0 >= E->num_rows || y1 < y0) return;
+    load_job_wait(E, y1);
+    if (y1 >= E->num_rows) {
+        y1 = E->num_rows - 1;
+        x1 = E->row[y1].size;
+    }
+    if (x0 < 0) x0 = 0;
+    if (x0 > E->row[y0].size) x0 = E->row[y0].size;
+    if (x1 > E->row[y1].size) x1 = E->row[y1].size;
+
+    if (y0 == y1) {
+        if (x1 > x0) editor_row_delete_span(E, x0, y0, x1 - x0);
+        return;
+    }
+
+    // Cut the end of the first row and put the rest of the last row there, then
+    // remove the rows after the first with a single splice
+    rows_begin_edit(E);
+    editor_row_delete_span(E, x0, y0, E->row[y0].size - x0);
+    erow *last = &E->row[y1];
+    if (x1 < last->size) editor_row_insert_span(E, x0, y0, &last->chars[x1], last->size - x1);
+    editor_delete_rows(E, y0 + 1, y1 - y0);
+}
+
+void editor_insert_character(Editor *E, const int x, const int y, const char c) {
+    // Bounds check
+    if (y < 0 || y >= E->num_rows) return;
+    if (x < 0 || x > E->row[y].size) return;
+
+    editor_row_insert_span(E, x, y, &c, 1);
+
+    // Move the cursor one to the right
+    E->cur_x++;
 }
 
 void editor_remove_character(Editor *E, const int x, const int y) {
@@ -254,36 +693,39 @@ void editor_remove_character(Editor *E, const int x, const int y) {
     // Bounds check
     if (x < 0 || x > row->size || (x == 0 && y == 0)) return;
 
-    // If at pos 0 (start of line), we need to delete the line and move the content.
+    // If at pos 0 (start of line), we need to join the line onto the one above.
     if (x == 0) {
-        if (row->size != 0 && y > 0) {
-            row_append_str(E, &E->row[y - 1], row->chars, row->size);
-        } else {
-            if (E->row != NULL) E->cur_x = E->row[E->cur_y - 1].size;
-        }
-        editor_remove_row(E, y);
+        E->cur_x = E->row[y - 1].size;
+        editor_join_rows(E, y - 1);
         if (E->cur_y > 0) E->cur_y--;
         return;
     }
 
-    // Move memory past x, over one
-    memmove(&row->chars[x - 1], &row->chars[x], sizeof(char) * (row->size - x + 1));
+    editor_delete_range(E, x - 1, y, x, y);
 
-    // We don't need to malloc less space, we just wait for the memory to be free when another change takes place
-
-    // Decrease the size
-    row->size--;
+    // Move then cursor one to the left
+    E->cur_x--;
+}
 
-    // Append null-terminator
-    // TODO: Abstract this into an update row function
-    row->chars[row->size] = '\0';
+void editor_set_row_chars(Editor *E, const int y, char *chars, const int size) {
+    // Bounds check
+    if (y < 0 || y >= E->num_rows) return;
 
-    // Move then cursor one to the left and update dirty status
-    E->cur_x--;
-    E->dirty++;
+    rows_begin_edit(E);
 
-    // Update the render in the row
-    editor_render_row(row);
+    erow *row = &E->row[y];
+    undo_record_row_set(E, y, row->chars, row->size, chars, size);
+    row_text_release(row->chars);
+    row->chars = chars;
+    E->num_bytes += size - row->size;
+    row->size = size;
+
+    // Mark the render dirty, editor_draw_row generates it when the row is visible
+    free(row->render);
+    row->render = NULL;
+    row->rsize = 0;
+
+    row_changed(E, y);
 }
 
 int editor_row_get_render_x(erow *row, int cur_x) {
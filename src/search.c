@@ -0,0 +1,380 @@
+#include "search.h"
+#include "search_job.h"
+#include "regexp.h"
+#include "editor.h"
+#include "rows.h"
+#include <ncurses.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+/**
+ * @brief Approximate frequency rank of each byte in text, higher is more common.
+ * @note Built on first use by search_byte_ranks.
+ */
+static unsigned char byte_rank[256];
+static bool byte_rank_ready = false;
+
+static void search_byte_ranks(void) {
+    if (byte_rank_ready) return;
+
+    const char *lower = "etaoinsrhldcumfpgwybvkxjqz";
+    const char *upper = "ETAOINSRHLDCUMFPGWYBVKXJQZ";
+    const char *punct = ".,_-()=;:/'\"*{}<>[]#+!&|%$@?\\~^`";
+
+    for (int c = 0; c < 256; c++) byte_rank[c] = (c >= 0x80) ? 20 : 10;
+    for (int i = 0; lower[i] != '\0'; i++) byte_rank[(unsigned char) lower[i]] = 250 - i * 3;
+    for (int i = 0; upper[i] != '\0'; i++) byte_rank[(unsigned char) upper[i]] = 150 - i * 2;
+    for (int i = 0; punct[i] != '\0'; i++) byte_rank[(unsigned char) punct[i]] = 190 - i * 3;
+    for (int c = '0'; c <= '9'; c++) byte_rank[c] = 170 - (c - '0') * 2;
+    byte_rank[' '] = 255;
+    byte_rank['\t'] = 200;
+
+    byte_rank_ready = true;
+}
+
+/**
+ * @brief Set the literal searched for by the memchr kernel.
+ */
+static void pattern_set_needle(SearchPattern *P, const char *s, const size_t len) {
+    P->needle = NULL;
+    P->len = 0;
+    P->rare = 0;
+    if (s == NULL || len == 0) return;
+
+    P->needle = malloc(len + 1);
+    if (P->needle == NULL) exit(1);
+    memcpy(P->needle, s, len);
+    P->needle[len] = '\0';
+    P->len = len;
+
+    // Pick the rarest byte of the needle as the memchr target
+    search_byte_ranks();
+    for (size_t i = 1; i < len; i++)
+        if (byte_rank[(unsigned char) s[i]] < byte_rank[(unsigned char) s[P->rare]]) P->rare = i;
+}
+
+bool search_pattern_compile(SearchPattern *P, const char *s, const size_t len, const char **error) {
+    search_pattern_free(P);
+    if (len == 0) return true;
+
+    Regexp *re = regexp_cache_get(s, len, error);
+    if (re == NULL) return false;
+
+    P->source = malloc(len + 1);
+    if (P->source == NULL) exit(1);
+    memcpy(P->source, s, len);
+    P->source[len] = '\0';
+
+    // Literal patterns only need the memchr kernel
+    size_t literal_len;
+    const char *literal = regexp_required_literal(re, &literal_len);
+    pattern_set_needle(P, literal, literal_len);
+    if (regexp_is_literal(re)) {
+        regexp_release(re);
+        return true;
+    }
+
+    P->re = re;
+    P->dfa = regexp_dfa_new(re);
+    return true;
+}
+
+void search_pattern_copy(SearchPattern *dst, const SearchPattern *src) {
+    search_pattern_free(dst);
+    if (src->source == NULL) return;
+
+    dst->source = malloc(strlen(src->source) + 1);
+    if (dst->source == NULL) exit(1);
+    strcpy(dst->source, src->source);
+    pattern_set_needle(dst, src->needle, src->len);
+
+    if (src->re != NULL) {
+        regexp_retain(src->re);
+        dst->re = src->re;
+        dst->dfa = regexp_dfa_new(src->re);
+    }
+}
+
+void search_pattern_free(SearchPattern *P) {
+    free(P->source);
+    free(P->needle);
+    regexp_dfa_free(P->dfa);
+    regexp_release(P->re);
+    P->source = NULL;
+    P->needle = NULL;
+    P->len = 0;
+    P->rare = 0;
+    P->re = NULL;
+    P->dfa = NULL;
+}
+
+/**
+ * @brief Find the needle of the pattern with the memchr kernel.
+ */
+static long literal_find(const SearchPattern *P, const char *hay, const size_t len, const size_t from) {
+    if (P->len == 0 || len < P->len || from > len - P->len) return -1;
+
+    const char rare = P->needle[P->rare];
+    // The rare byte of the last possible match is at this offset
+    const size_t last = len - P->len + P->rare;
+
+    size_t i = from + P->rare;
+    while (i <= last) {
+        const char *p = memchr(hay + i, rare, last - i + 1);
+        if (p == NULL) return -1;
+
+        size_t start = (size_t) (p - hay) - P->rare;
+        if (memcmp(hay + start, P->needle, P->len) == 0) return (long) start;
+        i = (size_t) (p - hay) + 1;
+    }
+    return -1;
+}
+
+long search_find(SearchPattern *P, const char *hay, const size_t len, const size_t from, size_t *match_len) {
+    if (P->source == NULL) return -1;
+
+    if (P->re == NULL) {
+        if (match_len) *match_len = P->len;
+        return literal_find(P, hay, len, from);
+    }
+
+    // Rows without the required literal cannot match
+    if (P->len > 0 && literal_find(P, hay, len, from) == -1) return -1;
+    return regexp_search(P->dfa, hay, len, from, match_len);
+}
+
+long search_find_last(SearchPattern *P, const char *hay, const size_t len, const size_t before, size_t *match_len) {
+    long found = -1;
+    size_t found_len = 0, pos_len = 0;
+    long pos = search_find(P, hay, len, 0, &pos_len);
+    while (pos != -1 && (size_t) pos < before) {
+        found = pos;
+        found_len = pos_len;
+        pos = search_find(P, hay, len, (size_t) pos + 1, &pos_len);
+    }
+    if (match_len) *match_len = found_len;
+    return found;
+}
+
+void search_state_init(SearchState *S) {
+    memset(&S->pattern, 0, sizeof(SearchPattern));
+    S->direction = 1;
+    S->origin_x = 0;
+    S->origin_y = 0;
+    S->match_x = 0;
+    S->match_y = -1;
+    S->active = false;
+    S->generation = 0;
+    S->highlights = NULL;
+    S->job = NULL;
+}
+
+void search_state_free(SearchState *S) {
+    search_pattern_free(&S->pattern);
+    if (S->highlights != NULL) {
+        for (int i = 0; i < SEARCH_HIGHLIGHT_CACHE; i++) free(S->highlights[i].spans);
+        free(S->highlights);
+    }
+    search_state_init(S);
+}
+
+bool search_next(Editor *E, const int x, const int y, const int direction, int *mx, int *my) {
+    SearchPattern *P = &E->search.pattern;
+    if (P->source == NULL || E->num_rows == 0) return false;
+
+    // Check the rest of the starting row first
+    erow *row = &E->row[y];
+    long pos = (direction > 0)
+        ? search_find(P, row->chars, row->size, x + 1, NULL)
+        : search_find_last(P, row->chars, row->size, x, NULL);
+    if (pos != -1) {
+        *mx = (int) pos;
+        *my = y;
+        return true;
+    }
+
+    // Then every other row, wrapping around the file. The starting row is checked
+    // again last, for matches on the other side of the cursor.
+    for (int i = 1; i <= E->num_rows; i++) {
+        int r = ((y + direction * i) % E->num_rows + E->num_rows) % E->num_rows;
+        row = &E->row[r];
+
+        pos = (direction > 0)
+            ? search_find(P, row->chars, row->size, 0, NULL)
+            : search_find_last(P, row->chars, row->size, row->size, NULL);
+        if (pos != -1) {
+            if ((direction > 0 && r <= y) || (direction < 0 && r >= y))
+                editor_set_status_message(E, direction > 0
+                    ? "search hit BOTTOM, continuing at TOP"
+                    : "search hit TOP, continuing at BOTTOM");
+            *mx = (int) pos;
+            *my = r;
+            return true;
+        }
+    }
+
+    return false;
+}
+
+bool search_find_match(Editor *E, const int x, const int y, const int direction, int *mx, int *my) {
+    if (E->search.pattern.source == NULL || E->num_rows == 0) return false;
+    if (!search_job_valid(E)) search_job_start(E, y);
+    return search_job_find(E, x, y, direction, mx, my);
+}
+
+void search_status(Editor *E, char *buf, const size_t len) {
+    SearchState *S = &E->search;
+    buf[0] = '\0';
+    if (S->pattern.source == NULL || S->match_y == -1 || !search_job_valid(E)) return;
+
+    long index, total;
+    bool complete = search_job_progress(E, S->match_x, S->match_y, &index, &total);
+    if (index > 0) snprintf(buf, len, "[%ld/%ld%s] ", index, total, complete ? "" : "+");
+    else snprintf(buf, len, "[?/%ld%s] ", total, complete ? "" : "+");
+}
+
+void search_callback(Editor *E, char *query, const int key) {
+    SearchState *S = &E->search;
+
+    // Cancelled: restore the cursor
+    if (key == 27) {
+        E->cur_x = S->origin_x;
+        E->cur_y = S->origin_y;
+        S->match_y = -1;
+        S->active = false;
+        return;
+    }
+
+    // Submitted: keep the cursor on the match
+    if (key == '\n' || key == '\r' || key == KEY_ENTER) {
+        S->active = false;
+        return;
+    }
+
+    int x, y;
+    if (key == KEY_DOWN || key == 14 || key == KEY_UP || key == 16) {
+        // Ctrl-N, Ctrl-P and the arrows move between matches
+        if (S->match_y == -1) return;
+        S->direction = (key == KEY_DOWN || key == 14) ? 1 : -1;
+        x = S->match_x;
+        y = S->match_y;
+    } else {
+        // The query changed, search again from where the prompt was opened
+        search_pattern_compile(&S->pattern, query, strlen(query), NULL);
+        S->generation++;
+        S->direction = 1;
+        x = S->origin_x - 1;
+        y = S->origin_y;
+
+        // Restart the parallel search for the new query, this cancels the old one
+        if (S->pattern.source != NULL) search_job_start(E, S->origin_y);
+        else search_job_cancel(E);
+    }
+
+    int mx, my;
+    if (search_find_match(E, x, y, S->direction, &mx, &my)) {
+        S->match_x = mx;
+        S->match_y = my;
+        E->cur_x = mx;
+        E->cur_y = my;
+    } else {
+        S->match_y = -1;
+        E->cur_x = S->origin_x;
+        E->cur_y = S->origin_y;
+    }
+}
+
+bool search_highlight_visible(Editor *E) {
+    SearchState *S = &E->search;
+    if (S->pattern.source == NULL || S->match_y < 0 || S->match_y >= E->num_rows) return false;
+
+    // Only highlight while searching, or while the cursor is on the match
+    return S->active || (E->cur_x == S->match_x && E->cur_y == S->match_y);
+}
+
+/**
+ * @brief Get the matches of the pattern in a row, from the cache if the row did not change.
+ */
+static SearchRowMatches *search_row_matches(Editor *E, erow *row) {
+    SearchState *S = &E->search;
+    if (S->highlights == NULL) {
+        S->highlights = calloc(SEARCH_HIGHLIGHT_CACHE, sizeof(SearchRowMatches));
+        if (S->highlights == NULL) exit(1);
+    }
+
+    SearchRowMatches *M = &S->highlights[row->version % SEARCH_HIGHLIGHT_CACHE];
+    if (M->spans != NULL && M->version == row->version && M->generation == S->generation) return M;
+
+    M->version = row->version;
+    M->generation = S->generation;
+    M->count = 0;
+
+    size_t from = 0, len;
+    long pos;
+    while (from <= (size_t) row->size &&
+           (pos = search_find(&S->pattern, row->chars, row->size, from, &len)) != -1) {
+        // Empty matches have nothing to paint
+        if (len > 0) {
+            if (M->count == M->cap) {
+                M->cap = M->cap ? M->cap * 2 : 8;
+                M->spans = realloc(M->spans, sizeof(SearchSpan) * M->cap);
+                if (M->spans == NULL) exit(1);
+            }
+            M->spans[M->count].start = (int) pos;
+            M->spans[M->count].len = (int) len;
+            M->count++;
+        }
+        from = (size_t) pos + (len > 0 ? len : 1);
+    }
+
+    // Mark the entry as computed even if there are no matches
+    if (M->spans == NULL) {
+        M->cap = 8;
+        M->spans = malloc(sizeof(SearchSpan) * M->cap);
+        if (M->spans == NULL) exit(1);
+    }
+    return M;
+}
+
+void editor_draw_row_matches(Editor *E, erow *row, const int pos) {
+    if (!search_highlight_visible(E)) return;
+
+    SearchRowMatches *M = search_row_matches(E, row);
+
+    // Walk the row once, mapping the spans through the tab expansion of the render
+    int x = 0, rx = 0;
+    for (int i = 0; i < M->count; i++) {
+        SearchSpan *span = &M->spans[i];
+        int start = rx, end;
+        for (; x < span->start + span->len; x++) {
+            if (x == span->start) start = rx;
+            if (row->chars[x] == '\t') rx += (TAB_STOP - 1) - (rx % TAB_STOP);
+            rx++;
+        }
+        end = rx;
+
+        // The rest of the matches are right of the window
+        const EditorWindow *W = E->windows.drawing;
+        if (start + NUM_COL_SIZE >= W->col_start + W->cols) break;
+        window_paint(E, pos, start + NUM_COL_SIZE, end - start, A_NORMAL, 3);
+    }
+}
+
+void editor_draw_search_match(Editor *E) {
+    SearchState *S = &E->search;
+    if (!search_highlight_visible(E)) return;
+
+    if (S->match_y < E->view_start || S->match_y >= E->view_start + E->view_rows) return;
+
+    // Get the length of the match, the row may have changed since it was found
+    erow *row = &E->row[S->match_y];
+    size_t len;
+    if (search_find(&S->pattern, row->chars, row->size, S->match_x, &len) != S->match_x) return;
+
+    // Map the match through the tab expansion of the render
+    int start = editor_row_get_render_x(row, S->match_x);
+    int end = editor_row_get_render_x(row, S->match_x + (int) len);
+
+    window_highlight(E, S->match_y, start, end - start, A_REVERSE, 0);
+}
@@ -0,0 +1,423 @@
+#include "search_job.h"
+#include "editor.h"
+#include "trigram.h"
+#include <limits.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+/**
+ * @brief Scan the rows of a chunk and store the results in it.
+ * @return false if the job was cancelled before the chunk was finished
+ * @note Called without the lock, the chunk is owned by the caller until it is finished.
+ * @note P is the copy of the job pattern owned by the calling thread.
+ */
+static bool scan_chunk(SearchJob *J, SearchChunk *C, SearchPattern *P) {
+    C->count = 0;
+    C->stored = 0;
+    C->overflow = false;
+
+    // With candidates from the trigram index, only those rows are scanned
+    int k = 0;
+    if (J->candidates != NULL) {
+        int hi = J->num_candidates;
+        while (k < hi) {
+            int mid = (k + hi) / 2;
+            if (J->candidates[mid] < C->start) k = mid + 1;
+            else hi = mid;
+        }
+    }
+
+    for (int y = C->start; y < C->end; y++) {
+        if (J->candidates != NULL) {
+            if (k == J->num_candidates || J->candidates[k] >= C->end) break;
+            y = J->candidates[k++];
+        }
+        if (__atomic_load_n(&J->cancel, __ATOMIC_RELAXED)) return false;
+
+        erow *row = &J->rows[y];
+        long pos = search_find(P, row->chars, row->size, 0, NULL);
+        while (pos != -1) {
+            C->count++;
+            if (C->stored < SEARCH_CHUNK_MATCHES) {
+                if (C->matches == NULL) {
+                    C->matches = malloc(sizeof(SearchMatch) * SEARCH_CHUNK_MATCHES);
+                    if (C->matches == NULL) exit(1);
+                }
+                C->matches[C->stored].y = y;
+                C->matches[C->stored].x = (int) pos;
+                C->stored++;
+            } else {
+                C->overflow = true;
+            }
+            pos = search_find(P, row->chars, row->size, (size_t) pos + 1, NULL);
+        }
+    }
+    return true;
+}
+
+/**
+ * @brief Mark a chunk as finished. Must be called with the lock held.
+ */
+static void finish_chunk(SearchJob *J, const int c) {
+    J->chunks[c].done = true;
+    J->completed++;
+    J->total += J->chunks[c].count;
+    pthread_cond_broadcast(&J->progress);
+}
+
+/**
+ * @brief Claim the next chunk in dispatch order. Must be called with the lock held.
+ * @return Index of the chunk, or -1 if there is nothing left to do
+ */
+static int claim_next(SearchJob *J) {
+    if (!J->valid || J->cancel) return -1;
+
+    // Chunks are handed out from the first chunk onwards, wrapping around. Chunks
+    // can also be claimed out of order by chunk_wait, so those are skipped.
+    while (J->next_claim < J->num_chunks) {
+        int c = (J->first_chunk + J->next_claim++) % J->num_chunks;
+        if (!J->chunks[c].claimed) {
+            J->chunks[c].claimed = true;
+            return c;
+        }
+    }
+    return -1;
+}
+
+static void *search_worker(void *arg) {
+    SearchJob *J = arg;
+
+    // Each worker matches with its own copy of the pattern
+    SearchPattern pattern;
+    memset(&pattern, 0, sizeof(SearchPattern));
+    unsigned long generation = 0;
+
+    pthread_mutex_lock(&J->lock);
+    while (!J->shutdown) {
+        int c = claim_next(J);
+        if (c == -1) {
+            pthread_cond_wait(&J->work, &J->lock);
+            continue;
+        }
+
+        if (generation != J->generation) {
+            search_pattern_copy(&pattern, &J->pattern);
+            generation = J->generation;
+        }
+
+        J->busy++;
+        pthread_mutex_unlock(&J->lock);
+        bool finished = scan_chunk(J, &J->chunks[c], &pattern);
+        pthread_mutex_lock(&J->lock);
+        J->busy--;
+
+        if (finished && !J->cancel) finish_chunk(J, c);
+        pthread_cond_broadcast(&J->progress);
+    }
+    pthread_mutex_unlock(&J->lock);
+
+    search_pattern_free(&pattern);
+    return NULL;
+}
+
+/**
+ * @brief Get the job of the editor, creating it and its worker pool on first use.
+ */
+static SearchJob *search_job_get(Editor *E) {
+    if (E->search.job != NULL) return E->search.job;
+
+    SearchJob *J = calloc(1, sizeof(SearchJob));
+    if (J == NULL) exit(1);
+
+    pthread_mutex_init(&J->lock, NULL);
+    pthread_cond_init(&J->work, NULL);
+    pthread_cond_init(&J->progress, NULL);
+
+    // The calling thread helps with the chunks it needs, so leave a core for it
+    long cores = sysconf(_SC_NPROCESSORS_ONLN);
+    J->num_threads = (int) (cores > 1 ? cores - 1 : 1);
+    if (J->num_threads > SEARCH_MAX_THREADS) J->num_threads = SEARCH_MAX_THREADS;
+
+    J->threads = malloc(sizeof(pthread_t) * J->num_threads);
+    if (J->threads == NULL) exit(1);
+    for (int i = 0; i < J->num_threads; i++)
+        pthread_create(&J->threads[i], NULL, search_worker, J);
+
+    E->search.job = J;
+    return J;
+}
+
+/**
+ * @brief Stop the workers and free the results. Must be called with the lock held.
+ */
+static void search_job_stop(SearchJob *J) {
+    __atomic_store_n(&J->cancel, true, __ATOMIC_RELAXED);
+    while (J->busy > 0) pthread_cond_wait(&J->progress, &J->lock);
+
+    for (int i = 0; i < J->num_chunks; i++) {
+        free(J->chunks[i].matches);
+        J->chunks[i].matches = NULL;
+    }
+    J->num_chunks = 0;
+    free(J->candidates);
+    J->candidates = NULL;
+    J->num_candidates = 0;
+    J->completed = 0;
+    J->total = 0;
+    J->valid = false;
+    __atomic_store_n(&J->cancel, false, __ATOMIC_RELAXED);
+
+    // Wake anyone waiting on a chunk of the cancelled job
+    pthread_cond_broadcast(&J->progress);
+}
+
+void search_job_start(Editor *E, int y) {
+    SearchJob *J = search_job_get(E);
+
+    pthread_mutex_lock(&J->lock);
+    search_job_stop(J);
+
+    J->candidates = trigram_index_candidates(E, &E->search.pattern, &J->num_candidates);
+
+    search_pattern_copy(&J->pattern, &E->search.pattern);
+    J->generation++;
+    J->rows = E->row;
+    J->num_rows = E->num_rows;
+
+    // Order the chunks starting at the row, so they are handed out from there
+    int n = (E->num_rows + SEARCH_CHUNK_ROWS - 1) / SEARCH_CHUNK_ROWS;
+    if (y < 0 || y >= E->num_rows) y = 0;
+    int first = y / SEARCH_CHUNK_ROWS;
+
+    free(J->chunks);
+    J->chunks = calloc(n > 0 ? n : 1, sizeof(SearchChunk));
+    if (J->chunks == NULL) exit(1);
+    J->num_chunks = n;
+    for (int k = 0; k < n; k++) {
+        J->chunks[k].start = k * SEARCH_CHUNK_ROWS;
+        J->chunks[k].end = J->chunks[k].start + SEARCH_CHUNK_ROWS;
+        if (J->chunks[k].end > E->num_rows) J->chunks[k].end = E->num_rows;
+    }
+
+    J->first_chunk = first;
+    J->next_claim = 0;
+    J->valid = true;
+    pthread_cond_broadcast(&J->work);
+    pthread_mutex_unlock(&J->lock);
+}
+
+void search_job_cancel(Editor *E) {
+    SearchJob *J = E->search.job;
+    if (J == NULL) return;
+
+    pthread_mutex_lock(&J->lock);
+    if (J->valid || J->busy > 0) search_job_stop(J);
+    pthread_mutex_unlock(&J->lock);
+}
+
+void search_job_destroy(Editor *E) {
+    SearchJob *J = E->search.job;
+    if (J == NULL) return;
+
+    pthread_mutex_lock(&J->lock);
+    search_job_stop(J);
+    J->shutdown = true;
+    pthread_cond_broadcast(&J->work);
+    pthread_mutex_unlock(&J->lock);
+
+    for (int i = 0; i < J->num_threads; i++) pthread_join(J->threads[i], NULL);
+
+    pthread_mutex_destroy(&J->lock);
+    pthread_cond_destroy(&J->work);
+    pthread_cond_destroy(&J->progress);
+    search_pattern_free(&J->pattern);
+    free(J->chunks);
+    free(J->threads);
+    free(J);
+    E->search.job = NULL;
+}
+
+bool search_job_valid(Editor *E) {
+    SearchJob *J = E->search.job;
+    if (J == NULL) return false;
+
+    pthread_mutex_lock(&J->lock);
+    bool valid = J->valid;
+    pthread_mutex_unlock(&J->lock);
+    return valid;
+}
+
+bool search_job_running(Editor *E) {
+    SearchJob *J = E->search.job;
+    if (J == NULL) return false;
+
+    pthread_mutex_lock(&J->lock);
+    bool running = J->valid && J->completed < J->num_chunks;
+    pthread_mutex_unlock(&J->lock);
+    return running;
+}
+
+/**
+ * @brief Wait for a chunk to be finished, scanning it here if no worker has claimed it.
+ * @return false if the job was cancelled
+ */
+static bool chunk_wait(SearchJob *J, const int c) {
+    pthread_mutex_lock(&J->lock);
+    if (!J->valid) {
+        pthread_mutex_unlock(&J->lock);
+        return false;
+    }
+
+    if (!J->chunks[c].claimed) {
+        J->chunks[c].claimed = true;
+        pthread_mutex_unlock(&J->lock);
+        scan_chunk(J, &J->chunks[c], &J->pattern);
+        pthread_mutex_lock(&J->lock);
+        finish_chunk(J, c);
+    }
+
+    while (J->valid && !J->chunks[c].done) pthread_cond_wait(&J->progress, &J->lock);
+    bool done = J->valid;
+    pthread_mutex_unlock(&J->lock);
+    return done;
+}
+
+/**
+ * @brief Find a match in rows [start, end) after (x, y) in the direction, by scanning the rows.
+ */
+static bool rows_find(SearchJob *J, const int start, const int end, const int x, const int y,
+                      const int direction, int *mx, int *my) {
+    if (direction > 0) {
+        for (int r = (y > start ? y : start); r < end; r++) {
+            erow *row = &J->rows[r];
+            long pos = search_find(&J->pattern, row->chars, row->size, (r == y) ? (size_t) (x + 1) : 0, NULL);
+            if (pos != -1) {
+                *mx = (int) pos;
+                *my = r;
+                return true;
+            }
+        }
+    } else {
+        for (int r = (y < end - 1 ? y : end - 1); r >= start; r--) {
+            erow *row = &J->rows[r];
+            long pos = search_find_last(&J->pattern, row->chars, row->size, (r == y) ? (size_t) x : (size_t) row->size, NULL);
+            if (pos != -1) {
+                *mx = (int) pos;
+                *my = r;
+                return true;
+            }
+        }
+    }
+    return false;
+}
+
+/**
+ * @brief Find a match in a finished chunk after (x, y) in the direction.
+ */
+static bool chunk_find(SearchJob *J, SearchChunk *C, const int x, const int y,
+                       const int direction, int *mx, int *my) {
+    if (C->count == 0) return false;
+    if (C->overflow) return rows_find(J, C->start, C->end, x, y, direction, mx, my);
+
+    if (direction > 0) {
+        for (int i = 0; i < C->stored; i++) {
+            SearchMatch *m = &C->matches[i];
+            if (m->y > y || (m->y == y && m->x > x)) {
+                *mx = m->x;
+                *my = m->y;
+                return true;
+            }
+        }
+    } else {
+        for (int i = C->stored - 1; i >= 0; i--) {
+            SearchMatch *m = &C->matches[i];
+            if (m->y < y || (m->y == y && m->x < x)) {
+                *mx = m->x;
+                *my = m->y;
+                return true;
+            }
+        }
+    }
+    return false;
+}
+
+bool search_job_find(Editor *E, const int x, const int y, const int direction, int *mx, int *my) {
+    SearchJob *J = E->search.job;
+    if (J == NULL || J->num_chunks == 0) return false;
+
+    const int n = J->num_chunks;
+    const int first = (y >= 0 && y < J->num_rows) ? y / SEARCH_CHUNK_ROWS : 0;
+
+    // Walk the chunks from the cursor in the direction, the first chunk is checked
+    // twice: once after the cursor, and once more after wrapping around the file.
+    for (int k = 0; k <= n; k++) {
+        int c = ((first + direction * k) % n + n) % n;
+        if (!chunk_wait(J, c)) return false;
+
+        bool found = (k == 0)
+            ? chunk_find(J, &J->chunks[c], x, y, direction, mx, my)
+            : chunk_find(J, &J->chunks[c], -1, direction > 0 ? -1 : INT_MAX,
+                         direction, mx, my);
+        if (found) {
+            if ((direction > 0 && first + k >= n) || (direction < 0 && first - k < 0) ||
+                (k == n))
+                editor_set_status_message(E, direction > 0
+                    ? "search hit BOTTOM, continuing at TOP"
+                    : "search hit TOP, continuing at BOTTOM");
+            return true;
+        }
+    }
+    return false;
+}
+
+bool search_job_progress(Editor *E, const int x, const int y, long *index, long *total) {
+    SearchJob *J = E->search.job;
+    *index = 0;
+    *total = 0;
+    if (J == NULL) return false;
+
+    pthread_mutex_lock(&J->lock);
+    if (!J->valid) {
+        pthread_mutex_unlock(&J->lock);
+        return false;
+    }
+
+    *total = J->total;
+    bool complete = J->completed == J->num_chunks;
+
+    // The index is known once every chunk up to the match is finished
+    int c = (y >= 0 && y < J->num_rows) ? y / SEARCH_CHUNK_ROWS : -1;
+    long before = 0;
+    for (int i = 0; c != -1 && i <= c; i++) {
+        if (!J->chunks[i].done) {
+            c = -1;
+            break;
+        }
+        if (i < c) before += J->chunks[i].count;
+    }
+
+    if (c != -1) {
+        SearchChunk *C = &J->chunks[c];
+        if (!C->overflow) {
+            for (int i = 0; i < C->stored; i++) {
+                SearchMatch *m = &C->matches[i];
+                if (m->y > y || (m->y == y && m->x > x)) break;
+                before++;
+            }
+        } else {
+            for (int r = C->start; r <= y; r++) {
+                erow *row = &J->rows[r];
+                long pos = search_find(&J->pattern, row->chars, row->size, 0, NULL);
+                while (pos != -1 && (r < y || pos <= x)) {
+                    before++;
+                    pos = search_find(&J->pattern, row->chars, row->size, (size_t) pos + 1, NULL);
+                }
+            }
+        }
+        *index = before;
+    }
+
+    pthread_mutex_unlock(&J->lock);
+    return complete;
+}
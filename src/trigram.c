@@ -0,0 +1,663 @@
+#include "trigram.h"
+#include "editor.h"
+#include <stdlib.h>
+#include <string.h>
+
+#define TRIGRAM_KEY(a, b, c) \
+    ((1u << 24) | ((uint32_t) (unsigned char) (a) << 16) | ((uint32_t) (unsigned char) (b) << 8) | (unsigned char) (c))
+
+static size_t trigram_hash(const uint32_t key, const size_t cap) {
+    return (size_t) ((key * 2654435761u) ^ (key >> 13)) & (cap - 1);
+}
+
+/**
+ * @brief Find the slot of a key in the table.
+ * @return Index of the slot holding the key, or of the empty slot it would go in
+ */
+static size_t table_slot(const TrigramTable *T, const uint32_t key) {
+    size_t i = trigram_hash(key, T->cap);
+    while (T->keys[i] != 0 && T->keys[i] != key) i = (i + 1) & (T->cap - 1);
+    return i;
+}
+
+static void table_grow(TrigramTable *T) {
+    uint32_t *keys = T->keys;
+    TrigramPostings *lists = T->lists;
+    size_t cap = T->cap;
+
+    T->cap = cap ? cap * 2 : 4096;
+    T->keys = calloc(T->cap, sizeof(uint32_t));
+    T->lists = malloc(sizeof(TrigramPostings) * T->cap);
+    if (T->keys == NULL || T->lists == NULL) exit(1);
+
+    for (size_t i = 0; i < cap; i++) {
+        if (keys[i] == 0) continue;
+        size_t j = table_slot(T, keys[i]);
+        T->keys[j] = keys[i];
+        T->lists[j] = lists[i];
+    }
+    free(keys);
+    free(lists);
+}
+
+static void table_free(TrigramTable *T) {
+    for (size_t i = 0; i < T->cap; i++)
+        if (T->keys[i] != 0) free(T->lists[i].data);
+    free(T->keys);
+    free(T->lists);
+    T->keys = NULL;
+    T->lists = NULL;
+    T->cap = 0;
+    T->used = 0;
+}
+
+/**
+ * @brief Find the list of a trigram.
+ * @return The list, or NULL if no row has the trigram
+ */
+static TrigramPostings *table_find(const TrigramTable *T, const uint32_t key) {
+    if (T->cap == 0) return NULL;
+    size_t i = table_slot(T, key);
+    return (T->keys[i] != 0) ? &T->lists[i] : NULL;
+}
+
+/**
+ * @brief Get the list of a trigram, an empty one is added for a new trigram.
+ */
+static TrigramPostings *table_list(TrigramTable *T, const uint32_t key) {
+    if (T->cap == 0) table_grow(T);
+    size_t i = table_slot(T, key);
+    if (T->keys[i] == 0) {
+        // Keep the table at most half full
+        if ((T->used + 1) * 2 > T->cap) {
+            table_grow(T);
+            i = table_slot(T, key);
+        }
+        T->keys[i] = key;
+        memset(&T->lists[i], 0, sizeof(TrigramPostings));
+        T->lists[i].last = -1;
+        T->used++;
+    }
+    return &T->lists[i];
+}
+
+/**
+ * @brief Add a row to a list, rows must be added in increasing order.
+ */
+static void postings_add(TrigramPostings *L, const int y) {
+    // The row was already added for an earlier occurrence of the trigram
+    if (L->last == y) return;
+
+    if (L->len + 5 > L->cap) {
+        L->cap = L->cap ? L->cap * 2 : 8;
+        L->data = realloc(L->data, L->cap);
+        if (L->data == NULL) exit(1);
+    }
+
+    // Varint encoded delta, 7 bits per byte, the high bit marks a continuation
+    uint32_t delta = (uint32_t) (y - L->last);
+    while (delta >= 0x80) {
+        L->data[L->len++] = (unsigned char) (delta | 0x80);
+        delta >>= 7;
+    }
+    L->data[L->len++] = (unsigned char) delta;
+
+    L->last = y;
+    L->count++;
+}
+
+/**
+ * @brief Decode a list of rows into out, which must hold L->count rows.
+ */
+static void postings_decode(const TrigramPostings *L, int *out) {
+    int y = -1, n = 0;
+    size_t i = 0;
+    while (i < L->len) {
+        uint32_t delta = 0;
+        int shift = 0;
+        while (L->data[i] & 0x80) {
+            delta |= (uint32_t) (L->data[i++] & 0x7f) << shift;
+            shift += 7;
+        }
+        delta |= (uint32_t) L->data[i++] << shift;
+        y += (int) delta;
+        out[n++] = y;
+    }
+}
+
+/**
+ * @brief Add every trigram of a row to a table, under the id given.
+ */
+static void table_add_row(TrigramTable *T, const erow *row, const int id) {
+    for (int i = 0; i + 2 < row->size; i++)
+        postings_add(table_list(T, TRIGRAM_KEY(row->chars[i], row->chars[i + 1], row->chars[i + 2])), id);
+}
+
+static void *trigram_build(void *arg) {
+    TrigramIndex *T = arg;
+
+    for (int y = 0; y < T->num_rows; y++) {
+        if ((y & 1023) == 0 && __atomic_load_n(&T->cancel, __ATOMIC_RELAXED)) break;
+        table_add_row(&T->table, &T->rows[y], y);
+    }
+
+    __atomic_store_n(&T->done, true, __ATOMIC_RELEASE);
+    return NULL;
+}
+
+/**
+ * @brief Map every row of the lists to itself, for lists just made from the rows.
+ */
+static void segments_reset(TrigramIndex *T, const int num_rows) {
+    T->num_rows = num_rows;
+    T->num_segments = 0;
+    if (num_rows == 0) return;
+
+    if (T->segments_cap == 0) {
+        T->segments_cap = 16;
+        T->segments = malloc(sizeof(TrigramSegment) * T->segments_cap);
+        if (T->segments == NULL) exit(1);
+    }
+    T->segments[0] = (TrigramSegment) {0, num_rows, 0};
+    T->num_segments = 1;
+}
+
+/**
+ * @brief Throw away the index, it is built again on the next search.
+ */
+static void trigram_index_reset(TrigramIndex *T) {
+    if (T->building) {
+        __atomic_store_n(&T->cancel, true, __ATOMIC_RELAXED);
+        pthread_join(T->thread, NULL);
+        T->building = false;
+    }
+
+    table_free(&T->table);
+    table_free(&T->overlay);
+    T->next_id = 0;
+    T->ready = false;
+    T->done = false;
+    T->cancel = false;
+    T->num_segments = 0;
+    T->num_dirty = 0;
+}
+
+void trigram_index_init(TrigramIndex *T) {
+    memset(T, 0, sizeof(TrigramIndex));
+}
+
+void trigram_index_free(TrigramIndex *T) {
+    trigram_index_reset(T);
+    free(T->segments);
+    free(T->dirty);
+    trigram_index_init(T);
+}
+
+void trigram_index_cancel(Editor *E) {
+    if (E->trigrams.building) trigram_index_reset(&E->trigrams);
+}
+
+/**
+ * @brief Join the build thread if it has finished.
+ * @return true if the index can be queried
+ */
+static bool trigram_index_poll(TrigramIndex *T) {
+    if (T->building && __atomic_load_n(&T->done, __ATOMIC_ACQUIRE)) {
+        pthread_join(T->thread, NULL);
+        T->building = false;
+        T->ready = !T->cancel;
+    }
+    return T->ready;
+}
+
+static int compare_rows(const void *a, const void *b) {
+    const int x = *(const int *) a, y = *(const int *) b;
+    return (x > y) - (x < y);
+}
+
+/**
+ * @brief Index the changed rows which are not in the overlay yet.
+ * @note Once the rows changed again left too many old ids behind, the overlay
+ * is built again from the changed rows.
+ */
+static void overlay_update(Editor *E) {
+    TrigramIndex *T = &E->trigrams;
+
+    int indexed = 0;
+    for (int i = 0; i < T->num_dirty; i++) indexed += (T->dirty[i].id != -1);
+    if (T->next_id - indexed > indexed + TRIGRAM_MAX_DEAD) {
+        table_free(&T->overlay);
+        T->next_id = 0;
+        for (int i = 0; i < T->num_dirty; i++) T->dirty[i].id = -1;
+    }
+
+    for (int i = 0; i < T->num_dirty; i++) {
+        TrigramDirty *D = &T->dirty[i];
+        if (D->id != -1) continue;
+        D->id = T->next_id++;
+        table_add_row(&T->overlay, &E->row[D->y], D->id);
+    }
+}
+
+/**
+ * @brief Get the current row of each id of the overlay, -1 for old ids.
+ * @return Rows to be freed by the caller
+ */
+static int *overlay_rows(const TrigramIndex *T) {
+    int *rows = malloc(sizeof(int) * (T->next_id + 1));
+    if (rows == NULL) exit(1);
+    for (int i = 0; i < T->next_id; i++) rows[i] = -1;
+    for (int i = 0; i < T->num_dirty; i++)
+        if (T->dirty[i].id != -1) rows[T->dirty[i].id] = T->dirty[i].y;
+    return rows;
+}
+
+/**
+ * @brief Fold the segments and the overlay into the lists.
+ * @note The lists are rewritten in one pass, the row contents are not read
+ * again but for the changed rows.
+ */
+static void trigram_index_compact(Editor *E) {
+    TrigramIndex *T = &E->trigrams;
+    overlay_update(E);
+    int *id_rows = overlay_rows(T);
+
+    // Where each row of the lists is now. Changed rows drop out, the overlay
+    // has their content.
+    int *map = malloc(sizeof(int) * (T->num_rows + 1));
+    char *changed = calloc(E->num_rows + 1, 1);
+    if (map == NULL || changed == NULL) exit(1);
+    for (int i = 0; i < T->num_rows; i++) map[i] = -1;
+    for (int s = 0; s < T->num_segments; s++) {
+        const TrigramSegment *S = &T->segments[s];
+        for (int k = 0; k < S->len; k++) map[S->base + k] = S->base + k + S->offset;
+    }
+    for (int i = 0; i < T->num_dirty; i++) changed[T->dirty[i].y] = 1;
+    for (int i = 0; i < T->num_rows; i++)
+        if (map[i] != -1 && changed[map[i]]) map[i] = -1;
+    free(changed);
+
+    int *tmp = NULL;
+    size_t tmp_cap = 0;
+    for (size_t i = 0; i < T->table.cap; i++) {
+        if (T->table.keys[i] == 0) continue;
+        TrigramPostings *L = &T->table.lists[i];
+        TrigramPostings *O = table_find(&T->overlay, T->table.keys[i]);
+        size_t need = (size_t) L->count + (O ? O->count : 0) + 1;
+        if (need > tmp_cap) {
+            tmp_cap = need * 2;
+            free(tmp);
+            tmp = malloc(sizeof(int) * tmp_cap);
+            if (tmp == NULL) exit(1);
+        }
+
+        // The rows of the list in their current position, they keep their order
+        postings_decode(L, tmp);
+        int n = 0;
+        for (int k = 0; k < L->count; k++)
+            if (map[tmp[k]] != -1) tmp[n++] = map[tmp[k]];
+
+        // The changed rows with the trigram, sorted after the rows of the list
+        int end = n;
+        if (O != NULL) {
+            postings_decode(O, &tmp[n]);
+            for (int k = 0; k < O->count; k++)
+                if (id_rows[tmp[n + k]] != -1) tmp[end++] = id_rows[tmp[n + k]];
+            qsort(&tmp[n], end - n, sizeof(int), compare_rows);
+            O->count = 0;
+        }
+
+        TrigramPostings merged = {.last = -1};
+        for (int a = 0, b = n; a < n || b < end;)
+            postings_add(&merged, (b == end || (a < n && tmp[a] < tmp[b])) ? tmp[a++] : tmp[b++]);
+        free(L->data);
+        *L = merged;
+    }
+
+    // Trigrams which only the changed rows have
+    for (size_t i = 0; i < T->overlay.cap; i++) {
+        if (T->overlay.keys[i] == 0 || T->overlay.lists[i].count == 0) continue;
+        const TrigramPostings *O = &T->overlay.lists[i];
+        if ((size_t) O->count + 1 > tmp_cap) {
+            tmp_cap = (size_t) O->count * 2 + 1;
+            free(tmp);
+            tmp = malloc(sizeof(int) * tmp_cap);
+            if (tmp == NULL) exit(1);
+        }
+
+        postings_decode(O, tmp);
+        int n = 0;
+        for (int k = 0; k < O->count; k++)
+            if (id_rows[tmp[k]] != -1) tmp[n++] = id_rows[tmp[k]];
+        qsort(tmp, n, sizeof(int), compare_rows);
+
+        TrigramPostings *L = table_list(&T->table, T->overlay.keys[i]);
+        for (int k = 0; k < n; k++) postings_add(L, tmp[k]);
+    }
+
+    free(tmp);
+    free(map);
+    free(id_rows);
+    table_free(&T->overlay);
+    T->next_id = 0;
+    T->num_dirty = 0;
+    T->rows = E->row;
+    segments_reset(T, E->num_rows);
+}
+
+/**
+ * @brief Add a piece of the lists to the segments, joined to the last one when they follow.
+ */
+static void segments_emit(TrigramSegment *out, int *n, const int base, const int len, const int offset) {
+    if (len <= 0) return;
+    if (*n > 0) {
+        TrigramSegment *P = &out[*n - 1];
+        if (P->base + P->len == base && P->offset == offset) {
+            P->len += len;
+            return;
+        }
+    }
+    out[(*n)++] = (TrigramSegment) {base, len, offset};
+}
+
+/**
+ * @brief Check if a shift is over before a row, so the row is moved by it.
+ */
+static bool shift_before(const TrigramShift *S, const int y) {
+    return (S->delta > 0) ? S->pos <= y : S->pos - S->delta <= y;
+}
+
+/**
+ * @brief Check if a row is removed by a shift.
+ */
+static bool shift_removes(const TrigramShift *S, const int y) {
+    return S->delta < 0 && S->pos <= y && y < S->pos - S->delta;
+}
+
+/**
+ * @brief Move the segments by sorted shifts, in a single pass.
+ * @note Rows removed are cut out of the segments, and rows inserted in the
+ * middle of a segment split it.
+ */
+static void segments_shift(TrigramIndex *T, const TrigramShift *shifts, const int num_shifts) {
+    TrigramSegment *out = malloc(sizeof(TrigramSegment) * (T->num_segments + num_shifts + 1));
+    if (out == NULL) exit(1);
+
+    int n = 0, j = 0, moved = 0;
+    for (int s = 0; s < T->num_segments; s++) {
+        const TrigramSegment *S = &T->segments[s];
+        int start = S->base + S->offset, end = start + S->len;
+        for (int y = start; y < end;) {
+            while (j < num_shifts && shift_before(&shifts[j], y)) moved += shifts[j++].delta;
+            if (j < num_shifts && shift_removes(&shifts[j], y)) {
+                int skip = shifts[j].pos - shifts[j].delta;
+                y = (skip < end) ? skip : end;
+                continue;
+            }
+
+            // The piece goes on to the next shift, or to the end of the segment
+            int next = (j < num_shifts && shifts[j].pos < end) ? shifts[j].pos : end;
+            segments_emit(out, &n, S->base + (y - start), next - y, S->offset + moved);
+            y = next;
+        }
+    }
+
+    free(T->segments);
+    T->segments = out;
+    T->num_segments = n;
+    T->segments_cap = T->num_segments + num_shifts + 1;
+}
+
+/**
+ * @brief Move the changed rows by sorted shifts, in a single pass.
+ * @note Removed rows are dropped, inserted rows are added as changed rows.
+ */
+static void dirty_shift(TrigramIndex *T, const TrigramShift *shifts, const int num_shifts) {
+    int n = 0, j = 0, moved = 0;
+    for (int i = 0; i < T->num_dirty; i++) {
+        TrigramDirty D = T->dirty[i];
+        while (j < num_shifts && shift_before(&shifts[j], D.y)) moved += shifts[j++].delta;
+        if (j < num_shifts && shift_removes(&shifts[j], D.y)) continue;
+        D.y += moved;
+        T->dirty[n++] = D;
+    }
+
+    int inserted = 0;
+    for (int k = 0; k < num_shifts; k++)
+        if (shifts[k].delta > 0) inserted += shifts[k].delta;
+    if (inserted == 0) {
+        T->num_dirty = n;
+        return;
+    }
+
+    // Merge the inserted rows in, at their position after the shifts before them
+    TrigramDirty *out = malloc(sizeof(TrigramDirty) * (n + inserted));
+    if (out == NULL) exit(1);
+    int i = 0, m = 0;
+    moved = 0;
+    for (int k = 0; k < num_shifts; k++) {
+        if (shifts[k].delta > 0) {
+            int start = shifts[k].pos + moved;
+            while (i < n && T->dirty[i].y < start) out[m++] = T->dirty[i++];
+            for (int r = 0; r < shifts[k].delta; r++) out[m++] = (TrigramDirty) {start + r, -1};
+        }
+        moved += shifts[k].delta;
+    }
+    while (i < n) out[m++] = T->dirty[i++];
+
+    free(T->dirty);
+    T->dirty = out;
+    T->num_dirty = m;
+    T->dirty_cap = n + inserted;
+}
+
+/**
+ * @brief Apply sorted shifts to the index, and compact it once the segments piled up.
+ * @note The segments are bounded here, since every shift is a pass over them.
+ */
+static void trigram_index_shift(Editor *E, const TrigramShift *shifts, const int num_shifts) {
+    TrigramIndex *T = &E->trigrams;
+    segments_shift(T, shifts, num_shifts);
+    dirty_shift(T, shifts, num_shifts);
+    if (T->num_segments > TRIGRAM_MAX_SEGMENTS) trigram_index_compact(E);
+}
+
+void trigram_index_update_row(Editor *E, const int y) {
+    TrigramIndex *T = &E->trigrams;
+    if (!T->ready) return;
+
+    int lo = 0, hi = T->num_dirty;
+    while (lo < hi) {
+        int mid = (lo + hi) / 2;
+        if (T->dirty[mid].y < y) lo = mid + 1;
+        else hi = mid;
+    }
+
+    // A row changed again is indexed again, its old id is left behind
+    if (lo < T->num_dirty && T->dirty[lo].y == y) {
+        T->dirty[lo].id = -1;
+        return;
+    }
+
+    if (T->num_dirty == T->dirty_cap) {
+        T->dirty_cap = T->dirty_cap ? T->dirty_cap * 2 : 64;
+        T->dirty = realloc(T->dirty, sizeof(TrigramDirty) * T->dirty_cap);
+        if (T->dirty == NULL) exit(1);
+    }
+    memmove(&T->dirty[lo + 1], &T->dirty[lo], sizeof(TrigramDirty) * (T->num_dirty - lo));
+    T->dirty[lo] = (TrigramDirty) {y, -1};
+    T->num_dirty++;
+}
+
+void trigram_index_shift_rows(Editor *E, const int y, const int count) {
+    if (!E->trigrams.ready || count == 0) return;
+    TrigramShift S = {y, count};
+    trigram_index_shift(E, &S, 1);
+}
+
+void trigram_index_shift_row_list(Editor *E, const int *ys, const int count, const bool inserted) {
+    if (!E->trigrams.ready || count <= 0) return;
+
+    // Each run of rows is one shift, inserted rows are placed before the rows
+    // they were inserted above
+    TrigramShift *shifts = malloc(sizeof(TrigramShift) * count);
+    if (shifts == NULL) exit(1);
+    int n = 0;
+    for (int i = 0; i < count;) {
+        int j = i;
+        while (j + 1 < count && ys[j + 1] == ys[j] + 1) j++;
+        int len = j - i + 1;
+        shifts[n++] = inserted ? (TrigramShift) {ys[i] - i, len} : (TrigramShift) {ys[i], -len};
+        i = j + 1;
+    }
+
+    trigram_index_shift(E, shifts, n);
+    free(shifts);
+}
+
+void trigram_index_move_rows(Editor *E, const int y, const int count, const int to) {
+    if (!E->trigrams.ready || count <= 0 || to == y) return;
+
+    // The rows go from y and come back in above the row they end up on top of
+    TrigramShift shifts[2];
+    if (to < y) {
+        shifts[0] = (TrigramShift) {to, count};
+        shifts[1] = (TrigramShift) {y, -count};
+    } else {
+        shifts[0] = (TrigramShift) {y, -count};
+        shifts[1] = (TrigramShift) {to + count, count};
+    }
+    trigram_index_shift(E, shifts, 2);
+}
+
+/**
+ * @brief Keep the rows of a which are also in b, both sorted.
+ * @return Number of rows kept
+ */
+static int rows_intersect(int *a, const int na, const int *b, const int nb) {
+    int n = 0, j = 0;
+    for (int i = 0; i < na; i++) {
+        while (j < nb && b[j] < a[i]) j++;
+        if (j == nb) break;
+        if (b[j] == a[i]) a[n++] = a[i];
+    }
+    return n;
+}
+
+static int compare_postings(const void *a, const void *b) {
+    const TrigramPostings *x = *(TrigramPostings *const *) a;
+    const TrigramPostings *y = *(TrigramPostings *const *) b;
+    return (x->count > y->count) - (x->count < y->count);
+}
+
+/**
+ * @brief Get the ids in the lists of every trigram of a literal.
+ * @return Sorted ids to be freed by the caller, or NULL if a trigram has no list
+ * @note The result can hold more ids, the rarest lists are intersected first
+ * and the much longer ones are skipped.
+ */
+static int *table_query(const TrigramTable *T, const char *s, const size_t len, int *count) {
+    *count = 0;
+    int num_lists = 0;
+    TrigramPostings **lists = malloc(sizeof(TrigramPostings *) * (len - 2));
+    if (lists == NULL) exit(1);
+    for (size_t i = 0; i + 2 < len; i++) {
+        TrigramPostings *L = table_find(T, TRIGRAM_KEY(s[i], s[i + 1], s[i + 2]));
+        if (L == NULL || L->count == 0) {
+            free(lists);
+            return NULL;
+        }
+        lists[num_lists++] = L;
+    }
+
+    // Start with the rarest trigram, and stop intersecting once the lists are
+    // much longer than the candidates, the exact match is cheaper then
+    qsort(lists, num_lists, sizeof(TrigramPostings *), compare_postings);
+    int *ids = malloc(sizeof(int) * (lists[0]->count + 1));
+    int *tmp = malloc(sizeof(int) * (lists[num_lists - 1]->count + 1));
+    if (ids == NULL || tmp == NULL) exit(1);
+
+    postings_decode(lists[0], ids);
+    int n = lists[0]->count;
+    for (int i = 1; i < num_lists && n > 0; i++) {
+        if (lists[i] == lists[i - 1]) continue;
+        if (lists[i]->count > n * 16) break;
+        postings_decode(lists[i], tmp);
+        n = rows_intersect(ids, n, tmp, lists[i]->count);
+    }
+    free(tmp);
+    free(lists);
+
+    *count = n;
+    return ids;
+}
+
+int *trigram_index_candidates(Editor *E, const SearchPattern *P, int *count) {
+    TrigramIndex *T = &E->trigrams;
+    *count = 0;
+    if (!TRIGRAM_INDEX || P->needle == NULL || P->len < 3) return NULL;
+
+    if (!trigram_index_poll(T)) {
+        // Build the index in the background, this search scans every row
+        if (!T->building && E->num_rows >= TRIGRAM_MIN_ROWS) {
+            trigram_index_reset(T);
+            T->rows = E->row;
+            segments_reset(T, E->num_rows);
+            T->building = true;
+            if (pthread_create(&T->thread, NULL, trigram_build, T) != 0) T->building = false;
+        }
+        return NULL;
+    }
+
+    // Many changed rows are folded into the lists, instead of an overlay as
+    // large as them
+    if (T->num_dirty > TRIGRAM_MAX_DIRTY) trigram_index_compact(E);
+
+    // Every row containing the literal has all of its trigrams. The rows of
+    // the lists are mapped to where they are now.
+    int n = 0;
+    int *rows = table_query(&T->table, P->needle, P->len, &n);
+    int m = 0;
+    for (int i = 0, s = 0; i < n; i++) {
+        while (s < T->num_segments && T->segments[s].base + T->segments[s].len <= rows[i]) s++;
+        if (s == T->num_segments) break;
+        const TrigramSegment *S = &T->segments[s];
+        if (rows[i] >= S->base) rows[m++] = rows[i] + S->offset;
+    }
+    n = m;
+
+    // The changed rows are looked up in the overlay, by their content now
+    overlay_update(E);
+    int o = 0;
+    int *changed = table_query(&T->overlay, P->needle, P->len, &o);
+    if (o > 0) {
+        int *id_rows = overlay_rows(T);
+        m = 0;
+        for (int i = 0; i < o; i++)
+            if (id_rows[changed[i]] != -1) changed[m++] = id_rows[changed[i]];
+        o = m;
+        qsort(changed, o, sizeof(int), compare_rows);
+        free(id_rows);
+    }
+
+    // Merge both, a changed row can still be in the lists with its old content
+    int *merged = malloc(sizeof(int) * (n + o + 1));
+    if (merged == NULL) exit(1);
+    int i = 0, j = 0;
+    m = 0;
+    while (i < n || j < o) {
+        int y;
+        if (j == o || (i < n && rows[i] < changed[j])) y = rows[i++];
+        else if (i == n || changed[j] < rows[i]) y = changed[j++];
+        else {
+            y = rows[i++];
+            j++;
+        }
+        merged[m++] = y;
+    }
+    free(rows);
+    free(changed);
+
+    *count = m;
+    return merged;
+}
@@ -0,0 +1,400 @@
+#include "undo.h"
+#include "editor.h"
+#include "rows.h"
+#include <stdlib.h>
+#include <string.h>
+
+static size_t align8(const size_t n) {
+    return (n + 7) & ~(size_t) 7;
+}
+
+void undo_journal_init(UndoJournal *J) {
+    memset(J, 0, sizeof(UndoJournal));
+    J->sealed = true;
+    J->log.fd = -1;
+}
+
+void undo_journal_free(UndoJournal *J) {
+    undo_log_close(J);
+
+    UndoBlock *B = J->head;
+    while (B != NULL) {
+        UndoBlock *next = B->next;
+        free(B);
+        B = next;
+    }
+    free(J->records);
+    undo_journal_init(J);
+}
+
+void undo_suspend(Editor *E) {
+    E->undo.suspended++;
+}
+
+void undo_resume(Editor *E) {
+    if (E->undo.suspended > 0) E->undo.suspended--;
+}
+
+void undo_seal(Editor *E) {
+    if (E->undo.grouped == 0) E->undo.sealed = true;
+}
+
+void undo_group_begin(Editor *E) {
+    E->undo.grouped++;
+}
+
+void undo_group_end(Editor *E) {
+    if (E->undo.grouped > 0) E->undo.grouped--;
+}
+
+/**
+ * @brief Derive the dirty value of the editor from the position in the journal.
+ */
+static void undo_update_dirty(Editor *E) {
+    UndoJournal *J = &E->undo;
+    unsigned long serial = (J->pos > J->first) ? J->records[J->pos - 1]->serial : J->base_serial;
+    E->dirty = (serial != J->saved_serial);
+}
+
+void undo_mark_saved(Editor *E) {
+    UndoJournal *J = &E->undo;
+    J->saved_serial = (J->pos > J->first) ? J->records[J->pos - 1]->serial : J->base_serial;
+    E->dirty = 0;
+}
+
+/**
+ * @brief Find the block a record was allocated from.
+ * @return NULL for records loaded from the log
+ */
+static UndoBlock *arena_block(const UndoJournal *J, const UndoRecord *R) {
+    for (UndoBlock *B = J->head; B != NULL; B = B->next)
+        if ((const char *) R >= B->data && (const char *) R < B->data + B->cap) return B;
+    return NULL;
+}
+
+/**
+ * @brief Bump allocate a record from the newest block.
+ */
+static UndoRecord *arena_alloc(UndoJournal *J, const size_t size) {
+    UndoBlock *B = J->tail;
+    size_t start = (B != NULL) ? align8(B->used) : 0;
+
+    if (B == NULL || start + size > B->cap) {
+        // Records larger than a block get a block of their own
+        size_t cap = (size > UNDO_BLOCK_SIZE) ? size : UNDO_BLOCK_SIZE;
+        B = malloc(sizeof(UndoBlock) + cap);
+        if (B == NULL) exit(1);
+        B->next = NULL;
+        B->used = 0;
+        B->cap = cap;
+
+        if (J->tail != NULL) J->tail->next = B;
+        else J->head = B;
+        J->tail = B;
+        J->bytes += cap;
+        start = 0;
+    }
+
+    B->used = start + size;
+    return (UndoRecord *) (B->data + start);
+}
+
+/**
+ * @brief Drop the undone records, a new edit makes them unreachable.
+ */
+static void undo_truncate(UndoJournal *J) {
+    if (J->pos >= J->num) return;
+
+    // Rewind the arena to where the first dropped record was allocated. If it came
+    // from the log, every record of the session is dropped with it.
+    UndoRecord *R = J->records[J->pos];
+    UndoBlock *B = arena_block(J, R);
+    UndoBlock *next;
+    if (B != NULL) {
+        B->used = (size_t) ((char *) R - B->data);
+        next = B->next;
+    } else {
+        next = J->head;
+        J->head = NULL;
+    }
+
+    while (next != NULL) {
+        UndoBlock *after = next->next;
+        J->bytes -= next->cap;
+        free(next);
+        next = after;
+    }
+    if (B != NULL) B->next = NULL;
+    J->tail = B;
+
+    J->num = J->pos;
+}
+
+/**
+ * @brief Drop the oldest steps until the journal fits in UNDO_MEMORY_CAP.
+ * @note Only steps which are applied are dropped, and never the newest one.
+ */
+static void undo_trim(UndoJournal *J) {
+    while (J->bytes > UNDO_MEMORY_CAP && J->head != J->tail && J->first < J->last_step) {
+        // Find the start of the second step
+        long s = J->first + 1;
+        while (s < J->num && !J->records[s]->step_start) s++;
+        if (s >= J->num || s > J->pos) break;
+
+        J->base_serial = J->records[s - 1]->serial;
+        J->first = s;
+
+        // Free the blocks which only hold dropped records, none do while the
+        // records from the log are dropped
+        UndoBlock *keep = arena_block(J, J->records[J->first]);
+        while (keep != NULL && J->head != keep) {
+            UndoBlock *B = J->head;
+            J->head = B->next;
+            J->bytes -= B->cap;
+            free(B);
+        }
+    }
+
+    // Compact the record index once most of it is dropped
+    if (J->first > 1024 && J->first > J->num / 2) {
+        memmove(J->records, &J->records[J->first], sizeof(UndoRecord *) * (J->num - J->first));
+        J->num -= J->first;
+        J->pos -= J->first;
+        J->last_step -= J->first;
+        J->offset += J->first;
+        J->first = 0;
+    }
+}
+
+/**
+ * @brief Append a record to the journal.
+ * @return New record, or NULL if recording is suspended
+ */
+static UndoRecord *undo_append(Editor *E, const UndoType type, const int x, const int y,
+                               const char *s, const int len, const char *s2, const int len2) {
+    UndoJournal *J = &E->undo;
+    if (J->suspended > 0) return NULL;
+
+    undo_log_truncate(J, J->offset + J->pos);
+    undo_truncate(J);
+
+    UndoRecord *R = arena_alloc(J, sizeof(UndoRecord) + len + len2);
+    R->type = (unsigned char) type;
+    R->step_start = J->sealed || J->num == J->first;
+    R->x = x;
+    R->y = y;
+    R->len = len;
+    R->len2 = len2;
+    R->serial = ++J->next_serial;
+    if (len > 0) memcpy(R->text, s, len);
+    if (len2 > 0) memcpy(R->text + len, s2, len2);
+    J->sealed = false;
+
+    if (J->num == J->cap) {
+        J->cap = J->cap ? J->cap * 2 : 256;
+        J->records = realloc(J->records, sizeof(UndoRecord *) * J->cap);
+        if (J->records == NULL) exit(1);
+    }
+    if (R->step_start) J->last_step = J->num;
+    J->records[J->num++] = R;
+    J->pos = J->num;
+
+    // Every record but the new one is final, the new one can still grow
+    undo_log_sync(J, J->offset + J->num - 1);
+    undo_trim(J);
+    undo_update_dirty(E);
+    return R;
+}
+
+void undo_record_insert(Editor *E, const int x, const int y, const char *s, const int len) {
+    UndoJournal *J = &E->undo;
+
+    // Typing coalesces: extend the last insert if the text continues it, it is
+    // the last thing in the arena, and it is not in the log yet
+    if (J->suspended == 0 && !J->sealed && J->pos == J->num && J->num > J->first &&
+        J->offset + J->num > J->log.base + J->log.logged) {
+        UndoRecord *R = J->records[J->num - 1];
+        UndoBlock *B = J->tail;
+        char *end = R->text + R->len;
+        if (R->type == UNDO_INSERT && R->y == y && R->x + R->len == x &&
+            end == B->data + B->used && B->used + len <= B->cap) {
+            memcpy(end, s, len);
+            R->len += len;
+            B->used += len;
+            R->serial = ++J->next_serial;
+            undo_update_dirty(E);
+            return;
+        }
+    }
+
+    undo_append(E, UNDO_INSERT, x, y, s, len, NULL, 0);
+}
+
+void undo_record_delete(Editor *E, const int x, const int y, const char *s, const int len) {
+    undo_append(E, UNDO_DELETE, x, y, s, len, NULL, 0);
+}
+
+void undo_record_split(Editor *E, const int x, const int y) {
+    undo_append(E, UNDO_SPLIT, x, y, NULL, 0, NULL, 0);
+}
+
+void undo_record_join(Editor *E, const int x, const int y) {
+    undo_append(E, UNDO_JOIN, x, y, NULL, 0, NULL, 0);
+}
+
+void undo_record_row_insert(Editor *E, const int y, const char *s, const int len) {
+    undo_append(E, UNDO_ROW_INSERT, 0, y, s, len, NULL, 0);
+}
+
+void undo_record_row_delete(Editor *E, const int y, const char *s, const int len) {
+    undo_append(E, UNDO_ROW_DELETE, 0, y, s, len, NULL, 0);
+}
+
+void undo_record_row_set(Editor *E, const int y, const char *old, const int old_len, const char *s, const int len) {
+    undo_append(E, UNDO_ROW_SET, 0, y, old, old_len, s, len);
+}
+
+/**
+ * @brief Set the content of a row to a copy of s.
+ */
+static void undo_set_row(Editor *E, const int y, const char *s, const int len) {
+    char *chars = row_text_new(len);
+    memcpy(chars, s, len);
+    editor_set_row_chars(E, y, chars, len);
+}
+
+/**
+ * @brief Apply a record, or its inverse.
+ * @param forward true to redo the record, false to undo it
+ */
+static void undo_apply(Editor *E, const UndoRecord *R, const bool forward) {
+    switch ((UndoType) R->type) {
+        case UNDO_INSERT:
+        case UNDO_DELETE:
+            if (forward == (R->type == UNDO_INSERT)) editor_row_insert_span(E, R->x, R->y, R->text, R->len);
+            else editor_row_delete_span(E, R->x, R->y, R->len);
+            break;
+        case UNDO_SPLIT:
+        case UNDO_JOIN:
+            if (forward == (R->type == UNDO_SPLIT)) editor_split_row(E, R->x, R->y);
+            else editor_join_rows(E, R->y);
+            break;
+        case UNDO_ROW_INSERT:
+        case UNDO_ROW_DELETE:
+            if (forward == (R->type == UNDO_ROW_INSERT))
+                editor_insert_row_below(E, R->y, (char *) R->text, R->len);
+            else
+                editor_remove_row(E, R->y);
+            break;
+        case UNDO_ROW_SET:
+            if (forward) undo_set_row(E, R->y, R->text + R->len, R->len2);
+            else undo_set_row(E, R->y, R->text, R->len);
+            break;
+    }
+}
+
+/**
+ * @brief Check if record b continues a run of row records ending in a.
+ * @note Rows removed one after the other never move back, e.g. the rows of
+ * ":g/pattern/d", and rows inserted one after the other move forward. A run
+ * never crosses the start of a step.
+ */
+static bool undo_row_run(const UndoRecord *a, const UndoRecord *b) {
+    if (a->type != UNDO_ROW_INSERT && a->type != UNDO_ROW_DELETE) return false;
+    if (b->type != a->type || b->step_start) return false;
+    return (a->type == UNDO_ROW_DELETE) ? b->y >= a->y : b->y > a->y;
+}
+
+/**
+ * @brief Apply a run of row records [from, to], or its inverse, with a single pass over the rows.
+ * @param forward true to redo the records, false to undo them
+ */
+static void undo_apply_rows(Editor *E, const long from, const long to, const bool forward) {
+    UndoRecord **records = &E->undo.records[from];
+    int count = (int) (to - from + 1);
+    bool insert = records[0]->type == UNDO_ROW_INSERT;
+
+    // Rows removed at the same place were next to each other before the removal
+    int *ys = malloc(sizeof(int) * count);
+    if (ys == NULL) exit(1);
+    for (int i = 0; i < count; i++) ys[i] = records[i]->y + (insert ? 0 : i);
+
+    if (forward == insert) {
+        char **texts = malloc(sizeof(char *) * count);
+        int *lens = malloc(sizeof(int) * count);
+        if (texts == NULL || lens == NULL) exit(1);
+        for (int i = 0; i < count; i++) {
+            texts[i] = records[i]->text;
+            lens[i] = records[i]->len;
+        }
+        editor_insert_row_list(E, ys, count, texts, lens);
+        free(texts);
+        free(lens);
+    } else {
+        editor_delete_row_list(E, ys, count);
+    }
+    free(ys);
+}
+
+/**
+ * @brief Move the cursor to where a record applies, kept inside the rows.
+ */
+static void undo_move_cursor(Editor *E, const UndoRecord *R) {
+    E->cur_y = R->y;
+    if (E->cur_y >= E->num_rows) E->cur_y = E->num_rows - 1;
+    if (E->cur_y < 0) E->cur_y = 0;
+
+    E->cur_x = R->x;
+    if (E->cur_x > E->row[E->cur_y].size) E->cur_x = E->row[E->cur_y].size;
+}
+
+bool undo_undo(Editor *E) {
+    UndoJournal *J = &E->undo;
+    if (J->pos <= J->first && !undo_log_load_history(J)) return false;
+
+    // Apply the inverse of every record of the step in one pass, newest first
+    undo_suspend(E);
+    long i = J->pos;
+    do {
+        i--;
+
+        // Rows inserted or removed together go back with one splice
+        long start = i;
+        while (start > J->first && undo_row_run(J->records[start - 1], J->records[start])) start--;
+        if (start < i) {
+            undo_apply_rows(E, start, i, false);
+            i = start;
+        } else {
+            undo_apply(E, J->records[i], false);
+        }
+    } while (i > J->first && !J->records[i]->step_start);
+    undo_resume(E);
+
+    J->pos = i;
+    J->sealed = true;
+    undo_move_cursor(E, J->records[i]);
+    undo_update_dirty(E);
+    return true;
+}
+
+bool undo_redo(Editor *E) {
+    UndoJournal *J = &E->undo;
+    if (J->pos >= J->num) return false;
+
+    undo_suspend(E);
+    long i = J->pos;
+    do {
+        long end = i;
+        while (end + 1 < J->num && undo_row_run(J->records[end], J->records[end + 1])) end++;
+        if (end > i) undo_apply_rows(E, i, end, true);
+        else undo_apply(E, J->records[i], true);
+        i = end + 1;
+    } while (i < J->num && !J->records[i]->step_start);
+    undo_resume(E);
+
+    undo_move_cursor(E, J->records[J->pos]);
+    J->pos = i;
+    J->sealed = true;
+    undo_update_dirty(E);
+    return true;
+}
@@ -0,0 +1,305 @@
+#include "undo_log.h"
+#include "editor.h"
+#include <fcntl.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+static size_t pad8(const size_t n) {
+    return (n + 7) & ~(size_t) 7;
+}
+
+uint64_t undo_log_hash(uint64_t hash, const char *s, const size_t len) {
+    for (size_t i = 0; i < len; i++) {
+        hash ^= (unsigned char) s[i];
+        hash *= 0x100000001b3ULL;
+    }
+    return hash;
+}
+
+/**
+ * @brief Get the path of the log of a file, "dir/name" becomes "dir/.name.undo".
+ */
+static char *log_path(const char *filename) {
+    const char *slash = strrchr(filename, '/');
+    size_t dir_len = (slash != NULL) ? (size_t) (slash - filename) + 1 : 0;
+    const char *name = filename + dir_len;
+
+    char *path = malloc(strlen(filename) + 7);
+    if (path == NULL) exit(1);
+    memcpy(path, filename, dir_len);
+    path[dir_len] = '.';
+    strcpy(path + dir_len + 1, name);
+    strcat(path, ".undo");
+    return path;
+}
+
+/**
+ * @brief Stop logging, e.g. after a failed write. The file is left as it is.
+ */
+static void log_disable(UndoLog *L) {
+    L->enabled = false;
+    L->buf_len = 0;
+}
+
+/**
+ * @brief Write the buffer to the end of the file, creating a new log first if needed.
+ */
+static bool log_flush(UndoLog *L) {
+    if (!L->enabled) return false;
+
+    if (L->fd == -1) {
+        L->fd = open(L->path, O_RDWR | O_CREAT | O_TRUNC, 0644);
+        if (L->fd == -1) {
+            log_disable(L);
+            return false;
+        }
+
+        UndoLogHeader header = {0};
+        memcpy(header.magic, UNDO_LOG_MAGIC, sizeof(header.magic));
+        if (pwrite(L->fd, &header, sizeof(header), 0) != sizeof(header)) {
+            log_disable(L);
+            return false;
+        }
+        L->end = sizeof(header);
+    }
+
+    size_t done = 0;
+    while (done < L->buf_len) {
+        ssize_t n = pwrite(L->fd, L->buf + done, L->buf_len - done, L->end + (off_t) done);
+        if (n <= 0) {
+            log_disable(L);
+            return false;
+        }
+        done += (size_t) n;
+    }
+    L->end += (off_t) L->buf_len;
+    L->buf_len = 0;
+    return true;
+}
+
+/**
+ * @brief Add an entry to the buffer, the buffer is written once it is full.
+ * @return Offset of the entry in the file
+ */
+static off_t log_append(UndoLog *L, const UndoLogKind kind, const void *a, const size_t a_len,
+                        const void *b, const size_t b_len) {
+    size_t size = pad8(a_len + b_len);
+    size_t need = sizeof(UndoLogEntry) + size;
+    if (L->buf_len + need > L->buf_cap) {
+        while (L->buf_len + need > L->buf_cap) L->buf_cap = L->buf_cap ? L->buf_cap * 2 : UNDO_LOG_BUFFER;
+        L->buf = realloc(L->buf, L->buf_cap);
+        if (L->buf == NULL) exit(1);
+    }
+
+    // A new log has its header written before the first entry
+    off_t offset = ((L->fd == -1) ? (off_t) sizeof(UndoLogHeader) : L->end) + (off_t) L->buf_len;
+
+    UndoLogEntry entry = {(uint32_t) kind, (uint32_t) size};
+    char *p = L->buf + L->buf_len;
+    memcpy(p, &entry, sizeof(entry));
+    p += sizeof(entry);
+    if (a_len > 0) memcpy(p, a, a_len);
+    if (b_len > 0) memcpy(p + a_len, b, b_len);
+    memset(p + a_len + b_len, 0, size - a_len - b_len);
+    L->buf_len += need;
+    L->touched = true;
+
+    if (L->buf_len >= UNDO_LOG_BUFFER) log_flush(L);
+    return offset;
+}
+
+void undo_log_open(Editor *E, const char *filename, const uint64_t hash) {
+    UndoJournal *J = &E->undo;
+    UndoLog *L = &J->log;
+    if (!UNDO_LOG || L->enabled) return;
+
+    L->enabled = true;
+    L->path = log_path(filename);
+    L->base = J->offset + J->first;
+    L->logged = 0;
+
+    // Continue the existing log only if it was last saved with the content on
+    // disk, and nothing was recorded yet this session
+    if (J->num > 0) return;
+    int fd = open(L->path, O_RDWR);
+    if (fd == -1) return;
+
+    struct stat st;
+    UndoLogHeader header;
+    UndoLogEntry entry;
+    int64_t save[2];
+    bool valid = fstat(fd, &st) == 0 &&
+                 pread(fd, &header, sizeof(header), 0) == sizeof(header) &&
+                 memcmp(header.magic, UNDO_LOG_MAGIC, sizeof(header.magic)) == 0 &&
+                 header.hash == hash && header.save_offset >= sizeof(header) && header.save_offset % 8 == 0 &&
+                 header.save_offset + sizeof(entry) + sizeof(save) <= (uint64_t) st.st_size &&
+                 pread(fd, &entry, sizeof(entry), (off_t) header.save_offset) == sizeof(entry) &&
+                 entry.kind == UNDO_LOG_SAVE &&
+                 pread(fd, save, sizeof(save), (off_t) header.save_offset + sizeof(entry)) == sizeof(save) &&
+                 (uint64_t) save[0] == hash && save[1] >= 0;
+    if (!valid) {
+        close(fd);
+        return;
+    }
+
+    // Private mapping, so the records can be renumbered when they are loaded
+    void *map = (save[1] > 0) ? mmap(NULL, st.st_size, PROT_READ | PROT_WRITE, MAP_PRIVATE, fd, 0) : NULL;
+    if (map == MAP_FAILED) {
+        close(fd);
+        return;
+    }
+
+    L->fd = fd;
+    L->end = st.st_size;
+    L->map = map;
+    L->map_len = st.st_size;
+    L->save_offset = header.save_offset;
+    L->history = (long) save[1];
+
+    // The session continues from the saved state, the records after it in the
+    // log belong to a session which exited without saving
+    L->base = 0;
+    L->logged = L->history;
+    J->offset = L->history;
+    log_append(L, UNDO_LOG_TRUNCATE, &save[1], sizeof(save[1]), NULL, 0);
+    L->touched = false;
+}
+
+void undo_log_save(Editor *E, const uint64_t hash) {
+    UndoJournal *J = &E->undo;
+    UndoLog *L = &J->log;
+    if (!L->enabled) {
+        // The file got its name on this save
+        if (E->filename == NULL) return;
+        undo_log_open(E, E->filename, hash);
+        if (!L->enabled) return;
+    }
+
+    undo_log_sync(J, J->offset + J->num);
+
+    int64_t save[2] = {(int64_t) hash, J->offset + J->pos - L->base};
+    off_t offset = log_append(L, UNDO_LOG_SAVE, save, sizeof(save), NULL, 0);
+    if (!log_flush(L)) return;
+
+    // Point the header at the new save, the entries are already on disk
+    UndoLogHeader header = {0};
+    memcpy(header.magic, UNDO_LOG_MAGIC, sizeof(header.magic));
+    header.hash = hash;
+    header.save_offset = (uint64_t) offset;
+    if (pwrite(L->fd, &header, sizeof(header), 0) != sizeof(header)) log_disable(L);
+}
+
+void undo_log_sync(UndoJournal *J, const long upto) {
+    UndoLog *L = &J->log;
+    if (!L->enabled) return;
+
+    for (long i = L->base + L->logged; i < upto; i++) {
+        const UndoRecord *R = J->records[i - J->offset];
+        log_append(L, UNDO_LOG_RECORD, R, sizeof(UndoRecord), R->text, (size_t) R->len + R->len2);
+    }
+    if (upto - L->base > L->logged) L->logged = upto - L->base;
+}
+
+void undo_log_truncate(UndoJournal *J, const long count) {
+    UndoLog *L = &J->log;
+    if (!L->enabled || count - L->base >= L->logged) return;
+
+    int64_t n = count - L->base;
+    log_append(L, UNDO_LOG_TRUNCATE, &n, sizeof(n), NULL, 0);
+    L->logged = (long) n;
+}
+
+/**
+ * @brief Find the records applied at the last save, by following the log up to it.
+ * @return Offsets of the records in the map, or NULL if the log is damaged
+ */
+static long *log_scan(const UndoLog *L) {
+    long *offsets = NULL;
+    long num = 0, cap = 0;
+    size_t pos = sizeof(UndoLogHeader);
+
+    while (pos < L->save_offset) {
+        UndoLogEntry entry;
+        memcpy(&entry, L->map + pos, sizeof(entry));
+        size_t payload = pos + sizeof(entry);
+        if (payload + entry.size > L->save_offset) break;
+
+        if (entry.kind == UNDO_LOG_RECORD) {
+            const UndoRecord *R = (const UndoRecord *) (L->map + payload);
+            if (entry.size < sizeof(UndoRecord) || R->len < 0 || R->len2 < 0 ||
+                sizeof(UndoRecord) + (size_t) R->len + R->len2 > entry.size || R->type > UNDO_ROW_SET) break;
+
+            if (num == cap) {
+                cap = cap ? cap * 2 : 256;
+                offsets = realloc(offsets, sizeof(long) * cap);
+                if (offsets == NULL) exit(1);
+            }
+            offsets[num++] = (long) payload;
+        } else if (entry.kind == UNDO_LOG_TRUNCATE) {
+            int64_t n;
+            memcpy(&n, L->map + payload, sizeof(n));
+            if (n < 0 || n > num) break;
+            num = (long) n;
+        }
+        pos = payload + entry.size;
+    }
+
+    if (pos != L->save_offset || num < L->history) {
+        free(offsets);
+        return NULL;
+    }
+    return offsets;
+}
+
+bool undo_log_load_history(UndoJournal *J) {
+    UndoLog *L = &J->log;
+
+    // Only possible while the session records follow the history without a gap
+    if (L->history == 0 || J->first != 0 || J->offset != L->history) return false;
+
+    long *offsets = log_scan(L);
+    long count = L->history;
+    L->history = 0;
+    if (offsets == NULL) return false;
+
+    if (J->num + count > J->cap) {
+        J->cap = J->num + count;
+        J->records = realloc(J->records, sizeof(UndoRecord *) * J->cap);
+        if (J->records == NULL) exit(1);
+    }
+    memmove(&J->records[count], J->records, sizeof(UndoRecord *) * J->num);
+
+    // Serials of the old session mean nothing here. The last record gets the
+    // serial of the session start, so undoing back to it is still clean.
+    for (long i = 0; i < count; i++) {
+        UndoRecord *R = (UndoRecord *) (L->map + offsets[i]);
+        R->serial = (i == count - 1) ? J->base_serial : ++J->next_serial;
+        J->records[i] = R;
+    }
+    J->base_serial = ++J->next_serial;
+    free(offsets);
+
+    J->num += count;
+    J->pos += count;
+    J->last_step += count;
+    J->offset = 0;
+    return true;
+}
+
+void undo_log_close(UndoJournal *J) {
+    UndoLog *L = &J->log;
+
+    // The last record is only added now, it could still have grown
+    undo_log_sync(J, J->offset + J->num);
+    if (L->enabled && L->touched) log_flush(L);
+
+    if (L->map != NULL) munmap(L->map, L->map_len);
+    if (L->fd != -1) close(L->fd);
+    free(L->path);
+    free(L->buf);
+    memset(L, 0, sizeof(UndoLog));
+    L->fd = -1;
+}
@@ -0,0 +1,556 @@
+#include "visual.h"
+#include "editor.h"
+#include "rows.h"
+#include <ncurses.h>
+#include <stdlib.h>
+#include <string.h>
+
+/**
+ * @brief Selection in order, with an inclusive end.
+ * @note For blocks, the columns are render columns without the row numbers.
+ */
+typedef struct {
+    int x0, y0;
+    int x1, y1;
+    int col0, col1;
+} Selection;
+
+/**
+ * @brief Per row plan of a block operation, worked out before the rows change.
+ * @note Slot i belongs to row y0 + i, so threads never share a slot.
+ */
+typedef struct {
+    int y0;
+    int col0;
+    int col1;
+    int count;
+
+    /**
+     * @brief Position of the change in each row, -1 to leave the row alone.
+     */
+    int *x;
+
+    /**
+     * @brief Characters removed, or spaces added before the text, in each row.
+     */
+    int *len;
+
+    /**
+     * @brief Text inserted into each row.
+     */
+    const char *text;
+    int text_len;
+} BlockPlan;
+
+/**
+ * @brief Growable text, used to build the content of the register.
+ */
+typedef struct {
+    char *b;
+    size_t len;
+    size_t cap;
+} Text;
+
+static void text_append(Text *T, const char *s, const size_t len) {
+    if (T->len + len > T->cap) {
+        while (T->len + len > T->cap) T->cap = T->cap ? T->cap * 2 : 256;
+        T->b = realloc(T->b, T->cap);
+        if (T->b == NULL) exit(1);
+    }
+    memcpy(T->b + T->len, s, len);
+    T->len += len;
+}
+
+/**
+ * @brief Width of a character in the render, tabs run to the next tab stop.
+ */
+static int char_width(const char c, const int rx) {
+    return (c == '\t') ? TAB_STOP - rx % TAB_STOP : 1;
+}
+
+/**
+ * @brief Render column of position x in a row.
+ */
+static int render_col(const erow *row, const int x) {
+    int rx = 0;
+    for (int i = 0; i < x && i < row->size; i++) rx += char_width(row->chars[i], rx);
+    return rx;
+}
+
+/**
+ * @brief Last render column covered by the character at x, the end of the row counts as one column.
+ */
+static int render_col_end(const erow *row, const int x) {
+    int rx = render_col(row, x);
+    return (x < row->size) ? rx + char_width(row->chars[x], rx) - 1 : rx;
+}
+
+/**
+ * @brief Find the characters of a row which cover the render columns [col0, col1].
+ * @return false if the row ends before col0
+ */
+static bool row_block_span(const erow *row, const int col0, const int col1, int *a, int *b) {
+    int rx = 0, i = 0;
+    while (i < row->size && rx + char_width(row->chars[i], rx) <= col0) rx += char_width(row->chars[i++], rx);
+    *a = i;
+    if (i == row->size) {
+        *b = i;
+        return false;
+    }
+    while (i < row->size && rx <= col1) rx += char_width(row->chars[i++], rx);
+    *b = i;
+    return true;
+}
+
+bool visual_active(const Editor *E) {
+    return E->mode == VISUAL_MODE || E->mode == VISUAL_LINE_MODE || E->mode == VISUAL_BLOCK_MODE;
+}
+
+void visual_start(Editor *E, const int mode) {
+    if (E->num_rows == 0) return;
+    if (E->mode == (EditorMode) mode) {
+        visual_exit(E);
+        return;
+    }
+
+    // Switching between the visual modes keeps the selection
+    if (!visual_active(E)) {
+        E->visual.anchor_x = E->cur_x;
+        E->visual.anchor_y = E->cur_y;
+    }
+    E->mode = (EditorMode) mode;
+}
+
+void visual_exit(Editor *E) {
+    E->mode = NORMAL_MODE;
+}
+
+void visual_swap_ends(Editor *E) {
+    int x = E->visual.anchor_x, y = E->visual.anchor_y;
+    E->visual.anchor_x = E->cur_x;
+    E->visual.anchor_y = E->cur_y;
+    E->cur_x = x;
+    E->cur_y = y;
+}
+
+/**
+ * @brief Get the selection between the anchor and the cursor, kept inside the rows.
+ */
+static void selection_get(Editor *E, Selection *S) {
+    int ax = E->visual.anchor_x, ay = E->visual.anchor_y;
+    if (ay >= E->num_rows) ay = E->num_rows - 1;
+    if (ax > E->row[ay].size) ax = E->row[ay].size;
+
+    if (ay < E->cur_y || (ay == E->cur_y && ax <= E->cur_x)) {
+        *S = (Selection) {ax, ay, E->cur_x, E->cur_y, 0, 0};
+    } else {
+        *S = (Selection) {E->cur_x, E->cur_y, ax, ay, 0, 0};
+    }
+
+    if (E->mode == VISUAL_BLOCK_MODE) {
+        // The block spans the columns of both ends, whichever rows they are on
+        const erow *arow = &E->row[ay], *crow = &E->row[E->cur_y];
+        int a0 = render_col(arow, ax), c0 = render_col(crow, E->cur_x);
+        int a1 = render_col_end(arow, ax), c1 = render_col_end(crow, E->cur_x);
+        S->col0 = (a0 < c0) ? a0 : c0;
+        S->col1 = (a1 > c1) ? a1 : c1;
+    }
+}
+
+// ---- BLOCK PLANS ----
+
+static void plan_init(BlockPlan *P, const int y0, const int y1) {
+    memset(P, 0, sizeof(BlockPlan));
+    P->y0 = y0;
+    P->count = y1 - y0 + 1;
+    P->x = malloc(sizeof(int) * P->count);
+    P->len = malloc(sizeof(int) * P->count);
+    if (P->x == NULL || P->len == NULL) exit(1);
+}
+
+static void plan_free(BlockPlan *P) {
+    free(P->x);
+    free(P->len);
+}
+
+/**
+ * @brief Find the characters of the block in a row.
+ */
+static void plan_span(Editor *E, const int y, void *arg) {
+    BlockPlan *P = arg;
+    int i = y - P->y0, a, b;
+    row_block_span(&E->row[y], P->col0, P->col1, &a, &b);
+    P->x[i] = a;
+    P->len[i] = b - a;
+}
+
+/**
+ * @brief Find where the text of a block insert goes in a row, rows which end before the block are skipped.
+ */
+static void plan_insert(Editor *E, const int y, void *arg) {
+    BlockPlan *P = arg;
+    int i = y - P->y0, a, b;
+    P->x[i] = row_block_span(&E->row[y], P->col0, P->col0, &a, &b) ? a : -1;
+    P->len[i] = 0;
+}
+
+/**
+ * @brief Find where the text of a block append goes in a row, short rows are padded up to the column.
+ */
+static void plan_append(Editor *E, const int y, void *arg) {
+    BlockPlan *P = arg;
+    const erow *row = &E->row[y];
+    int i = y - P->y0;
+
+    int rx = 0, x = 0;
+    while (x < row->size && rx < P->col0) rx += char_width(row->chars[x++], rx);
+    P->x[i] = x;
+    P->len[i] = (rx < P->col0) ? P->col0 - rx : 0;
+}
+
+/**
+ * @brief Find the indent to remove from a row, one level is a tab or up to TAB_STOP spaces.
+ * @note The number of levels is passed in text_len.
+ */
+static void plan_unindent(Editor *E, const int y, void *arg) {
+    BlockPlan *P = arg;
+    const erow *row = &E->row[y];
+    int i = y - P->y0, x = 0;
+
+    for (int level = 0; level < P->text_len && x < row->size; level++) {
+        if (row->chars[x] == '\t') {
+            x++;
+            continue;
+        }
+        int spaces = 0;
+        while (x < row->size && row->chars[x] == ' ' && spaces < TAB_STOP) {
+            x++;
+            spaces++;
+        }
+        if (spaces == 0) break;
+    }
+    P->x[i] = 0;
+    P->len[i] = x;
+}
+
+/**
+ * @brief Indent a row which is not empty.
+ */
+static void plan_indent(Editor *E, const int y, void *arg) {
+    BlockPlan *P = arg;
+    int i = y - P->y0;
+    P->x[i] = (E->row[y].size > 0) ? 0 : -1;
+    P->len[i] = 0;
+}
+
+/**
+ * @brief Apply the plan to a row, removing len characters or adding len spaces before the text.
+ */
+static void apply_delete(Editor *E, const int y, void *arg) {
+    BlockPlan *P = arg;
+    int i = y - P->y0;
+    if (P->x[i] >= 0 && P->len[i] > 0) row_splice(&E->row[y], P->x[i], P->len[i], NULL, 0);
+}
+
+static void apply_insert(Editor *E, const int y, void *arg) {
+    BlockPlan *P = arg;
+    int i = y - P->y0;
+    if (P->x[i] < 0) return;
+
+    if (P->len[i] > 0) {
+        char *spaces = malloc(P->len[i]);
+        if (spaces == NULL) exit(1);
+        memset(spaces, ' ', P->len[i]);
+        row_splice(&E->row[y], P->x[i], 0, spaces, P->len[i]);
+        free(spaces);
+    }
+    row_splice(&E->row[y], P->x[i] + P->len[i], 0, P->text, P->text_len);
+}
+
+/**
+ * @brief Record the deletes of a plan for undo, before the rows change.
+ */
+static void plan_record_delete(Editor *E, const BlockPlan *P) {
+    for (int i = 0; i < P->count; i++) {
+        if (P->x[i] < 0 || P->len[i] == 0) continue;
+        undo_record_delete(E, P->x[i], P->y0 + i, &E->row[P->y0 + i].chars[P->x[i]], P->len[i]);
+    }
+}
+
+/**
+ * @brief Record the inserts of a plan for undo, padding included.
+ */
+static void plan_record_insert(Editor *E, const BlockPlan *P) {
+    Text T = {0};
+    for (int i = 0; i < P->count; i++) {
+        if (P->x[i] < 0) continue;
+        T.len = 0;
+        for (int k = 0; k < P->len[i]; k++) text_append(&T, " ", 1);
+        text_append(&T, P->text, P->text_len);
+        if (T.len > 0) undo_record_insert(E, P->x[i], P->y0 + i, T.b, (int) T.len);
+    }
+    free(T.b);
+}
+
+// ---- OPERATORS ----
+
+/**
+ * @brief Get the end of a characterwise selection, exclusive.
+ * @note The end of the last row is selected when the cursor is on it, which takes its newline.
+ */
+static void selection_end(Editor *E, const Selection *S, int *x1, int *y1) {
+    if (S->x1 >= E->row[S->y1].size && S->y1 < E->num_rows - 1) {
+        *x1 = 0;
+        *y1 = S->y1 + 1;
+    } else {
+        *x1 = S->x1 + 1;
+        *y1 = S->y1;
+    }
+}
+
+/**
+ * @brief Yank the selection into the register of the command, sharing the content of the rows.
+ * @param P Plan with the spans of the rows, for blocks
+ */
+static void selection_yank(Editor *E, const Selection *S, const BlockPlan *P) {
+    if (E->mode == VISUAL_LINE_MODE) {
+        register_yank_lines(E, S->y0, S->y1 - S->y0 + 1);
+    } else if (E->mode == VISUAL_BLOCK_MODE) {
+        register_yank_block(E, P->y0, P->count, P->x, P->len);
+    } else {
+        int x1, y1;
+        selection_end(E, S, &x1, &y1);
+        register_yank_text(E, S->x0, S->y0, x1, y1);
+    }
+}
+
+/**
+ * @brief Put the cursor at the start of the selection.
+ */
+static void selection_cursor(Editor *E, const Selection *S) {
+    E->cur_y = S->y0;
+    E->cur_x = (E->mode == VISUAL_LINE_MODE) ? 0 : S->x0;
+    if (E->mode == VISUAL_BLOCK_MODE) {
+        int a, b;
+        row_block_span(&E->row[S->y0], S->col0, S->col1, &a, &b);
+        E->cur_x = a;
+    }
+}
+
+void visual_yank(Editor *E) {
+    Selection S;
+    selection_get(E, &S);
+
+    BlockPlan P = {0};
+    if (E->mode == VISUAL_BLOCK_MODE) {
+        plan_init(&P, S.y0, S.y1);
+        P.col0 = S.col0;
+        P.col1 = S.col1;
+        editor_for_rows(E, S.y0, S.y1, plan_span, &P);
+    }
+
+    selection_yank(E, &S, &P);
+    plan_free(&P);
+
+    int lines = S.y1 - S.y0 + 1;
+    if (lines > 2) editor_set_status_message(E, "%s%d lines yanked", E->mode == VISUAL_BLOCK_MODE ? "block of " : "", lines);
+
+    selection_cursor(E, &S);
+    visual_exit(E);
+}
+
+void visual_delete(Editor *E) {
+    Selection S;
+    selection_get(E, &S);
+    int lines = S.y1 - S.y0 + 1;
+
+    if (E->mode == VISUAL_BLOCK_MODE) {
+        BlockPlan P;
+        plan_init(&P, S.y0, S.y1);
+        P.col0 = S.col0;
+        P.col1 = S.col1;
+
+        // Work out the spans in parallel, record them, then cut them in parallel
+        editor_for_rows(E, S.y0, S.y1, plan_span, &P);
+        selection_yank(E, &S, &P);
+        selection_cursor(E, &S);
+
+        plan_record_delete(E, &P);
+        editor_edit_rows(E, S.y0, S.y1, apply_delete, &P);
+        plan_free(&P);
+    } else {
+        selection_yank(E, &S, NULL);
+
+        if (E->mode == VISUAL_LINE_MODE) {
+            editor_delete_rows(E, S.y0, lines);
+            if (S.y0 >= E->num_rows) S.y0 = E->num_rows - 1;
+        } else {
+            int x1, y1;
+            selection_end(E, &S, &x1, &y1);
+            editor_delete_range(E, S.x0, S.y0, x1, y1);
+        }
+        selection_cursor(E, &S);
+        if (E->mode == VISUAL_LINE_MODE) {
+            while (E->cur_x < E->row[E->cur_y].size &&
+                  (E->row[E->cur_y].chars[E->cur_x] == ' ' || E->row[E->cur_y].chars[E->cur_x] == '\t')) E->cur_x++;
+        }
+    }
+
+    if (lines > 2) editor_set_status_message(E, "%d fewer lines", lines);
+    visual_exit(E);
+}
+
+void visual_indent(Editor *E, const int direction, const int count) {
+    Selection S;
+    selection_get(E, &S);
+
+    BlockPlan P;
+    plan_init(&P, S.y0, S.y1);
+
+    char *tabs = malloc(count);
+    if (tabs == NULL) exit(1);
+    memset(tabs, '\t', count);
+
+    if (direction > 0) {
+        editor_for_rows(E, S.y0, S.y1, plan_indent, &P);
+        P.text = tabs;
+        P.text_len = count;
+        plan_record_insert(E, &P);
+        editor_edit_rows(E, S.y0, S.y1, apply_insert, &P);
+    } else {
+        P.text_len = count;
+        editor_for_rows(E, S.y0, S.y1, plan_unindent, &P);
+        plan_record_delete(E, &P);
+        editor_edit_rows(E, S.y0, S.y1, apply_delete, &P);
+    }
+    free(tabs);
+    plan_free(&P);
+
+    int lines = S.y1 - S.y0 + 1;
+    if (lines > 2) editor_set_status_message(E, "%d lines %sed %d time%s", lines,
+        direction > 0 ? ">" : "<", count, count == 1 ? "" : "s");
+
+    // Back to the first character of the first row
+    E->cur_y = S.y0;
+    E->cur_x = 0;
+    while (E->cur_x < E->row[E->cur_y].size &&
+          (E->row[E->cur_y].chars[E->cur_x] == ' ' || E->row[E->cur_y].chars[E->cur_x] == '\t')) E->cur_x++;
+    visual_exit(E);
+}
+
+void visual_block_insert(Editor *E, const bool append) {
+    if (E->mode != VISUAL_BLOCK_MODE) return;
+
+    Selection S;
+    selection_get(E, &S);
+    VisualState *V = &E->visual;
+
+    // Find the position on the first row, an append pads it to the column
+    BlockPlan P;
+    plan_init(&P, S.y0, S.y0);
+    P.col0 = append ? S.col1 + 1 : S.col0;
+    if (append) plan_append(E, S.y0, &P);
+    else plan_insert(E, S.y0, &P);
+
+    int x = P.x[0];
+    if (x < 0) x = E->row[S.y0].size;
+    if (append && P.len[0] > 0) {
+        char *spaces = malloc(P.len[0]);
+        if (spaces == NULL) exit(1);
+        memset(spaces, ' ', P.len[0]);
+        editor_row_insert_span(E, x, S.y0, spaces, P.len[0]);
+        x += P.len[0];
+        free(spaces);
+    }
+    plan_free(&P);
+
+    V->block_insert = true;
+    V->block_append = append;
+    V->block_y0 = S.y0;
+    V->block_y1 = S.y1;
+    V->block_col = append ? S.col1 + 1 : S.col0;
+    V->block_x = x;
+    V->block_size = E->row[S.y0].size;
+
+    E->cur_x = x;
+    E->cur_y = S.y0;
+    E->mode = INSERT_MODE;
+}
+
+bool visual_block_insert_finish(Editor *E) {
+    VisualState *V = &E->visual;
+    if (!V->block_insert) return false;
+    V->block_insert = false;
+
+    // Only text typed on the first row, with nothing removed, is copied
+    int y0 = V->block_y0, y1 = V->block_y1;
+    int typed = (y0 < E->num_rows) ? E->row[y0].size - V->block_size : 0;
+    if (E->cur_y == y0 && typed > 0 && y1 < E->num_rows && V->block_x + typed <= E->row[y0].size && y1 > y0) {
+        char *text = malloc(typed);
+        if (text == NULL) exit(1);
+        memcpy(text, &E->row[y0].chars[V->block_x], typed);
+
+        BlockPlan P;
+        plan_init(&P, y0 + 1, y1);
+        P.col0 = V->block_col;
+        P.text = text;
+        P.text_len = typed;
+
+        // Plan in parallel, record in order, then insert in parallel
+        editor_for_rows(E, y0 + 1, y1, V->block_append ? plan_append : plan_insert, &P);
+        plan_record_insert(E, &P);
+        editor_edit_rows(E, y0 + 1, y1, apply_insert, &P);
+
+        plan_free(&P);
+        free(text);
+    }
+
+    E->cur_x = V->block_x;
+    E->cur_y = (y0 < E->num_rows) ? y0 : E->num_rows - 1;
+    return true;
+}
+
+void visual_cursors(Editor *E) {
+    Selection S;
+    selection_get(E, &S);
+
+    int col = render_col(&E->row[E->cur_y], E->cur_x);
+    cursors_add_column(E, S.y0, S.y1, col);
+    editor_set_status_message(E, "%d cursors", E->cursors.num + 1);
+    visual_exit(E);
+}
+
+void editor_draw_selection(Editor *E) {
+    if (!visual_active(E)) return;
+
+    Selection S;
+    selection_get(E, &S);
+
+    // Only the rows on screen are looked at
+    int view_height = E->view_rows;
+    int top = (S.y0 > E->view_start) ? S.y0 : E->view_start;
+    int bottom = (S.y1 < E->view_start + view_height - 1) ? S.y1 : E->view_start + view_height - 1;
+
+    for (int y = top; y <= bottom; y++) {
+        const erow *row = &E->row[y];
+        int c0, c1;
+
+        if (E->mode == VISUAL_LINE_MODE) {
+            c0 = 0;
+            c1 = render_col(row, row->size) - 1;
+            if (c1 < 0) c1 = 0;
+        } else if (E->mode == VISUAL_BLOCK_MODE) {
+            c0 = S.col0;
+            c1 = render_col(row, row->size) - 1;
+            if (c1 > S.col1) c1 = S.col1;
+            if (c1 < c0) continue;
+        } else {
+            int from = (y == S.y0) ? S.x0 : 0;
+            int to = (y == S.y1) ? S.x1 : row->size;
+            c0 = render_col(row, from);
+            c1 = render_col_end(row, to);
+        }
+
+        window_highlight(E, y, NUM_COL_SIZE + c0, c1 - c0 + 1, A_REVERSE, 0);
+    }
+}
@@ -0,0 +1,593 @@
+#include "watch.h"
+#include "editor.h"
+#include "cursors.h"
+#include "rows.h"
+#include "undo_log.h"
+#include "visual.h"
+#include <fcntl.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/inotify.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#define WATCH_EVENTS (IN_MODIFY | IN_ATTRIB | IN_CLOSE_WRITE | IN_MOVE_SELF | IN_DELETE_SELF)
+
+/**
+ * @brief Line of the file on disk, or a row of the buffer, for the diff.
+ */
+typedef struct WatchLine {
+    const char *s;
+    int len;
+    uint64_t hash;
+} WatchLine;
+
+/**
+ * @brief Rows of the buffer replaced by lines of the file, the rows between hunks are the same.
+ */
+typedef struct WatchHunk {
+    int old_start;
+    int old_count;
+    int new_start;
+    int new_count;
+} WatchHunk;
+
+void watch_init(FileWatch *W) {
+    memset(W, 0, sizeof(FileWatch));
+    W->fd = -1;
+    W->wd = -1;
+    W->file = -1;
+}
+
+/**
+ * @brief Watch the file of the current buffer, the inotify instance is made on first use.
+ */
+static bool watch_add(Editor *E) {
+    FileWatch *W = &E->watch;
+    if (E->headless || E->filename == NULL) return false;
+    if (W->fd < 0) {
+        W->fd = inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+        if (W->fd < 0) return false;
+        E->input.notify = W->fd;
+    }
+    if (W->wd < 0) W->wd = inotify_add_watch(W->fd, E->filename, WATCH_EVENTS);
+    return W->wd >= 0;
+}
+
+static void watch_remove(FileWatch *W) {
+    if (W->wd >= 0) inotify_rm_watch(W->fd, W->wd);
+    W->wd = -1;
+}
+
+void watch_free(Editor *E) {
+    FileWatch *W = &E->watch;
+    watch_stop(E);
+    if (W->fd >= 0) close(W->fd);
+    free(W->carry);
+    E->input.notify = -1;
+    watch_init(W);
+}
+
+/**
+ * @brief Add the complete lines in the carried bytes as rows, with a single insert.
+ * @return true if rows were added or changed
+ */
+static bool watch_add_lines(Editor *E) {
+    FileWatch *W = &E->watch;
+    int count = 0, cap = 0;
+    char **s = NULL;
+    int *len = NULL;
+
+    size_t start = 0;
+    bool changed = false;
+    while (start < W->carry_len) {
+        char *nl = memchr(W->carry + start, '\n', W->carry_len - start);
+        if (nl == NULL) break;
+
+        size_t end = (size_t) (nl - W->carry);
+        size_t next = end + 1;
+
+        // Remove the \r from end of line
+        while (end > start && W->carry[end - 1] == '\r') end--;
+
+        if (W->open_row) {
+            // The writer finished the line the file ended with
+            int y = E->num_rows - 1;
+            editor_row_insert_span(E, E->row[y].size, y, W->carry + start, (int) (end - start));
+            W->open_row = false;
+            changed = true;
+        } else {
+            if (count == cap) {
+                cap = cap ? cap * 2 : 4096;
+                s = realloc(s, sizeof(char *) * cap);
+                len = realloc(len, sizeof(int) * cap);
+                if (s == NULL || len == NULL) exit(1);
+            }
+            s[count] = W->carry + start;
+            len[count] = (int) (end - start);
+            count++;
+        }
+        start = next;
+    }
+
+    if (count > 0) {
+        editor_insert_rows(E, E->num_rows, count, s, len);
+        changed = true;
+    }
+    free(s);
+    free(len);
+
+    // Keep the line which is not complete yet
+    memmove(W->carry, W->carry + start, W->carry_len - start);
+    W->carry_len -= start;
+    return changed;
+}
+
+/**
+ * @brief Read what was written to the followed file since the last read.
+ */
+static void watch_follow_read(Editor *E) {
+    FileWatch *W = &E->watch;
+    struct stat st;
+    if (fstat(W->file, &st) != 0) return;
+
+    if (st.st_size < W->offset) {
+        watch_follow_stop(E);
+        editor_set_status_message(E, "%s was truncated, follow stopped", E->filename);
+        return;
+    }
+
+    // The view only moves with the file if the cursor is at its end
+    bool at_end = (E->cur_y == E->num_rows - 1);
+    bool changed = false;
+
+    // Following the file is not an edit
+    undo_suspend(E);
+    while (W->offset < st.st_size) {
+        size_t want = (size_t) (st.st_size - W->offset);
+        if (want > WATCH_READ_MAX) want = WATCH_READ_MAX;
+        if (W->carry_len + want > W->carry_cap) {
+            W->carry_cap = W->carry_len + want;
+            W->carry = realloc(W->carry, W->carry_cap);
+            if (W->carry == NULL) exit(1);
+        }
+
+        ssize_t n = pread(W->file, W->carry + W->carry_len, want, W->offset);
+        if (n <= 0) break;
+        W->offset += n;
+        W->carry_len += (size_t) n;
+        if (watch_add_lines(E)) changed = true;
+    }
+    undo_resume(E);
+
+    // A burst of lines leaves a large buffer behind
+    if (W->carry_cap > LOAD_BLOCK_SIZE && W->carry_len < LOAD_BLOCK_SIZE) {
+        W->carry_cap = LOAD_BLOCK_SIZE;
+        W->carry = realloc(W->carry, W->carry_cap);
+        if (W->carry == NULL) exit(1);
+    }
+
+    // The rows on disk are the rows in the editor again
+    E->disk_size = W->offset - (off_t) W->carry_len;
+    E->disk_mtime = st.st_mtim;
+
+    if (changed && at_end) {
+        E->cur_y = E->num_rows - 1;
+        E->cur_x = 0;
+    }
+}
+
+void watch_start(Editor *E) {
+    FileWatch *W = &E->watch;
+    watch_remove(W);
+    if (!watch_add(E)) return;
+
+    // The file may have changed while the buffer was away
+    W->pending = true;
+}
+
+void watch_stop(Editor *E) {
+    FileWatch *W = &E->watch;
+    watch_follow_stop(E);
+    watch_remove(W);
+    W->pending = false;
+}
+
+bool watch_follow_start(Editor *E) {
+    FileWatch *W = &E->watch;
+    if (E->headless || E->filename == NULL) return false;
+    if (W->follow) return true;
+
+    // Rows are added where the load ends
+    load_job_finish(E);
+
+    int file = open(E->filename, O_RDONLY | O_CLOEXEC);
+    if (file < 0) return false;
+    if (!watch_add(E)) {
+        close(file);
+        return false;
+    }
+
+    W->follow = true;
+    W->file = file;
+    W->offset = E->disk_size;
+    W->carry_len = 0;
+
+    // The last row may be the start of a line the writer has not finished
+    char last;
+    W->open_row = W->offset > 0 && pread(file, &last, 1, W->offset - 1) == 1 && last != '\n';
+
+    watch_follow_read(E);
+    return true;
+}
+
+void watch_follow_stop(Editor *E) {
+    FileWatch *W = &E->watch;
+    if (!W->follow) return;
+
+    close(W->file);
+    W->file = -1;
+    W->follow = false;
+    W->carry_len = 0;
+}
+
+/**
+ * @brief Read the whole file.
+ * @return Content of the file, or NULL if it cannot be read
+ */
+static char *watch_read_file(const int fd, const off_t size, size_t *len) {
+    size_t cap = (size_t) size + 1;
+    char *buf = malloc(cap);
+    if (buf == NULL) exit(1);
+
+    // The file may grow while it is read
+    *len = 0;
+    while (true) {
+        if (*len == cap) {
+            cap *= 2;
+            buf = realloc(buf, cap);
+            if (buf == NULL) exit(1);
+        }
+        ssize_t n = read(fd, buf + *len, cap - *len);
+        if (n == 0) break;
+        if (n < 0) {
+            free(buf);
+            return NULL;
+        }
+        *len += (size_t) n;
+    }
+    return buf;
+}
+
+/**
+ * @brief Split the content of a file into lines, the way it is split into rows when it is opened.
+ * @return Number of lines, a file without any has a single empty one like the rows
+ */
+static int watch_split_lines(const char *buf, const size_t len, WatchLine **lines) {
+    int count = 0, cap = 0;
+    WatchLine *L = NULL;
+
+    size_t start = 0;
+    while (start < len || count == 0) {
+        const char *nl = (start < len) ? memchr(buf + start, '\n', len - start) : NULL;
+        size_t end = nl ? (size_t) (nl - buf) : len;
+        size_t next = nl ? end + 1 : len;
+
+        // Remove the \r from end of line
+        while (end > start && buf[end - 1] == '\r') end--;
+
+        if (count == cap) {
+            cap = cap ? cap * 2 : 4096;
+            L = realloc(L, sizeof(WatchLine) * cap);
+            if (L == NULL) exit(1);
+        }
+        L[count++] = (WatchLine) {buf + start, (int) (end - start), 0};
+        start = next;
+        if (start >= len) break;
+    }
+    *lines = L;
+    return count;
+}
+
+static bool watch_line_same(const WatchLine *a, const WatchLine *b) {
+    return a->hash == b->hash && a->len == b->len && memcmp(a->s, b->s, a->len) == 0;
+}
+
+/**
+ * @brief Add an edit of the diff to the hunks, the edits come from the bottom of the file up.
+ */
+static void watch_add_edit(WatchHunk **hunks, int *count, int *cap, const int x, const int y, const bool insert) {
+    WatchHunk *H = (*count > 0) ? &(*hunks)[*count - 1] : NULL;
+    if (H == NULL || H->old_start != x + !insert || H->new_start != y + insert) {
+        if (*count == *cap) {
+            *cap = *cap ? *cap * 2 : 64;
+            *hunks = realloc(*hunks, sizeof(WatchHunk) * *cap);
+            if (*hunks == NULL) exit(1);
+        }
+        H = &(*hunks)[(*count)++];
+        *H = (WatchHunk) {x + !insert, 0, y + insert, 0};
+    }
+    H->old_start = x;
+    H->new_start = y;
+    if (insert) H->new_count++;
+    else H->old_count++;
+}
+
+/**
+ * @brief Find the fewest rows to delete and insert to turn rows a into lines b, with the Myers diff.
+ * @return Number of hunks, from the bottom of the file up, or -1 if more than WATCH_DIFF_MAX rows differ
+ */
+static int watch_diff(const WatchLine *a, const int n, const WatchLine *b, const int m, WatchHunk **hunks) {
+    int max = n + m;
+    if (max > WATCH_DIFF_MAX) max = WATCH_DIFF_MAX;
+
+    // v[k] is the furthest row of a reached on diagonal k = x - y, a copy of
+    // it is kept after each step to walk back along the edits
+    int *v = malloc(sizeof(int) * (2 * max + 3));
+    int **trace = malloc(sizeof(int *) * (max + 1));
+    if (v == NULL || trace == NULL) exit(1);
+    int *V = v + max + 1;
+    V[1] = 0;
+
+    int steps = -1;
+    for (int d = 0; d <= max && steps < 0; d++) {
+        for (int k = -d; k <= d; k += 2) {
+            int x = (k == -d || (k != d && V[k - 1] < V[k + 1])) ? V[k + 1] : V[k - 1] + 1;
+            int y = x - k;
+            while (x < n && y < m && watch_line_same(&a[x], &b[y])) {
+                x++;
+                y++;
+            }
+            V[k] = x;
+            if (x >= n && y >= m) {
+                steps = d;
+                break;
+            }
+        }
+        if (steps >= 0) break;
+
+        trace[d] = malloc(sizeof(int) * (2 * d + 1));
+        if (trace[d] == NULL) exit(1);
+        memcpy(trace[d], V - d, sizeof(int) * (2 * d + 1));
+    }
+
+    int count = -1;
+    if (steps >= 0) {
+        int cap = 0;
+        count = 0;
+        *hunks = NULL;
+        int x = n, y = m;
+        for (int d = steps; d > 0; d--) {
+            const int *P = trace[d - 1] + (d - 1);
+            int k = x - y;
+            bool insert = (k == -d || (k != d && P[k - 1] < P[k + 1]));
+            int pk = insert ? k + 1 : k - 1;
+            x = P[pk];
+            y = x - pk;
+            watch_add_edit(hunks, &count, &cap, x, y, insert);
+        }
+    }
+
+    int kept = (steps >= 0) ? steps : max + 1;
+    for (int d = 0; d < kept; d++) free(trace[d]);
+    free(trace);
+    free(v);
+    return count;
+}
+
+/**
+ * @brief Find where a row is after the hunks were applied, a row which was replaced stays at the same offset in its hunk.
+ */
+static int watch_map_row(const WatchHunk *hunks, const int count, const int y) {
+    int delta = 0;
+    for (int i = 0; i < count; i++) {
+        const WatchHunk *H = &hunks[i];
+        if (y >= H->old_start + H->old_count) {
+            delta += H->new_count - H->old_count;
+        } else if (y >= H->old_start) {
+            int offset = y - H->old_start;
+            if (offset >= H->new_count) offset = H->new_count - 1;
+            return H->new_start + (offset > 0 ? offset : 0);
+        }
+    }
+    return y + delta;
+}
+
+/**
+ * @brief Replace the rows of a hunk with the lines of the file.
+ */
+static void watch_apply_hunk(Editor *E, const WatchHunk *H, const WatchLine *lines) {
+    int same = (H->old_count < H->new_count) ? H->old_count : H->new_count;
+    for (int i = 0; i < same; i++) {
+        const WatchLine *L = &lines[H->new_start + i];
+        char *chars = row_text_new(L->len);
+        memcpy(chars, L->s, L->len);
+        editor_set_row_chars(E, H->old_start + i, chars, L->len);
+    }
+
+    if (H->old_count > same) {
+        editor_delete_rows(E, H->old_start + same, H->old_count - same);
+    } else if (H->new_count > same) {
+        int count = H->new_count - same;
+        char **s = malloc(sizeof(char *) * count);
+        int *len = malloc(sizeof(int) * count);
+        if (s == NULL || len == NULL) exit(1);
+        for (int i = 0; i < count; i++) {
+            s[i] = (char *) lines[H->new_start + same + i].s;
+            len[i] = lines[H->new_start + same + i].len;
+        }
+        editor_insert_rows(E, H->old_start + same, count, s, len);
+        free(s);
+        free(len);
+    }
+}
+
+/**
+ * @brief Read the changed file again, replacing only the rows which differ from its lines.
+ * @return Number of rows replaced, deleted or inserted, -1 if the file cannot be read
+ */
+static int watch_reload(Editor *E) {
+    int fd = open(E->filename, O_RDONLY | O_CLOEXEC);
+    if (fd < 0) return -1;
+    struct stat st;
+    size_t len = 0;
+    char *buf = (fstat(fd, &st) == 0) ? watch_read_file(fd, st.st_size, &len) : NULL;
+    close(fd);
+    if (buf == NULL) return -1;
+
+    WatchLine *lines;
+    int m = watch_split_lines(buf, len, &lines);
+    int n = E->num_rows;
+
+    // Most changes touch a few places, the rows around them are compared
+    // directly and only the rows in between are hashed and diffed
+    int top = 0;
+    while (top < n && top < m && E->row[top].size == lines[top].len &&
+           memcmp(E->row[top].chars, lines[top].s, lines[top].len) == 0)
+        top++;
+    int bottom = 0;
+    while (bottom < n - top && bottom < m - top) {
+        const erow *row = &E->row[n - 1 - bottom];
+        const WatchLine *L = &lines[m - 1 - bottom];
+        if (row->size != L->len || memcmp(row->chars, L->s, L->len) != 0) break;
+        bottom++;
+    }
+
+    int old_count = n - top - bottom, new_count = m - top - bottom;
+    WatchLine *rows = malloc(sizeof(WatchLine) * (old_count + 1));
+    if (rows == NULL) exit(1);
+    for (int i = 0; i < old_count; i++) {
+        const erow *row = &E->row[top + i];
+        rows[i] = (WatchLine) {row->chars, row->size, undo_log_hash(UNDO_LOG_HASH_INIT, row->chars, row->size)};
+    }
+    for (int i = 0; i < new_count; i++) {
+        WatchLine *L = &lines[top + i];
+        L->hash = undo_log_hash(UNDO_LOG_HASH_INIT, L->s, L->len);
+    }
+
+    WatchHunk *hunks = NULL;
+    int count = 0;
+    if (old_count > 0 || new_count > 0) {
+        count = watch_diff(rows, old_count, lines + top, new_count, &hunks);
+        if (count < 0) {
+            // Too much changed to be worth the diff
+            hunks = malloc(sizeof(WatchHunk));
+            if (hunks == NULL) exit(1);
+            hunks[0] = (WatchHunk) {0, old_count, 0, new_count};
+            count = 1;
+        }
+    }
+    free(rows);
+
+    int changed = 0;
+    for (int i = 0; i < count; i++) {
+        hunks[i].old_start += top;
+        hunks[i].new_start += top;
+        changed += (hunks[i].old_count > hunks[i].new_count) ? hunks[i].old_count : hunks[i].new_count;
+    }
+
+    if (count > 0) {
+        if (visual_active(E)) visual_exit(E);
+        cursors_clear(E);
+
+        // The reload is a single step which undo takes back, the hunks are
+        // applied from the bottom up so the rows above each one stay in place
+        undo_seal(E);
+        undo_group_begin(E);
+        for (int i = 0; i < count; i++) watch_apply_hunk(E, &hunks[i], lines);
+        undo_group_end(E);
+        undo_seal(E);
+
+        E->cur_y = watch_map_row(hunks, count, E->cur_y);
+        E->view_start = watch_map_row(hunks, count, E->view_start);
+        if (E->cur_y >= E->num_rows) E->cur_y = E->num_rows - 1;
+        if (E->view_start > E->cur_y) E->view_start = E->cur_y;
+        if (E->cur_x > E->row[E->cur_y].size) E->cur_x = E->row[E->cur_y].size;
+        E->search.match_y = -1;
+    }
+    free(hunks);
+    free(lines);
+
+    // The rows are the file again
+    E->disk_size = (off_t) len;
+    E->disk_mtime = st.st_mtim;
+    undo_mark_saved(E);
+    if (count > 0) undo_log_save(E, undo_log_hash(UNDO_LOG_HASH_INIT, buf, len));
+    free(buf);
+    return changed;
+}
+
+/**
+ * @brief Compare the file with what was last read or written, and read it again if it changed.
+ */
+static void watch_check(Editor *E) {
+    struct stat st;
+    if (stat(E->filename, &st) != 0) {
+        editor_set_status_message(E, "%s was removed from disk", E->filename);
+        return;
+    }
+    if (st.st_size == E->disk_size && st.st_mtim.tv_sec == E->disk_mtime.tv_sec &&
+        st.st_mtim.tv_nsec == E->disk_mtime.tv_nsec)
+        return;
+
+    if (E->dirty) {
+        editor_set_status_message(E, "%s changed on disk, the buffer has unsaved changes", E->filename);
+        return;
+    }
+
+    int changed = watch_reload(E);
+    if (changed < 0) editor_set_status_message(E, "%s changed on disk, cannot read it", E->filename);
+    else if (changed > 0) editor_set_status_message(E, "%s changed on disk, %d rows read again", E->filename, changed);
+}
+
+void watch_poll(Editor *E) {
+    FileWatch *W = &E->watch;
+    if (W->fd < 0) return;
+
+    // What changed is read from the file, the events only say when to look:
+    // a followed file as it is written, any other once its writer closed it
+    char events[4096] __attribute__((aligned(__alignof__(struct inotify_event))));
+    bool modified = false, replaced = false;
+    ssize_t n;
+    while ((n = read(W->fd, events, sizeof(events))) > 0) {
+        for (char *p = events; p < events + n;) {
+            const struct inotify_event *ev = (const struct inotify_event *) p;
+            p += sizeof(struct inotify_event) + ev->len;
+            if (ev->wd != W->wd) continue;
+
+            if (ev->mask & IN_MODIFY) modified = true;
+            if (ev->mask & (IN_CLOSE_WRITE | IN_ATTRIB)) W->pending = true;
+            if (ev->mask & (IN_MOVE_SELF | IN_DELETE_SELF | IN_IGNORED)) replaced = true;
+        }
+    }
+
+    // A file written to a new name and moved over the old one is a new file,
+    // the name is watched again
+    if (replaced) {
+        watch_remove(W);
+        watch_add(E);
+        W->pending = true;
+    }
+
+    if (W->follow) {
+        if (modified || W->pending) watch_follow_read(E);
+        W->pending = false;
+    } else if (W->pending && !load_job_running(E)) {
+        W->pending = false;
+        watch_check(E);
+    }
+}
+
+void watch_saved(Editor *E) {
+    FileWatch *W = &E->watch;
+
+    // The file may be new, or have a new name
+    watch_remove(W);
+    watch_add(E);
+    if (!W->follow) return;
+
+    // The rows were written whole, each with its newline
+    W->offset = E->disk_size;
+    W->carry_len = 0;
+    W->open_row = false;
+}
@@ -0,0 +1,420 @@
+#include "windows.h"
+#include "buffers.h"
+#include "editor.h"
+#include "rows.h"
+#include <ncurses.h>
+#include <stdlib.h>
+#include <string.h>
+
+static EditorWindow *window_new(const int buffer) {
+    EditorWindow *W = calloc(1, sizeof(EditorWindow));
+    if (W == NULL) exit(1);
+    W->split = WINDOW_LEAF;
+    W->buffer = buffer;
+    W->damaged = true;
+    return W;
+}
+
+/**
+ * @brief Free a window, or a split with the windows in it, but keep one of them.
+ */
+static void window_free(EditorWindow *W, const EditorWindow *keep) {
+    if (W == NULL || W == keep) return;
+    window_free(W->child[0], keep);
+    window_free(W->child[1], keep);
+    if (W->win != NULL) delwin(W->win);
+    free(W->lines);
+    free(W);
+}
+
+static int window_count(const EditorWindow *W) {
+    if (W->split == WINDOW_LEAF) return 1;
+    return window_count(W->child[0]) + window_count(W->child[1]);
+}
+
+/**
+ * @brief Collect the windows in the order they are on the screen, left to right and top to bottom.
+ */
+static int window_collect(EditorWindow *W, EditorWindow **list, int n) {
+    if (W->split == WINDOW_LEAF) {
+        list[n] = W;
+        return n + 1;
+    }
+    n = window_collect(W->child[0], list, n);
+    return window_collect(W->child[1], list, n);
+}
+
+static EditorWindow **window_list(EditorWindow *root, int *count) {
+    *count = window_count(root);
+    EditorWindow **list = malloc(sizeof(EditorWindow *) * *count);
+    if (list == NULL) exit(1);
+    window_collect(root, list, 0);
+    return list;
+}
+
+/**
+ * @brief Place a window, or a split and the windows in it, in a rectangle of the screen.
+ * @note The border between windows side by side is drawn on stdscr.
+ */
+static void window_place(EditorWindow *W, const int top, const int left, int rows, int cols) {
+    if (rows < 2) rows = 2;
+    if (cols < NUM_COL_SIZE + 1) cols = NUM_COL_SIZE + 1;
+    W->top = top;
+    W->left = left;
+    W->rows = rows;
+    W->cols = cols;
+
+    if (W->split == WINDOW_SPLIT_ROWS) {
+        int first = rows / 2;
+        window_place(W->child[0], top, left, first, cols);
+        window_place(W->child[1], top + first, left, rows - first, cols);
+        return;
+    }
+    if (W->split == WINDOW_SPLIT_COLUMNS) {
+        int first = (cols - 1) / 2;
+        window_place(W->child[0], top, left, rows, first);
+        mvwvline(stdscr, top, left + first, ACS_VLINE, rows);
+        window_place(W->child[1], top, left + first + 1, rows, cols - first - 1);
+        return;
+    }
+
+    if (W->win != NULL) delwin(W->win);
+    W->win = newwin(rows, cols, top, left);
+    if (W->win == NULL) exit(1);
+    W->lines = realloc(W->lines, sizeof(WindowLine) * (rows - 1));
+    if (W->lines == NULL) exit(1);
+    W->damaged = true;
+}
+
+/**
+ * @brief Set the size of the view in the editor to the text of the current window.
+ */
+static void window_view_size(Editor *E) {
+    const EditorWindow *W = E->windows.current;
+    E->view_rows = W->rows - 1;
+    E->view_cols = W->cols;
+}
+
+/**
+ * @brief Place every window again, after the layout or the terminal changed.
+ */
+static void window_layout_apply(Editor *E) {
+    // Clear the borders of the old layout
+    werase(stdscr);
+    window_place(E->windows.root, 0, 0, LINES - 1, COLS);
+    window_view_size(E);
+}
+
+/**
+ * @brief Write the view in the editor back to the current window.
+ */
+static void window_sync(Editor *E) {
+    EditorWindow *W = E->windows.current;
+    int id = buffer_current_id(E);
+    if (W->buffer != id) {
+        W->buffer = id;
+        W->damaged = true;
+    }
+
+    // Every line moves sideways
+    if (W->col_start != E->col_start) W->damaged = true;
+
+    W->cur_x = E->cur_x;
+    W->cur_y = E->cur_y;
+    W->view_start = E->view_start;
+    W->col_start = E->col_start;
+}
+
+/**
+ * @brief Make a window current, the view of the one before must already be written back.
+ */
+static void window_enter(Editor *E, EditorWindow *W) {
+    if (visual_active(E)) visual_exit(E);
+    cursors_clear(E);
+
+    E->windows.current = W;
+    if (W->buffer != buffer_current_id(E)) buffer_activate(E, W->buffer);
+
+    E->cur_x = W->cur_x;
+    E->cur_y = W->cur_y;
+    E->view_start = W->view_start;
+    E->col_start = W->col_start;
+
+    // The rows may have changed through another window
+    if (E->cur_y >= E->num_rows) E->cur_y = E->num_rows - 1;
+    if (E->cur_x > E->row[E->cur_y].size) E->cur_x = E->row[E->cur_y].size;
+    window_view_size(E);
+}
+
+void window_layout_init(Editor *E) {
+    WindowLayout *L = &E->windows;
+    L->root = window_new(buffer_current_id(E));
+    L->current = L->root;
+    L->drawing = L->root;
+    window_layout_apply(E);
+}
+
+void window_layout_free(Editor *E) {
+    window_free(E->windows.root, NULL);
+    memset(&E->windows, 0, sizeof(WindowLayout));
+}
+
+void window_layout_resize(Editor *E) {
+    if (E->windows.root == NULL) return;
+    window_layout_apply(E);
+}
+
+bool window_split(Editor *E, const WindowSplit split) {
+    WindowLayout *L = &E->windows;
+    if (L->root == NULL) return false;
+
+    EditorWindow *W = L->current;
+    if (split == WINDOW_SPLIT_ROWS && W->rows < 2 * WINDOW_MIN_ROWS) return false;
+    if (split == WINDOW_SPLIT_COLUMNS && W->cols < 2 * WINDOW_MIN_COLS + 1) return false;
+    window_sync(E);
+
+    // The window becomes the split, and both halves start with its view
+    for (int i = 0; i < 2; i++) {
+        EditorWindow *C = window_new(W->buffer);
+        C->cur_x = W->cur_x;
+        C->cur_y = W->cur_y;
+        C->view_start = W->view_start;
+        C->col_start = W->col_start;
+        C->parent = W;
+        W->child[i] = C;
+    }
+    W->split = split;
+    delwin(W->win);
+    W->win = NULL;
+    free(W->lines);
+    W->lines = NULL;
+
+    L->current = W->child[0];
+    L->drawing = L->current;
+    window_layout_apply(E);
+    return true;
+}
+
+bool window_close(Editor *E) {
+    WindowLayout *L = &E->windows;
+    if (L->root == NULL || L->current->parent == NULL) return false;
+
+    // The sibling takes the place of the split
+    EditorWindow *W = L->current;
+    EditorWindow *P = W->parent;
+    EditorWindow *S = P->child[P->child[0] == W];
+    S->parent = P->parent;
+    if (P->parent == NULL) L->root = S;
+    else P->parent->child[P->parent->child[1] == P] = S;
+
+    P->child[0] = P->child[1] = NULL;
+    window_free(P, NULL);
+    window_free(W, NULL);
+
+    EditorWindow *T = S;
+    while (T->split != WINDOW_LEAF) T = T->child[0];
+    L->drawing = T;
+    window_enter(E, T);
+    window_layout_apply(E);
+    return true;
+}
+
+void window_only(Editor *E) {
+    WindowLayout *L = &E->windows;
+    if (L->root == NULL || L->current == L->root) return;
+
+    EditorWindow *W = L->current;
+    if (W->parent->child[0] == W) W->parent->child[0] = NULL;
+    else W->parent->child[1] = NULL;
+    window_free(L->root, W);
+
+    W->parent = NULL;
+    L->root = W;
+    window_layout_apply(E);
+}
+
+void window_cycle(Editor *E, const int count) {
+    WindowLayout *L = &E->windows;
+    if (L->root == NULL) return;
+
+    int n;
+    EditorWindow **list = window_list(L->root, &n);
+    int i = 0;
+    while (list[i] != L->current) i++;
+    i = (i + count) % n;
+    if (i < 0) i += n;
+
+    if (list[i] != L->current) {
+        window_sync(E);
+        window_enter(E, list[i]);
+    }
+    free(list);
+}
+
+bool window_shows_buffer(Editor *E, const int id) {
+    WindowLayout *L = &E->windows;
+    if (L->root == NULL) return false;
+
+    // The current window shows the current buffer, which is never evicted
+    int n;
+    bool shown = false;
+    EditorWindow **list = window_list(L->root, &n);
+    for (int i = 0; i < n && !shown; i++) shown = list[i] != L->current && list[i]->buffer == id;
+    free(list);
+    return shown;
+}
+
+struct _win_st *window_canvas(Editor *E) {
+    return E->windows.drawing->win;
+}
+
+void window_print(Editor *E, const int line, const char *s, const int len) {
+    const EditorWindow *W = E->windows.drawing;
+    int width = W->cols - NUM_COL_SIZE;
+    if (width <= 0 || W->col_start >= len) return;
+
+    int n = len - W->col_start;
+    mvwaddnstr(W->win, line, NUM_COL_SIZE, s + W->col_start, (n < width) ? n : width);
+}
+
+void window_paint(Editor *E, const int line, int x, int n, const int attr, const short pair) {
+    const EditorWindow *W = E->windows.drawing;
+    x -= W->col_start;
+    if (x < NUM_COL_SIZE) {
+        n -= NUM_COL_SIZE - x;
+        x = NUM_COL_SIZE;
+    }
+    if (x + n > W->cols) n = W->cols - x;
+    if (n <= 0) return;
+
+    mvwchgat(W->win, line, x, n, attr, pair, NULL);
+}
+
+void window_highlight(Editor *E, const int y, const int x, const int n, const int attr, const short pair) {
+    EditorWindow *W = E->windows.drawing;
+    int line = y - W->view_start;
+    if (line < 0 || line >= W->rows - 1) return;
+
+    W->lines[line].overlaid = true;
+    window_paint(E, line, x, n, attr, pair);
+}
+
+/**
+ * @brief Get the line number shown for a row, negative on the cursor line, see editor_draw_row_num.
+ */
+static int window_line_number(const int y, const int cur_y) {
+    if (y == cur_y) return -(y + 1);
+    if (!RELATIVE_NUM) return y + 1;
+    return (y > cur_y) ? y - cur_y : cur_y - y;
+}
+
+/**
+ * @brief Draw the lines of the window which do not show what they showed last time.
+ * @note A line whose row did not change only has its number drawn again when
+ * the number changed, e.g. relative numbers after the cursor moved.
+ */
+static void window_draw_lines(Editor *E, EditorWindow *W, erow *rows, const int num_rows) {
+    // The search highlights are drawn with the rows, a new pattern changes every line
+    unsigned long search_key = search_highlight_visible(E) ? E->search.generation : 0;
+    if (W->search_key != search_key) {
+        W->search_key = search_key;
+        W->damaged = true;
+    }
+    if (W->damaged) werase(W->win);
+
+    // Rows may have been removed through another window
+    if (W->view_start >= num_rows) W->view_start = (num_rows > 0) ? num_rows - 1 : 0;
+
+    int text_rows = W->rows - 1;
+    for (int line = 0; line < text_rows; line++) {
+        WindowLine *L = &W->lines[line];
+        int y = W->view_start + line;
+        int row = (y < num_rows) ? y : -1;
+        unsigned long version = (row >= 0) ? rows[y].version : 0;
+        int number = (row >= 0) ? window_line_number(y, W->cur_y) : 0;
+
+        bool text = W->damaged || L->overlaid || L->row != row || L->version != version;
+        if (!text && L->number == number) continue;
+
+        if (!text) {
+            editor_draw_row_num(E, W->cur_y - W->view_start, line, W->view_start);
+        } else if (row < 0) {
+            wmove(W->win, line, 0);
+            wclrtoeol(W->win);
+            mvwaddch(W->win, line, 0, '~');
+        } else {
+            wmove(W->win, line, 0);
+            wclrtoeol(W->win);
+            editor_draw_row_num(E, W->cur_y - W->view_start, line, W->view_start);
+            editor_draw_row(E, &rows[y], line);
+            W->drawn++;
+        }
+        L->row = row;
+        L->version = version;
+        L->number = number;
+        L->overlaid = false;
+    }
+    W->damaged = false;
+}
+
+/**
+ * @brief Draw the status line of a window which is not current.
+ */
+static void window_draw_status(EditorWindow *W, const char *filename, const int dirty) {
+    char status[160];
+    snprintf(status, sizeof(status), " %.60s %s", filename ? filename : "[No Name]", dirty ? "- (modified)" : "");
+
+    wattron(W->win, COLOR_PAIR(1));
+    mvwprintw(W->win, W->rows - 1, 0, "%-*.*s", W->cols, W->cols, status);
+    wattroff(W->win, COLOR_PAIR(1));
+}
+
+void window_draw(Editor *E) {
+    WindowLayout *L = &E->windows;
+    if (L->root == NULL) return;
+    window_sync(E);
+
+    // The other windows first, the cursor is left where the current one puts it
+    int n;
+    int current = buffer_current_id(E);
+    EditorWindow **list = window_list(L->root, &n);
+    for (int i = 0; i < n; i++) {
+        EditorWindow *W = list[i];
+        if (W == L->current) continue;
+
+        // A window on the current buffer draws the rows in the editor, the
+        // renders made for one window are used by the other
+        erow *rows = E->row;
+        int num_rows = E->num_rows, dirty = E->dirty;
+        const char *filename = E->filename;
+        if (W->buffer != current) {
+            const FileBuffer *B = buffer_find(E, W->buffer);
+            rows = B ? B->row : NULL;
+            num_rows = B ? B->num_rows : 0;
+            dirty = B ? B->dirty : 0;
+            filename = B ? B->filename : NULL;
+        }
+
+        L->drawing = W;
+        window_draw_lines(E, W, rows, num_rows);
+        window_draw_status(W, filename, dirty);
+        wnoutrefresh(W->win);
+    }
+    free(list);
+
+    EditorWindow *W = L->current;
+    L->drawing = W;
+    editor_scroll(E);
+    window_sync(E);
+    window_draw_lines(E, W, E->row, E->num_rows);
+
+    // Highlight the bracket matching the one under the cursor, and the search match
+    editor_draw_bracket_match(E);
+    editor_draw_search_match(E);
+    editor_draw_selection(E);
+    editor_draw_cursors(E);
+    editor_draw_status_bar(E);
+
+    wmove(W->win, E->cur_y - E->view_start, E->ren_x - E->col_start);
+    wnoutrefresh(W->win);
+}